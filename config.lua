@@ -3,3 +3,29 @@ lib_script = "lib/main.lua" -- Entry script for the library module
 game_port = 5000 -- The port the game should run on
 database_file = "mud.db" -- Location of the sqlite database
 ticks_per_second = 5 -- Amount of ticks per second
+tick_policy = "catch-up" -- What to do with ticks that fall due while a tick overruns: skip, catch-up or stretch
+tick_catch_up_limit = 5 -- Overdue ticks run back to back under the catch-up policy before the rest are skipped
+output_buffer_limit = 65536 -- Maximum bytes of output buffered per client between flushes
+output_pending_limit = 262144 -- Bytes queued for a client before it is throttled
+backpressure_policy = "drop" -- What to do with throttled clients' output: drop, coalesce or disconnect
+backpressure_timeout = 30 -- Seconds a client may stay throttled before disconnect under the disconnect policy
+output_coalescing = false -- Flush input triggered output once per loop iteration instead of immediately
+output_coalesce_latency = 0 -- Milliseconds coalesced output may be held for, 0 for one loop iteration
+commands_per_tick = 1 -- Queued commands each player may run per tick
+command_burst = 10 -- Commands a player may run at once before being queued
+login_idle_timeout = 300 -- Seconds a connection may idle before logging in, 0 to never time out
+play_idle_timeout = 0 -- Seconds a logged in player may idle, 0 to never time out
+keepalive_delay = 0 -- Seconds idle before TCP keepalive probes are sent, 0 to disable
+mccp = true -- Offer MCCP2 and MCCP3 telnet compression to clients
+mccp_compression_level = 6 -- zlib compression level from 0 to 9
+mccp_low_memory = false -- Use a smaller compression window and state for high connection counts
+-- simulation_script = "sim/load.sim" -- Run a headless simulation of scripted clients on a virtual clock instead of listening
+-- simulation_report = "sim/report.txt" -- Where to write the simulation's tick time profile
+-- simulation_epoch = 946684800 -- Unix time the simulation's virtual clock starts at
+-- mssp = { NAME = "My MUD", CODEBASE = "lunac" } -- MSSP variables sent to MUD crawlers
+-- listeners = { -- Replaces game_port when set, each entry takes a port or a Unix socket path
+--   { port = 5000, backlog = 128, shards = 1 },
+--   { path = "/tmp/mud.sock", backlog = 16 },
+--   { port = 5080, websocket = true }, -- WebSocket clients such as browsers
+--   { port = 5443, tls_certificate = "cert.pem", tls_key = "key.pem" }, -- TLS
+-- }
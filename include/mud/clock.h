@@ -0,0 +1,21 @@
+#ifndef MUD_CLOCK_H
+#define MUD_CLOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <uv.h>
+
+/**
+ * Function prototypes
+ **/
+uint64_t clock_hrtime(void);
+uint64_t clock_now(const uv_loop_t* loop);
+time_t clock_time(void);
+
+void clock_use_virtual_time(time_t epoch);
+void clock_use_real_time(void);
+bool clock_is_virtual(void);
+void clock_advance_to(uint64_t hrtime);
+
+#endif
@@ -1,21 +1,72 @@
 #ifndef _CONFIG_H_
 #define _CONFIG_H_
 
+#include <stdbool.h>
+#include <time.h>
+
+#include "mud/data/linked_list/linked_list.h"
+#include "mud/network/mccp.h"
+#include "mud/network/network.h"
+#include "mud/tick.h"
+
 #define MINIMUM_PORT 1024
+#define MAXIMUM_PORT 65535
+#define MAX_LISTENER_SHARDS 64
 #define DEFAULT_PORT 5000
 #define DEFAULT_TICKS_PER_SECOND 20
+#define DEFAULT_OUTPUT_BUFFER_LIMIT (1024 * 64)
+#define DEFAULT_COMMANDS_PER_TICK 1
+#define DEFAULT_COMMAND_BURST 10
+#define DEFAULT_SIMULATION_EPOCH 946684800
 #define MAX_CONFIG_LINE_LENGTH 1024
 #define BASE_10 10
 
 /**
  * Structs
  **/
+typedef struct listener_config {
+  unsigned int port;
+  char* path;
+  unsigned int backlog;
+  unsigned int shards;
+  bool reuseport;
+  bool websocket;
+  char* tls_certificate;
+  char* tls_key;
+} listener_config_t;
+
+typedef struct mssp_variable_config {
+  char* name;
+  char* value;
+} mssp_variable_config_t;
+
 typedef struct config {
   char* game_script;
   char* lib_script;
   char* database_file;
   unsigned int game_port;
   unsigned int ticks_per_second;
+  tick_policy_t tick_policy;
+  unsigned int tick_catch_up_limit;
+  unsigned int output_buffer_limit;
+  unsigned int output_pending_limit;
+  backpressure_policy_t backpressure_policy;
+  unsigned int backpressure_timeout;
+  bool output_coalescing;
+  unsigned int output_coalesce_latency;
+  unsigned int commands_per_tick;
+  unsigned int command_burst;
+  unsigned int login_idle_timeout;
+  unsigned int play_idle_timeout;
+  unsigned int keepalive_delay;
+  bool mccp;
+  unsigned int mccp_compression_level;
+  bool mccp_low_memory;
+  char* simulation_script; // Script of virtual client traffic, set to run a headless simulation
+  char* simulation_report; // File the simulation's tick time profile is written to, or NULL
+  time_t simulation_epoch; // Unix time the simulation's virtual clock starts at
+  linked_list_t* listeners;
+  linked_list_t* mssp_variables;
 } config_t;
 
 /**
@@ -28,5 +28,6 @@ int hash_table_insert(hash_table_t* table, const char* key, void* value);
 void hash_table_delete(hash_table_t* table, const char* key);
 int hash_table_has(hash_table_t* table, const char* key);
 void* hash_table_get(hash_table_t* table, const char* key);
+int hash_table_size(hash_table_t* table);
 
 #endif
\ No newline at end of file
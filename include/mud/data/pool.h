@@ -0,0 +1,6 @@
+#ifndef MUD_DATA_POOL_H
+#define MUD_DATA_POOL_H
+
+#include "mud/data/pool/pool.h"
+
+#endif
\ No newline at end of file
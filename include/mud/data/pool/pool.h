@@ -0,0 +1,57 @@
+#ifndef _POOL_H_
+#define _POOL_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Definitions
+ **/
+#define POOL_INVALID_ID 0
+
+/**
+ * Typedefs
+ **/
+typedef struct pool pool_t;
+typedef struct pool_slot pool_slot_t;
+typedef uint64_t pool_id_t;
+
+/**
+ * Structs
+ **/
+typedef struct pool_slot {
+  pool_t* pool;
+  pool_slot_t* next;
+  uint32_t index;
+  uint32_t generation;
+  bool used;
+} pool_slot_t;
+
+typedef struct pool {
+  size_t object_size;
+  size_t stride;
+  size_t slab_objects;
+  char** slabs;
+  size_t slab_count;
+  size_t slab_capacity;
+  pool_slot_t* free;
+  size_t used;
+} pool_t;
+
+/**
+ * Function prototypes
+ **/
+pool_t* create_pool_t(size_t object_size, size_t slab_objects);
+void free_pool_t(pool_t* pool);
+
+void* pool_acquire(pool_t* pool);
+void pool_release(void* object);
+
+pool_id_t pool_id(const void* object);
+void* pool_lookup(pool_t* pool, pool_id_t id);
+
+size_t pool_used(pool_t* pool);
+size_t pool_capacity(pool_t* pool);
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef MUD_DATA_TIMER_WHEEL_H
+#define MUD_DATA_TIMER_WHEEL_H
+
+#include "mud/data/timer_wheel/timer_wheel.h"
+
+#endif
\ No newline at end of file
@@ -0,0 +1,47 @@
+#ifndef _TIMER_WHEEL_H_
+#define _TIMER_WHEEL_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Typedefs
+ **/
+typedef struct timer_wheel timer_wheel_t;
+typedef struct timer_wheel_entry timer_wheel_entry_t;
+typedef void (*timer_wheel_func_t)(timer_wheel_entry_t* entry, void* context);
+
+/**
+ * Structs
+ **/
+typedef struct timer_wheel_entry {
+  timer_wheel_entry_t* prev;
+  timer_wheel_entry_t* next;
+  uint64_t deadline;
+  size_t slot;
+  bool active;
+  void* data;
+} timer_wheel_entry_t;
+
+typedef struct timer_wheel {
+  timer_wheel_entry_t** slots;
+  size_t slot_count;
+  uint64_t resolution;
+  uint64_t tick;
+  timer_wheel_entry_t* pending;
+  size_t active;
+} timer_wheel_t;
+
+/**
+ * Function prototypes
+ **/
+timer_wheel_t* create_timer_wheel_t(size_t slot_count, uint64_t resolution, uint64_t now);
+void free_timer_wheel_t(timer_wheel_t* wheel);
+
+void timer_wheel_schedule(timer_wheel_t* wheel, timer_wheel_entry_t* entry, uint64_t deadline);
+void timer_wheel_cancel(timer_wheel_t* wheel, timer_wheel_entry_t* entry);
+size_t timer_wheel_advance(timer_wheel_t* wheel, uint64_t now, timer_wheel_func_t func, void* context);
+void timer_wheel_each(timer_wheel_t* wheel, timer_wheel_func_t func, void* context);
+
+#endif
@@ -2,9 +2,18 @@
 #define _SYSTEM_H_
 
 #include <stdbool.h>
+#include <stdint.h>
 
+#include "mud/tick.h"
 #include "mud/util/muduuid.h"
 
+/**
+ * Definitions
+ **/
+#define MAX_SYSTEM_DEFERRAL 8 // Most runs a system is put back by for going over its budget once
+#define MAX_SYSTEM_INTERVAL 86400000 // Most ticks between runs of a system, a day at 1000 ticks per second
+#define MAX_SYSTEM_BUDGET 60000 // Most milliseconds a run of a system may be budgeted
+
 /**
  * Typedefs
  **/
@@ -19,6 +28,16 @@ typedef struct system {
   char* name;
   bool enabled;
   lua_ref_t* ref;
+
+  unsigned int interval; // Ticks between runs
+  uint64_t budget; // Nanoseconds a run may take, 0 for no budget
+  uint64_t due; // Tick the system next runs on
+  bool over_budget;
+
+  uint64_t runs;
+  uint64_t overruns; // Runs which went over budget
+  uint64_t deferred; // Runs put back for going over budget
+  tick_timing_t timing;
 } system_t;
 
 /**
@@ -30,6 +49,8 @@ void ecs_deallocate_system_t(void* value);
 
 void ecs_enable_system(system_t* system);
 void ecs_disable_system(system_t* system);
+void ecs_set_system_schedule(system_t* system, unsigned int interval, uint64_t budget);
+void ecs_stagger_system(game_t* game, system_t* system);
 
 void ecs_update_systems(game_t* game);
 
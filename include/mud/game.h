@@ -2,8 +2,12 @@
 #define _GAME_H_
 
 #include <sqlite3.h>
+#include <stdint.h>
+#include <time.h>
 #include <uv.h>
 
+#include "mud/tick.h"
+
 /**
  * Typedefs
  **/
@@ -14,6 +18,8 @@ typedef struct network network_t;
 typedef struct event_broker event_broker_t;
 typedef struct lua_State lua_State;
 typedef struct lua_hooks lua_hooks_t;
+typedef struct timer_wheel timer_wheel_t;
+typedef struct task task_t;
 
 /**
  * Structs
@@ -22,7 +28,9 @@ typedef struct game {
   unsigned int shutdown;
 
   uv_loop_t* loop;
-  uv_timer_t tick_timer;
+  tick_scheduler_t scheduler;
+  uint64_t tick;
+  time_t started;
 
   config_t* config;
 
@@ -39,8 +47,12 @@ typedef struct game {
   linked_list_t* components;
   linked_list_t* archetypes;
   linked_list_t* systems;
-  linked_list_t* tasks;
   linked_list_t* events;
+  linked_list_t* backlog;
+
+  timer_wheel_t* task_wheel;
+  hash_table_t* task_waiters;
+  task_t* current_task;
 
   network_t* network;
   lua_State* lua_state;
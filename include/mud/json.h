@@ -5,11 +5,19 @@
 #include <stdlib.h>
 #include <stdbool.h>
 
+/**
+ * Definitions
+**/
+#define JSON_MAX_DEPTH 32
+#define JSON_MAX_VALUES 4096
+#define JSON_MAX_STRING_LENGTH 4096
+
 /**
  * Typedef
 **/
 typedef union json_value json_value_t;
 typedef struct json_node json_node_t;
+typedef struct json_visitor json_visitor_t;
 
 /**
  * Enums
@@ -38,6 +46,23 @@ typedef struct json_type_str {
   char* str;
 } json_type_str_t;
 
+/**
+ * Callbacks made by json_parse as each part of a document is read.  Keys and strings
+ * are unescaped and are not null terminated.  Returning -1 from any callback stops
+ * the parse.
+**/
+typedef struct json_visitor {
+  int (*object_start)(void* context);
+  int (*object_end)(void* context);
+  int (*array_start)(void* context);
+  int (*array_end)(void* context);
+  int (*key)(void* context, const char* key, size_t len);
+  int (*string)(void* context, const char* str, size_t len);
+  int (*number)(void* context, double number);
+  int (*boolean)(void* context, bool boolean);
+  int (*null)(void* context);
+} json_visitor_t;
+
 typedef union json_value {
   char* str;
   double number;
@@ -54,6 +79,7 @@ void json_free_json_node_t(json_node_t* node);
 
 json_node_t* json_deserialize(const char* input, size_t len);
 int json_serialize(json_node_t* json, char* output, size_t len);
+int json_parse(const char* input, size_t len, const json_visitor_t* visitor, void* context);
 
 json_node_t* json_new_object();
 json_node_t* json_new_array();
@@ -12,6 +12,7 @@ typedef struct lua_event_data lua_event_data_t;
 typedef struct system system_t;
 typedef struct task task_t;
 typedef struct lua_ref lua_ref_t;
+typedef struct output_buffer output_buffer_t;
 
 /**
  * Functions
@@ -33,11 +34,14 @@ int lua_call_narrate_event_hook(lua_State* l, player_t* player, lua_ref_t* narra
 int lua_call_state_enter_hook(lua_State* l, player_t* player, lua_ref_t* state);
 int lua_call_state_exit_hook(lua_State* l, player_t* player, lua_ref_t* state);
 int lua_call_state_input_hook(lua_State* l, player_t* player, lua_ref_t* state, const char* input);
-int lua_call_state_output_hook(lua_State* l, player_t* player, lua_ref_t* state, const char* output);
+int lua_call_state_output_hook(lua_State* l, player_t* player, lua_ref_t* state, const output_buffer_t* output);
 int lua_call_state_event_hook(lua_State* l, player_t* player, lua_ref_t* state, event_t* event);
 int lua_call_state_gmcp_hook(lua_State*l, player_t* player, lua_ref_t* state, const char* topic, const char* msg);
 
 int lua_call_system_execute_hook(lua_State* l, system_t* system);
 int lua_call_task_execute_hook(lua_State* l, task_t* task);
+int lua_resume_task_hook(lua_State* l, task_t* task);
+
+const char* lua_get_event_type(lua_State* l, lua_ref_t* event);
 
 #endif
\ No newline at end of file
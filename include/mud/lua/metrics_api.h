@@ -0,0 +1,15 @@
+#ifndef MUD_LUA_METRICS_API_H
+#define MUD_LUA_METRICS_API_H
+
+/**
+ * Forward declations
+ **/
+typedef struct lua_State lua_State;
+typedef struct game game_t;
+
+/**
+ * Function prototypes
+ **/
+int lua_metrics_register_api(lua_State* l);
+
+#endif
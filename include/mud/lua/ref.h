@@ -17,6 +17,7 @@ typedef struct lua_ref {
 **/
 lua_ref_t* lua_new_lua_ref_t(lua_State* state, int ref);
 lua_ref_t* lua_init_lua_ref_t(lua_ref_t* reference, lua_State* state, int ref);
+lua_ref_t* lua_dup_lua_ref_t(lua_ref_t* reference, lua_ref_t* ref);
 void lua_release_lua_ref_t(lua_ref_t* ref);
 void lua_free_lua_ref_t(lua_ref_t* ref);
 void lua_deallocate_lua_ref_t(void* value);
@@ -1,6 +1,8 @@
 #ifndef MUD_LUA_STRUCT_H
 #define MUD_LUA_STRUCT_H
 
+#include <stddef.h>
+
 /**
  * Typedefs
  **/
@@ -39,6 +41,7 @@ void lua_push_action(lua_State* l, action_t* action);
 void lua_push_system(lua_State* l, system_t* system);
 void lua_push_task(lua_State* l, task_t* task);
 void lua_push_json_node(lua_State* l, json_node_t* node);
+int lua_push_json(lua_State* l, const char* json, size_t len);
 
 entity_t* lua_to_entity(lua_State* l, int index);
 player_t* lua_to_player(lua_State* l, int index);
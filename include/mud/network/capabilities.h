@@ -0,0 +1,62 @@
+#ifndef MUD_NETWORK_CAPABILITIES_H
+#define MUD_NETWORK_CAPABILITIES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Definitions
+ **/
+#define CAPABILITY_NAME_LENGTH 32 // Client, terminal and charset names including null terminator
+#define DEFAULT_CLIENT_WIDTH 80 // Assumed until the client reports its window size
+#define DEFAULT_CLIENT_HEIGHT 24
+#define CAPABILITY_MTTS_MASK 0xFFFu // Flags taken directly from an MTTS terminal type
+
+/**
+ * Enums
+ **/
+typedef enum client_capability {
+  // MTTS bits, as reported by the client in its final terminal type
+  CAPABILITY_ANSI = 1u << 0,
+  CAPABILITY_VT100 = 1u << 1,
+  CAPABILITY_UTF8 = 1u << 2,
+  CAPABILITY_256_COLOURS = 1u << 3,
+  CAPABILITY_MOUSE_TRACKING = 1u << 4,
+  CAPABILITY_OSC_COLOUR_PALETTE = 1u << 5,
+  CAPABILITY_SCREEN_READER = 1u << 6,
+  CAPABILITY_PROXY = 1u << 7,
+  CAPABILITY_TRUECOLOUR = 1u << 8,
+  CAPABILITY_MNES = 1u << 9,
+  CAPABILITY_MSLP = 1u << 10,
+  CAPABILITY_SSL = 1u << 11,
+
+  // Telnet options the client has negotiated
+  CAPABILITY_NAWS = 1u << 16,
+  CAPABILITY_TTYPE = 1u << 17,
+  CAPABILITY_CHARSET = 1u << 18,
+  CAPABILITY_MSSP = 1u << 19
+} client_capability_t;
+
+/**
+ * Structs
+ **/
+typedef struct client_capabilities {
+  uint32_t flags;
+  uint16_t width;
+  uint16_t height;
+  char client_name[CAPABILITY_NAME_LENGTH];
+  char terminal[CAPABILITY_NAME_LENGTH];
+  char charset[CAPABILITY_NAME_LENGTH];
+} client_capabilities_t;
+
+/**
+ * Function prototypes
+ **/
+void network_init_capabilities(client_capabilities_t* capabilities);
+
+void network_capabilities_set_name(char* dest, const char* name, size_t len);
+void network_capabilities_set_terminal(client_capabilities_t* capabilities, const char* terminal, size_t len);
+void network_capabilities_set_mtts(client_capabilities_t* capabilities, uint32_t mtts);
+unsigned int network_capabilities_colours(const client_capabilities_t* capabilities);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef MUD_NETWORK_CHARSET_H
+#define MUD_NETWORK_CHARSET_H
+
+#include "mud/network/telnet.h"
+
+/**
+ * Definitions
+**/
+#define TELOPT_CHARSET 42
+
+#define CHARSET_REQUEST 1
+#define CHARSET_ACCEPTED 2
+#define CHARSET_REJECTED 3
+
+#define CHARSET_OFFERED ";UTF-8;ISO-8859-1;US-ASCII" // Charsets offered in order of preference
+
+/**
+ * Structs
+**/
+typedef struct charset {
+  telnet_option_t charset;
+} charset_t;
+
+/**
+ * Function prototypes
+**/
+telnet_extension_t* network_new_charset_telnet_extension(protocol_pools_t* pools);
+
+#endif
@@ -2,9 +2,15 @@
 #define MUD_NETWORK_CLIENT_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <time.h>
 #include <uv.h>
 
+#include "mud/data/pool.h"
+#include "mud/data/timer_wheel.h"
+#include "mud/network/capabilities.h"
+#include "mud/network/input.h"
+#include "mud/network/output.h"
 #include "mud/network/protocol.h"
 #include "mud/util/muduuid.h"
 
@@ -12,45 +18,76 @@
  * Definitions
  **/
 #define CLIENT_BUFFER_SIZE (1024 * 5) + 1 // 5 KB + null terminator
-#define CLIENT_BUFFER_LENGTH CLIENT_BUFFER_SIZE - 1 // 5 KB
+#define CLIENT_OUTPUT_LIMIT (1024 * 64) // 64 KB default output high-water mark
 #define DELIM_SIZE 2
 
 /**
  * Typedefs
  **/
 typedef struct protocol protocol_t;
+typedef struct telnet telnet_t;
 typedef struct network network_t;
+typedef struct client client_t;
 
 /**
  * Structs
  **/
 typedef struct client {
-  uv_tcp_t handle;
+  union {
+    uv_tcp_t tcp;
+    uv_pipe_t pipe;
+  } handle;
+  pool_id_t id;
   int fd;
   unsigned int hungup;
-  time_t last_active;
+  bool connected; // The connection callback has been made, deferred for WebSocket clients until upgraded
+  uint64_t last_active;
+  bool authenticated;
+  bool trace;
+  client_capabilities_t capabilities;
+  timer_wheel_entry_t idle_entry;
   void* userdata;
   protocol_t* protocol;
+  protocol_t* protocols[PROTOCOL_TYPES]; // First protocol in the chain of each type
   network_t* network;
 
-  char input[CLIENT_BUFFER_SIZE];
-  char output[CLIENT_BUFFER_SIZE];
-  size_t output_length;
+  input_buffer_t input;
+  bool input_held; // A protocol holds input it had no space to pass on, set by protocols on each pass
+  output_buffer_t output;
+
+  size_t pending;
+  bool throttled;
+  bool held;
+  uint64_t throttled_since;
+
+  bool flush_queued;
+  uint64_t flush_queued_at;
+  bool deferred; // A protocol has output to write when the client is next flushed
+
+  bool dirty;
+  client_t* dirty_prev;
+  client_t* dirty_next;
 } client_t;
 
 /**
  * Function prototypes
  **/
-client_t* create_client_t(void);
+client_t* create_client_t(pool_t* pool);
 void free_client_t(client_t* client);
 
 int send_to_client(client_t* client, const char* data, size_t len);
+int send_essential_to_client(client_t* client, const char* data, size_t len);
 int flush_client_output(client_t* client);
 int client_get_idle_seconds(const client_t* const client);
+void network_client_update_pending(client_t* client);
+void network_client_defer_output(client_t* client);
+void network_client_hang_up(client_t* client);
+void network_client_set_trace(client_t* client, bool trace);
 int extract_from_input(client_t* client, char* dest, size_t dest_len, const char* delim);
 
 int network_add_client_protocol(client_t* client, protocol_t* protocol);
 bool network_client_has_protocol(client_t* client, protocol_type_t type);
 void* network_client_get_protocol(client_t* client, protocol_type_t type);
+telnet_t* network_client_get_telnet(client_t* client);
 
 #endif
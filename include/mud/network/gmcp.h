@@ -4,6 +4,9 @@
 #include "mud/network/telnet.h"
 
 #define TELOPT_GMCP 201
+#define GMCP_FRAME_SIZE 2048 // Frames up to this size are built on the stack
+#define GMCP_COALESCED_TOPICS 8 // Topics per client which can be coalesced
+#define GMCP_TOPIC_SIZE 64 // Longest coalesced topic including null terminator
 
 /**
  * Typededs
@@ -14,16 +17,26 @@ typedef void (*on_gmcp_func_t)(client_t*, void*, const char*, const char*);
 /**
  Structs
 **/
+typedef struct gmcp_coalesced {
+  char topic[GMCP_TOPIC_SIZE];
+  char* frame;
+  size_t len;
+  size_t size;
+  bool pending;
+} gmcp_coalesced_t;
+
 typedef struct gmcp {
   void* context;
   on_gmcp_func_t on_gmcp;
   telnet_option_t gmcp;
+  gmcp_coalesced_t* coalesced; // GMCP_COALESCED_TOPICS entries, allocated on first use
 } gmcp_t;
 
 /**
  * Function prototypes
 **/
-telnet_extension_t* network_new_gmcp_telnet_extension(void* context, on_gmcp_func_t on_gmcp);
-void network_send_gmcp_message(client_t* client, char* topic, size_t topic_len, char* msg, size_t msg_len);
+telnet_extension_t* network_new_gmcp_telnet_extension(protocol_pools_t* pools, void* context, on_gmcp_func_t on_gmcp);
+int network_send_gmcp_message(client_t* client, const char* topic, size_t topic_len, const char* msg, size_t msg_len);
+int network_send_coalesced_gmcp_message(client_t* client, const char* topic, size_t topic_len, const char* msg, size_t msg_len);
 
 #endif
@@ -0,0 +1,29 @@
+#ifndef MUD_NETWORK_INPUT_H
+#define MUD_NETWORK_INPUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Structs
+ **/
+typedef struct input_buffer {
+  char* data;
+  size_t size;
+  size_t read;
+  size_t write;
+  size_t scan;
+} input_buffer_t;
+
+/**
+ * Function prototypes
+ **/
+void network_init_input_buffer(input_buffer_t* buffer, size_t size);
+void network_release_input_buffer(input_buffer_t* buffer);
+
+char* network_input_buffer_reserve(input_buffer_t* buffer, size_t* len);
+void network_input_buffer_commit(input_buffer_t* buffer, size_t len);
+int network_input_buffer_extract(input_buffer_t* buffer, char* dest, size_t dest_len, const char* delim, size_t delim_len);
+bool network_input_buffer_is_empty(const input_buffer_t* buffer);
+
+#endif
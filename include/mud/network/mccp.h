@@ -0,0 +1,46 @@
+#ifndef MUD_NETWORK_MCCP_H
+#define MUD_NETWORK_MCCP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <zlib.h>
+
+#include "mud/network/telnet.h"
+
+/**
+ * Definitions
+**/
+#define TELOPT_MCCP2 86
+#define TELOPT_MCCP3 87
+
+#define DEFAULT_MCCP_COMPRESSION_LEVEL 6
+#define MCCP_WINDOW_BITS 15 // 32 KB window, zlib's default
+#define MCCP_MEM_LEVEL 8 // zlib's default, around 256 KB of deflate state per client
+#define MCCP_LOW_MEMORY_WINDOW_BITS 11 // 2 KB window
+#define MCCP_LOW_MEMORY_MEM_LEVEL 4 // Around 16 KB of deflate state per client
+
+/**
+ * Structs
+**/
+typedef struct mccp {
+  int level;
+  bool low_memory;
+  telnet_option_t mccp2;
+  telnet_option_t mccp3;
+  z_stream* deflate;
+  z_stream* inflate;
+  size_t start;
+  bool finish;
+  char* pending;
+  size_t pending_len;
+  size_t pending_size;
+  uint64_t raw_bytes;
+  uint64_t compressed_bytes;
+} mccp_t;
+
+/**
+ * Function prototypes
+**/
+telnet_extension_t* network_new_mccp_telnet_extension(protocol_pools_t* pools, int level, bool low_memory);
+
+#endif
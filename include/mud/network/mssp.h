@@ -0,0 +1,34 @@
+#ifndef MUD_NETWORK_MSSP_H
+#define MUD_NETWORK_MSSP_H
+
+#include "mud/network/telnet.h"
+
+/**
+ * Definitions
+**/
+#define TELOPT_MSSP 70
+
+#define MSSP_VAR 1
+#define MSSP_VAL 2
+
+/**
+ * Typedefs
+**/
+typedef void (*on_mssp_func_t)(client_t*, void*);
+
+/**
+ * Structs
+**/
+typedef struct mssp {
+  void* context;
+  on_mssp_func_t on_mssp;
+  telnet_option_t mssp;
+} mssp_t;
+
+/**
+ * Function prototypes
+**/
+telnet_extension_t* network_new_mssp_telnet_extension(protocol_pools_t* pools, void* context, on_mssp_func_t on_mssp);
+void network_send_mssp(client_t* client, const char* const* names, const char* const* values, size_t count);
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef MUD_NETWORK_NAWS_H
+#define MUD_NETWORK_NAWS_H
+
+#include "mud/network/telnet.h"
+
+/**
+ * Structs
+**/
+typedef struct naws {
+  telnet_option_t naws;
+} naws_t;
+
+/**
+ * Function prototypes
+**/
+telnet_extension_t* network_new_naws_telnet_extension(protocol_pools_t* pools);
+
+#endif
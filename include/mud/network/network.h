@@ -1,23 +1,60 @@
 #ifndef _NETWORK_H_
 #define _NETWORK_H_
 
+#include <openssl/ssl.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <uv.h>
 
+#include "mud/data/pool.h"
+#include "mud/data/timer_wheel.h"
 #include "mud/network/callback.h"
+#include "mud/network/output.h"
+#include "mud/network/protocol.h"
 
 /**
  * Definitions
  **/
-#define BACKLOG 10
+#define DEFAULT_BACKLOG 128 // Pending connections queued by the kernel per listener
+#define CLIENT_POOL_SLAB_SIZE 64 // Clients allocated together per client pool slab
+#define DEFAULT_PENDING_LIMIT (1024 * 256) // 256 KB queued in libuv before a client is throttled
+#define DEFAULT_BACKPRESSURE_TIMEOUT 30 // Seconds a client may stay throttled under the disconnect policy
+#define DEFAULT_COALESCE_LATENCY 0 // Milliseconds coalesced output may wait, 0 flushes once per loop iteration
+#define DEFAULT_LOGIN_IDLE_TIMEOUT 300 // Seconds a client may idle before authenticating, 0 never times out
+#define DEFAULT_PLAY_IDLE_TIMEOUT 0 // Seconds an authenticated client may idle, 0 never times out
+#define DEFAULT_KEEPALIVE_DELAY 0 // Seconds before TCP keepalive probes start, 0 disables keepalive
+#define IDLE_WHEEL_SLOTS 256 // Slots in the idle timing wheel
+#define IDLE_WHEEL_RESOLUTION 1000 // Milliseconds per idle timing wheel tick
+
+/**
+ * Enums
+ **/
+typedef enum backpressure_policy {
+  BACKPRESSURE_DROP,
+  BACKPRESSURE_COALESCE,
+  BACKPRESSURE_DISCONNECT
+} backpressure_policy_t;
 
 /**
  * Typedefs
  **/
 typedef struct linked_list linked_list_t;
+typedef struct client client_t;
 
 /**
  * Structs
  **/
+typedef struct network_metrics {
+  size_t connections;
+  size_t disconnections;
+  size_t dropped_bytes;
+  size_t coalesced_flushes;
+  size_t slow_disconnects;
+  size_t idle_disconnects;
+  size_t tls_handshakes;
+  size_t tls_resumptions;
+} network_metrics_t;
+
 typedef struct network {
   uv_loop_t* loop;
 
@@ -28,6 +65,33 @@ typedef struct network {
 
   linked_list_t* servers;
   linked_list_t* clients;
+  pool_t* client_pool;
+
+  client_t* dirty_head;
+  client_t* dirty_tail;
+
+  size_t output_limit;
+  output_pool_t output_pool;
+  protocol_pools_t protocol_pools;
+
+  size_t pending_limit;
+  backpressure_policy_t backpressure_policy;
+  unsigned int backpressure_timeout;
+
+  network_metrics_t metrics;
+
+  bool coalesce_output;
+  unsigned int coalesce_latency;
+  uv_check_t coalesce_check;
+  uv_timer_t coalesce_timer;
+  linked_list_t* flush_queue;
+
+  unsigned int login_idle_timeout;
+  unsigned int play_idle_timeout;
+  unsigned int keepalive_delay;
+  bool reap_idle;
+  timer_wheel_t* idle_wheel;
+  uv_timer_t idle_timer;
 } network_t;
 
 /**
@@ -38,11 +102,26 @@ void free_network_t(network_t* network);
 
 int start_game_server(network_t* network, unsigned int port);
 int stop_game_server(network_t* network, unsigned int port);
+int network_start_tcp_server(network_t* network, unsigned int port, unsigned int backlog, unsigned int shards, bool reuseport, bool websocket, SSL_CTX* tls);
+int network_start_unix_server(network_t* network, const char* path, unsigned int backlog);
+int network_stop_unix_server(network_t* network, const char* path);
+int network_connect_local_client(network_t* network, uv_file fd);
+
+client_t* network_get_client(network_t* network, pool_id_t id);
 
 void flush_output(network_t* network);
+void network_mark_client_dirty(network_t* network, client_t* client);
+int network_enable_output_coalescing(network_t* network, unsigned int latency);
+int network_enable_idle_reaper(network_t* network);
+void network_reap_idle_clients(network_t* network);
+void network_touch_client(network_t* network, client_t* client);
+void network_client_authenticated(client_t* client);
 void disconnect_clients(network_t* network);
 void network_shutdown(network_t* network);
 
+int network_parse_backpressure_policy(const char* value, backpressure_policy_t* policy);
+const char* network_backpressure_policy_name(backpressure_policy_t policy);
+
 void register_connection_callback(network_t* network, callback_func func, void* context);
 void register_disconnection_callback(network_t* network, callback_func func, void* context);
 void register_input_callback(network_t* network, callback_func func, void* context);
@@ -0,0 +1,83 @@
+#ifndef MUD_NETWORK_OUTPUT_H
+#define MUD_NETWORK_OUTPUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <uv.h>
+
+/**
+ * Definitions
+ **/
+#define OUTPUT_SEGMENT_SIZE (1024 * 2) // 2 KB per segment
+#define OUTPUT_POOL_MAX_FREE 256 // Segments retained by a pool for reuse
+#define OUTPUT_WRITE_BUFS 32 // uv_buf_t entries available on the stack per flush
+
+/**
+ * Typedefs
+ **/
+typedef struct output_segment output_segment_t;
+typedef struct output_write output_write_t;
+typedef struct output_pool output_pool_t;
+
+/**
+ * Structs
+ **/
+typedef struct output_segment {
+  output_segment_t* next;
+  unsigned int refs;
+  size_t len;
+  char data[OUTPUT_SEGMENT_SIZE];
+} output_segment_t;
+
+typedef struct output_write {
+  uv_write_t req;
+  output_pool_t* pool;
+  output_segment_t* segments;
+  output_write_t* next;
+} output_write_t;
+
+typedef struct output_pool {
+  output_segment_t* segments;
+  output_write_t* writes;
+  size_t free_segments;
+  size_t free_writes;
+  size_t max_free;
+} output_pool_t;
+
+typedef struct output_buffer {
+  output_pool_t* pool;
+  output_segment_t* head;
+  output_segment_t* tail;
+  size_t length;
+  size_t limit;
+  bool essential;
+} output_buffer_t;
+
+/**
+ * Function prototypes
+ **/
+void network_init_output_pool(output_pool_t* pool, size_t max_free);
+void network_clear_output_pool(output_pool_t* pool);
+
+void network_output_segment_retain(output_segment_t* segment);
+void network_output_segment_release(output_pool_t* pool, output_segment_t* segment);
+void network_output_segments_retain(output_segment_t* head);
+void network_output_segments_release(output_pool_t* pool, output_segment_t* head);
+
+output_write_t* network_output_write_acquire(output_pool_t* pool);
+void network_output_write_release(output_write_t* write);
+
+void network_init_output_buffer(output_buffer_t* buffer, size_t limit);
+void network_clear_output_buffer(output_buffer_t* buffer);
+
+int network_output_buffer_append(output_buffer_t* buffer, const char* data, size_t len);
+char* network_output_buffer_reserve(output_buffer_t* buffer, size_t* len);
+void network_output_buffer_commit(output_buffer_t* buffer, size_t len);
+void network_output_buffer_move(output_buffer_t* dest, output_buffer_t* src);
+int network_output_buffer_splice(output_buffer_t* dest, output_buffer_t* src, size_t len);
+void network_output_buffer_consume(output_buffer_t* buffer, size_t len);
+size_t network_output_buffer_copy(const output_buffer_t* buffer, char* dest, size_t len);
+size_t network_output_buffer_bufs(const output_buffer_t* buffer, uv_buf_t* bufs, size_t nbufs);
+size_t network_output_buffer_count(const output_buffer_t* buffer);
+
+#endif
@@ -1,27 +1,51 @@
 #ifndef MUD_NETWORK_PROTOCOL_H
 #define MUD_NETWORK_PROTOCOL_H
 
+#include <stddef.h>
+
+#include "mud/data/pool.h"
+
+/**
+ * Definitions
+**/
+#define PROTOCOL_POOL_SLAB_SIZE 32 // Objects allocated together per protocol pool slab
+#define PROTOCOL_POOL_CLASSES 16 // Distinct object sizes pooled, objects of any other size are allocated from the heap
+
 /**
  * Typedefs
 **/
 typedef struct client client_t;
 typedef struct protocol protocol_t;
+typedef struct output_buffer output_buffer_t;
 
 typedef void (*protocol_func_t)(client_t*, void*);
-typedef int (*protocol_data_func_t)(client_t*, void*, char*, size_t);
-typedef void (*protocol_flush_func_t)(client_t*, void*, char*, size_t);
+typedef int (*protocol_data_func_t)(client_t*, void*, char*, size_t, size_t);
+typedef int (*protocol_output_func_t)(client_t*, void*, output_buffer_t*, output_buffer_t*);
+typedef void (*protocol_flush_func_t)(client_t*, void*, output_buffer_t*);
 typedef void (*protocol_deallocate_func_t)(void*);
 
 /**
  * Enums
 **/
 typedef enum protocol_type {
-  TELNET
+  TELNET,
+  WEBSOCKET,
+  TLS,
+  PROTOCOL_TYPES // Number of protocol types, not a protocol
 } protocol_type_t;
 
 /**
  * Structs
 **/
+typedef struct protocol_pools {
+  pool_t* pools[PROTOCOL_POOL_CLASSES];
+} protocol_pools_t;
+
+typedef union protocol_object_header {
+  pool_t* pool; // Pool the object was acquired from, NULL if it was allocated from the heap
+  max_align_t align;
+} protocol_object_header_t;
+
 typedef struct protocol {
   void* data;
 
@@ -31,7 +55,7 @@ typedef struct protocol {
 
   protocol_func_t initialiser;
   protocol_data_func_t on_input;
-  protocol_data_func_t on_output;
+  protocol_output_func_t on_output;
   protocol_flush_func_t on_flush;
 
   protocol_t* next;
@@ -40,18 +64,23 @@ typedef struct protocol {
 /**
  * Function prototypes
 **/
-protocol_t* network_new_protocol_t();
+void network_init_protocol_pools(protocol_pools_t* pools);
+void network_clear_protocol_pools(protocol_pools_t* pools);
+void* network_protocol_alloc(protocol_pools_t* pools, size_t size);
+void network_protocol_free(void* object);
+
+protocol_t* network_new_protocol_t(protocol_pools_t* pools);
 void network_free_protocol_t(protocol_t* protocol);
 void network_deallocate_protocol_chain(protocol_t* protocol);
 
 void network_protocol_chain_initialise(client_t* client);
-int network_protocol_chain_on_input(client_t* client, char* input, size_t len);
-int network_protocol_chain_on_output(client_t* client, char* output, size_t len);
-void network_protocol_chain_on_flush(client_t* client, char* output, size_t len);
+int network_protocol_chain_on_input(client_t* client, char* input, size_t len, size_t size);
+int network_protocol_chain_on_output(client_t* client, output_buffer_t* output);
+void network_protocol_chain_on_flush(client_t* client, output_buffer_t* output);
 
 void network_protocol_initialise(protocol_t* protocol, client_t* client);
-int network_protocol_on_input(protocol_t* protocol, client_t* client, char* input, size_t len);
-int network_protocol_on_output(protocol_t* protocol, client_t* client, char* output, size_t len);
-void network_protocol_on_flush(protocol_t* protocol, client_t* client, char* output, size_t len);
+int network_protocol_on_input(protocol_t* protocol, client_t* client, char* input, size_t len, size_t size);
+int network_protocol_on_output(protocol_t* protocol, client_t* client, output_buffer_t* output);
+void network_protocol_on_flush(protocol_t* protocol, client_t* client, output_buffer_t* output);
 
 #endif
\ No newline at end of file
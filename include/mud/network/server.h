@@ -1,6 +1,8 @@
 #ifndef _SERVER_H_
 #define _SERVER_H_
 
+#include <openssl/ssl.h>
+#include <stdbool.h>
 #include <uv.h>
 
 /**
@@ -13,13 +15,29 @@
  **/
 typedef struct network network_t;
 
+/**
+ * Enums
+ **/
+typedef enum server_type {
+  SERVER_TCP,
+  SERVER_UNIX
+} server_type_t;
+
 /**
  * Structs
  **/
 typedef struct server {
-  uv_tcp_t handle;
+  union {
+    uv_tcp_t tcp;
+    uv_pipe_t pipe;
+  } handle;
+  server_type_t type;
   unsigned int port;
+  char* path;
   unsigned int backlog;
+  bool reuseport;
+  bool websocket; // Connections must upgrade to WebSocket before they're connected
+  SSL_CTX* tls; // Connections are TLS terminated using this context when set
   network_t* network;
 } server_t;
 
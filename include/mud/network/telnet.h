@@ -2,8 +2,11 @@
 #define MUD_NETWORK_TELNET_H
 
 #define TELNET_BUFFER_SIZE (1024 * 1) + 1 // 1 KB + null terminator
+#define TELNET_OPTIONS 256 // Every option byte
+#define TELNET_MAX_OPTIONS 24 // Options a telnet_t can support, including ECHO and SGA
 
 #include <stdbool.h>
+#include <stddef.h>
 
 /**
  * Typedefs
@@ -11,6 +14,8 @@
 typedef struct telnet telnet_t;
 typedef struct client client_t;
 typedef struct protocol protocol_t;
+typedef struct protocol_pools protocol_pools_t;
+typedef struct output_buffer output_buffer_t;
 typedef struct telnet_option telnet_option_t;
 typedef struct telnet_config telnet_config_t;
 typedef struct telnet_extension telnet_extension_t;
@@ -20,12 +25,16 @@ typedef void (*telnet_initialise_func_t)(void*, telnet_t*, client_t*);
 typedef telnet_option_t* (*telnet_option_func_t)(void*, int);
 typedef telnet_config_t* (*telnet_config_func_t)(void*, int);
 typedef void (*telnet_se_func_t)(void*, telnet_t*, client_t*, int, const char*, size_t);
+typedef void (*telnet_negotiated_func_t)(void*, telnet_t*, client_t*, int, bool, bool);
+typedef int (*telnet_encode_func_t)(void*, telnet_t*, client_t*, output_buffer_t*);
+typedef int (*telnet_decode_func_t)(void*, telnet_t*, client_t*, const char*, size_t, char*, size_t);
+typedef int (*telnet_flush_func_t)(void*, telnet_t*, client_t*, output_buffer_t*);
 
 /**
  * Structs
 **/
 typedef enum parse_state {
-  READ_IAC, READ_OP, READ_OP_VALUE, READ_SB_OPTION, READ_SE_IAC, READ_SE, DONE
+  READ_IAC, READ_OP, READ_OP_VALUE, READ_SB_OPTION, READ_SE_IAC, READ_SE
 } parse_state_t;
 
 typedef enum option_state {
@@ -51,6 +60,12 @@ typedef struct telnet_config {
   bool accept_do;
 } telnet_config_t;
 
+typedef struct telnet_option_entry {
+  telnet_option_t* state;
+  telnet_config_t* config;
+  telnet_extension_t* extension; // NULL for options telnet handles itself
+} telnet_option_entry_t;
+
 typedef struct telnet_extension {
   void* extension;
   telnet_deallocator_func_t deallocate;
@@ -58,32 +73,49 @@ typedef struct telnet_extension {
   telnet_option_func_t get_option;
   telnet_config_func_t get_config;
   telnet_se_func_t subnegotiation;
+  telnet_negotiated_func_t negotiated;
+  telnet_encode_func_t encode;
+  telnet_decode_func_t decode;
+  telnet_flush_func_t flush;
   telnet_extension_t* next;
 } telnet_extension_t;
 
 typedef struct telnet {
   telnet_extension_t* extensions;
+  telnet_extension_t* encoder;
+  telnet_extension_t* decoder;
+  bool encoded;
+  bool encode_failed; // The encoder's state can't be trusted, so no more output is sent
   telnet_parse_t incoming;
   telnet_parse_t outgoing; 
   telnet_option_t echo;
   telnet_option_t suppress_go_ahead;
+  unsigned char option_index[TELNET_OPTIONS]; // Option byte to entry in options plus one, 0 if unsupported
+  unsigned char option_count;
+  telnet_option_entry_t options[TELNET_MAX_OPTIONS];
 } telnet_t;
 
 /**
  * Function prototypes
 **/
-telnet_t* network_new_telnet_t();
+telnet_t* network_new_telnet_t(protocol_pools_t* pools);
 void network_free_telnet_t(telnet_t* telnet);
 void network_deallocate_telnet_t(void* value);
 
-protocol_t* network_new_telnet_protocol_t();
+protocol_t* network_new_telnet_protocol_t(protocol_pools_t* pools);
+telnet_extension_t* network_new_telnet_extension(protocol_pools_t* pools, size_t size);
 
 void network_register_telnet_extension(telnet_t* telnet, telnet_extension_t* extension);
+void network_telnet_set_encoder(telnet_t* telnet, void* extension);
+void network_telnet_set_decoder(telnet_t* telnet, void* extension);
+void* network_telnet_get_extension(telnet_t* telnet, int option);
+void network_telnet_negotiate(telnet_t* telnet, client_t* client, int op, int option);
+void network_telnet_subnegotiate(telnet_t* telnet, client_t* client, int option, const char* data, size_t len);
 
 void network_telnet_initialised(client_t* client, void* protocol);
-int network_telnet_on_input(client_t* client, void* protocol, char* input, size_t len);
-int network_telnet_on_output(client_t* client, void* protocol, char* output, size_t len);
-void network_telnet_on_flush(client_t* client, void* protocol, char* output, size_t len);
+int network_telnet_on_input(client_t* client, void* protocol, char* input, size_t len, size_t size);
+int network_telnet_on_output(client_t* client, void* protocol, output_buffer_t* input, output_buffer_t* output);
+void network_telnet_on_flush(client_t* client, void* protocol, output_buffer_t* output);
 
 int network_telnet_send_ga(telnet_t* telnet, client_t* client);
 int network_telnet_send_will(telnet_t* telnet, client_t* client, int option);
@@ -0,0 +1,52 @@
+#ifndef MUD_NETWORK_TLS_H
+#define MUD_NETWORK_TLS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <openssl/ssl.h>
+
+#include "mud/network/output.h"
+
+/**
+ * Definitions
+**/
+#define TLS_RECORD_SIZE (1024 * 16) // Largest TLS record payload, output is encrypted in records this size
+#define TLS_SESSION_CACHE_SIZE 1024 // Sessions cached per listener for resumption by session ID
+#define TLS_SESSION_TIMEOUT 3600 // Seconds a session or ticket can be resumed for
+#define TLS_SESSION_TICKETS 1 // Tickets issued per TLS 1.3 handshake
+#define TLS_SESSION_CONTEXT "lunac"
+
+/**
+ * Typedefs
+**/
+typedef struct client client_t;
+typedef struct protocol protocol_t;
+typedef struct protocol_pools protocol_pools_t;
+
+/**
+ * Structs
+**/
+typedef struct tls {
+  SSL* ssl;
+  BIO* input; // Ciphertext received from the client, read by OpenSSL
+  BIO* output; // Ciphertext written by OpenSSL, to be sent to the client
+  output_buffer_t pending; // Output held back until the handshake has completed
+  bool established;
+  bool failed;
+  bool shutdown;
+} tls_t;
+
+/**
+ * Function prototypes
+**/
+SSL_CTX* network_new_tls_context(const char* certificate, const char* key);
+void network_free_tls_context(SSL_CTX* context);
+
+protocol_t* network_new_tls_protocol_t(protocol_pools_t* pools, SSL_CTX* context);
+void network_deallocate_tls_t(void* value);
+
+void network_tls_initialised(client_t* client, void* protocol);
+int network_tls_on_input(client_t* client, void* protocol, char* input, size_t len, size_t size);
+int network_tls_on_output(client_t* client, void* protocol, output_buffer_t* input, output_buffer_t* output);
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef MUD_NETWORK_TTYPE_H
+#define MUD_NETWORK_TTYPE_H
+
+#include "mud/network/capabilities.h"
+#include "mud/network/telnet.h"
+
+/**
+ * Definitions
+**/
+#define TTYPE_MAX_REQUESTS 3 // Client name, terminal type and MTTS bitvector
+
+/**
+ * Structs
+**/
+typedef struct ttype {
+  telnet_option_t ttype;
+  unsigned int replies;
+  char last[CAPABILITY_NAME_LENGTH];
+} ttype_t;
+
+/**
+ * Function prototypes
+**/
+telnet_extension_t* network_new_ttype_telnet_extension(protocol_pools_t* pools);
+
+#endif
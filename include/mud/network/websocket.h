@@ -0,0 +1,111 @@
+#ifndef MUD_NETWORK_WEBSOCKET_H
+#define MUD_NETWORK_WEBSOCKET_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mud/network/callback.h"
+#include "mud/network/output.h"
+
+/**
+ * Definitions
+**/
+#define WEBSOCKET_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+#define WEBSOCKET_GMCP_PROTOCOL "gmcp.mudstandards.org"
+#define WEBSOCKET_REQUEST_SIZE (1024 * 4) // Longest handshake request accepted
+#define WEBSOCKET_MESSAGE_SIZE (1024 * 4) // Longest GMCP message accepted from the client
+#define WEBSOCKET_MAX_PAYLOAD (1024 * 64) // Longest frame accepted from the client
+#define WEBSOCKET_MAX_HEADER 14 // Frame header with a 64 bit length and a mask
+#define WEBSOCKET_CONTROL_SIZE 125 // Longest control frame payload
+#define WEBSOCKET_REPLIES 16 // Telnet negotiations answered per flush
+
+#define WEBSOCKET_CLOSE_NORMAL 1000
+#define WEBSOCKET_CLOSE_PROTOCOL_ERROR 1002
+#define WEBSOCKET_CLOSE_TOO_BIG 1009
+
+/**
+ * Typedefs
+**/
+typedef struct client client_t;
+typedef struct protocol_pools protocol_pools_t;
+typedef struct protocol protocol_t;
+
+/**
+ * Enums
+**/
+typedef enum websocket_opcode {
+  WEBSOCKET_CONTINUATION = 0x0,
+  WEBSOCKET_TEXT = 0x1,
+  WEBSOCKET_BINARY = 0x2,
+  WEBSOCKET_CLOSE = 0x8,
+  WEBSOCKET_PING = 0x9,
+  WEBSOCKET_PONG = 0xA
+} websocket_opcode_t;
+
+typedef enum websocket_state {
+  WEBSOCKET_HANDSHAKE, WEBSOCKET_OPEN, WEBSOCKET_CLOSED
+} websocket_state_t;
+
+typedef enum websocket_output_state {
+  WEBSOCKET_OUTPUT_DATA, WEBSOCKET_OUTPUT_IAC, WEBSOCKET_OUTPUT_OPTION, WEBSOCKET_OUTPUT_SB, WEBSOCKET_OUTPUT_SB_DATA, WEBSOCKET_OUTPUT_SB_IAC
+} websocket_output_state_t;
+
+/**
+ * Structs
+**/
+typedef struct websocket_reply {
+  unsigned char op;
+  unsigned char option;
+} websocket_reply_t;
+
+typedef struct websocket {
+  websocket_state_t state;
+  callback_func on_open;
+  void* context;
+  bool gmcp; // The client asked for the GMCP sub-protocol
+
+  char* request; // Handshake request, only allocated until the connection is upgraded
+  size_t request_len;
+  size_t raw; // Output at the start of the buffer which is written unframed
+
+  unsigned char header[WEBSOCKET_MAX_HEADER];
+  size_t header_len;
+  size_t header_need;
+  unsigned char opcode;
+  bool fin;
+  uint64_t remaining;
+  unsigned char mask[4];
+  size_t mask_pos;
+  unsigned char message_opcode; // Opcode of the data message being received, 0 if none
+  char tail[2]; // Last bytes of the message being received
+  char control[WEBSOCKET_CONTROL_SIZE];
+  size_t control_len;
+  char* message; // GMCP message being received, allocated on first use
+  size_t message_len;
+
+  websocket_output_state_t output_state;
+  unsigned char output_op;
+  bool capture; // Output subnegotiation is GMCP and is framed as a message
+  output_buffer_t frame; // Payload of the frame being built
+  websocket_opcode_t frame_opcode;
+  websocket_reply_t replies[WEBSOCKET_REPLIES];
+  size_t reply_count;
+  char pong[WEBSOCKET_CONTROL_SIZE];
+  size_t pong_len;
+  bool pong_pending;
+  uint16_t close_code;
+  bool close_pending;
+} websocket_t;
+
+/**
+ * Function prototypes
+**/
+protocol_t* network_new_websocket_protocol_t(protocol_pools_t* pools, callback_func on_open, void* context);
+void network_deallocate_websocket_t(void* value);
+
+void network_websocket_initialised(client_t* client, void* protocol);
+int network_websocket_on_input(client_t* client, void* protocol, char* input, size_t len, size_t size);
+int network_websocket_on_output(client_t* client, void* protocol, output_buffer_t* input, output_buffer_t* output);
+
+#endif
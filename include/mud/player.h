@@ -1,6 +1,10 @@
 #ifndef _PLAYER_H_
 #define _PLAYER_H_
 
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "mud/data/pool/pool.h"
 #include "mud/util/mudhash.h"
 #include "mud/util/muduuid.h"
 
@@ -11,12 +15,15 @@
 #define PASSWORD_SIZE 30
 #define SEND_SIZE 1024
 #define COMMAND_SIZE 256
+#define COMMAND_QUEUE_LIMIT 256
 #define TOPIC_LEN 128
 #define MSG_LEN 1024
 /**
  * Typedefs
  **/
 typedef struct client client_t;
+typedef struct network network_t;
+typedef struct client_capabilities client_capabilities_t;
 typedef struct game game_t;
 typedef struct entity entity_t;
 typedef struct event event_t;
@@ -35,12 +42,19 @@ typedef struct player {
 
   char* username;
 
-  client_t* client;
+  network_t* network;
+  pool_id_t client; // Resolved with player_get_client as the connection may have closed
   entity_t* entity;
   lua_ref_t* state;
   lua_ref_t* narrator;
 
   linked_list_t* command_groups;
+
+  linked_list_t* command_queue;
+  unsigned int queued_commands;
+  unsigned int command_tokens;
+  uint64_t command_tokens_tick;
+  bool backlogged;
 } player_t;
 
 /**
@@ -55,6 +69,7 @@ void player_disconnected(client_t* client, void* context);
 void player_input(client_t* client, void* context);
 void player_output(client_t* client, void* context);
 void player_gmcp(client_t* client, void* context, const char* topic, const char* message);
+void player_mssp(client_t* client, void* context);
 void player_on_event(player_t* player, game_t* game, event_t* event);
 
 int player_change_state(player_t* player, game_t* game, lua_ref_t* state);
@@ -63,14 +78,19 @@ int player_narrate(player_t* player, game_t* game, event_t* event);
 
 int player_request_disable_echo(player_t* player);
 int player_request_enable_echo(player_t* player);
+int player_set_protocol_trace(player_t* player, bool trace);
+client_t* player_get_client(player_t* player);
+const client_capabilities_t* player_get_capabilities(player_t* player);
 
 int player_add_command_group(player_t* player, command_group_t* group);
 int player_remove_command_group(player_t* player, command_group_t* group);
 int player_get_commands(player_t* player, game_t* game, const char* name, linked_list_t* commands);
 int player_execute_command(player_t* player, game_t* game, command_t* cmd, const char* arguments);
+void player_drain_commands(game_t* game);
 
 void send_to_player(player_t* player, const char* fmt, ...);
 void send_gmcp_to_player(player_t* player, char* topic, char* msg);
+void send_coalesced_gmcp_to_player(player_t* player, char* topic, char* msg);
 void send_to_players(linked_list_t* players, const char* fmt, ...);
 void send_to_all_players(game_t* game, player_t* excluding, const char* fmt, ...);
 
@@ -0,0 +1,81 @@
+#ifndef MUD_SIM_H
+#define MUD_SIM_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <uv.h>
+
+#include "mud/tick.h"
+
+/**
+ * Definitions
+ **/
+#define SIM_MAX_LINE_LENGTH 4096 // Longest line accepted in a simulation script
+#define SIM_READ_SIZE (1024 * 64) // Bytes read from a virtual client's connection at a time
+#define SIM_END_STEP "end"
+
+/**
+ * Typedefs
+ **/
+typedef struct game game_t;
+typedef struct hash_table hash_table_t;
+typedef struct linked_list linked_list_t;
+
+/**
+ * Enums
+ **/
+typedef enum sim_action {
+  SIM_CONNECT, // Connect the virtual client
+  SIM_SEND, // Send a line of input from the virtual client
+  SIM_DISCONNECT, // Hang up the virtual client's connection
+  SIM_END // Stop the simulation
+} sim_action_t;
+
+/**
+ * Structs
+ **/
+typedef struct sim_step {
+  uint64_t at; // Milliseconds of virtual time into the simulation the step runs at
+  sim_action_t action;
+  char* client;
+  char* text;
+} sim_step_t;
+
+typedef struct sim_client {
+  char* name;
+  uv_os_sock_t fd; // The virtual client's end of its connection, -1 while disconnected
+  char* pending; // Input the connection had no room for, written once the game has read
+  size_t pending_len;
+  size_t sent;
+  size_t received;
+} sim_client_t;
+
+typedef struct sim {
+  game_t* game;
+  linked_list_t* steps;
+  hash_table_t* clients;
+
+  uint64_t end; // Milliseconds of virtual time the simulation stops at
+  uint64_t start; // clock_hrtime the simulation started at
+  uint64_t wall; // Nanoseconds of real time the simulation took
+
+  uint64_t steps_run;
+  uint64_t connections;
+  uint64_t bytes_sent;
+  uint64_t bytes_received;
+
+  char buffer[SIM_READ_SIZE];
+} sim_t;
+
+/**
+ * Function prototypes
+ **/
+sim_t* sim_new_sim_t(game_t* game);
+void sim_free_sim_t(sim_t* sim);
+
+int sim_load_script(sim_t* sim, const char* filename);
+int sim_parse_step(const char* line, sim_step_t* step);
+int sim_run(sim_t* sim, tick_func_t func);
+void sim_write_report(sim_t* sim, FILE* file);
+
+#endif
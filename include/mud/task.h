@@ -1,16 +1,30 @@
 #ifndef MUD_TASK_TASK_H
 #define MUD_TASK_TASK_H
 
-#include <uv.h>
+#include <stdbool.h>
+#include <stdint.h>
 
+#include "mud/data/timer_wheel.h"
+#include "mud/lua/ref.h"
 #include "mud/util/muduuid.h"
 
+/**
+ * Definitions
+ **/
+#define TASK_WHEEL_SLOTS 8192 // Slots in the task wheel, a full rotation is just over 8 seconds
+#define TASK_WHEEL_RESOLUTION 1 // Milliseconds per slot
+#define MAX_TASK_DELAY 31536000 // Most seconds a task may be scheduled ahead, a year
+
 /**
  * Typedefs
  **/
 typedef struct game game_t;
-typedef struct linked_list linked_list_t;
-typedef struct lua_ref lua_ref_t;
+typedef struct event event_t;
+typedef struct lua_State lua_State;
+typedef struct task task_t;
+typedef struct task_waiters task_waiters_t;
+
+typedef void (*task_func_t)(task_t*, void*);
 
 /**
  * Structs
@@ -18,21 +32,41 @@ typedef struct lua_ref lua_ref_t;
 typedef struct task {
   mud_uuid_t uuid;
   char* name;
-  int execute_in;
-  uv_timer_t timer;
+  uint64_t execute_at; // uv_now the task next runs at
+  uint64_t interval; // Milliseconds between runs of a repeating task, 0 to run once
+  bool running;
+  bool cancelled;
+  timer_wheel_entry_t entry;
   game_t* game;
-  lua_ref_t* ref;
+  lua_ref_t* ref; // Function a callback task runs, or the coroutine of a coroutine task
+
+  lua_State* thread; // Coroutine of a coroutine task, NULL for a callback task
+  task_waiters_t* waiting; // Tasks waiting for the event type this task is waiting for, or NULL
+  task_t* prev_waiter;
+  task_t* next_waiter;
+  lua_ref_t event; // Event which woke the task, passed to it when it resumes
 } task_t;
 
+typedef struct task_waiters {
+  task_t* head;
+} task_waiters_t;
+
 /**
  * Function prototypes
  **/
-task_t* task_new_task_t(game_t* game, const char* name, int execute_in, lua_ref_t* ref);
+task_t* task_new_task_t(game_t* game, const char* name, uint64_t interval, lua_ref_t* ref);
+task_t* task_new_coroutine_task_t(game_t* game, const char* name, lua_State* thread, lua_ref_t* ref);
 void task_free_task_t(task_t* task);
 void task_deallocate_task_t(void* value);
 
-int task_schedule_task(game_t* game, task_t* task);
+int task_schedule_task(game_t* game, task_t* task, uint64_t delay);
 int task_cancel_task(game_t* game, task_t* task);
+size_t task_run_due_tasks(game_t* game);
+void task_each_pending(game_t* game, task_func_t func, void* context);
 void task_shutdown(game_t* game);
 
+int task_wait(game_t* game, task_t* task, uint64_t delay);
+int task_wait_event(game_t* game, task_t* task, const char* type, uint64_t timeout);
+void task_on_event(game_t* game, event_t* event);
+
 #endif
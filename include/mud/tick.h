@@ -0,0 +1,89 @@
+#ifndef MUD_TICK_H
+#define MUD_TICK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <uv.h>
+
+/**
+ * Definitions
+ **/
+#define DEFAULT_TICK_CATCH_UP_LIMIT 5 // Overdue ticks run back to back before the rest are skipped
+
+/**
+ * Typedefs
+ **/
+typedef struct tick_scheduler tick_scheduler_t;
+
+typedef void (*tick_func_t)(tick_scheduler_t*, void*);
+
+/**
+ * Enums
+ **/
+typedef enum tick_policy {
+  TICK_POLICY_SKIP, // Ticks which fall due while a tick overruns are skipped
+  TICK_POLICY_CATCH_UP, // Overdue ticks are run back to back, up to the catch up limit
+  TICK_POLICY_STRETCH // The schedule is pushed back so the next tick is a full interval away
+} tick_policy_t;
+
+typedef enum tick_phase {
+  TICK_PHASE_COMMANDS, // Draining queued player commands
+  TICK_PHASE_EVENTS,
+  TICK_PHASE_TASKS,
+  TICK_PHASE_SYSTEMS,
+  TICK_PHASE_FLUSH,
+  TICK_PHASES // Number of phases, not a phase
+} tick_phase_t;
+
+/**
+ * Structs
+ **/
+typedef struct tick_timing {
+  uint64_t last; // Nanoseconds taken the last time
+  uint64_t max;
+  uint64_t total;
+  uint64_t count;
+} tick_timing_t;
+
+typedef struct tick_scheduler {
+  uv_timer_t timer;
+  bool running;
+  bool manual; // Ticks are run by tick_step_scheduler rather than the timer
+
+  tick_func_t func;
+  void* context;
+
+  uint64_t interval; // Nanoseconds between ticks
+  uint64_t due; // clock_hrtime the next tick is due at
+  uint64_t mark; // uv_hrtime the current phase started at
+  tick_policy_t policy;
+  unsigned int catch_up_limit;
+  bool overrunning;
+
+  uint64_t ticks;
+  uint64_t overruns;
+  uint64_t skipped;
+  uint64_t caught_up;
+  uint64_t stretched; // Nanoseconds the schedule has been pushed back by
+  uint64_t lag; // Nanoseconds after it was due the last tick started
+
+  tick_timing_t duration;
+  tick_timing_t phases[TICK_PHASES];
+} tick_scheduler_t;
+
+/**
+ * Function prototypes
+ **/
+void tick_init_scheduler(tick_scheduler_t* scheduler, unsigned int ticks_per_second, tick_policy_t policy, unsigned int catch_up_limit);
+int tick_start_scheduler(tick_scheduler_t* scheduler, uv_loop_t* loop, tick_func_t func, void* context);
+void tick_drive_scheduler(tick_scheduler_t* scheduler, tick_func_t func, void* context);
+void tick_step_scheduler(tick_scheduler_t* scheduler);
+void tick_stop_scheduler(tick_scheduler_t* scheduler);
+void tick_record_phase(tick_scheduler_t* scheduler, tick_phase_t phase);
+void tick_record_timing(tick_timing_t* timing, uint64_t elapsed);
+
+int tick_parse_policy(const char* value, tick_policy_t* policy);
+const char* tick_policy_name(tick_policy_t policy);
+const char* tick_phase_name(tick_phase_t phase);
+
+#endif
@@ -0,0 +1,89 @@
+#include <assert.h>
+
+#include "mud/clock.h"
+
+#define NANOSECONDS_PER_SECOND 1000000000ULL
+#define NANOSECONDS_PER_MILLISECOND 1000000ULL
+
+static bool virtual_time = false;
+static uint64_t virtual_hrtime = 0; // Current virtual time in nanoseconds since the Unix epoch
+
+/**
+ * Returns the current time in nanoseconds as uv_hrtime does, or the virtual time while
+ * the clock is virtual.  Used to schedule work, while time spent doing work is still
+ * measured with uv_hrtime.
+ **/
+uint64_t clock_hrtime(void) {
+  return virtual_time ? virtual_hrtime : uv_hrtime();
+}
+
+/**
+ * Returns the loop's time in milliseconds as uv_now does, or the virtual time while the
+ * clock is virtual.
+ *
+ * loop - the loop to read the time of
+ **/
+uint64_t clock_now(const uv_loop_t* loop) {
+  assert(loop);
+
+  if (!virtual_time) {
+    return uv_now(loop);
+  }
+
+  return virtual_hrtime / NANOSECONDS_PER_MILLISECOND;
+}
+
+/**
+ * Returns the wall clock time as time(NULL) does, or the virtual time while the clock is
+ * virtual.
+ **/
+time_t clock_time(void) {
+  if (!virtual_time) {
+    return time(NULL);
+  }
+
+  return (time_t)(virtual_hrtime / NANOSECONDS_PER_SECOND);
+}
+
+/**
+ * Switches the clock to virtual time, which only moves when clock_advance_to is called.
+ * Virtual time starts from a fixed epoch so every run sees the same times.  Anything
+ * scheduled against the real clock, such as timer wheels, won't be in step with it and
+ * must be created after the switch.
+ *
+ * epoch - the Unix time virtual time starts at
+ **/
+void clock_use_virtual_time(time_t epoch) {
+  assert(epoch >= 0);
+
+  virtual_hrtime = (uint64_t)epoch * NANOSECONDS_PER_SECOND;
+  virtual_time = true;
+}
+
+/**
+ * Switches the clock back to real time.
+ **/
+void clock_use_real_time(void) {
+  virtual_time = false;
+}
+
+/**
+ * Returns true if the clock is running on virtual time.
+ **/
+bool clock_is_virtual(void) {
+  return virtual_time;
+}
+
+/**
+ * Moves virtual time forward.  Virtual time never moves backwards, so a time which has
+ * already passed is ignored.
+ *
+ * hrtime - the time to move to, on the same scale as clock_hrtime
+ **/
+void clock_advance_to(uint64_t hrtime) {
+  assert(virtual_time);
+
+  if (hrtime > virtual_hrtime) {
+    virtual_hrtime = hrtime;
+  }
+}
@@ -1,5 +1,6 @@
 #include <assert.h>
 #include <getopt.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -19,6 +20,26 @@ int set_lib_script(const char* value, config_t* config);
 int set_database_file(const char* value, config_t* config);
 int set_game_port(const char* value, config_t* config);
 int set_ticks_per_second(const char* value, config_t* config);
+int set_tick_policy(const char* value, config_t* config);
+int set_tick_catch_up_limit(const char* value, config_t* config);
+int set_output_buffer_limit(const char* value, config_t* config);
+int set_output_pending_limit(const char* value, config_t* config);
+int set_backpressure_policy(const char* value, config_t* config);
+int set_backpressure_timeout(const char* value, config_t* config);
+int set_output_coalesce_latency(const char* value, config_t* config);
+int set_commands_per_tick(const char* value, config_t* config);
+int set_command_burst(const char* value, config_t* config);
+int set_login_idle_timeout(const char* value, config_t* config);
+int set_play_idle_timeout(const char* value, config_t* config);
+int set_keepalive_delay(const char* value, config_t* config);
+int set_mccp_compression_level(const char* value, config_t* config);
+int set_simulation_script(const char* value, config_t* config);
+int set_simulation_report(const char* value, config_t* config);
+int set_simulation_epoch(const char* value, config_t* config);
+int load_listeners(lua_State* lua, config_t* config);
+int load_mssp_variables(lua_State* lua, config_t* config);
+void free_listener_config_t(void* value);
+void free_mssp_variable_config_t(void* value);
 
 /**
  * Allocates a new config_t structure.
@@ -32,6 +53,29 @@ config_t* config_new(void) {
   config->database_file = strdup("dist/mud.db");
   config->game_port = DEFAULT_PORT;
   config->ticks_per_second = DEFAULT_TICKS_PER_SECOND;
+  config->tick_policy = TICK_POLICY_CATCH_UP;
+  config->tick_catch_up_limit = DEFAULT_TICK_CATCH_UP_LIMIT;
+  config->output_buffer_limit = DEFAULT_OUTPUT_BUFFER_LIMIT;
+  config->output_pending_limit = DEFAULT_PENDING_LIMIT;
+  config->backpressure_policy = BACKPRESSURE_DROP;
+  config->backpressure_timeout = DEFAULT_BACKPRESSURE_TIMEOUT;
+  config->output_coalescing = false;
+  config->output_coalesce_latency = DEFAULT_COALESCE_LATENCY;
+  config->commands_per_tick = DEFAULT_COMMANDS_PER_TICK;
+  config->command_burst = DEFAULT_COMMAND_BURST;
+  config->login_idle_timeout = DEFAULT_LOGIN_IDLE_TIMEOUT;
+  config->play_idle_timeout = DEFAULT_PLAY_IDLE_TIMEOUT;
+  config->keepalive_delay = DEFAULT_KEEPALIVE_DELAY;
+  config->mccp = true;
+  config->mccp_compression_level = DEFAULT_MCCP_COMPRESSION_LEVEL;
+  config->mccp_low_memory = false;
+  config->simulation_script = NULL;
+  config->simulation_report = NULL;
+  config->simulation_epoch = DEFAULT_SIMULATION_EPOCH;
+  config->listeners = create_linked_list_t();
+  config->listeners->deallocator = free_listener_config_t;
+  config->mssp_variables = create_linked_list_t();
+  config->mssp_variables->deallocator = free_mssp_variable_config_t;
 
   return config;
 }
@@ -45,6 +89,11 @@ void config_free(config_t* config) {
   free(config->game_script);
   free(config->lib_script);
   free(config->database_file);
+  free(config->simulation_script);
+  free(config->simulation_report);
+
+  free_linked_list_t(config->listeners);
+  free_linked_list_t(config->mssp_variables);
 
   free(config);
 }
@@ -55,7 +104,7 @@ void config_free(config_t* config) {
 int parse_configuration(int argc, char* argv[], config_t* config) {
   int opt = 0;
 
-  while ((opt = getopt(argc, argv, ":s:l:d:p:t:h")) != -1) { // NOLINT(concurrency-mt-unsafe)
+  while ((opt = getopt(argc, argv, ":s:l:d:p:t:S:R:h")) != -1) { // NOLINT(concurrency-mt-unsafe)
     switch (opt) {
     case 's':
       if (set_game_script(optarg, config) == -1) {
@@ -92,8 +141,22 @@ int parse_configuration(int argc, char* argv[], config_t* config) {
 
       break;
 
+    case 'S':
+      if (set_simulation_script(optarg, config) == -1) {
+        return -1;
+      }
+
+      break;
+
+    case 'R':
+      if (set_simulation_report(optarg, config) == -1) {
+        return -1;
+      }
+
+      break;
+
     case 'h':
-      printf("%s [-s game script] [-lua lib script] [-d database file] [-p port] [-t ticks per second]\n\r", argv[0]);
+      printf("%s [-s game script] [-lua lib script] [-d database file] [-p port] [-t ticks per second] [-S simulation script] [-R simulation report]\n\r", argv[0]);
 
       return -1;
 
@@ -179,6 +242,176 @@ int load_configuration(const char* filename, config_t* config) {
 
   lua_pop(lua, 1);
 
+  lua_getglobal(lua, "tick_policy");
+
+  if (lua_isstring(lua, -1)) {
+    set_tick_policy(lua_tostring(lua, -1), config);
+  }
+
+  lua_pop(lua, 1);
+
+  lua_getglobal(lua, "tick_catch_up_limit");
+
+  if (lua_isstring(lua, -1)) {
+    set_tick_catch_up_limit(lua_tostring(lua, -1), config);
+  }
+
+  lua_pop(lua, 1);
+
+  lua_getglobal(lua, "output_buffer_limit");
+
+  if (lua_isstring(lua, -1)) {
+    set_output_buffer_limit(lua_tostring(lua, -1), config);
+  }
+
+  lua_pop(lua, 1);
+
+  lua_getglobal(lua, "output_pending_limit");
+
+  if (lua_isstring(lua, -1)) {
+    set_output_pending_limit(lua_tostring(lua, -1), config);
+  }
+
+  lua_pop(lua, 1);
+
+  lua_getglobal(lua, "backpressure_policy");
+
+  if (lua_isstring(lua, -1)) {
+    set_backpressure_policy(lua_tostring(lua, -1), config);
+  }
+
+  lua_pop(lua, 1);
+
+  lua_getglobal(lua, "backpressure_timeout");
+
+  if (lua_isstring(lua, -1)) {
+    set_backpressure_timeout(lua_tostring(lua, -1), config);
+  }
+
+  lua_pop(lua, 1);
+
+  lua_getglobal(lua, "output_coalescing");
+
+  if (lua_isboolean(lua, -1)) {
+    config->output_coalescing = lua_toboolean(lua, -1);
+  }
+
+  lua_pop(lua, 1);
+
+  lua_getglobal(lua, "output_coalesce_latency");
+
+  if (lua_isstring(lua, -1)) {
+    set_output_coalesce_latency(lua_tostring(lua, -1), config);
+  }
+
+  lua_pop(lua, 1);
+
+  lua_getglobal(lua, "commands_per_tick");
+
+  if (lua_isstring(lua, -1)) {
+    set_commands_per_tick(lua_tostring(lua, -1), config);
+  }
+
+  lua_pop(lua, 1);
+
+  lua_getglobal(lua, "command_burst");
+
+  if (lua_isstring(lua, -1)) {
+    set_command_burst(lua_tostring(lua, -1), config);
+  }
+
+  lua_pop(lua, 1);
+
+  lua_getglobal(lua, "login_idle_timeout");
+
+  if (lua_isstring(lua, -1)) {
+    set_login_idle_timeout(lua_tostring(lua, -1), config);
+  }
+
+  lua_pop(lua, 1);
+
+  lua_getglobal(lua, "play_idle_timeout");
+
+  if (lua_isstring(lua, -1)) {
+    set_play_idle_timeout(lua_tostring(lua, -1), config);
+  }
+
+  lua_pop(lua, 1);
+
+  lua_getglobal(lua, "keepalive_delay");
+
+  if (lua_isstring(lua, -1)) {
+    set_keepalive_delay(lua_tostring(lua, -1), config);
+  }
+
+  lua_pop(lua, 1);
+
+  lua_getglobal(lua, "mccp");
+
+  if (lua_isboolean(lua, -1)) {
+    config->mccp = lua_toboolean(lua, -1);
+  }
+
+  lua_pop(lua, 1);
+
+  lua_getglobal(lua, "mccp_compression_level");
+
+  if (lua_isstring(lua, -1)) {
+    set_mccp_compression_level(lua_tostring(lua, -1), config);
+  }
+
+  lua_pop(lua, 1);
+
+  lua_getglobal(lua, "mccp_low_memory");
+
+  if (lua_isboolean(lua, -1)) {
+    config->mccp_low_memory = lua_toboolean(lua, -1);
+  }
+
+  lua_pop(lua, 1);
+
+  lua_getglobal(lua, "simulation_script");
+
+  if (lua_isstring(lua, -1)) {
+    set_simulation_script(lua_tostring(lua, -1), config);
+  }
+
+  lua_pop(lua, 1);
+
+  lua_getglobal(lua, "simulation_report");
+
+  if (lua_isstring(lua, -1)) {
+    set_simulation_report(lua_tostring(lua, -1), config);
+  }
+
+  lua_pop(lua, 1);
+
+  lua_getglobal(lua, "simulation_epoch");
+
+  if (lua_isstring(lua, -1)) {
+    set_simulation_epoch(lua_tostring(lua, -1), config);
+  }
+
+  lua_pop(lua, 1);
+
+  lua_getglobal(lua, "mssp");
+
+  if (lua_istable(lua, -1)) {
+    load_mssp_variables(lua, config);
+  }
+
+  lua_pop(lua, 1);
+
+  lua_getglobal(lua, "listeners");
+
+  if (lua_istable(lua, -1) && load_listeners(lua, config) == -1) {
+    lua_close(lua);
+
+    return -1;
+  }
+
+  lua_pop(lua, 1);
+
   lua_close(lua);
 
   return 0;
@@ -224,6 +457,61 @@ int set_database_file(const char* value, config_t* config) {
   return 0;
 }
 
+/**
+ * Sets the filename of the script of virtual client traffic to simulate in the
+ * configuration.  When set the game runs a headless simulation rather than listening.
+ *
+ * Returns 0 on success.
+ **/
+int set_simulation_script(const char* value, config_t* config) {
+  if (config->simulation_script != NULL) {
+    free(config->simulation_script);
+  }
+
+  config->simulation_script = strdup(value);
+
+  return 0;
+}
+
+/**
+ * Sets the filename the tick time profile of a simulation is written to in the
+ * configuration.
+ *
+ * Returns 0 on success.
+ **/
+int set_simulation_report(const char* value, config_t* config) {
+  if (config->simulation_report != NULL) {
+    free(config->simulation_report);
+  }
+
+  config->simulation_report = strdup(value);
+
+  return 0;
+}
+
+/**
+ * Sets the Unix time the virtual clock of a simulation starts at in the configuration,
+ * so every run of a script sees the same times.
+ *
+ * Returns 0 on success.
+ *
+ * Returns -1 if the value isn't numeric, is less than 0 or is greater than UINT_MAX.
+ **/
+int set_simulation_epoch(const char* value, config_t* config) {
+  char* end = NULL;
+  long long epoch = strtoll(value, &end, BASE_10);
+
+  if (end == value || *end != '\0' || epoch < 0 || epoch > UINT_MAX) {
+    printf("Invalid value for simulation epoch [%s], valid values are 0 to %u.\n\r", value, UINT_MAX);
+
+    return -1;
+  }
+
+  config->simulation_epoch = (time_t)epoch;
+
+  return 0;
+}
+
 /**
  * Sets the game port in the configuration.
  *
@@ -257,3 +545,469 @@ int set_ticks_per_second(const char* value, config_t* config) {
 
   return 0;
 }
+
+/**
+ * Sets the policy applied to ticks which fall due while a tick overruns in the configuration.
+ *
+ * Returns 0 on success.
+ *
+ * Returns -1 if the value isn't one of skip, catch-up or stretch.
+ **/
+int set_tick_policy(const char* value, config_t* config) {
+  if (tick_parse_policy(value, &config->tick_policy) == -1) {
+    printf("Invalid value for tick policy [%s], valid values are skip, catch-up or stretch.\n\r", value);
+
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * Sets the number of overdue ticks run back to back under the catch-up tick policy in the
+ * configuration.  A value of 0 behaves as the skip policy.
+ *
+ * Returns 0 on success.
+ *
+ * Returns -1 if the value isn't numeric, is less than 0 or is greater than UINT_MAX.
+ **/
+int set_tick_catch_up_limit(const char* value, config_t* config) {
+  char* end = NULL;
+  long limit = strtol(value, &end, BASE_10);
+
+  if (end == value || *end != '\0' || limit < 0 || limit > UINT_MAX) {
+    printf("Invalid value for tick catch up limit [%s], valid values are 0 or higher.\n\r", value);
+
+    return -1;
+  }
+
+  config->tick_catch_up_limit = (unsigned int)limit;
+
+  return 0;
+}
+
+/**
+ * Sets the per client output buffer high-water mark in the configuration.
+ *
+ * Returns 0 on success.
+ *
+ * Returns -1 if the value isn't numeric or is equal to or less than 0.
+ **/
+int set_output_buffer_limit(const char* value, config_t* config) {
+  long limit = strtol(value, NULL, BASE_10);
+
+  if (limit <= 0 || limit > UINT_MAX) {
+    printf("Invalid value for output buffer limit [%s], valid values are 1 or higher.\n\r", value);
+
+    return -1;
+  }
+
+  config->output_buffer_limit = (unsigned int)limit;
+
+  return 0;
+}
+
+/**
+ * Sets the number of bytes a client may have queued for writing before it is
+ * throttled in the configuration.
+ *
+ * Returns 0 on success.
+ *
+ * Returns -1 if the value isn't numeric or is equal to or less than 0.
+ **/
+int set_output_pending_limit(const char* value, config_t* config) {
+  long limit = strtol(value, NULL, BASE_10);
+
+  if (limit <= 0 || limit > UINT_MAX) {
+    printf("Invalid value for output pending limit [%s], valid values are 1 or higher.\n\r", value);
+
+    return -1;
+  }
+
+  config->output_pending_limit = (unsigned int)limit;
+
+  return 0;
+}
+
+/**
+ * Sets the policy applied to throttled clients in the configuration.
+ *
+ * Returns 0 on success.
+ *
+ * Returns -1 if the value isn't one of drop, coalesce or disconnect.
+ **/
+int set_backpressure_policy(const char* value, config_t* config) {
+  if (network_parse_backpressure_policy(value, &config->backpressure_policy) == -1) {
+    printf("Invalid value for backpressure policy [%s], valid values are drop, coalesce or disconnect.\n\r", value);
+
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * Sets the number of seconds a client may stay throttled before being disconnected
+ * under the disconnect backpressure policy in the configuration.
+ *
+ * Returns 0 on success.
+ *
+ * Returns -1 if the value isn't numeric or is equal to or less than 0.
+ **/
+int set_backpressure_timeout(const char* value, config_t* config) {
+  long timeout = strtol(value, NULL, BASE_10);
+
+  if (timeout <= 0 || timeout > UINT_MAX) {
+    printf("Invalid value for backpressure timeout [%s], valid values are 1 or higher.\n\r", value);
+
+    return -1;
+  }
+
+  config->backpressure_timeout = (unsigned int)timeout;
+
+  return 0;
+}
+
+/**
+ * Sets the maximum milliseconds coalesced output may be held for in the configuration.
+ * A value of 0 flushes coalesced output once per loop iteration.
+ *
+ * Returns 0 on success.
+ *
+ * Returns -1 if the value isn't numeric, is less than 0 or is greater than UINT_MAX.
+ **/
+int set_output_coalesce_latency(const char* value, config_t* config) {
+  char* end = NULL;
+  long latency = strtol(value, &end, BASE_10);
+
+  if (end == value || *end != '\0' || latency < 0 || latency > UINT_MAX) {
+    printf("Invalid value for output coalesce latency [%s], valid values are 0 or higher.\n\r", value);
+
+    return -1;
+  }
+
+  config->output_coalesce_latency = (unsigned int)latency;
+
+  return 0;
+}
+
+/**
+ * Sets the number of command tokens each player regains per tick in the configuration.
+ *
+ * Returns 0 on success.
+ *
+ * Returns -1 if the value isn't numeric or is equal to or less than 0.
+ **/
+int set_commands_per_tick(const char* value, config_t* config) {
+  long commands = strtol(value, NULL, BASE_10);
+
+  if (commands <= 0 || commands > UINT_MAX) {
+    printf("Invalid value for commands per tick [%s], valid values are 1 or higher.\n\r", value);
+
+    return -1;
+  }
+
+  config->commands_per_tick = (unsigned int)commands;
+
+  return 0;
+}
+
+/**
+ * Sets the maximum number of command tokens a player may accumulate in the configuration.
+ *
+ * Returns 0 on success.
+ *
+ * Returns -1 if the value isn't numeric or is equal to or less than 0.
+ **/
+int set_command_burst(const char* value, config_t* config) {
+  long burst = strtol(value, NULL, BASE_10);
+
+  if (burst <= 0 || burst > UINT_MAX) {
+    printf("Invalid value for command burst [%s], valid values are 1 or higher.\n\r", value);
+
+    return -1;
+  }
+
+  config->command_burst = (unsigned int)burst;
+
+  return 0;
+}
+
+/**
+ * Sets the seconds a client may idle before authenticating in the configuration.
+ * A value of 0 never times out unauthenticated clients.
+ *
+ * Returns 0 on success.
+ *
+ * Returns -1 if the value isn't numeric, is less than 0 or is greater than UINT_MAX.
+ **/
+int set_login_idle_timeout(const char* value, config_t* config) {
+  char* end = NULL;
+  long seconds = strtol(value, &end, BASE_10);
+
+  if (end == value || *end != '\0' || seconds < 0 || seconds > UINT_MAX) {
+    printf("Invalid value for login idle timeout [%s], valid values are 0 or higher.\n\r", value);
+
+    return -1;
+  }
+
+  config->login_idle_timeout = (unsigned int)seconds;
+
+  return 0;
+}
+
+/**
+ * Sets the seconds an authenticated client may idle in the configuration.
+ * A value of 0 never times out authenticated clients.
+ *
+ * Returns 0 on success.
+ *
+ * Returns -1 if the value isn't numeric, is less than 0 or is greater than UINT_MAX.
+ **/
+int set_play_idle_timeout(const char* value, config_t* config) {
+  char* end = NULL;
+  long seconds = strtol(value, &end, BASE_10);
+
+  if (end == value || *end != '\0' || seconds < 0 || seconds > UINT_MAX) {
+    printf("Invalid value for play idle timeout [%s], valid values are 0 or higher.\n\r", value);
+
+    return -1;
+  }
+
+  config->play_idle_timeout = (unsigned int)seconds;
+
+  return 0;
+}
+
+/**
+ * Sets the seconds a connection may idle before TCP keepalive probes are sent in the configuration.
+ * A value of 0 disables TCP keepalive.
+ *
+ * Returns 0 on success.
+ *
+ * Returns -1 if the value isn't numeric, is less than 0 or is greater than UINT_MAX.
+ **/
+int set_keepalive_delay(const char* value, config_t* config) {
+  char* end = NULL;
+  long seconds = strtol(value, &end, BASE_10);
+
+  if (end == value || *end != '\0' || seconds < 0 || seconds > UINT_MAX) {
+    printf("Invalid value for keepalive delay [%s], valid values are 0 or higher.\n\r", value);
+
+    return -1;
+  }
+
+  config->keepalive_delay = (unsigned int)seconds;
+
+  return 0;
+}
+
+/**
+ * Sets the zlib compression level used for MCCP in the configuration.
+ *
+ * Returns 0 on success.
+ *
+ * Returns -1 if the value isn't numeric or is outside of 0 to 9.
+ **/
+int set_mccp_compression_level(const char* value, config_t* config) {
+  long level = strtol(value, NULL, BASE_10);
+
+  if (level < Z_NO_COMPRESSION || level > Z_BEST_COMPRESSION) {
+    printf("Invalid value for MCCP compression level [%s], valid values are 0 to 9.\n\r", value);
+
+    return -1;
+  }
+
+  config->mccp_compression_level = (unsigned int)level;
+
+  return 0;
+}
+
+/**
+ * Reads the listeners table at the top of the Lua stack into the configuration.  Each
+ * entry is a table holding either a port for a TCP listener or a path for a Unix
+ * domain socket listener, along with an optional backlog, number of SO_REUSEPORT
+ * shards, whether to set SO_REUSEPORT on a single listener, whether connections to
+ * a TCP listener speak WebSocket and the certificate and key to terminate TLS with.
+ *
+ * Returns 0 on success.
+ *
+ * Returns -1 if any entry is invalid.
+ **/
+int load_listeners(lua_State* lua, config_t* config) {
+  for (lua_Integer i = 1;; i++) {
+    lua_rawgeti(lua, -1, i);
+
+    if (lua_isnil(lua, -1)) {
+      lua_pop(lua, 1);
+
+      break;
+    }
+
+    if (!lua_istable(lua, -1)) {
+      printf("Invalid value for listener [%lld], each listener must be a table.\n\r", (long long)i);
+      lua_pop(lua, 1);
+
+      return -1;
+    }
+
+    listener_config_t* listener = calloc(1, sizeof *listener);
+    lua_Integer port = 0;
+    lua_Integer backlog = DEFAULT_BACKLOG;
+    lua_Integer shards = 1;
+
+    lua_getfield(lua, -1, "port");
+
+    if (lua_isnumber(lua, -1)) {
+      port = lua_tointeger(lua, -1);
+    }
+
+    lua_pop(lua, 1);
+
+    lua_getfield(lua, -1, "path");
+
+    if (lua_isstring(lua, -1)) {
+      listener->path = strdup(lua_tostring(lua, -1));
+    }
+
+    lua_pop(lua, 1);
+
+    lua_getfield(lua, -1, "backlog");
+
+    if (lua_isnumber(lua, -1)) {
+      backlog = lua_tointeger(lua, -1);
+    }
+
+    lua_pop(lua, 1);
+
+    lua_getfield(lua, -1, "shards");
+
+    if (lua_isnumber(lua, -1)) {
+      shards = lua_tointeger(lua, -1);
+    }
+
+    lua_pop(lua, 1);
+
+    lua_getfield(lua, -1, "reuseport");
+
+    if (lua_isboolean(lua, -1)) {
+      listener->reuseport = lua_toboolean(lua, -1);
+    }
+
+    lua_pop(lua, 1);
+
+    lua_getfield(lua, -1, "websocket");
+
+    if (lua_isboolean(lua, -1)) {
+      listener->websocket = lua_toboolean(lua, -1);
+    }
+
+    lua_pop(lua, 1);
+
+    lua_getfield(lua, -1, "tls_certificate");
+
+    if (lua_isstring(lua, -1)) {
+      listener->tls_certificate = strdup(lua_tostring(lua, -1));
+    }
+
+    lua_pop(lua, 1);
+
+    lua_getfield(lua, -1, "tls_key");
+
+    if (lua_isstring(lua, -1)) {
+      listener->tls_key = strdup(lua_tostring(lua, -1));
+    }
+
+    lua_pop(lua, 2);
+
+    if (port < 0 || port > MAXIMUM_PORT || (listener->path == NULL && port < MINIMUM_PORT)) {
+      printf("Invalid value for listener [%lld], a path or a port from 1024 to 65535 is required.\n\r", (long long)i);
+      free_listener_config_t(listener);
+
+      return -1;
+    }
+
+    if ((listener->tls_certificate == NULL) != (listener->tls_key == NULL) || (listener->tls_certificate != NULL && listener->path != NULL)) {
+      printf("Invalid value for listener [%lld], TLS listeners require a port, tls_certificate and tls_key.\n\r", (long long)i);
+      free_listener_config_t(listener);
+
+      return -1;
+    }
+
+    if (listener->websocket && listener->path != NULL) {
+      printf("Invalid value for listener [%lld], WebSocket listeners require a port.\n\r", (long long)i);
+      free_listener_config_t(listener);
+
+      return -1;
+    }
+
+    if (backlog < 1 || backlog > INT_MAX || shards < 1 || shards > MAX_LISTENER_SHARDS) {
+      printf("Invalid value for listener [%lld], backlog must be 1 or higher and shards from 1 to %d.\n\r", (long long)i, MAX_LISTENER_SHARDS);
+      free_listener_config_t(listener);
+
+      return -1;
+    }
+
+    listener->port = (unsigned int)port;
+    listener->backlog = (unsigned int)backlog;
+    listener->shards = (unsigned int)shards;
+
+    list_add(config->listeners, listener);
+  }
+
+  return 0;
+}
+
+/**
+ * Reads the mssp table at the top of the Lua stack into the configuration.  Each key
+ * is the name of an MSSP variable and each value a string or number sent for it.
+ * Anything else is ignored.
+ *
+ * Returns 0 on success.
+ **/
+int load_mssp_variables(lua_State* lua, config_t* config) {
+  lua_pushnil(lua);
+
+  while (lua_next(lua, -2) != 0) {
+    if (lua_type(lua, -2) == LUA_TSTRING && (lua_type(lua, -1) == LUA_TSTRING || lua_type(lua, -1) == LUA_TNUMBER)) {
+      mssp_variable_config_t* variable = calloc(1, sizeof *variable);
+      variable->name = strdup(lua_tostring(lua, -2));
+      variable->value = strdup(lua_tostring(lua, -1));
+
+      list_add(config->mssp_variables, variable);
+    } else {
+      printf("Invalid value for mssp, each entry must be a name and a string or number.\n\r");
+    }
+
+    lua_pop(lua, 1);
+  }
+
+  return 0;
+}
+
+/**
+ * Frees a listener_config_t struct.
+ **/
+void free_listener_config_t(void* value) {
+  assert(value);
+
+  listener_config_t* listener = (listener_config_t*)value;
+
+  free(listener->path);
+  free(listener->tls_certificate);
+  free(listener->tls_key);
+  free(listener);
+}
+
+/**
+ * Frees a mssp_variable_config_t struct.
+ **/
+void free_mssp_variable_config_t(void* value) {
+  assert(value);
+
+  mssp_variable_config_t* variable = (mssp_variable_config_t*)value;
+
+  free(variable->name);
+  free(variable->value);
+  free(variable);
+}
@@ -188,3 +188,22 @@ void* hash_table_get(hash_table_t* table, const char* key) {
 
   return NULL;
 }
+
+/**
+ * Counts the entries in a hash table.
+ *
+ * Returns the number of keys in the hash table.
+ **/
+int hash_table_size(hash_table_t* table) {
+  assert(table);
+
+  int size = 0;
+
+  for (int i = 0; i < HASH_TABLE_SIZE; i++) {
+    if (table->nodes[i] != NULL) {
+      size += list_size(table->nodes[i]);
+    }
+  }
+
+  return size;
+}
@@ -0,0 +1,253 @@
+#include "mud/data/pool/pool.h"
+#include "mud/log.h"
+
+#include <assert.h>
+#include <stdalign.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define POOL_ALIGN alignof(max_align_t)
+#define POOL_ROUND_UP(value) (((value) + POOL_ALIGN - 1) & ~(POOL_ALIGN - 1))
+#define POOL_HEADER_SIZE POOL_ROUND_UP(sizeof(pool_slot_t))
+
+static int grow_pool(pool_t* pool);
+static pool_slot_t* slot_at(pool_t* pool, uint32_t index);
+static pool_slot_t* slot_of(const void* object);
+
+/**
+ * Allocates a new pool_t handing out fixed size objects carved from slabs.  Slabs are
+ * only allocated as the pool grows and are never returned to the allocator until the
+ * pool itself is freed, so released objects are reused in place rather than churning
+ * the heap.
+ *
+ * object_size - the size of each object handed out by the pool
+ * slab_objects - the number of objects allocated together in each slab
+ *
+ * Returns the newly allocated pool_t or NULL on failure
+**/
+pool_t* create_pool_t(size_t object_size, size_t slab_objects) {
+  assert(object_size > 0);
+  assert(slab_objects > 0);
+
+  pool_t* pool = calloc(1, sizeof *pool);
+
+  if (pool == NULL) {
+    LOG(ERROR, "Failed to allocate pool");
+
+    return NULL;
+  }
+
+  pool->object_size = object_size;
+  pool->stride = POOL_HEADER_SIZE + POOL_ROUND_UP(object_size);
+  pool->slab_objects = slab_objects;
+  pool->slabs = NULL;
+  pool->slab_count = 0;
+  pool->slab_capacity = 0;
+  pool->free = NULL;
+  pool->used = 0;
+
+  return pool;
+}
+
+/**
+ * Frees a pool_t and every slab it allocated.  Any objects still acquired from the
+ * pool are invalidated.
+ *
+ * pool - the pool_t to free
+**/
+void free_pool_t(pool_t* pool) {
+  assert(pool);
+
+  if (pool->used > 0) {
+    LOG(WARN, "Freeing pool with [%zu] objects still in use", pool->used);
+  }
+
+  for (size_t i = 0; i < pool->slab_count; i++) {
+    free(pool->slabs[i]);
+  }
+
+  free(pool->slabs);
+  free(pool);
+}
+
+/**
+ * Acquires a zeroed object from the pool, growing the pool by a slab if no free
+ * objects remain.
+ *
+ * pool - the pool_t to acquire from
+ *
+ * Returns the object or NULL on failure
+**/
+void* pool_acquire(pool_t* pool) {
+  assert(pool);
+
+  if (pool->free == NULL && grow_pool(pool) == -1) {
+    return NULL;
+  }
+
+  pool_slot_t* slot = pool->free;
+  pool->free = slot->next;
+
+  slot->next = NULL;
+  slot->used = true;
+  pool->used++;
+
+  void* object = (char*)slot + POOL_HEADER_SIZE;
+  memset(object, 0, pool->object_size);
+
+  return object;
+}
+
+/**
+ * Returns an object to the pool it was acquired from.  The slot's generation is
+ * advanced so any ID previously taken for the object no longer resolves.
+ *
+ * object - the object to release
+**/
+void pool_release(void* object) {
+  assert(object);
+
+  pool_slot_t* slot = slot_of(object);
+  pool_t* pool = slot->pool;
+
+  assert(slot->used);
+
+  slot->used = false;
+  slot->generation++;
+
+  if (slot->generation == 0) {
+    slot->generation = 1;
+  }
+
+  slot->next = pool->free;
+  pool->free = slot;
+  pool->used--;
+}
+
+/**
+ * Gets the generation-tagged ID of an acquired object.  The ID remains stable for as
+ * long as the object is held and stops resolving once it's released, even if the
+ * slot is later reused.
+ *
+ * object - the object to get the ID of
+ *
+ * Returns the ID of the object
+**/
+pool_id_t pool_id(const void* object) {
+  assert(object);
+
+  pool_slot_t* slot = slot_of(object);
+
+  return ((pool_id_t)slot->generation << 32) | slot->index;
+}
+
+/**
+ * Resolves a generation-tagged ID back to its object.
+ *
+ * pool - the pool_t the object was acquired from
+ * id - the ID of the object
+ *
+ * Returns the object or NULL if the ID is unknown or its object has been released
+**/
+void* pool_lookup(pool_t* pool, pool_id_t id) {
+  assert(pool);
+
+  pool_slot_t* slot = slot_at(pool, (uint32_t)(id & UINT32_MAX));
+
+  if (slot == NULL || !slot->used || slot->generation != (uint32_t)(id >> 32)) {
+    return NULL;
+  }
+
+  return (char*)slot + POOL_HEADER_SIZE;
+}
+
+/**
+ * Returns the number of objects currently acquired from the pool.
+**/
+size_t pool_used(pool_t* pool) {
+  assert(pool);
+
+  return pool->used;
+}
+
+/**
+ * Returns the number of objects the pool's slabs can hold.
+**/
+size_t pool_capacity(pool_t* pool) {
+  assert(pool);
+
+  return pool->slab_count * pool->slab_objects;
+}
+
+/**
+ * Allocates a new slab and threads its slots onto the free list, lowest index first.
+ *
+ * Returns 0 on success or -1 on failure
+**/
+static int grow_pool(pool_t* pool) {
+  if ((pool->slab_count + 1) * pool->slab_objects > UINT32_MAX) {
+    LOG(ERROR, "Pool exhausted at [%zu] objects", pool_capacity(pool));
+
+    return -1;
+  }
+
+  if (pool->slab_count == pool->slab_capacity) {
+    size_t capacity = pool->slab_capacity == 0 ? 4 : pool->slab_capacity * 2;
+    char** slabs = realloc(pool->slabs, capacity * sizeof(char*));
+
+    if (slabs == NULL) {
+      LOG(ERROR, "Failed to grow pool slab table");
+
+      return -1;
+    }
+
+    pool->slabs = slabs;
+    pool->slab_capacity = capacity;
+  }
+
+  char* slab = malloc(pool->stride * pool->slab_objects);
+
+  if (slab == NULL) {
+    LOG(ERROR, "Failed to allocate pool slab");
+
+    return -1;
+  }
+
+  size_t base = pool->slab_count * pool->slab_objects;
+
+  pool->slabs[pool->slab_count++] = slab;
+
+  for (size_t i = pool->slab_objects; i > 0; i--) {
+    pool_slot_t* slot = (pool_slot_t*)(slab + ((i - 1) * pool->stride));
+
+    slot->pool = pool;
+    slot->index = (uint32_t)(base + i - 1);
+    slot->generation = 1;
+    slot->used = false;
+    slot->next = pool->free;
+
+    pool->free = slot;
+  }
+
+  return 0;
+}
+
+/**
+ * Returns the slot at a given index or NULL if the index is out of range.
+**/
+static pool_slot_t* slot_at(pool_t* pool, uint32_t index) {
+  size_t slab = index / pool->slab_objects;
+
+  if (slab >= pool->slab_count) {
+    return NULL;
+  }
+
+  return (pool_slot_t*)(pool->slabs[slab] + ((index % pool->slab_objects) * pool->stride));
+}
+
+/**
+ * Returns the slot header preceding an object.
+**/
+static pool_slot_t* slot_of(const void* object) {
+  return (pool_slot_t*)((char*)object - POOL_HEADER_SIZE);
+}
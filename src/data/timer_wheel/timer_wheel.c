@@ -0,0 +1,209 @@
+#include "mud/data/timer_wheel/timer_wheel.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+static void unlink_entry(timer_wheel_t* wheel, timer_wheel_entry_t* entry);
+
+/**
+ * Allocates a new hashed timing wheel.  Deadlines are hashed into slots by the tick
+ * they fall in so scheduling, rescheduling and cancelling are all O(1), and advancing
+ * the wheel only visits the slots for the ticks which have passed.  Deadlines further
+ * away than a full rotation share a slot with nearer ones and are skipped until the
+ * rotation they fall in.
+ *
+ * slot_count - the number of slots in the wheel
+ * resolution - the length of a tick, in the same unit as deadlines
+ * now - the current time the wheel starts from
+ *
+ * Returns the newly allocated timer_wheel_t
+**/
+timer_wheel_t* create_timer_wheel_t(size_t slot_count, uint64_t resolution, uint64_t now) {
+  assert(slot_count > 0);
+  assert(resolution > 0);
+
+  timer_wheel_t* wheel = calloc(1, sizeof *wheel);
+
+  wheel->slots = calloc(slot_count, sizeof(timer_wheel_entry_t*));
+  wheel->slot_count = slot_count;
+  wheel->resolution = resolution;
+  wheel->tick = now / resolution;
+  wheel->pending = NULL;
+  wheel->active = 0;
+
+  return wheel;
+}
+
+/**
+ * Frees a timer_wheel_t.  Entries are owned by the caller and are not freed.
+ *
+ * wheel - the timer_wheel_t to free
+**/
+void free_timer_wheel_t(timer_wheel_t* wheel) {
+  assert(wheel);
+
+  free(wheel->slots);
+  free(wheel);
+}
+
+/**
+ * Schedules an entry to expire at a deadline, moving it if it's already scheduled.
+ * Deadlines which have already passed expire on the next advance.
+ *
+ * wheel - the timer_wheel_t to schedule the entry in
+ * entry - the timer_wheel_entry_t to schedule
+ * deadline - the time at which the entry expires
+**/
+void timer_wheel_schedule(timer_wheel_t* wheel, timer_wheel_entry_t* entry, uint64_t deadline) {
+  assert(wheel);
+  assert(entry);
+
+  if (entry->active) {
+    unlink_entry(wheel, entry);
+  }
+
+  uint64_t tick = deadline / wheel->resolution;
+
+  if (tick <= wheel->tick) {
+    tick = wheel->tick + 1;
+  }
+
+  size_t slot = (size_t)(tick % wheel->slot_count);
+
+  entry->deadline = deadline;
+  entry->slot = slot;
+  entry->active = true;
+  entry->prev = NULL;
+  entry->next = wheel->slots[slot];
+
+  if (entry->next != NULL) {
+    entry->next->prev = entry;
+  }
+
+  wheel->slots[slot] = entry;
+  wheel->active++;
+}
+
+/**
+ * Removes an entry from the wheel.  Does nothing if the entry isn't scheduled.
+ *
+ * wheel - the timer_wheel_t the entry is scheduled in
+ * entry - the timer_wheel_entry_t to cancel
+**/
+void timer_wheel_cancel(timer_wheel_t* wheel, timer_wheel_entry_t* entry) {
+  assert(wheel);
+  assert(entry);
+
+  if (entry->active) {
+    unlink_entry(wheel, entry);
+  }
+}
+
+/**
+ * Advances the wheel to the current time, expiring every entry whose deadline has
+ * passed.  Expired entries are removed from the wheel before the callback is called
+ * so the callback may reschedule them, or schedule and cancel any other entry.
+ *
+ * wheel - the timer_wheel_t to advance
+ * now - the current time
+ * func - the callback to call with each expired entry
+ * context - context passed to the callback
+ *
+ * Returns the number of entries which expired
+**/
+size_t timer_wheel_advance(timer_wheel_t* wheel, uint64_t now, timer_wheel_func_t func, void* context) {
+  assert(wheel);
+  assert(func);
+
+  uint64_t target = now / wheel->resolution;
+
+  if (target <= wheel->tick) {
+    return 0;
+  }
+
+  // Once a full rotation has passed every slot is due, so there's no need to visit
+  // any slot more than once however far behind the wheel has fallen.
+  uint64_t ticks = target - wheel->tick;
+
+  if (ticks > wheel->slot_count) {
+    ticks = wheel->slot_count;
+  }
+
+  size_t expired = 0;
+
+  for (uint64_t i = 1; i <= ticks; i++) {
+    wheel->tick = target - ticks + i;
+
+    size_t slot = (size_t)(wheel->tick % wheel->slot_count);
+    timer_wheel_entry_t* entry = wheel->slots[slot];
+
+    while (entry != NULL) {
+      // The callback may cancel the next entry, which updates pending if so.
+      wheel->pending = entry->next;
+
+      if (entry->deadline / wheel->resolution <= target) {
+        unlink_entry(wheel, entry);
+        func(entry, context);
+        expired++;
+      }
+
+      entry = wheel->pending;
+    }
+  }
+
+  wheel->pending = NULL;
+
+  return expired;
+}
+
+/**
+ * Calls a callback with every entry scheduled in the wheel, in no particular order.
+ * The callback may cancel the entry it is given but no other.  Safe to call from
+ * within an advance callback.
+ *
+ * wheel - the timer_wheel_t to visit the entries of
+ * func - the callback to call with each entry
+ * context - context passed to the callback
+**/
+void timer_wheel_each(timer_wheel_t* wheel, timer_wheel_func_t func, void* context) {
+  assert(wheel);
+  assert(func);
+
+  timer_wheel_entry_t* advancing = wheel->pending;
+
+  for (size_t slot = 0; slot < wheel->slot_count; slot++) {
+    timer_wheel_entry_t* entry = wheel->slots[slot];
+
+    while (entry != NULL) {
+      wheel->pending = entry->next;
+      func(entry, context);
+      entry = wheel->pending;
+    }
+  }
+
+  wheel->pending = advancing;
+}
+
+/**
+ * Unlinks a scheduled entry from its slot.
+**/
+static void unlink_entry(timer_wheel_t* wheel, timer_wheel_entry_t* entry) {
+  if (wheel->pending == entry) {
+    wheel->pending = entry->next;
+  }
+
+  if (entry->prev != NULL) {
+    entry->prev->next = entry->next;
+  } else {
+    wheel->slots[entry->slot] = entry->next;
+  }
+
+  if (entry->next != NULL) {
+    entry->next->prev = entry->prev;
+  }
+
+  entry->prev = NULL;
+  entry->next = NULL;
+  entry->active = false;
+  wheel->active--;
+}
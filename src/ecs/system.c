@@ -9,6 +9,10 @@
 #include "mud/lua/ref.h"
 #include "mud/game.h"
 
+static void run_system(game_t* game, system_t* system);
+static void defer_system(system_t* system, uint64_t elapsed);
+static size_t count_sharing(game_t* game, system_t* system, uint64_t slot);
+
 /**
  * Creates a new instance of system_t.
  *
@@ -24,6 +28,7 @@ system_t* ecs_new_system_t(const char* name, lua_ref_t* ref) {
   system->name = strdup(name);
   system->enabled = true;
   system->ref = ref;
+  system->interval = 1;
 
   return system;
 }
@@ -72,7 +77,54 @@ void ecs_disable_system(system_t* system) {
 }
 
 /**
- * Runs systems registered with the game.
+ * Sets how often a system runs and how long each run may take.
+ *
+ * system - the system to schedule
+ * interval - ticks between runs
+ * budget - nanoseconds a run may take, 0 for no budget
+**/
+void ecs_set_system_schedule(system_t* system, unsigned int interval, uint64_t budget) {
+  assert(system);
+  assert(interval > 0);
+  assert(interval <= MAX_SYSTEM_INTERVAL);
+
+  system->interval = interval;
+  system->budget = budget;
+}
+
+/**
+ * Picks the tick a system next runs on so that enabled systems sharing its interval
+ * are spread across the ticks of that interval rather than all running on the same
+ * one.  The system runs on whichever of the next interval's ticks has the fewest of
+ * them, the soonest if there's a tie.  With fewer systems than ticks in the interval
+ * one of the ticks up to the number of systems is always free, so only those are
+ * counted no matter how long the interval is.
+ *
+ * game - game instance containing systems
+ * system - the system to schedule
+**/
+void ecs_stagger_system(game_t* game, system_t* system) {
+  assert(game);
+  assert(system);
+
+  size_t systems = (size_t)list_size(game->systems);
+  unsigned int offset = 0;
+  size_t fewest = SIZE_MAX;
+
+  for (unsigned int i = 0; i < system->interval && i <= systems && fewest > 0; i++) {
+    size_t shared = count_sharing(game, system, (game->tick + 1 + i) % system->interval);
+
+    if (shared < fewest) {
+      fewest = shared;
+      offset = i;
+    }
+  }
+
+  system->due = game->tick + 1 + offset;
+}
+
+/**
+ * Runs the enabled systems registered with the game which are due this tick.
  *
  * game - game instance containing systems
  **/
@@ -82,12 +134,90 @@ void ecs_update_systems(game_t* game) {
   system_t* system = NULL;
 
   while ((system = it_get(iter)) != NULL) {
-    if (system->enabled) {
-      if (lua_call_system_execute_hook(game->lua_state, system) == -1) {
-        LOG(ERROR, "Failed to execute system");
-      }
+    if (system->enabled && system->due <= game->tick) {
+      run_system(game, system);
     }
 
     iter = it_next(iter);
   }
 }
+
+/**
+ * Module internal method to run a system, time it and work out when it next runs.
+ *
+ * game - game instance containing the system
+ * system - the system to run
+**/
+static void run_system(game_t* game, system_t* system) {
+  uint64_t start = uv_hrtime();
+
+  if (lua_call_system_execute_hook(game->lua_state, system) == -1) {
+    LOG(ERROR, "Failed to execute system [%s]", system->name);
+  }
+
+  uint64_t elapsed = uv_hrtime() - start;
+
+  system->runs++;
+  tick_record_timing(&system->timing, elapsed);
+
+  system->due += ((game->tick - system->due) / system->interval + 1) * system->interval;
+
+  if (system->budget == 0 || elapsed <= system->budget) {
+    system->over_budget = false;
+
+    return;
+  }
+
+  defer_system(system, elapsed);
+}
+
+/**
+ * Module internal method to put back a system which went over its budget.  It skips a
+ * run for every whole budget it took, up to MAX_SYSTEM_DEFERRAL, so that on average it
+ * stays within budget.  Only the first of a run of overruns is logged.
+ *
+ * system - the system which went over budget
+ * elapsed - nanoseconds the system took
+**/
+static void defer_system(system_t* system, uint64_t elapsed) {
+  uint64_t runs = elapsed / system->budget;
+
+  runs = runs > MAX_SYSTEM_DEFERRAL ? MAX_SYSTEM_DEFERRAL : runs;
+
+  system->due += runs * system->interval;
+  system->overruns++;
+  system->deferred += runs;
+
+  if (!system->over_budget) {
+    LOG(WARN, "System [%s] took [%llu] us against a budget of [%llu] us, deferring it by [%llu] runs",
+      system->name, (unsigned long long)(elapsed / 1000), (unsigned long long)(system->budget / 1000), (unsigned long long)runs);
+  }
+
+  system->over_budget = true;
+}
+
+/**
+ * Module internal method to count the other enabled systems sharing a system's interval
+ * which run on a given tick of it.
+ *
+ * game - game instance containing systems
+ * system - the system being scheduled
+ * slot - the tick of the interval, as a remainder of the interval
+ *
+ * Returns the number of systems running on that tick of the interval
+**/
+static size_t count_sharing(game_t* game, system_t* system, uint64_t slot) {
+  it_t iter = list_begin(game->systems);
+  system_t* other = NULL;
+  size_t shared = 0;
+
+  while ((other = it_get(iter)) != NULL) {
+    if (other != system && other->enabled && other->interval == system->interval && other->due % system->interval == slot) {
+      shared++;
+    }
+
+    iter = it_next(iter);
+  }
+
+  return shared;
+}
@@ -9,6 +9,7 @@
 #include "mud/game.h"
 #include "mud/log.h"
 #include "mud/player.h"
+#include "mud/task.h"
 
 /**
  * Allocates a new instance of an event_t.
@@ -92,7 +93,8 @@ bool event_has_events(event_broker_t* event_broker) {
 }
 
 /**
- * Dispatches any events in the event_broker_t to a given collection of entities and players.
+ * Dispatches any events in the event_broker_t to a given collection of entities and players, then
+ * wakes any tasks waiting for them.
  *
  * Parameters
  *   event_broker - The event_broker_t instance to retrieve events from.
@@ -117,6 +119,8 @@ void event_dispatch_events(event_broker_t* event_broker, game_t* game, hash_tabl
       player_on_event(player, game, event);
     }
 
+    task_on_event(game, event);
+
     event_free_event_t(event);
   }
 }
@@ -7,10 +7,12 @@
 #include "lualib.h"
 
 #include "mud/action.h"
+#include "mud/clock.h"
 #include "mud/command.h"
 #include "mud/config.h"
 #include "mud/data/hash_table.h"
 #include "mud/data/linked_list.h"
+#include "mud/data/timer_wheel.h"
 #include "mud/ecs/ecs.h"
 #include "mud/event.h"
 #include "mud/game.h"
@@ -21,16 +23,21 @@
 #include "mud/lua/hooks.h"
 #include "mud/lua/hooks_api.h"
 #include "mud/lua/log_api.h"
+#include "mud/lua/metrics_api.h"
 #include "mud/lua/player_api.h"
 #include "mud/lua/script.h"
 #include "mud/lua/script_api.h"
 #include "mud/network/network.h"
+#include "mud/network/tls.h"
 #include "mud/player.h"
+#include "mud/sim.h"
 #include "mud/task.h"
 
 static int connect_to_database(game_t* game, const char* filename);
+static int start_listeners(game_t* game);
 static int initialise_lua(game_t* game, config_t* config);
-static void game_tick_cb(uv_timer_t* timer);
+static void game_tick_cb(tick_scheduler_t* scheduler, void* context);
+static int run_simulation(game_t* game);
 
 /**
  * Allocate a new instance of a game_t struct.
@@ -42,6 +49,8 @@ game_t* create_game_t(void) {
 
   game->shutdown = 0;
   game->loop = uv_default_loop();
+  game->tick = 0;
+  game->started = 0;
 
   game->config = config_new();
 
@@ -73,9 +82,13 @@ game_t* create_game_t(void) {
   game->systems = create_linked_list_t();
   game->systems->deallocator = ecs_deallocate_system_t;
 
-  game->tasks = create_linked_list_t();
+  game->task_wheel = NULL;
+
+  game->task_waiters = create_hash_table_t();
+  game->task_waiters->deallocator = free;
 
   game->events = create_linked_list_t();
+  game->backlog = create_linked_list_t();
 
   game->network = create_network_t();
 
@@ -106,8 +119,14 @@ void free_game_t(game_t* game) {
   free_linked_list_t(game->components);
   free_linked_list_t(game->archetypes);
   free_linked_list_t(game->systems);
-  free_linked_list_t(game->tasks);
   free_linked_list_t(game->events);
+  free_linked_list_t(game->backlog);
+
+  if (game->task_wheel != NULL) {
+    free_timer_wheel_t(game->task_wheel);
+  }
+
+  free_hash_table_t(game->task_waiters);
 
   free_network_t(game->network);
 
@@ -140,7 +159,22 @@ int start_game(int argc, char* argv[]) {
     exit(-1); // NOLINT(concurrency-mt-unsafe)
   }
 
+  // Virtual time has to begin before anything is scheduled against the clock
+  if (game->config->simulation_script != NULL) {
+    clock_use_virtual_time(game->config->simulation_epoch);
+  }
+
+  game->started = clock_time();
+  game->task_wheel = create_timer_wheel_t(TASK_WHEEL_SLOTS, TASK_WHEEL_RESOLUTION, clock_now(game->loop));
+
   game->network->loop = game->loop;
+  game->network->output_limit = game->config->output_buffer_limit;
+  game->network->pending_limit = game->config->output_pending_limit;
+  game->network->backpressure_policy = game->config->backpressure_policy;
+  game->network->backpressure_timeout = game->config->backpressure_timeout;
+  game->network->login_idle_timeout = game->config->login_idle_timeout;
+  game->network->play_idle_timeout = game->config->play_idle_timeout;
+  game->network->keepalive_delay = game->config->keepalive_delay;
 
   register_connection_callback(game->network, player_connected, game);
   register_disconnection_callback(game->network, player_disconnected, game);
@@ -183,17 +217,37 @@ int start_game(int argc, char* argv[]) {
     return -1;
   }
 
-  if (start_game_server(game->network, game->config->game_port) == -1) {
+  if (game->config->simulation_script == NULL && start_listeners(game) == -1) {
     LOG(ERROR, "Failed to start game server");
 
     return -1;
   }
 
-  uint64_t tick_ms = 1000 / game->config->ticks_per_second;
+  if (game->config->output_coalescing && network_enable_output_coalescing(game->network, game->config->output_coalesce_latency) == -1) {
+    LOG(ERROR, "Failed to enable output coalescing");
+
+    return -1;
+  }
+
+  if ((game->config->login_idle_timeout > 0 || game->config->play_idle_timeout > 0) && network_enable_idle_reaper(game->network) == -1) {
+    LOG(ERROR, "Failed to enable idle reaper");
+
+    return -1;
+  }
+
+  tick_init_scheduler(&game->scheduler, game->config->ticks_per_second, game->config->tick_policy, game->config->tick_catch_up_limit);
+
+  if (game->config->simulation_script != NULL) {
+    if (run_simulation(game) == -1) {
+      LOG(ERROR, "Failed to run simulation");
 
-  uv_timer_init(game->loop, &game->tick_timer);
-  game->tick_timer.data = game;
-  uv_timer_start(&game->tick_timer, game_tick_cb, tick_ms, tick_ms);
+      return -1;
+    }
+  } else if (tick_start_scheduler(&game->scheduler, game->loop, game_tick_cb, game) == -1) {
+    LOG(ERROR, "Failed to start tick scheduler");
+
+    return -1;
+  }
 
   uv_run(game->loop, UV_RUN_DEFAULT);
 
@@ -227,24 +281,116 @@ int connect_to_database(game_t* game, const char* filename) {
 }
 
 /**
- * Called by libuv on every game tick.  Dispatches events, updates ECS systems and
- * flushes network output.  Initiates a clean shutdown when game->shutdown is set.
+ * Starts every listener in the configuration, or a single TCP listener on the game
+ * port when none are configured.  Returns -1 on failure or 0 on success.
  **/
-static void game_tick_cb(uv_timer_t* timer) {
-  game_t* game = timer->data;
+static int start_listeners(game_t* game) {
+  config_t* config = game->config;
+
+  if (list_size(config->listeners) == 0) {
+    return start_game_server(game->network, config->game_port);
+  }
+
+  it_t iter = list_begin(config->listeners);
+  listener_config_t* listener = NULL;
+
+  while ((listener = (listener_config_t*)it_get(iter)) != NULL) {
+    int res = 0;
+
+    if (listener->path != NULL) {
+      res = network_start_unix_server(game->network, listener->path, listener->backlog);
+    } else if (listener->tls_certificate != NULL) {
+      SSL_CTX* tls = network_new_tls_context(listener->tls_certificate, listener->tls_key);
+
+      if (tls == NULL) {
+        return -1;
+      }
+
+      res = network_start_tcp_server(game->network, listener->port, listener->backlog, listener->shards, listener->reuseport, listener->websocket, tls);
+      network_free_tls_context(tls);
+    } else {
+      res = network_start_tcp_server(game->network, listener->port, listener->backlog, listener->shards, listener->reuseport, listener->websocket, NULL);
+    }
+
+    if (res == -1) {
+      return -1;
+    }
+
+    iter = it_next(iter);
+  }
+
+  return 0;
+}
+
+/**
+ * Called by the tick scheduler on every game tick.  Drains queued player commands, dispatches events,
+ * runs due tasks, updates ECS systems and flushes network output, timing each phase.  Initiates a clean
+ * shutdown when game->shutdown is set.
+ **/
+static void game_tick_cb(tick_scheduler_t* scheduler, void* context) {
+  game_t* game = context;
 
   if (game->shutdown) {
     task_shutdown(game);
     network_shutdown(game->network);
-    uv_timer_stop(timer);
-    uv_close((uv_handle_t*)timer, NULL);
+    tick_stop_scheduler(scheduler);
 
     return;
   }
 
+  game->tick++;
+
+  player_drain_commands(game);
+  tick_record_phase(scheduler, TICK_PHASE_COMMANDS);
+
   event_dispatch_events(game->event_broker, game, game->entities, game->players);
+  tick_record_phase(scheduler, TICK_PHASE_EVENTS);
+
+  task_run_due_tasks(game);
+  tick_record_phase(scheduler, TICK_PHASE_TASKS);
+
   ecs_update_systems(game);
+  tick_record_phase(scheduler, TICK_PHASE_SYSTEMS);
+
   flush_output(game->network);
+  tick_record_phase(scheduler, TICK_PHASE_FLUSH);
+}
+
+/**
+ * Runs a headless simulation of the virtual clients in the configured simulation script
+ * on virtual time, then writes the tick time profile to the configured report file, or
+ * to stdout if there isn't one.
+ *
+ * Returns 0 on success or -1 on failure
+ **/
+static int run_simulation(game_t* game) {
+  sim_t* sim = sim_new_sim_t(game);
+
+  if (sim_load_script(sim, game->config->simulation_script) == -1) {
+    sim_free_sim_t(sim);
+
+    return -1;
+  }
+
+  sim_run(sim, game_tick_cb);
+
+  FILE* report = stdout;
+
+  if (game->config->simulation_report != NULL && (report = fopen(game->config->simulation_report, "w")) == NULL) {
+    LOG(ERROR, "Unable to open simulation report [%s]", game->config->simulation_report);
+
+    report = stdout;
+  }
+
+  sim_write_report(sim, report);
+
+  if (report != stdout) {
+    fclose(report);
+  }
+
+  sim_free_sim_t(sim);
+
+  return 0;
 }
 
 int initialise_lua(game_t* game, config_t* config) {
@@ -290,6 +436,11 @@ int initialise_lua(game_t* game, config_t* config) {
     return -1;
   }
 
+  if (lua_metrics_register_api(game->lua_state) == -1) {
+    LOG(ERROR, "Failed to register Lua metrics API with state");
+    return -1;
+  }
+
   if (config->lib_script == NULL) {
     LOG(ERROR, "Lua library script was not defined");
 
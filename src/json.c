@@ -20,6 +20,27 @@ json_node_t* parse_null(const char* input, size_t len, size_t* pos);
 
 int write_node_value(json_node_t* node, char* buffer, size_t len, size_t* pos);
 
+typedef struct json_reader {
+  const char* input;
+  size_t len;
+  size_t pos;
+  unsigned int depth;
+  unsigned int values;
+  const json_visitor_t* visitor;
+  void* context;
+  char scratch[JSON_MAX_STRING_LENGTH];
+} json_reader_t;
+
+static void skip_whitespace(json_reader_t* reader);
+static int read_value(json_reader_t* reader);
+static int read_object(json_reader_t* reader);
+static int read_array(json_reader_t* reader);
+static int read_string(json_reader_t* reader, const char** str, size_t* len);
+static int read_escape(json_reader_t* reader, char* output, size_t* written);
+static int read_hex(json_reader_t* reader, unsigned int* code);
+static int read_number(json_reader_t* reader);
+static int read_literal(json_reader_t* reader, const char* literal);
+
 static const json_type_str_t json_type_strs[] = {
   { OBJECT, "object"},
   { ARRAY, "array" },
@@ -887,3 +908,639 @@ void json_attach_array(json_node_t* array, json_node_t* item) {
 
   next->next = item;
 }
+
+/**
+ * Parses JSON in a single pass, calling back to the visitor as each object, array, key
+ * and value is read rather than building a tree of json_node_t.  Nesting is limited to
+ * JSON_MAX_DEPTH, the document to JSON_MAX_VALUES values and each decoded string to
+ * JSON_MAX_STRING_LENGTH bytes so untrusted input can't recurse or allocate without bound.
+ *
+ * input - the JSON to be parsed, need not be null terminated
+ * len - length of the input
+ * visitor - callbacks made as the document is read, any may be NULL
+ * context - passed to each callback
+ *
+ * Returns 0 on success or -1 if the input is invalid, exceeds a limit or a callback failed.
+**/
+int json_parse(const char* input, size_t len, const json_visitor_t* visitor, void* context) {
+  assert(input);
+  assert(visitor);
+
+  json_reader_t reader;
+
+  reader.input = input;
+  reader.len = len;
+  reader.pos = 0;
+  reader.depth = 0;
+  reader.values = 0;
+  reader.visitor = visitor;
+  reader.context = context;
+
+  if (read_value(&reader) == -1) {
+    return -1;
+  }
+
+  skip_whitespace(&reader);
+
+  if (reader.pos != reader.len) {
+    LOG(ERROR, "Unexpected data after JSON value at position [%zu]", reader.pos);
+
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * Module internal method to move the reader past any whitespace.
+ *
+ * reader - the reader to advance
+**/
+static void skip_whitespace(json_reader_t* reader) {
+  assert(reader);
+
+  while (reader->pos < reader->len) {
+    char chr = reader->input[reader->pos];
+
+    if (chr != ' ' && chr != '\t' && chr != '\n' && chr != '\r') {
+      return;
+    }
+
+    reader->pos++;
+  }
+}
+
+/**
+ * Module internal method to read whichever value is next in the input.
+ *
+ * reader - the reader to read from
+ *
+ * Returns 0 on success or -1 on failure
+**/
+static int read_value(json_reader_t* reader) {
+  assert(reader);
+
+  const json_visitor_t* visitor = reader->visitor;
+
+  if (++reader->values > JSON_MAX_VALUES) {
+    LOG(ERROR, "JSON contains more than [%d] values", JSON_MAX_VALUES);
+
+    return -1;
+  }
+
+  skip_whitespace(reader);
+
+  if (reader->pos >= reader->len) {
+    LOG(ERROR, "Reached end of JSON while expecting a value");
+
+    return -1;
+  }
+
+  char chr = reader->input[reader->pos];
+
+  if (chr == '{') {
+    return read_object(reader);
+  }
+
+  if (chr == '[') {
+    return read_array(reader);
+  }
+
+  if (chr == '"') {
+    const char* str = NULL;
+    size_t len = 0;
+
+    if (read_string(reader, &str, &len) == -1) {
+      return -1;
+    }
+
+    return visitor->string ? visitor->string(reader->context, str, len) : 0;
+  }
+
+  if (chr == '-' || isdigit((unsigned char) chr)) {
+    return read_number(reader);
+  }
+
+  if (chr == 't' || chr == 'f') {
+    bool boolean = chr == 't';
+
+    if (read_literal(reader, boolean ? TRUE_STR : FALSE_STR) == -1) {
+      return -1;
+    }
+
+    return visitor->boolean ? visitor->boolean(reader->context, boolean) : 0;
+  }
+
+  if (chr == 'n') {
+    if (read_literal(reader, NULL_STR) == -1) {
+      return -1;
+    }
+
+    return visitor->null ? visitor->null(reader->context) : 0;
+  }
+
+  LOG(ERROR, "Expected a JSON value but encountered [%c] at position [%zu]", chr, reader->pos);
+
+  return -1;
+}
+
+/**
+ * Module internal method to read an object, calling back for each key and its value.
+ *
+ * reader - the reader, positioned at the opening brace
+ *
+ * Returns 0 on success or -1 on failure
+**/
+static int read_object(json_reader_t* reader) {
+  assert(reader);
+
+  const json_visitor_t* visitor = reader->visitor;
+
+  if (reader->depth == JSON_MAX_DEPTH) {
+    LOG(ERROR, "JSON is nested deeper than [%d]", JSON_MAX_DEPTH);
+
+    return -1;
+  }
+
+  reader->depth++;
+  reader->pos++;
+
+  if (visitor->object_start && visitor->object_start(reader->context) == -1) {
+    return -1;
+  }
+
+  skip_whitespace(reader);
+
+  if (reader->pos < reader->len && reader->input[reader->pos] == '}') {
+    reader->pos++;
+    reader->depth--;
+
+    return visitor->object_end ? visitor->object_end(reader->context) : 0;
+  }
+
+  while (true) {
+    const char* key = NULL;
+    size_t key_len = 0;
+
+    skip_whitespace(reader);
+
+    if (reader->pos >= reader->len || reader->input[reader->pos] != '"') {
+      LOG(ERROR, "Expected object key at position [%zu]", reader->pos);
+
+      return -1;
+    }
+
+    if (read_string(reader, &key, &key_len) == -1) {
+      return -1;
+    }
+
+    if (visitor->key && visitor->key(reader->context, key, key_len) == -1) {
+      return -1;
+    }
+
+    skip_whitespace(reader);
+
+    if (reader->pos >= reader->len || reader->input[reader->pos] != ':') {
+      LOG(ERROR, "Expected ':' after object key at position [%zu]", reader->pos);
+
+      return -1;
+    }
+
+    reader->pos++;
+
+    if (read_value(reader) == -1) {
+      return -1;
+    }
+
+    skip_whitespace(reader);
+
+    if (reader->pos >= reader->len) {
+      LOG(ERROR, "Reached end of JSON before object was closed");
+
+      return -1;
+    }
+
+    char chr = reader->input[reader->pos++];
+
+    if (chr == '}') {
+      break;
+    }
+
+    if (chr != ',') {
+      LOG(ERROR, "Expected ',' or '}' but encountered [%c] at position [%zu]", chr, reader->pos - 1);
+
+      return -1;
+    }
+  }
+
+  reader->depth--;
+
+  return visitor->object_end ? visitor->object_end(reader->context) : 0;
+}
+
+/**
+ * Module internal method to read an array, calling back for each item.
+ *
+ * reader - the reader, positioned at the opening bracket
+ *
+ * Returns 0 on success or -1 on failure
+**/
+static int read_array(json_reader_t* reader) {
+  assert(reader);
+
+  const json_visitor_t* visitor = reader->visitor;
+
+  if (reader->depth == JSON_MAX_DEPTH) {
+    LOG(ERROR, "JSON is nested deeper than [%d]", JSON_MAX_DEPTH);
+
+    return -1;
+  }
+
+  reader->depth++;
+  reader->pos++;
+
+  if (visitor->array_start && visitor->array_start(reader->context) == -1) {
+    return -1;
+  }
+
+  skip_whitespace(reader);
+
+  if (reader->pos < reader->len && reader->input[reader->pos] == ']') {
+    reader->pos++;
+    reader->depth--;
+
+    return visitor->array_end ? visitor->array_end(reader->context) : 0;
+  }
+
+  while (true) {
+    if (read_value(reader) == -1) {
+      return -1;
+    }
+
+    skip_whitespace(reader);
+
+    if (reader->pos >= reader->len) {
+      LOG(ERROR, "Reached end of JSON before array was closed");
+
+      return -1;
+    }
+
+    char chr = reader->input[reader->pos++];
+
+    if (chr == ']') {
+      break;
+    }
+
+    if (chr != ',') {
+      LOG(ERROR, "Expected ',' or ']' but encountered [%c] at position [%zu]", chr, reader->pos - 1);
+
+      return -1;
+    }
+  }
+
+  reader->depth--;
+
+  return visitor->array_end ? visitor->array_end(reader->context) : 0;
+}
+
+/**
+ * Module internal method to read a string.  Strings without escapes are returned in
+ * place, otherwise they're unescaped into the reader's scratch buffer which is only
+ * valid until the next string is read.
+ *
+ * reader - the reader, positioned at the opening quote
+ * str - populated with the start of the string
+ * len - populated with the length of the string
+ *
+ * Returns 0 on success or -1 on failure
+**/
+static int read_string(json_reader_t* reader, const char** str, size_t* len) {
+  assert(reader);
+  assert(str);
+  assert(len);
+
+  size_t start = ++reader->pos;
+  size_t written = 0;
+  bool escaped = false;
+
+  while (reader->pos < reader->len) {
+    char chr = reader->input[reader->pos];
+
+    if (chr == '"') {
+      size_t str_len = escaped ? written : reader->pos - start;
+
+      if (str_len > JSON_MAX_STRING_LENGTH) {
+        LOG(ERROR, "JSON string is longer than [%d] bytes", JSON_MAX_STRING_LENGTH);
+
+        return -1;
+      }
+
+      *str = escaped ? reader->scratch : reader->input + start;
+      *len = str_len;
+      reader->pos++;
+
+      return 0;
+    }
+
+    if ((unsigned char) chr < 0x20) {
+      LOG(ERROR, "Unescaped control character in JSON string at position [%zu]", reader->pos);
+
+      return -1;
+    }
+
+    if (chr == '\\' && !escaped) {
+      written = reader->pos - start;
+
+      if (written > JSON_MAX_STRING_LENGTH) {
+        LOG(ERROR, "JSON string is longer than [%d] bytes", JSON_MAX_STRING_LENGTH);
+
+        return -1;
+      }
+
+      memcpy(reader->scratch, reader->input + start, written);
+      escaped = true;
+    }
+
+    if (!escaped) {
+      reader->pos++;
+
+      continue;
+    }
+
+    if (chr == '\\') {
+      char decoded[4];
+      size_t decoded_len = 0;
+
+      reader->pos++;
+
+      if (read_escape(reader, decoded, &decoded_len) == -1) {
+        return -1;
+      }
+
+      if (written + decoded_len > JSON_MAX_STRING_LENGTH) {
+        LOG(ERROR, "JSON string is longer than [%d] bytes", JSON_MAX_STRING_LENGTH);
+
+        return -1;
+      }
+
+      memcpy(reader->scratch + written, decoded, decoded_len);
+      written += decoded_len;
+
+      continue;
+    }
+
+    if (written == JSON_MAX_STRING_LENGTH) {
+      LOG(ERROR, "JSON string is longer than [%d] bytes", JSON_MAX_STRING_LENGTH);
+
+      return -1;
+    }
+
+    reader->scratch[written++] = chr;
+    reader->pos++;
+  }
+
+  LOG(ERROR, "Reached end of JSON before string was closed");
+
+  return -1;
+}
+
+/**
+ * Module internal method to decode the escape sequence following a backslash, with
+ * unicode escapes (including surrogate pairs) being encoded as UTF-8.
+ *
+ * reader - the reader, positioned after the backslash
+ * output - populated with the decoded bytes, at least four bytes long
+ * written - populated with the number of bytes decoded
+ *
+ * Returns 0 on success or -1 on failure
+**/
+static int read_escape(json_reader_t* reader, char* output, size_t* written) {
+  assert(reader);
+  assert(output);
+  assert(written);
+
+  if (reader->pos >= reader->len) {
+    LOG(ERROR, "Reached end of JSON in string escape");
+
+    return -1;
+  }
+
+  char chr = reader->input[reader->pos++];
+  unsigned int code = 0;
+
+  switch (chr) {
+    case '"': case '\\': case '/':
+      output[0] = chr;
+      *written = 1;
+
+      return 0;
+
+    case 'b': output[0] = '\b'; *written = 1; return 0;
+    case 'f': output[0] = '\f'; *written = 1; return 0;
+    case 'n': output[0] = '\n'; *written = 1; return 0;
+    case 'r': output[0] = '\r'; *written = 1; return 0;
+    case 't': output[0] = '\t'; *written = 1; return 0;
+
+    case 'u':
+      break;
+
+    default:
+      LOG(ERROR, "Invalid JSON string escape [%c] at position [%zu]", chr, reader->pos - 1);
+
+      return -1;
+  }
+
+  if (read_hex(reader, &code) == -1) {
+    return -1;
+  }
+
+  if (code >= 0xDC00 && code <= 0xDFFF) {
+    LOG(ERROR, "Unpaired low surrogate in JSON string at position [%zu]", reader->pos);
+
+    return -1;
+  }
+
+  if (code >= 0xD800 && code <= 0xDBFF) {
+    unsigned int low = 0;
+
+    if (reader->pos + 2 > reader->len || reader->input[reader->pos] != '\\' || reader->input[reader->pos + 1] != 'u') {
+      LOG(ERROR, "Unpaired high surrogate in JSON string at position [%zu]", reader->pos);
+
+      return -1;
+    }
+
+    reader->pos += 2;
+
+    if (read_hex(reader, &low) == -1) {
+      return -1;
+    }
+
+    if (low < 0xDC00 || low > 0xDFFF) {
+      LOG(ERROR, "Invalid low surrogate in JSON string at position [%zu]", reader->pos);
+
+      return -1;
+    }
+
+    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+  }
+
+  if (code < 0x80) {
+    output[0] = (char) code;
+    *written = 1;
+  } else if (code < 0x800) {
+    output[0] = (char) (0xC0 | (code >> 6));
+    output[1] = (char) (0x80 | (code & 0x3F));
+    *written = 2;
+  } else if (code < 0x10000) {
+    output[0] = (char) (0xE0 | (code >> 12));
+    output[1] = (char) (0x80 | ((code >> 6) & 0x3F));
+    output[2] = (char) (0x80 | (code & 0x3F));
+    *written = 3;
+  } else {
+    output[0] = (char) (0xF0 | (code >> 18));
+    output[1] = (char) (0x80 | ((code >> 12) & 0x3F));
+    output[2] = (char) (0x80 | ((code >> 6) & 0x3F));
+    output[3] = (char) (0x80 | (code & 0x3F));
+    *written = 4;
+  }
+
+  return 0;
+}
+
+/**
+ * Module internal method to read the four hex digits of a unicode escape.
+ *
+ * reader - the reader, positioned at the first digit
+ * code - populated with the code unit
+ *
+ * Returns 0 on success or -1 on failure
+**/
+static int read_hex(json_reader_t* reader, unsigned int* code) {
+  assert(reader);
+  assert(code);
+
+  if (reader->pos + 4 > reader->len) {
+    LOG(ERROR, "Reached end of JSON in unicode escape");
+
+    return -1;
+  }
+
+  *code = 0;
+
+  for (int i = 0; i < 4; i++) {
+    char chr = reader->input[reader->pos++];
+
+    if (!isxdigit((unsigned char) chr)) {
+      LOG(ERROR, "Invalid hex digit [%c] in unicode escape at position [%zu]", chr, reader->pos - 1);
+
+      return -1;
+    }
+
+    *code = (*code << 4) | (unsigned int) (isdigit((unsigned char) chr) ? chr - '0' : (tolower((unsigned char) chr) - 'a' + 10));
+  }
+
+  return 0;
+}
+
+/**
+ * Module internal method to read a number.
+ *
+ * reader - the reader, positioned at the first character of the number
+ *
+ * Returns 0 on success or -1 on failure
+**/
+static int read_number(json_reader_t* reader) {
+  assert(reader);
+
+  const char* input = reader->input;
+  size_t start = reader->pos;
+  size_t pos = reader->pos;
+  char number[64];
+
+  if (pos < reader->len && input[pos] == '-') {
+    pos++;
+  }
+
+  if (pos >= reader->len || !isdigit((unsigned char) input[pos])) {
+    LOG(ERROR, "Expected digit in JSON number at position [%zu]", pos);
+
+    return -1;
+  }
+
+  if (input[pos] == '0') {
+    pos++;
+  } else {
+    while (pos < reader->len && isdigit((unsigned char) input[pos])) {
+      pos++;
+    }
+  }
+
+  if (pos < reader->len && input[pos] == '.') {
+    pos++;
+
+    if (pos >= reader->len || !isdigit((unsigned char) input[pos])) {
+      LOG(ERROR, "Expected digit after decimal point in JSON number at position [%zu]", pos);
+
+      return -1;
+    }
+
+    while (pos < reader->len && isdigit((unsigned char) input[pos])) {
+      pos++;
+    }
+  }
+
+  if (pos < reader->len && (input[pos] == 'e' || input[pos] == 'E')) {
+    pos++;
+
+    if (pos < reader->len && (input[pos] == '+' || input[pos] == '-')) {
+      pos++;
+    }
+
+    if (pos >= reader->len || !isdigit((unsigned char) input[pos])) {
+      LOG(ERROR, "Expected digit in exponent of JSON number at position [%zu]", pos);
+
+      return -1;
+    }
+
+    while (pos < reader->len && isdigit((unsigned char) input[pos])) {
+      pos++;
+    }
+  }
+
+  if (pos - start >= sizeof(number)) {
+    LOG(ERROR, "JSON number at position [%zu] is too long", start);
+
+    return -1;
+  }
+
+  memcpy(number, input + start, pos - start);
+  number[pos - start] = '\0';
+  reader->pos = pos;
+
+  return reader->visitor->number ? reader->visitor->number(reader->context, strtod(number, NULL)) : 0;
+}
+
+/**
+ * Module internal method to read one of the literals true, false or null.
+ *
+ * reader - the reader, positioned at the first character of the literal
+ * literal - the literal expected
+ *
+ * Returns 0 on success or -1 on failure
+**/
+static int read_literal(json_reader_t* reader, const char* literal) {
+  assert(reader);
+  assert(literal);
+
+  size_t len = strlen(literal);
+
+  if (reader->len - reader->pos < len || strncmp(reader->input + reader->pos, literal, len) != 0) {
+    LOG(ERROR, "Expected [%s] at position [%zu]", literal, reader->pos);
+
+    return -1;
+  }
+
+  reader->pos += len;
+
+  return 0;
+}
@@ -5,8 +5,10 @@
 
 #include "mud/action.h"
 #include "mud/command.h"
+#include "mud/config.h"
 #include "mud/data/hash_table.h"
 #include "mud/data/linked_list.h"
+#include "mud/data/timer_wheel.h"
 #include "mud/ecs/ecs.h"
 #include "mud/event.h"
 #include "mud/game.h"
@@ -43,10 +45,17 @@ static int lua_register_system(lua_State *lua);
 static int lua_deregister_system(lua_State *lua);
 static int lua_enable_system(lua_State *lua);
 static int lua_disable_system(lua_State *lua);
+static void read_system_schedule(lua_State* lua, game_t* game, unsigned int* interval, uint64_t* budget);
 
 static int lua_schedule_task(lua_State *lua);
 static int lua_cancel_task(lua_State* lua);
 static int lua_get_tasks(lua_State* lua);
+static int lua_schedule_repeating_task(lua_State* lua);
+static int lua_spawn_task(lua_State* lua);
+static int lua_wait(lua_State* lua);
+static int lua_wait_event(lua_State* lua);
+static task_t* current_coroutine_task(lua_State* lua, game_t* game);
+static void push_pending_task(task_t* task, void* context);
 
 static int lua_has_component(lua_State* lua);
 static int lua_add_component(lua_State* lua);
@@ -84,6 +93,10 @@ static const struct luaL_Reg game_lib[] = {
   { "schedule_task", lua_schedule_task },
   { "cancel_task", lua_cancel_task },
   { "get_tasks", lua_get_tasks },
+  { "schedule_repeating_task", lua_schedule_repeating_task },
+  { "spawn_task", lua_spawn_task },
+  { "wait", lua_wait },
+  { "wait_event", lua_wait_event },
 
   { "has_component", lua_has_component },
   { "add_component", lua_add_component },
@@ -392,16 +405,22 @@ static int lua_register_system(lua_State *lua) {
   luaL_checktype(lua, -1, LUA_TTABLE);
   luaL_checktype(lua, -2, LUA_TSTRING);
 
+  game_t* game = lua_get_game(lua);
+  unsigned int interval = 1;
+  uint64_t budget = 0;
+
+  read_system_schedule(lua, game, &interval, &budget);
+
   lua_ref_t* ref = lua_new_lua_ref_t(lua, luaL_ref(lua, LUA_REGISTRYINDEX));
   const char* name = lua_tostring(lua, -1);
 
   lua_pop(lua, 1);
 
   system_t* system = ecs_new_system_t(name, ref);
-
-  game_t* game = lua_get_game(lua);
+  ecs_set_system_schedule(system, interval, budget);
 
   list_add(game->systems, system);
+  ecs_stagger_system(game, system);
 
   lua_push_system(lua, system);
 
@@ -441,6 +460,7 @@ static int lua_enable_system(lua_State *lua) {
   lua_pop(lua, 1);
 
   ecs_enable_system(system);
+  ecs_stagger_system(lua_get_game(lua), system);
   lua_push_system(lua, system);
 
   return 1;
@@ -464,6 +484,64 @@ static int lua_disable_system(lua_State *lua) {
   return 1;
 }
 
+/**
+ * Reads how often a system runs and how long each run may take from the optional
+ * every_ticks, every_ms and budget_ms fields of the system table on top of the stack.
+ * every_ms is rounded up to whole ticks.  Intervals longer than MAX_SYSTEM_INTERVAL
+ * ticks are an error.
+ *
+ * lua - Lua state instance
+ * game - game instance, for the tick rate
+ * interval - populated with the ticks between runs
+ * budget - populated with the nanoseconds a run may take
+**/
+static void read_system_schedule(lua_State* lua, game_t* game, unsigned int* interval, uint64_t* budget) {
+  lua_getfield(lua, -1, "every_ticks");
+
+  if (lua_isnumber(lua, -1)) {
+    lua_Integer ticks = lua_tointeger(lua, -1);
+
+    if (ticks < 1 || ticks > MAX_SYSTEM_INTERVAL) {
+      luaL_error(lua, "System every_ticks must be between 1 and %d", MAX_SYSTEM_INTERVAL);
+    }
+
+    *interval = (unsigned int)ticks;
+  }
+
+  lua_pop(lua, 1);
+
+  lua_getfield(lua, -1, "every_ms");
+
+  if (lua_isnumber(lua, -1)) {
+    lua_Integer ms = lua_tointeger(lua, -1);
+
+    lua_Integer max = (lua_Integer)MAX_SYSTEM_INTERVAL * 1000 / game->config->ticks_per_second;
+
+    if (ms < 1 || ms > max) {
+      luaL_error(lua, "System every_ms must be between 1 and %lld", (long long)max);
+    }
+
+    lua_Integer ticks = (ms * game->config->ticks_per_second + 999) / 1000;
+    *interval = ticks > 1 ? (unsigned int)ticks : 1;
+  }
+
+  lua_pop(lua, 1);
+
+  lua_getfield(lua, -1, "budget_ms");
+
+  if (lua_isnumber(lua, -1)) {
+    lua_Number ms = lua_tonumber(lua, -1);
+
+    if (!(ms >= 0 && ms <= MAX_SYSTEM_BUDGET)) {
+      luaL_error(lua, "System budget_ms must be between 0 and %d", MAX_SYSTEM_BUDGET);
+    }
+
+    *budget = (uint64_t)(ms * 1000000);
+  }
+
+  lua_pop(lua, 1);
+}
+
 /**
  * API method which schedules a task for execution
  *
@@ -478,17 +556,58 @@ static int lua_schedule_task(lua_State *lua) {
   luaL_checktype(lua, -2, LUA_TNUMBER);
   luaL_checktype(lua, -3, LUA_TSTRING);
 
-  lua_ref_t* ref = lua_new_lua_ref_t(lua, luaL_ref(lua, LUA_REGISTRYINDEX));
+  lua_Number seconds = lua_tonumber(lua, -2);
+
+  if (!(seconds >= 0 && seconds <= MAX_TASK_DELAY)) {
+    return luaL_error(lua, "Task delay must be between 0 and %d seconds", MAX_TASK_DELAY);
+  }
 
-  int execute_in = lua_tonumber(lua, -1);
+  lua_ref_t* ref = lua_new_lua_ref_t(lua, luaL_ref(lua, LUA_REGISTRYINDEX));
   const char* name = lua_tostring(lua, -2);
 
+  game_t* game = lua_get_game(lua);
+  task_t* task = task_new_task_t(game, name, 0, ref);
+
   lua_pop(lua, 2);
 
+  task_schedule_task(game, task, (uint64_t)(seconds * 1000));
+
+  lua_push_task(lua, task);
+
+  return 1;
+}
+
+/**
+ * API method which schedules a task to run repeatedly, first after one interval
+ *
+ * lua - Lua state instance
+ *
+ * game.schedule_repeating_task("name", 0.5, task_func)
+ *
+ * Returns 0 on success or calls luaL_error on error
+**/
+static int lua_schedule_repeating_task(lua_State* lua) {
+  luaL_checktype(lua, -1, LUA_TFUNCTION);
+  luaL_checktype(lua, -2, LUA_TNUMBER);
+  luaL_checktype(lua, -3, LUA_TSTRING);
+
+  lua_Number seconds = lua_tonumber(lua, -2);
+
+  if (!(seconds >= 0.001 && seconds <= MAX_TASK_DELAY)) {
+    return luaL_error(lua, "Task interval must be between 0.001 and %d seconds", MAX_TASK_DELAY);
+  }
+
+  uint64_t interval = (uint64_t)(seconds * 1000);
+
+  lua_ref_t* ref = lua_new_lua_ref_t(lua, luaL_ref(lua, LUA_REGISTRYINDEX));
+  const char* name = lua_tostring(lua, -2);
+
   game_t* game = lua_get_game(lua);
-  task_t* task = task_new_task_t(game, name, execute_in, ref);
+  task_t* task = task_new_task_t(game, name, interval, ref);
+
+  lua_pop(lua, 2);
 
-  task_schedule_task(game, task);
+  task_schedule_task(game, task, interval);
 
   lua_push_task(lua, task);
 
@@ -529,24 +648,131 @@ static int lua_cancel_task(lua_State* lua) {
 static int lua_get_tasks(lua_State* lua) {
   game_t* game = lua_get_game(lua);
 
-  it_t iter = list_begin(game->tasks);
-  task_t* task = NULL;
+  lua_newtable(lua);
 
-  int count = 1;
+  task_each_pending(game, push_pending_task, lua);
 
-  lua_newtable(lua);
+  return 1;
+}
 
-  while ((task = it_get(iter) ) != NULL) {
-    lua_pushnumber(lua, count);
-    lua_push_task(lua, task);
-    lua_settable(lua, -3);
+/**
+ * Appends a pending task to the array on top of the stack.
+ *
+ * task - the pending task
+ * context - Lua state instance
+**/
+static void push_pending_task(task_t* task, void* context) {
+  lua_State* lua = context;
 
-    iter = it_next(iter);
-  }
+  lua_pushnumber(lua, lua_rawlen(lua, -1) + 1);
+  lua_push_task(lua, task);
+  lua_settable(lua, -3);
+}
+
+/**
+ * API method which runs a function as a coroutine task, starting on the next tick.  The
+ * function may suspend itself with game.wait and game.wait_event.
+ *
+ * lua - Lua state instance
+ *
+ * game.spawn_task("name", task_func)
+ *
+ * Returns 1 on success or calls luaL_error on error
+**/
+static int lua_spawn_task(lua_State* lua) {
+  luaL_checktype(lua, -1, LUA_TFUNCTION);
+  luaL_checktype(lua, -2, LUA_TSTRING);
+
+  lua_State* thread = lua_newthread(lua); // -3 = name, -2 = function, -1 = thread
+
+  lua_pushvalue(lua, -2);
+  lua_xmove(lua, thread, 1);
+
+  lua_ref_t* ref = lua_new_lua_ref_t(lua, luaL_ref(lua, LUA_REGISTRYINDEX));
+  const char* name = lua_tostring(lua, -2);
+
+  game_t* game = lua_get_game(lua);
+  task_t* task = task_new_coroutine_task_t(game, name, thread, ref);
+
+  lua_pop(lua, 2);
+
+  task_schedule_task(game, task, 0);
+
+  lua_push_task(lua, task);
 
   return 1;
 }
 
+/**
+ * API method which suspends the running coroutine task for a number of seconds.  Waiting
+ * for no time at all resumes the task on the next tick.
+ *
+ * lua - Lua state instance
+ *
+ * game.wait(0.5)
+ *
+ * Returns by yielding or calls luaL_error on error
+**/
+static int lua_wait(lua_State* lua) {
+  lua_Number seconds = luaL_optnumber(lua, 1, 0);
+
+  if (!(seconds >= 0 && seconds <= MAX_TASK_DELAY)) {
+    return luaL_error(lua, "Wait must be between 0 and %d seconds", MAX_TASK_DELAY);
+  }
+
+  game_t* game = lua_get_game(lua);
+  task_t* task = current_coroutine_task(lua, game);
+
+  task_wait(game, task, (uint64_t)(seconds * 1000));
+
+  return lua_yield(lua, 0);
+}
+
+/**
+ * API method which suspends the running coroutine task until an event of a given type
+ * is submitted, returning the event.  If a timeout in seconds is given and passes first
+ * nothing is returned.
+ *
+ * lua - Lua state instance
+ *
+ * local event = game.wait_event("arrive", 10)
+ *
+ * Returns by yielding or calls luaL_error on error
+**/
+static int lua_wait_event(lua_State* lua) {
+  const char* type = luaL_checkstring(lua, 1);
+  lua_Number seconds = luaL_optnumber(lua, 2, 0);
+
+  if (!(seconds >= 0 && seconds <= MAX_TASK_DELAY)) {
+    return luaL_error(lua, "Wait timeout must be between 0 and %d seconds", MAX_TASK_DELAY);
+  }
+
+  game_t* game = lua_get_game(lua);
+  task_t* task = current_coroutine_task(lua, game);
+
+  task_wait_event(game, task, type, (uint64_t)(seconds * 1000));
+
+  return lua_yield(lua, 0);
+}
+
+/**
+ * Retrieves the coroutine task currently running on a Lua thread.
+ *
+ * lua - the Lua thread calling the API
+ * game - game instance
+ *
+ * Returns the task or calls luaL_error if the thread isn't running a coroutine task
+**/
+static task_t* current_coroutine_task(lua_State* lua, game_t* game) {
+  task_t* task = game->current_task;
+
+  if (task == NULL || task->thread != lua) {
+    luaL_error(lua, "Only a task started with spawn_task can wait");
+  }
+
+  return task;
+}
+
 /**
  * API method that returns if an entity has a given component.
  *
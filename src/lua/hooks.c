@@ -10,12 +10,12 @@
 #include "mud/ecs/system.h"
 #include "mud/game.h"
 #include "mud/log.h"
-#include "mud/json.h"
 #include "mud/lua/common.h"
 #include "mud/lua/hooks.h"
 #include "mud/lua/hooks_api.h"
 #include "mud/lua/ref.h"
 #include "mud/lua/struct.h"
+#include "mud/network/output.h"
 #include "mud/player.h"
 #include "mud/task.h"
 #include "mud/util/muduuid.h"
@@ -31,6 +31,8 @@
 
 #define SYSTEM_EXECUTE_HOOK_FUNCTION "execute"
 
+#define EVENT_TYPE_FIELD "type"
+
 /**
  * Calls the startup hook if one has been registered.
  *
@@ -520,13 +522,15 @@ int lua_call_state_input_hook(lua_State* lua, player_t* player, lua_ref_t* state
  *   lua - The Lua state
  *   player - The player whom we're calling this state for
  *   state - The state we're calling
+ *   output - The buffered output about to be flushed to the player
  *
  * Returns 0 on success or returns luaL_error on error.
  **/
-int lua_call_state_output_hook(lua_State* lua, player_t* player, lua_ref_t* state, const char* output) {
+int lua_call_state_output_hook(lua_State* lua, player_t* player, lua_ref_t* state, const output_buffer_t* output) {
   assert(lua);
   assert(player);
   assert(state);
+  assert(output);
 
   lua_rawgeti(lua, LUA_REGISTRYINDEX, state->ref); // -1 = state module table
   lua_pushstring(lua, STATE_OUTPUT_HOOK_FUNCTION); // -2 = state module table, -1 = on_input method name
@@ -539,7 +543,15 @@ int lua_call_state_output_hook(lua_State* lua, player_t* player, lua_ref_t* stat
 
   lua_remove(lua, -2); // -1 = on_input method
   lua_push_player(lua, player); // -2 = on_input method, -1 = player table
-  lua_pushstring(lua, output); // -3 = on_input method, -2 = player table, -1 = output string
+
+  luaL_Buffer buffer;
+  luaL_buffinit(lua, &buffer);
+
+  for (output_segment_t* segment = output->head; segment != NULL; segment = segment->next) {
+    luaL_addlstring(&buffer, segment->data, segment->len);
+  }
+
+  luaL_pushresult(&buffer); // -3 = on_input method, -2 = player table, -1 = output string
 
   if (lua_pcall(lua, 2, 0, 0) != 0) {
     LOG(ERROR, "Error when calling state output hook [%s]", lua_tostring(lua, -1));
@@ -623,17 +635,12 @@ int lua_call_state_gmcp_hook(lua_State* lua, player_t* player, lua_ref_t* state,
   lua_pushstring(lua, topic); // -3 = on_gmcp method, -2 = player table, -1 = topic
 
   if (msg != NULL) {
-    json_node_t* node = NULL;
-
-    if ((node = json_deserialize(msg, strlen(msg))) == NULL) {
+    if (lua_push_json(lua, msg, strlen(msg)) == -1) { // -4 = on_gmcp method, -3 player table, -2 = topic, -1 msg
       LOG(ERROR, "Failed to deserialize GMCP JSON data [%s]", msg);
       lua_pop(lua, 3);
 
       return -1;
     }
-
-    lua_push_json_node(lua, node); // -4 = on_gmcp method, -3 player table, -2 = topic, -1 msg
-    json_free_json_node_t(node);
   }
 
   if (lua_pcall(lua, msg == NULL ? 2 : 3, 0, 0) != 0) {
@@ -701,3 +708,77 @@ int lua_call_task_execute_hook(lua_State* lua, task_t* task) {
 
   return 0;
 }
+
+/**
+ * Resumes the coroutine of a coroutine task until it next yields or finishes.  If an
+ * event woke the task it is passed to the coroutine, becoming the result of the call to
+ * wait_event which suspended it.
+ *
+ * lua - Lua state
+ * task - the coroutine task to be resumed
+ *
+ * Returns 1 if the coroutine yielded, 0 if it finished or -1 on error
+**/
+int lua_resume_task_hook(lua_State* lua, task_t* task) {
+  assert(lua);
+  assert(task);
+  assert(task->thread);
+
+  lua_State* thread = task->thread;
+  int args = 0;
+
+  if (task->event.state != NULL) {
+    lua_rawgeti(thread, LUA_REGISTRYINDEX, task->event.ref);
+    args = 1;
+  }
+
+#if LUA_VERSION_NUM >= 504
+  int results = 0;
+  int res = lua_resume(thread, lua, args, &results);
+#else
+  int res = lua_resume(thread, lua, args);
+#endif
+
+  if (res == LUA_YIELD) {
+    lua_settop(thread, 0);
+
+    return 1;
+  }
+
+  if (res != LUA_OK) {
+    LOG(ERROR, "Error when resuming task [%s] [%s]", task->name, lua_tostring(thread, -1));
+
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * Retrieves the type of a Lua event from the type field of its table.
+ *
+ * lua - Lua state
+ * event - reference to the event table
+ *
+ * Returns the type, valid for as long as the event is, or NULL if the event has no type
+**/
+const char* lua_get_event_type(lua_State* lua, lua_ref_t* event) {
+  assert(lua);
+  assert(event);
+
+  lua_rawgeti(lua, LUA_REGISTRYINDEX, event->ref); // -1 = event table
+
+  if (lua_type(lua, -1) != LUA_TTABLE) {
+    lua_pop(lua, 1);
+
+    return NULL;
+  }
+
+  lua_getfield(lua, -1, EVENT_TYPE_FIELD); // -2 = event table, -1 = type
+
+  const char* type = lua_type(lua, -1) == LUA_TSTRING ? lua_tostring(lua, -1) : NULL;
+
+  lua_pop(lua, 2);
+
+  return type;
+}
@@ -0,0 +1,281 @@
+#include <stdbool.h>
+
+#include "lauxlib.h"
+#include "lua.h"
+
+#include "mud/clock.h"
+#include "mud/data/linked_list.h"
+#include "mud/data/pool.h"
+#include "mud/ecs/system.h"
+#include "mud/game.h"
+#include "mud/lua/common.h"
+#include "mud/lua/metrics_api.h"
+#include "mud/network/client.h"
+#include "mud/network/network.h"
+#include "mud/player.h"
+#include "mud/tick.h"
+
+#define METRICS_LIB_NAME "metrics"
+
+static int lua_metrics_network(lua_State* lua);
+static int lua_metrics_connections(lua_State* lua);
+static int lua_metrics_ticks(lua_State* lua);
+static int lua_metrics_systems(lua_State* lua);
+
+static void push_integer_field(lua_State* lua, const char* name, lua_Integer value);
+static void push_timing_field(lua_State* lua, const char* name, const tick_timing_t* timing);
+
+static const struct luaL_Reg metrics_lib[] = {
+  { "network", lua_metrics_network },
+  { "connections", lua_metrics_connections },
+  { "ticks", lua_metrics_ticks },
+  { "systems", lua_metrics_systems },
+  { NULL, NULL }
+};
+
+/**
+ * Registers the metrics module with the Lua state.
+ *
+ * lua - The Lua state.
+ *
+ * Returns 0 on success
+ **/
+int lua_metrics_register_api(lua_State* lua) {
+  lua_push_api_table(lua);
+
+  lua_pushstring(lua, METRICS_LIB_NAME);
+  luaL_newlib(lua, metrics_lib);
+
+  lua_rawset(lua, -3);
+
+  return 0;
+}
+
+/**
+ * Lua API method which returns a table of aggregate connection metrics, including
+ * how much output is buffered and queued across all clients and what the
+ * backpressure policy has done to slow clients.
+ *
+ * lua - The Lua state.
+ *
+ * Returns 1, the metrics table
+ **/
+static int lua_metrics_network(lua_State* lua) {
+  game_t* game = lua_get_game(lua);
+  network_t* network = game->network;
+
+  size_t clients = 0;
+  size_t buffered = 0;
+  size_t pending = 0;
+  size_t max_pending = 0;
+  size_t throttled = 0;
+
+  it_t iter = list_begin(network->clients);
+  client_t* client = NULL;
+
+  while ((client = it_get(iter)) != NULL) {
+    clients++;
+    buffered += client->output.length;
+    pending += client->pending;
+    max_pending = client->pending > max_pending ? client->pending : max_pending;
+    throttled += client->throttled ? 1 : 0;
+
+    iter = it_next(iter);
+  }
+
+  lua_newtable(lua);
+
+  push_integer_field(lua, "clients", (lua_Integer)clients);
+  push_integer_field(lua, "connections", (lua_Integer)network->metrics.connections);
+  push_integer_field(lua, "disconnections", (lua_Integer)network->metrics.disconnections);
+  push_integer_field(lua, "buffered_bytes", (lua_Integer)buffered);
+  push_integer_field(lua, "pending_bytes", (lua_Integer)pending);
+  push_integer_field(lua, "max_pending_bytes", (lua_Integer)max_pending);
+  push_integer_field(lua, "pending_limit", (lua_Integer)network->pending_limit);
+  push_integer_field(lua, "throttled", (lua_Integer)throttled);
+  push_integer_field(lua, "dropped_bytes", (lua_Integer)network->metrics.dropped_bytes);
+  push_integer_field(lua, "coalesced_flushes", (lua_Integer)network->metrics.coalesced_flushes);
+  push_integer_field(lua, "slow_disconnects", (lua_Integer)network->metrics.slow_disconnects);
+  push_integer_field(lua, "idle_disconnects", (lua_Integer)network->metrics.idle_disconnects);
+  push_integer_field(lua, "tls_handshakes", (lua_Integer)network->metrics.tls_handshakes);
+  push_integer_field(lua, "tls_resumptions", (lua_Integer)network->metrics.tls_resumptions);
+  push_integer_field(lua, "client_slots", (lua_Integer)pool_capacity(network->client_pool));
+
+  lua_pushstring(lua, "backpressure_policy");
+  lua_pushstring(lua, network_backpressure_policy_name(network->backpressure_policy));
+  lua_rawset(lua, -3);
+
+  return 1;
+}
+
+/**
+ * Lua API method which returns an array with an entry per connected client giving
+ * its buffered and pending output and whether it is currently throttled.
+ *
+ * lua - The Lua state.
+ *
+ * Returns 1, the array of connection tables
+ **/
+static int lua_metrics_connections(lua_State* lua) {
+  game_t* game = lua_get_game(lua);
+  network_t* network = game->network;
+  uint64_t now = clock_now(network->loop);
+
+  lua_newtable(lua);
+
+  it_t iter = list_begin(network->clients);
+  client_t* client = NULL;
+  int count = 1;
+
+  while ((client = it_get(iter)) != NULL) {
+    lua_pushnumber(lua, count++);
+    lua_newtable(lua);
+
+    player_t* player = client->userdata;
+
+    if (player != NULL) {
+      lua_pushstring(lua, "uuid");
+      lua_pushstring(lua, uuid_str(&player->uuid));
+      lua_rawset(lua, -3);
+    }
+
+    push_integer_field(lua, "id", (lua_Integer)client->id);
+    push_integer_field(lua, "fd", client->fd);
+    push_integer_field(lua, "buffered_bytes", (lua_Integer)client->output.length);
+    push_integer_field(lua, "pending_bytes", (lua_Integer)client->pending);
+    push_integer_field(lua, "throttled_ms", client->throttled ? (lua_Integer)(now - client->throttled_since) : 0);
+
+    lua_pushstring(lua, "throttled");
+    lua_pushboolean(lua, client->throttled);
+    lua_rawset(lua, -3);
+
+    lua_settable(lua, -3);
+
+    iter = it_next(iter);
+  }
+
+  return 1;
+}
+
+/**
+ * Lua API method which returns a table of tick scheduler metrics, including how often
+ * ticks have overrun, what the tick policy has done about it and how long each phase
+ * of a tick takes.  Times are in microseconds.
+ *
+ * lua - The Lua state.
+ *
+ * Returns 1, the metrics table
+ **/
+static int lua_metrics_ticks(lua_State* lua) {
+  game_t* game = lua_get_game(lua);
+  tick_scheduler_t* scheduler = &game->scheduler;
+
+  lua_newtable(lua);
+
+  push_integer_field(lua, "interval_us", (lua_Integer)(scheduler->interval / 1000));
+  push_integer_field(lua, "ticks", (lua_Integer)scheduler->ticks);
+  push_integer_field(lua, "overruns", (lua_Integer)scheduler->overruns);
+  push_integer_field(lua, "skipped", (lua_Integer)scheduler->skipped);
+  push_integer_field(lua, "caught_up", (lua_Integer)scheduler->caught_up);
+  push_integer_field(lua, "stretched_us", (lua_Integer)(scheduler->stretched / 1000));
+  push_integer_field(lua, "lag_us", (lua_Integer)(scheduler->lag / 1000));
+
+  lua_pushstring(lua, "tick_policy");
+  lua_pushstring(lua, tick_policy_name(scheduler->policy));
+  lua_rawset(lua, -3);
+
+  push_timing_field(lua, "duration", &scheduler->duration);
+
+  lua_pushstring(lua, "phases");
+  lua_newtable(lua);
+
+  for (tick_phase_t phase = 0; phase < TICK_PHASES; phase++) {
+    push_timing_field(lua, tick_phase_name(phase), &scheduler->phases[phase]);
+  }
+
+  lua_rawset(lua, -3);
+
+  return 1;
+}
+
+/**
+ * Lua API method which returns an array with an entry per registered system giving
+ * how often it runs, its budget, how often it has gone over budget and been deferred
+ * and how long its runs take.  Times are in microseconds.
+ *
+ * lua - The Lua state.
+ *
+ * Returns 1, the array of system tables
+ **/
+static int lua_metrics_systems(lua_State* lua) {
+  game_t* game = lua_get_game(lua);
+
+  lua_newtable(lua);
+
+  it_t iter = list_begin(game->systems);
+  system_t* system = NULL;
+  int count = 1;
+
+  while ((system = it_get(iter)) != NULL) {
+    lua_pushnumber(lua, count++);
+    lua_newtable(lua);
+
+    lua_pushstring(lua, "name");
+    lua_pushstring(lua, system->name);
+    lua_rawset(lua, -3);
+
+    lua_pushstring(lua, "enabled");
+    lua_pushboolean(lua, system->enabled);
+    lua_rawset(lua, -3);
+
+    lua_pushstring(lua, "over_budget");
+    lua_pushboolean(lua, system->over_budget);
+    lua_rawset(lua, -3);
+
+    push_integer_field(lua, "every_ticks", (lua_Integer)system->interval);
+    push_integer_field(lua, "budget_us", (lua_Integer)(system->budget / 1000));
+    push_integer_field(lua, "next_tick", (lua_Integer)system->due);
+    push_integer_field(lua, "runs", (lua_Integer)system->runs);
+    push_integer_field(lua, "overruns", (lua_Integer)system->overruns);
+    push_integer_field(lua, "deferred", (lua_Integer)system->deferred);
+    push_timing_field(lua, "duration", &system->timing);
+
+    lua_settable(lua, -3);
+
+    iter = it_next(iter);
+  }
+
+  return 1;
+}
+
+/**
+ * Sets an integer field on the table at the top of the stack.
+ *
+ * lua - The Lua state.
+ * name - the name of the field
+ * value - the value of the field
+ **/
+static void push_integer_field(lua_State* lua, const char* name, lua_Integer value) {
+  lua_pushstring(lua, name);
+  lua_pushinteger(lua, value);
+  lua_rawset(lua, -3);
+}
+
+/**
+ * Sets a field on the table at the top of the stack to a table of the last, longest
+ * and average times from a timing, in microseconds.
+ *
+ * lua - The Lua state.
+ * name - the name of the field
+ * timing - the timing to push
+ **/
+static void push_timing_field(lua_State* lua, const char* name, const tick_timing_t* timing) {
+  lua_pushstring(lua, name);
+  lua_newtable(lua);
+
+  push_integer_field(lua, "last_us", (lua_Integer)(timing->last / 1000));
+  push_integer_field(lua, "max_us", (lua_Integer)(timing->max / 1000));
+  push_integer_field(lua, "average_us", timing->count > 0 ? (lua_Integer)(timing->total / timing->count / 1000) : 0);
+
+  lua_rawset(lua, -3);
+}
@@ -16,6 +16,7 @@
 #include "mud/lua/common.h"
 #include "mud/lua/player_api.h"
 #include "mud/lua/struct.h"
+#include "mud/network/capabilities.h"
 #include "mud/network/client.h"
 #include "mud/player.h"
 #include "mud/util/muduuid.h"
@@ -33,12 +34,20 @@ static int lua_send_to_player(lua_State* lua);
 static int lua_disconnect(lua_State* lua);
 static int lua_disable_echo(lua_State* lua);
 static int lua_enable_echo(lua_State* lua);
+static int lua_set_protocol_trace(lua_State* lua);
+static int lua_get_capabilities(lua_State* lua);
 static int lua_send_gmcp(lua_State* lua);
+static int lua_send_gmcp_latest(lua_State* lua);
 static int lua_add_command_group(lua_State* lua);
 static int lua_remove_command_group(lua_State* lua);
 static int lua_get_commands(lua_State* lua);
 static int lua_execute_command(lua_State* lua);
 
+static int send_gmcp(lua_State* lua, bool coalesced);
+static void push_integer_field(lua_State* lua, const char* name, lua_Integer value);
+static void push_string_field(lua_State* lua, const char* name, const char* value);
+static void push_boolean_field(lua_State* lua, const char* name, bool value);
+
 static const struct luaL_Reg player_lib[] = {
   { "authenticate", lua_authenticate },
   { "narrate", lua_narrate },
@@ -51,7 +60,10 @@ static const struct luaL_Reg player_lib[] = {
   { "disconnect", lua_disconnect },
   { "disable_echo", lua_disable_echo },
   { "enable_echo", lua_enable_echo },
+  { "set_protocol_trace", lua_set_protocol_trace },
+  { "capabilities", lua_get_capabilities },
   { "send_gmcp", lua_send_gmcp },
+  { "send_gmcp_latest", lua_send_gmcp_latest },
   { "add_command_group", lua_add_command_group },
   { "remove_command_group", lua_remove_command_group },
   { "get_commands", lua_get_commands },
@@ -306,7 +318,11 @@ static int lua_disconnect(lua_State* lua) {
   player_t* player = lua_to_player(lua, -1);
   lua_pop(lua, 1);
 
-  player->client->hungup = 1;
+  client_t* client = player_get_client(player);
+
+  if (client != NULL) {
+    network_client_hang_up(client);
+  }
 
   return 0;
 }
@@ -349,6 +365,73 @@ static int lua_enable_echo(lua_State* lua) {
   return 0;
 }
 
+/**
+ * API method to switch protocol tracing on or off for the player's connection.
+ *
+ * lua - The current Lua state
+ *
+ * player.set_protocol_trace(p, enabled)
+ *
+ * Returns 0 on success or calls luaL_error on failure
+**/
+static int lua_set_protocol_trace(lua_State* lua) {
+  luaL_checktype(lua, -1, LUA_TBOOLEAN);
+  luaL_checktype(lua, -2, LUA_TTABLE);
+
+  bool trace = lua_toboolean(lua, -1);
+  player_t* player = lua_to_player(lua, -2);
+
+  lua_pop(lua, 2);
+
+  player_set_protocol_trace(player, trace);
+
+  return 0;
+}
+
+/**
+ * API method which returns what the player's client has negotiated and reported about
+ * itself, so content can be rendered for its real width and colour depth.
+ *
+ * lua - The current Lua state
+ *
+ * player.capabilities(p)
+ *
+ * Returns 1, the capabilities table or nil if the player has disconnected, or calls
+ * luaL_error on failure
+**/
+static int lua_get_capabilities(lua_State* lua) {
+  luaL_checktype(lua, -1, LUA_TTABLE);
+
+  player_t* player = lua_to_player(lua, -1);
+
+  lua_pop(lua, 1);
+
+  const client_capabilities_t* capabilities = player_get_capabilities(player);
+
+  if (capabilities == NULL) {
+    lua_pushnil(lua);
+
+    return 1;
+  }
+
+  lua_newtable(lua);
+
+  push_integer_field(lua, "flags", (lua_Integer)capabilities->flags);
+  push_integer_field(lua, "width", capabilities->width);
+  push_integer_field(lua, "height", capabilities->height);
+  push_integer_field(lua, "colours", (lua_Integer)network_capabilities_colours(capabilities));
+  push_string_field(lua, "client", capabilities->client_name);
+  push_string_field(lua, "terminal", capabilities->terminal);
+  push_string_field(lua, "charset", capabilities->charset);
+  push_boolean_field(lua, "utf8", capabilities->flags & CAPABILITY_UTF8);
+  push_boolean_field(lua, "screen_reader", capabilities->flags & CAPABILITY_SCREEN_READER);
+  push_boolean_field(lua, "naws", capabilities->flags & CAPABILITY_NAWS);
+  push_boolean_field(lua, "ttype", capabilities->flags & CAPABILITY_TTYPE);
+  push_boolean_field(lua, "charset_negotiated", capabilities->flags & CAPABILITY_CHARSET);
+
+  return 1;
+}
+
 /**
  * API method to send a GMCP message to a player.
  * lua - The current Lua state
@@ -358,6 +441,30 @@ static int lua_enable_echo(lua_State* lua) {
  * Returns 0 or calls luaL_error on error
 **/
 static int lua_send_gmcp(lua_State* lua) {
+  return send_gmcp(lua, false);
+}
+
+/**
+ * API method to send a GMCP message to a player when their output is next flushed,
+ * replacing any message for the same topic which hasn't been sent yet.
+ * lua - The current Lua state
+ *
+ * player.send_gmcp_latest(p, "topic", "msg")
+ *
+ * Returns 0 or calls luaL_error on error
+**/
+static int lua_send_gmcp_latest(lua_State* lua) {
+  return send_gmcp(lua, true);
+}
+
+/**
+ * Sends a GMCP message from the arguments of send_gmcp or send_gmcp_latest.
+ * lua - The current Lua state
+ * coalesced - whether only the latest message for the topic should be sent
+ *
+ * Returns 0 or calls luaL_error on error
+**/
+static int send_gmcp(lua_State* lua, bool coalesced) {
   char* msg = NULL;
   char* topic = NULL;
   player_t* player = NULL;
@@ -381,7 +488,11 @@ static int lua_send_gmcp(lua_State* lua) {
     return luaL_error(lua, "Invalid parameters to send_gmcp");
   }  
 
-  send_gmcp_to_player(player, topic, msg);
+  if (coalesced) {
+    send_coalesced_gmcp_to_player(player, topic, msg);
+  } else {
+    send_gmcp_to_player(player, topic, msg);
+  }
 
   free(topic);
 
@@ -541,3 +652,42 @@ static int lua_execute_command(lua_State* lua) {
 
   return 0;
 }
+
+/**
+ * Sets an integer field on the table at the top of the stack.
+ *
+ * lua - The current Lua state
+ * name - the name of the field
+ * value - the value of the field
+**/
+static void push_integer_field(lua_State* lua, const char* name, lua_Integer value) {
+  lua_pushstring(lua, name);
+  lua_pushinteger(lua, value);
+  lua_rawset(lua, -3);
+}
+
+/**
+ * Sets a string field on the table at the top of the stack.
+ *
+ * lua - The current Lua state
+ * name - the name of the field
+ * value - the value of the field
+**/
+static void push_string_field(lua_State* lua, const char* name, const char* value) {
+  lua_pushstring(lua, name);
+  lua_pushstring(lua, value);
+  lua_rawset(lua, -3);
+}
+
+/**
+ * Sets a boolean field on the table at the top of the stack.
+ *
+ * lua - The current Lua state
+ * name - the name of the field
+ * value - the value of the field
+**/
+static void push_boolean_field(lua_State* lua, const char* name, bool value) {
+  lua_pushstring(lua, name);
+  lua_pushboolean(lua, value);
+  lua_rawset(lua, -3);
+}
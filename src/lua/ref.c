@@ -24,10 +24,12 @@ lua_ref_t* lua_new_lua_ref_t(lua_State* state, int ref) {
 }
 
 /**
- * Initialises an instance of lua_ref_t.
+ * Initialises an instance of lua_ref_t.  References are always associated with the main
+ * thread of the state, so a reference made from within a coroutine can still be released
+ * once the coroutine has been collected.
  *
  * reference - the lua_ref_t instance to be initialised
- * state - the state that the reference is associated with
+ * state - the state, or a thread of the state, that the reference is associated with
  * ref - the actual luaL_ref reference
  *
  * Returns the newly initialised instance of lua_ref_t*
@@ -36,12 +38,33 @@ lua_ref_t* lua_init_lua_ref_t(lua_ref_t* reference, lua_State* state, int ref) {
   assert(reference);
   assert(state);
 
-  reference->state = state;
+  lua_rawgeti(state, LUA_REGISTRYINDEX, LUA_RIDX_MAINTHREAD);
+  reference->state = lua_tothread(state, -1);
+  lua_pop(state, 1);
+
   reference->ref = ref;
 
   return reference;
 }
 
+/**
+ * Initialises an instance of lua_ref_t with a new reference to the same value as
+ * another.  Each reference must be released separately.
+ *
+ * reference - the lua_ref_t instance to be initialised
+ * ref - the lua_ref_t referring to the value
+ *
+ * Returns the newly initialised instance of lua_ref_t*
+**/
+lua_ref_t* lua_dup_lua_ref_t(lua_ref_t* reference, lua_ref_t* ref) {
+  assert(reference);
+  assert(ref);
+
+  lua_rawgeti(ref->state, LUA_REGISTRYINDEX, ref->ref);
+
+  return lua_init_lua_ref_t(reference, ref->state, luaL_ref(ref->state, LUA_REGISTRYINDEX));
+}
+
 /**
  * Releases the reference of an instance of lua_ref_t
  *
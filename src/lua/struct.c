@@ -5,10 +5,12 @@
 #include "lua.h"
 
 #include "mud/action.h"
+#include "mud/clock.h"
 #include "mud/command.h"
 #include "mud/data/linked_list.h"
 #include "mud/ecs/entity.h"
 #include "mud/ecs/system.h"
+#include "mud/game.h"
 #include "mud/json.h"
 #include "mud/log.h"
 #include "mud/lua/common.h"
@@ -35,13 +37,44 @@
 
 #define SYSTEM_NAME_FIELD "name"
 #define SYSTEM_ENABLED_FIELD "enabled"
+#define SYSTEM_INTERVAL_FIELD "every_ticks"
+#define SYSTEM_BUDGET_FIELD "budget_ms"
 
 #define TASK_NAME_FIELD "name"
 #define TASK_EXECUTE_AT "execute_at"
+#define TASK_INTERVAL_FIELD "interval"
 
 #define JSON_NODE_VALUE_FIELD "node"
 
+typedef struct lua_json_builder {
+  lua_State* lua;
+  int depth;
+  lua_Integer index[JSON_MAX_DEPTH + 1];
+} lua_json_builder_t;
+
 static void lua_push_json_value(lua_State* lua, json_node_t* node);
+static int lua_json_added(lua_json_builder_t* builder);
+static int lua_json_open(lua_json_builder_t* builder, lua_Integer index);
+static int lua_json_close(void* context);
+static int lua_json_object_start(void* context);
+static int lua_json_array_start(void* context);
+static int lua_json_key(void* context, const char* key, size_t len);
+static int lua_json_string(void* context, const char* str, size_t len);
+static int lua_json_number(void* context, double number);
+static int lua_json_boolean(void* context, bool boolean);
+static int lua_json_null(void* context);
+
+static const json_visitor_t lua_json_visitor = {
+  lua_json_object_start,
+  lua_json_close,
+  lua_json_array_start,
+  lua_json_close,
+  lua_json_key,
+  lua_json_string,
+  lua_json_number,
+  lua_json_boolean,
+  lua_json_null
+};
 
 /**
  * Converts an entity structure to a Lua table and pushes iter on top of the stack.
@@ -257,6 +290,14 @@ void lua_push_system(lua_State* lua, system_t* system) {
   lua_pushstring(lua, SYSTEM_ENABLED_FIELD);
   lua_pushboolean(lua, system->enabled);
   lua_rawset(lua, -3);
+
+  lua_pushstring(lua, SYSTEM_INTERVAL_FIELD);
+  lua_pushinteger(lua, system->interval);
+  lua_rawset(lua, -3);
+
+  lua_pushstring(lua, SYSTEM_BUDGET_FIELD);
+  lua_pushnumber(lua, (lua_Number)system->budget / 1000000);
+  lua_rawset(lua, -3);
 }
 
 /**
@@ -289,8 +330,15 @@ void lua_push_task(lua_State* lua, task_t* task) {
   lua_pushstring(lua, task->name);
   lua_rawset(lua, -3);
 
+  uint64_t now = clock_now(task->game->loop);
+  uint64_t remaining = task->execute_at > now ? task->execute_at - now : 0;
+
   lua_pushstring(lua, TASK_EXECUTE_AT);
-  lua_pushnumber(lua, task->execute_in);
+  lua_pushnumber(lua, (lua_Number)clock_time() + (lua_Number)remaining / 1000);
+  lua_rawset(lua, -3);
+
+  lua_pushstring(lua, TASK_INTERVAL_FIELD);
+  lua_pushnumber(lua, (lua_Number)task->interval / 1000);
   lua_rawset(lua, -3);
 }
 
@@ -376,6 +424,179 @@ void lua_push_json_value(lua_State* lua, json_node_t* node) {
   }
 }
 
+/**
+ * Decodes JSON straight into a Lua table and pushes it on top of the stack, in the same
+ * shape as lua_push_json_node but without building an intermediate json_node_t tree.
+ *
+ * lua - Lua state instance
+ * json - the JSON to be decoded
+ * len - length of the JSON
+ *
+ * Returns 0 on success or -1 on failure, in which case nothing is pushed
+ **/
+int lua_push_json(lua_State* lua, const char* json, size_t len) {
+  assert(lua);
+  assert(json);
+
+  int top = lua_gettop(lua);
+  lua_json_builder_t builder;
+
+  builder.lua = lua;
+  builder.depth = 0;
+
+  if (!lua_checkstack(lua, 4)) {
+    LOG(ERROR, "Unable to grow Lua stack to decode JSON");
+
+    return -1;
+  }
+
+  lua_newtable(lua);
+
+  lua_pushstring(lua, TYPE_FIELD);
+  lua_pushnumber(lua, STRUCT_JSON_NODE);
+  lua_rawset(lua, -3);
+
+  lua_pushstring(lua, JSON_NODE_VALUE_FIELD);
+
+  if (json_parse(json, len, &lua_json_visitor, &builder) == -1) {
+    lua_settop(lua, top);
+
+    return -1;
+  }
+
+  lua_rawset(lua, -3);
+
+  return 0;
+}
+
+/**
+ * Module internal method called once a value has been pushed, which stores it in the
+ * enclosing table if there is one.
+ *
+ * builder - the builder state
+ *
+ * Returns 0
+**/
+static int lua_json_added(lua_json_builder_t* builder) {
+  assert(builder);
+
+  if (builder->depth == 0) {
+    return 0;
+  }
+
+  if (builder->index[builder->depth] < 0) {
+    lua_rawset(builder->lua, -3);
+  } else {
+    lua_rawseti(builder->lua, -2, ++builder->index[builder->depth]);
+  }
+
+  return 0;
+}
+
+/**
+ * Module internal method to push a new table for an object or array.
+ *
+ * builder - the builder state
+ * index - -1 for an object or 0 for an array
+ *
+ * Returns 0 on success or -1 on failure
+**/
+static int lua_json_open(lua_json_builder_t* builder, lua_Integer index) {
+  assert(builder);
+
+  if (!lua_checkstack(builder->lua, 3)) {
+    LOG(ERROR, "Unable to grow Lua stack to decode JSON");
+
+    return -1;
+  }
+
+  lua_newtable(builder->lua);
+  builder->index[++builder->depth] = index;
+
+  return 0;
+}
+
+/**
+ * Module internal callback for the end of an object or array.
+**/
+static int lua_json_close(void* context) {
+  lua_json_builder_t* builder = context;
+
+  builder->depth--;
+
+  return lua_json_added(builder);
+}
+
+/**
+ * Module internal callback for the start of an object.
+**/
+static int lua_json_object_start(void* context) {
+  return lua_json_open(context, -1);
+}
+
+/**
+ * Module internal callback for the start of an array.
+**/
+static int lua_json_array_start(void* context) {
+  return lua_json_open(context, 0);
+}
+
+/**
+ * Module internal callback for an object key, which is pushed ready for its value.
+**/
+static int lua_json_key(void* context, const char* key, size_t len) {
+  lua_json_builder_t* builder = context;
+
+  lua_pushlstring(builder->lua, key, len);
+
+  return 0;
+}
+
+/**
+ * Module internal callback for a string value.
+**/
+static int lua_json_string(void* context, const char* str, size_t len) {
+  lua_json_builder_t* builder = context;
+
+  lua_pushlstring(builder->lua, str, len);
+
+  return lua_json_added(builder);
+}
+
+/**
+ * Module internal callback for a number value.
+**/
+static int lua_json_number(void* context, double number) {
+  lua_json_builder_t* builder = context;
+
+  lua_pushnumber(builder->lua, number);
+
+  return lua_json_added(builder);
+}
+
+/**
+ * Module internal callback for a boolean value.
+**/
+static int lua_json_boolean(void* context, bool boolean) {
+  lua_json_builder_t* builder = context;
+
+  lua_pushboolean(builder->lua, boolean);
+
+  return lua_json_added(builder);
+}
+
+/**
+ * Module internal callback for a null value, which is pushed as a NULL light userdata
+ * to match lua_push_json_node.
+**/
+static int lua_json_null(void* context) {
+  lua_json_builder_t* builder = context;
+
+  lua_pushlightuserdata(builder->lua, NULL);
+
+  return lua_json_added(builder);
+}
+
 /**
  * Extracts the pointer to an entity_t from the table on top of the stack.
  *
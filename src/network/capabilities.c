@@ -0,0 +1,130 @@
+#include <assert.h>
+#include <ctype.h>
+#include <string.h>
+
+#include "mud/network/capabilities.h"
+
+typedef struct terminal_profile {
+  const char* match;
+  uint32_t flags;
+} terminal_profile_t;
+
+// Checked in order against the upper cased terminal type, first match wins
+static const terminal_profile_t terminal_profiles[] = {
+  { "TRUECOLOR", CAPABILITY_ANSI | CAPABILITY_256_COLOURS | CAPABILITY_TRUECOLOUR },
+  { "-DIRECT", CAPABILITY_ANSI | CAPABILITY_256_COLOURS | CAPABILITY_TRUECOLOUR },
+  { "256COLOR", CAPABILITY_ANSI | CAPABILITY_256_COLOURS },
+  { "VT100", CAPABILITY_ANSI | CAPABILITY_VT100 },
+  { "XTERM", CAPABILITY_ANSI | CAPABILITY_VT100 },
+  { "ANSI", CAPABILITY_ANSI },
+  { "SCREEN", CAPABILITY_ANSI | CAPABILITY_VT100 },
+  { "TMUX", CAPABILITY_ANSI | CAPABILITY_VT100 },
+  { "RXVT", CAPABILITY_ANSI | CAPABILITY_VT100 },
+  { "LINUX", CAPABILITY_ANSI },
+  { NULL, 0 }
+};
+
+/**
+ * Initialises a capability profile with nothing negotiated and the default window size.
+ *
+ * capabilities - the client_capabilities_t to initialise
+ **/
+void network_init_capabilities(client_capabilities_t* capabilities) {
+  assert(capabilities);
+
+  memset(capabilities, 0, sizeof(client_capabilities_t));
+
+  capabilities->width = DEFAULT_CLIENT_WIDTH;
+  capabilities->height = DEFAULT_CLIENT_HEIGHT;
+}
+
+/**
+ * Copies a name sent by the client into one of the profile's fixed length names.  Names
+ * are truncated to fit and anything unprintable is replaced so names are always safe
+ * to log or hand to Lua.
+ *
+ * dest - the name to set, CAPABILITY_NAME_LENGTH bytes long
+ * name - the name sent by the client, not null terminated
+ * len - the length of the name
+ **/
+void network_capabilities_set_name(char* dest, const char* name, size_t len) {
+  assert(dest);
+  assert(name);
+
+  if (len > CAPABILITY_NAME_LENGTH - 1) {
+    len = CAPABILITY_NAME_LENGTH - 1;
+  }
+
+  for (size_t i = 0; i < len; i++) {
+    dest[i] = isprint((unsigned char)name[i]) ? name[i] : '?';
+  }
+
+  dest[len] = '\0';
+}
+
+/**
+ * Sets the client's terminal type and adds whatever the terminal type implies it
+ * supports to the profile.
+ *
+ * capabilities - the client_capabilities_t to update
+ * terminal - the terminal type sent by the client, not null terminated
+ * len - the length of the terminal type
+ **/
+void network_capabilities_set_terminal(client_capabilities_t* capabilities, const char* terminal, size_t len) {
+  assert(capabilities);
+  assert(terminal);
+
+  network_capabilities_set_name(capabilities->terminal, terminal, len);
+
+  char upper[CAPABILITY_NAME_LENGTH];
+
+  for (size_t i = 0; i < sizeof(upper); i++) {
+    upper[i] = (char)toupper((unsigned char)capabilities->terminal[i]);
+  }
+
+  for (const terminal_profile_t* profile = terminal_profiles; profile->match != NULL; profile++) {
+    if (strstr(upper, profile->match) != NULL) {
+      capabilities->flags |= profile->flags;
+
+      return;
+    }
+  }
+}
+
+/**
+ * Replaces whatever was inferred from terminal types with the flags the client reported
+ * through MTTS, which is what the client says it actually supports.
+ *
+ * capabilities - the client_capabilities_t to update
+ * mtts - the MTTS bitvector sent by the client
+ **/
+void network_capabilities_set_mtts(client_capabilities_t* capabilities, uint32_t mtts) {
+  assert(capabilities);
+
+  capabilities->flags = (capabilities->flags & ~CAPABILITY_MTTS_MASK) | (mtts & CAPABILITY_MTTS_MASK);
+}
+
+/**
+ * Determines the colour depth content should be rendered at for the client.
+ *
+ * capabilities - the client_capabilities_t to check
+ *
+ * Returns 16777216, 256, 16 or 0 if the client supports no colour at all
+ **/
+unsigned int network_capabilities_colours(const client_capabilities_t* capabilities) {
+  assert(capabilities);
+
+  if (capabilities->flags & CAPABILITY_TRUECOLOUR) {
+    return 16777216;
+  }
+
+  if (capabilities->flags & CAPABILITY_256_COLOURS) {
+    return 256;
+  }
+
+  if (capabilities->flags & CAPABILITY_ANSI) {
+    return 16;
+  }
+
+  return 0;
+}
@@ -0,0 +1,258 @@
+#include <arpa/telnet.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "mud/log.h"
+#include "mud/network/capabilities.h"
+#include "mud/network/charset.h"
+#include "mud/network/client.h"
+#include "mud/network/protocol.h"
+
+static void deallocate_charset_t(void* value);
+static void initialise_charset(void* extension, telnet_t* telnet, client_t* client);
+static telnet_option_t* get_option(void* extension, int option);
+static telnet_config_t* get_config(void* extension, int option);
+static void process_se(void* extension, telnet_t* telnet, client_t* client, int option, const char* data, size_t len);
+static void process_negotiated(void* extension, telnet_t* telnet, client_t* client, int option, bool local, bool enabled);
+
+static void accept_charset(client_t* client, const char* name, size_t len);
+static void process_request(client_t* client, const char* data, size_t len);
+static int send_charset(client_t* client, unsigned char command, const char* data, size_t len);
+
+static telnet_config_t charset_config = {TELOPT_CHARSET, false, true};
+
+/**
+ * Creates a new telnet_extension_t for the CHARSET extension, which agrees on a charset
+ * with the client, preferring UTF-8, and records it in its capability profile.
+ *
+ * pools - the protocol_pools_t to allocate from, or NULL to allocate from the heap
+ *
+ * Returns the new telnet_extension_t instance or NULL on failure.
+**/
+telnet_extension_t* network_new_charset_telnet_extension(protocol_pools_t* pools) {
+  telnet_extension_t* extension = network_new_telnet_extension(pools, sizeof(charset_t));
+
+  if (extension == NULL) {
+    return NULL;
+  }
+
+  extension->deallocate = deallocate_charset_t;
+  extension->initialise = initialise_charset;
+  extension->get_option = get_option;
+  extension->get_config = get_config;
+  extension->subnegotiation = process_se;
+  extension->negotiated = process_negotiated;
+  extension->encode = NULL;
+  extension->decode = NULL;
+  extension->flush = NULL;
+  extension->next = NULL;
+
+  return extension;
+}
+
+/**
+ * Deallocates a void pointer to charset_t
+ *
+ * value - void pointer to charset_t
+**/
+void deallocate_charset_t(void* value) {
+  assert(value);
+
+  network_protocol_free(value);
+}
+
+/**
+ * Initialises CHARSET by sending a WILL to the client
+ *
+ * extension - void pointer to the extension (should be charset_t)
+ * telnet - the telnet_t instance for the client
+ * client - the client_t instance of the client
+**/
+void initialise_charset(void* extension, telnet_t* telnet, client_t* client) {
+  assert(extension);
+  assert(telnet);
+  assert(client);
+
+  network_telnet_send_will(telnet, client, TELOPT_CHARSET);
+}
+
+/**
+ * Retrieves telnet options relevant to the CHARSET extension
+ *
+ * extension - void pointer to the charset_t instance
+ * option - the option number of the option we're looking for
+ *
+ * Returns the option if CHARSET or NULL.
+**/
+telnet_option_t* get_option(void* extension, int option) {
+  assert(extension);
+
+  charset_t* charset = extension;
+
+  if (option == TELOPT_CHARSET) {
+    return &charset->charset;
+  }
+
+  return NULL;
+}
+
+/**
+ * Retrieves config options relevant to the CHARSET extension
+ *
+ * extension - void pointer to the charset_t instance
+ * option - the option number of the option we're looking for
+ *
+ * Returns the option config or NULL.
+**/
+telnet_config_t* get_config(void* extension, int option) {
+  assert(extension);
+
+  if (option == TELOPT_CHARSET) {
+    return &charset_config;
+  }
+
+  return NULL;
+}
+
+/**
+ * Processes the client's answer to the charsets we offered, or charsets the client is
+ * offering us.
+ *
+ * extension - void pointer to charset_t
+ * telnet - telnet_t instance
+ * client - client_t instance representing the remote client
+ * option - the option negotiated for
+ * data - the data for the subnegotiation
+ * len - the length of the data
+**/
+void process_se(void* extension, telnet_t* telnet, client_t* client, int option, const char* data, size_t len) {
+  assert(extension);
+  assert(telnet);
+  assert(client);
+  assert(data);
+
+  if (option != TELOPT_CHARSET || len < 1) {
+    return;
+  }
+
+  switch ((unsigned char)data[0]) {
+    case CHARSET_ACCEPTED:
+      accept_charset(client, data + 1, len - 1);
+      break;
+
+    case CHARSET_REJECTED:
+      LOG(INFO, "Client [%d] rejected the charsets offered", client->fd);
+      break;
+
+    case CHARSET_REQUEST:
+      process_request(client, data + 1, len - 1);
+      break;
+  }
+}
+
+/**
+ * Offers the client our charsets once it agrees to CHARSET.
+ *
+ * extension - void pointer to charset_t
+ * telnet - telnet_t instance
+ * client - client_t instance representing the remote client
+ * option - the option negotiated
+ * local - whether the option is ours rather than the client's
+ * enabled - whether the option is now enabled
+**/
+void process_negotiated(void* extension, telnet_t* telnet, client_t* client, int option, bool local, bool enabled) {
+  assert(extension);
+  assert(telnet);
+  assert(client);
+
+  if (option != TELOPT_CHARSET || !local || !enabled) {
+    return;
+  }
+
+  if (send_charset(client, CHARSET_REQUEST, CHARSET_OFFERED, strlen(CHARSET_OFFERED)) == -1) {
+    LOG(ERROR, "Failed to send CHARSET request to client [%d]", client->fd);
+  }
+}
+
+/**
+ * Records the charset agreed with the client.
+ *
+ * client - client_t instance representing the remote client
+ * name - the charset, not null terminated
+ * len - the length of the charset
+**/
+void accept_charset(client_t* client, const char* name, size_t len) {
+  client_capabilities_t* capabilities = &client->capabilities;
+
+  network_capabilities_set_name(capabilities->charset, name, len);
+  capabilities->flags |= CAPABILITY_CHARSET;
+
+  if (strcasecmp(capabilities->charset, "UTF-8") == 0) {
+    capabilities->flags |= CAPABILITY_UTF8;
+  } else {
+    capabilities->flags &= ~CAPABILITY_UTF8;
+  }
+
+  LOG(INFO, "Client [%d] is using charset [%s]", client->fd, capabilities->charset);
+}
+
+/**
+ * Answers charsets offered by the client.  The first byte is the separator used
+ * between them and UTF-8 is the only charset accepted.
+ *
+ * client - client_t instance representing the remote client
+ * data - the separator followed by the charsets offered
+ * len - the length of the data
+**/
+void process_request(client_t* client, const char* data, size_t len) {
+  static const char utf8[] = "UTF-8";
+
+  if (len > 1) {
+    char separator = data[0];
+    const char* name = data + 1;
+    const char* end = data + len;
+
+    while (name < end) {
+      const char* next = memchr(name, separator, (size_t)(end - name));
+      size_t name_len = next != NULL ? (size_t)(next - name) : (size_t)(end - name);
+
+      if (name_len == sizeof(utf8) - 1 && strncasecmp(name, utf8, name_len) == 0) {
+        send_charset(client, CHARSET_ACCEPTED, utf8, sizeof(utf8) - 1);
+        accept_charset(client, utf8, sizeof(utf8) - 1);
+
+        return;
+      }
+
+      name += name_len + 1;
+    }
+  }
+
+  send_charset(client, CHARSET_REJECTED, NULL, 0);
+}
+
+/**
+ * Sends an IAC SB CHARSET command to the client, followed by its data.
+ *
+ * client - the client to send to
+ * command - the CHARSET command
+ * data - the data following the command, may be NULL if len is 0
+ * len - the length of the data
+ *
+ * Returns 0 on success or -1 on failure
+**/
+int send_charset(client_t* client, unsigned char command, const char* data, size_t len) {
+  char begin[] = { (char) IAC, (char) SB, (char) TELOPT_CHARSET, (char) command };
+  char end[] = { (char) IAC, (char) SE };
+
+  if (send_essential_to_client(client, begin, sizeof(begin)) == -1) {
+    return -1;
+  }
+
+  if (len > 0 && send_essential_to_client(client, data, len) == -1) {
+    return -1;
+  }
+
+  return send_essential_to_client(client, end, sizeof(end));
+}
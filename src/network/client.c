@@ -1,7 +1,9 @@
 #include "bsd/string.h"
 
+#include "mud/clock.h"
 #include "mud/log.h"
 #include "mud/network/client.h"
+#include "mud/network/network.h"
 #include "mud/util/mudstring.h"
 
 #include <assert.h>
@@ -9,34 +11,58 @@
 #include <string.h>
 #include <uv.h>
 
-typedef struct {
-  uv_write_t req;
-  char data[];
-} write_req_t;
-
+static bool apply_send_policy(client_t* client, size_t len);
+static int append_to_output(client_t* client, const char* data, size_t len);
+static int write_client_output(client_t* client, uv_buf_t* bufs, size_t nbufs);
 static void on_write_complete(uv_write_t* req, int status);
 
 /**
- * Allocates memory for and initialises a new client_t struct.
+ * Acquires a client_t struct from the client pool and initialises it.  The client's
+ * ID is tagged with the generation of its pool slot so references to a client which
+ * has since disconnected don't resolve to whichever client reuses the slot.
  *
- * Returns the allocated client_t struct.
+ * Returns the initialised client_t struct or NULL on failure.
  **/
-client_t* create_client_t(void) {
-  client_t* client = calloc(1, sizeof *client);
+client_t* create_client_t(pool_t* pool) {
+  assert(pool);
+
+  client_t* client = pool_acquire(pool);
 
+  if (client == NULL) {
+    return NULL;
+  }
+
+  client->id = pool_id(client);
   client->fd = 0;
   client->hungup = 0;
-  client->last_active = time(NULL);
+  client->connected = false;
+  client->last_active = 0;
+  client->authenticated = false;
+  client->trace = false;
   client->userdata = NULL;
   client->protocol = NULL;
+  memset(client->protocols, 0, sizeof(client->protocols));
   client->network = NULL;
-  client->output_length = 0;
+  client->pending = 0;
+  client->throttled = false;
+  client->held = false;
+  client->throttled_since = 0;
+  client->flush_queued = false;
+  client->flush_queued_at = 0;
+  client->deferred = false;
+  client->dirty = false;
+  client->dirty_prev = NULL;
+  client->dirty_next = NULL;
+
+  network_init_capabilities(&client->capabilities);
+  network_init_input_buffer(&client->input, CLIENT_BUFFER_SIZE);
+  network_init_output_buffer(&client->output, CLIENT_OUTPUT_LIMIT);
 
   return client;
 }
 
 /**
- * Frees a client_t struct.
+ * Releases a client_t struct back to the pool it was acquired from.
  **/
 void free_client_t(client_t* client) {
   assert(client);
@@ -45,11 +71,17 @@ void free_client_t(client_t* client) {
     network_deallocate_protocol_chain(client->protocol);
   }
 
-  free(client);
+  network_clear_output_buffer(&client->output);
+  network_release_input_buffer(&client->input);
+
+  pool_release(client);
 }
 
 /**
  * Attempts to write output to the remote client represented by the client parameter.
+ * Output is appended to the client's segmented output buffer which grows as required
+ * up to its high-water mark.  While the client is throttled for having too much output
+ * queued the network's backpressure policy may drop or coalesce the output instead.
  *
  * Returns 0 on success or -1 on failure.
  **/
@@ -57,29 +89,41 @@ int send_to_client(client_t* client, const char* data, size_t len) {
   assert(client);
   assert(data);
 
-  if ((client->output_length + len) > CLIENT_BUFFER_LENGTH) {
-    LOG(ERROR, "Send to client for fd [%d] would fail as data is too big to append to buffer", client->fd);
-
-    return -1;
+  if (client->throttled && !apply_send_policy(client, len)) {
+    return 0;
   }
 
-  const char* current = data;
-  char* dest = client->output + client->output_length;
-  size_t count = len;
+  return append_to_output(client, data, len);
+}
+
+/**
+ * Writes output which must reach the client regardless of backpressure, such as
+ * protocol negotiation.  It is never dropped or coalesced away by the backpressure
+ * policy.
+ *
+ * Returns 0 on success or -1 on failure.
+ **/
+int send_essential_to_client(client_t* client, const char* data, size_t len) {
+  assert(client);
+  assert(data);
 
-  while (count > 0) {
-    *dest++ = *current++;
-    count--;
+  if (append_to_output(client, data, len) == -1) {
+    return -1;
   }
 
-  client->output_length += len;
+  client->output.essential = true;
 
   return 0;
 }
 
 /**
  * Flushes the contents of the output buffer, runs it through the protocol chain and
- * submits it for async writing via libuv.
+ * writes it to the client.  The output segments are handed to libuv directly as a
+ * vector of buffers rather than being copied.  A synchronous write is attempted first
+ * and only whatever the socket can't immediately accept is queued, with the queued
+ * write holding a reference to the segments until it completes.  Output which one of
+ * the protocols failed to process is discarded rather than being sent half formed and
+ * the client is hung up, as whatever follows it would be garbled too.
  *
  * client - client_t instance whose output is being flushed
  *
@@ -88,34 +132,50 @@ int send_to_client(client_t* client, const char* data, size_t len) {
 int flush_client_output(client_t* client) {
   assert(client);
 
-  if (client->output_length == 0) {
+  if (client->output.length == 0 && !client->deferred) {
     return 0;
   }
 
-  network_protocol_chain_on_output(client, client->output, client->output_length);
+  client->deferred = false;
 
-  size_t len = client->output_length;
+  if (network_protocol_chain_on_output(client, &client->output) == -1) {
+    LOG(ERROR, "Failed to pass output through the protocols of fd [%d]", client->fd);
 
-  write_req_t* write_req = malloc(sizeof(write_req_t) + len);
+    network_clear_output_buffer(&client->output);
+    network_client_hang_up(client);
 
-  if (write_req == NULL) {
-    LOG(ERROR, "Failed to allocate write request for fd [%d]", client->fd);
+    return -1;
+  }
+
+  if (client->output.length == 0) {
+    return 0;
+  }
+
+  uv_buf_t stack_bufs[OUTPUT_WRITE_BUFS];
+  uv_buf_t* bufs = stack_bufs;
+  size_t count = network_output_buffer_count(&client->output);
+
+  if (count > OUTPUT_WRITE_BUFS && (bufs = malloc(sizeof(uv_buf_t) * count)) == NULL) {
+    LOG(ERROR, "Failed to allocate write buffers for fd [%d]", client->fd);
 
     return -1;
   }
 
-  memcpy(write_req->data, client->output, len);
+  size_t nbufs = network_output_buffer_bufs(&client->output, bufs, count);
 
-  uv_buf_t buf = uv_buf_init(write_req->data, len);
+  int res = write_client_output(client, bufs, nbufs);
 
-  uv_write(&write_req->req, (uv_stream_t*)&client->handle, &buf, 1, on_write_complete);
+  if (bufs != stack_bufs) {
+    free(bufs);
+  }
 
-  network_protocol_chain_on_flush(client, client->output, len);
+  network_client_update_pending(client);
 
-  memset(client->output, 0, sizeof(client->output));
-  client->output_length = 0;
+  network_protocol_chain_on_flush(client, &client->output);
 
-  return 0;
+  network_clear_output_buffer(&client->output);
+
+  return res;
 }
 
 /**
@@ -126,48 +186,101 @@ int flush_client_output(client_t* client) {
  **/
 int client_get_idle_seconds(const client_t* const client) {
   assert(client);
+  assert(client->network);
 
-  return (int)(time(NULL) - client->last_active);
+  return (int)((clock_now(client->network->loop) - client->last_active) / 1000);
 }
 
 /**
- * Attempts to extract text from the input buffer.  The buffer is read character by character.
- * If the delim is encountered, we take all characters up to and including the delim and move
- * them into the character buffer referenced by dest and then append with a null character.
+ * Lets a protocol hold output back until the client is next flushed, such as batched
+ * messages where only the latest is wanted.  The client is flushed with the rest at
+ * the end of the tick and the protocol writes its output from its output callback.
  *
- * Returns -1 if delim is not found.  Returns 0 if successful.
+ * client - the client_t with deferred output
  **/
-int extract_from_input(client_t* client, char* dest, size_t dest_len, const char* delim) {
+void network_client_defer_output(client_t* client) {
   assert(client);
-  assert(dest);
 
-  size_t delim_len = strnlen(delim, DELIM_SIZE);
+  client->deferred = true;
 
-  size_t idx = 0;
-  size_t len = strnlen(client->input, CLIENT_BUFFER_SIZE);
+  if (!client->dirty && client->network != NULL) {
+    network_mark_client_dirty(client->network, client);
+  }
+}
 
-  int ret = -1;
+/**
+ * Marks a client to be disconnected once its output has next been flushed, such as
+ * after a protocol has written a final response.
+ *
+ * client - the client_t to disconnect
+ **/
+void network_client_hang_up(client_t* client) {
+  assert(client);
+
+  client->hungup = 1;
+
+  network_client_defer_output(client);
+}
+
+/**
+ * Switches protocol tracing on or off for a client.  While tracing, protocols log the
+ * commands they send as well as those they receive, at the cost of scanning every
+ * byte of output as it's flushed.
+ *
+ * client - the client_t to trace
+ * trace - whether tracing should be enabled
+ **/
+void network_client_set_trace(client_t* client, bool trace) {
+  assert(client);
 
-  for (idx = 0; idx < len; idx++) {
-    char* current = &client->input[idx];
+  client->trace = trace;
 
-    if (strncmp(delim, current, delim_len) == 0) {
-      if (idx > dest_len) {
-        LOG(ERROR, "Unable to extract input from client fd [%d], supplied dest buffer was too small at [%ld], needed [%ld]", client->fd, dest_len, idx);
-      } else {
-        strncpy(dest, client->input, idx);
-        dest[idx] = '\0';
+  LOG(INFO, "Protocol tracing [%s] for client fd [%d]", trace ? "enabled" : "disabled", client->fd);
+}
 
-        ret = 0;
-      }
+/**
+ * Refreshes the number of bytes the client has queued in libuv waiting to be written
+ * and throttles or unthrottles the client against the network's pending limit.
+ *
+ * client - the client_t whose pending output is being measured
+ **/
+void network_client_update_pending(client_t* client) {
+  assert(client);
 
-      memcpy(client->input, current + delim_len, len - idx);
+  client->pending = uv_stream_get_write_queue_size((uv_stream_t*)&client->handle);
 
-      break;
+  if (client->network == NULL) {
+    return;
+  }
+
+  if (client->pending > client->network->pending_limit) {
+    if (!client->throttled) {
+      LOG(WARN, "Throttling client fd [%d] with [%zu] bytes of output pending", client->fd, client->pending);
+
+      client->throttled = true;
+      client->throttled_since = clock_now(client->network->loop);
     }
+
+    return;
   }
 
-  return ret;
+  client->throttled = false;
+  client->throttled_since = 0;
+}
+
+/**
+ * Attempts to extract a line of text from the input buffer.  If the delim is found, all
+ * characters up to the delim are copied into the character buffer referenced by dest
+ * and null terminated, and the line and delim are consumed from the input buffer.
+ *
+ * Returns -1 if delim is not found.  Returns the length of the line if successful.
+ **/
+int extract_from_input(client_t* client, char* dest, size_t dest_len, const char* delim) {
+  assert(client);
+  assert(dest);
+  assert(delim);
+
+  return network_input_buffer_extract(&client->input, dest, dest_len, delim, strnlen(delim, DELIM_SIZE));
 }
 
 /**
@@ -184,6 +297,7 @@ int extract_from_input(client_t* client, char* dest, size_t dest_len, const char
 int network_add_client_protocol(client_t* client, protocol_t* protocol) {
   assert(client);
   assert(protocol);
+  assert(protocol->type < PROTOCOL_TYPES);
 
   if (client->protocol == NULL) {
     client->protocol = protocol;
@@ -191,12 +305,16 @@ int network_add_client_protocol(client_t* client, protocol_t* protocol) {
     protocol_t* chain = client->protocol;
 
     while (chain->next != NULL) {
-      chain = protocol->next;
+      chain = chain->next;
     }
 
     chain->next = protocol;
   }
 
+  if (client->protocols[protocol->type] == NULL) {
+    client->protocols[protocol->type] = protocol;
+  }
+
   if (client->fd != 0) {
     network_protocol_initialise(protocol, client);
   }
@@ -213,17 +331,10 @@ int network_add_client_protocol(client_t* client, protocol_t* protocol) {
  * Returns true if client has protocol or false otherwise
 **/
 bool network_client_has_protocol(client_t* client, protocol_type_t type) {
-  protocol_t* protocol = client->protocol;
-
-  while (protocol != NULL) {
-    if (protocol->type == type) {
-      return true;
-    }
-
-    protocol = protocol->next;
-  }
+  assert(client);
+  assert(type < PROTOCOL_TYPES);
 
-  return false;
+  return client->protocols[type] != NULL;
 }
 
 /**
@@ -235,26 +346,158 @@ bool network_client_has_protocol(client_t* client, protocol_type_t type) {
  * Returns a pointer to the protocol or NULL if not found
 **/
 void* network_client_get_protocol(client_t* client, protocol_type_t type) {
-  protocol_t* protocol = client->protocol;
+  assert(client);
+  assert(type < PROTOCOL_TYPES);
 
-  while (protocol != NULL) {
-    if (protocol->type == type) {
-      return protocol->data;
+  protocol_t* protocol = client->protocols[type];
+
+  return protocol != NULL ? protocol->data : NULL;
+}
+
+/**
+ * Retrieves the client's telnet protocol.
+ *
+ * client - the client for whom we are retrieving the protocol
+ *
+ * Returns the telnet_t instance or NULL if the client doesn't use telnet
+**/
+telnet_t* network_client_get_telnet(client_t* client) {
+  return network_client_get_protocol(client, TELNET);
+}
+
+/**
+ * Applies the network's backpressure policy to output sent to a throttled client.
+ * The drop policy discards the output outright.  The coalesce policy discards any
+ * output held back from a previous flush so only the latest state is sent once the
+ * client catches up.
+ *
+ * client - the throttled client_t being sent output
+ * len - the length of the output being sent
+ *
+ * Returns true if the output should still be appended or false if it was dropped
+ **/
+static bool apply_send_policy(client_t* client, size_t len) {
+  network_t* network = client->network;
+
+  if (network == NULL) {
+    return true;
+  }
+
+  if (network->backpressure_policy == BACKPRESSURE_DROP) {
+    network->metrics.dropped_bytes += len;
+
+    return false;
+  }
+
+  if (network->backpressure_policy == BACKPRESSURE_COALESCE && client->held) {
+    client->held = false;
+
+    if (!client->output.essential) {
+      network->metrics.dropped_bytes += client->output.length;
+      network->metrics.coalesced_flushes++;
+
+      network_clear_output_buffer(&client->output);
     }
   }
 
-  return NULL;
+  return true;
+}
+
+/**
+ * Appends output to the client's output buffer, logging if it would take the buffer
+ * past its limit.  The client is marked dirty with its network so the next flush
+ * knows it has output pending.
+ *
+ * Returns 0 on success or -1 on failure.
+ **/
+static int append_to_output(client_t* client, const char* data, size_t len) {
+  if (network_output_buffer_append(&client->output, data, len) == -1) {
+    LOG(ERROR, "Send to client for fd [%d] failed as data would take output buffer past its limit of [%zu] bytes", client->fd, client->output.limit);
+
+    return -1;
+  }
+
+  if (!client->dirty && client->network != NULL) {
+    network_mark_client_dirty(client->network, client);
+  }
+
+  return 0;
+}
+
+/**
+ * Writes a vector of output buffers to the client.  Whatever uv_try_write is able
+ * to send immediately is skipped over and the remainder is queued with uv_write,
+ * the queued write retaining the client's output segments until it completes.
+ *
+ * client - the client_t being written to
+ * bufs - uv_buf_t array pointing at the client's output segments
+ * nbufs - the number of entries in bufs
+ *
+ * Returns 0 on success or -1 on error.
+ **/
+static int write_client_output(client_t* client, uv_buf_t* bufs, size_t nbufs) {
+  uv_stream_t* stream = (uv_stream_t*)&client->handle;
+
+  int written = uv_try_write(stream, bufs, nbufs);
+
+  if (written < 0 && written != UV_EAGAIN) {
+    LOG(ERROR, "Write to fd [%d] failed: %s", client->fd, uv_strerror(written));
+
+    return -1;
+  }
+
+  size_t remaining = written < 0 ? 0 : (size_t)written;
+  size_t idx = 0;
+
+  while (idx < nbufs && remaining >= bufs[idx].len) {
+    remaining -= bufs[idx].len;
+    idx++;
+  }
+
+  if (idx == nbufs) {
+    return 0;
+  }
+
+  bufs[idx].base += remaining;
+  bufs[idx].len -= remaining;
+
+  output_write_t* write = network_output_write_acquire(client->output.pool);
+
+  if (write == NULL) {
+    LOG(ERROR, "Failed to allocate write request for fd [%d]", client->fd);
+
+    return -1;
+  }
+
+  write->segments = client->output.head;
+  network_output_segments_retain(write->segments);
+
+  int res = uv_write(&write->req, stream, bufs + idx, nbufs - idx, on_write_complete);
+
+  if (res != 0) {
+    LOG(ERROR, "uv_write to fd [%d] failed: %s", client->fd, uv_strerror(res));
+    network_output_write_release(write);
+
+    return -1;
+  }
+
+  return 0;
 }
 
 /**
- * Called by libuv when an async write request completes.
+ * Called by libuv when an async write request completes.  Releases the write's
+ * references to the output segments so they can be recycled and refreshes the
+ * client's pending output now the queue has drained.
  **/
 static void on_write_complete(uv_write_t* req, int status) {
-  write_req_t* write_req = (write_req_t*)req;
+  output_write_t* write = (output_write_t*)req;
+  client_t* client = req->handle->data;
 
   if (status < 0) {
     LOG(ERROR, "Write error: %s", uv_strerror(status));
   }
 
-  free(write_req);
+  network_output_write_release(write);
+
+  network_client_update_pending(client);
 }
@@ -3,40 +3,56 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include "bsd/string.h"
-
 #include "mud/log.h"
 #include "mud/network/client.h"
 #include "mud/network/gmcp.h"
+#include "mud/network/output.h"
+#include "mud/network/protocol.h"
 
 static void deallocate_gmcp_t(void* value);
 static void initialise_gmcp(void* extension, telnet_t* telnet, client_t* client);
 static telnet_option_t* get_option(void* extension, int option);
 static telnet_config_t* get_config(void* extension, int option);
 static void process_se(void* extension, telnet_t* telnet, client_t* client, int option, const char* data, size_t len);
+static int flush_coalesced(void* extension, telnet_t* telnet, client_t* client, output_buffer_t* output);
+
+static size_t frame_length(const char* topic, size_t topic_len, const char* msg, size_t msg_len);
+static size_t write_frame(char* dest, const char* topic, size_t topic_len, const char* msg, size_t msg_len);
+static size_t write_escaped(char* dest, const char* data, size_t len);
+static gmcp_coalesced_t* find_coalesced(gmcp_t* gmcp, const char* topic, size_t topic_len);
 
 static telnet_config_t gmcp_config = {TELOPT_GMCP, true, true};
 
 /**
  * Creates a new telnet_extension_t for the GMCP extension.
  *
- * Returns the new telnet_extension_t instance.
+ * pools - the protocol_pools_t to allocate from, or NULL to allocate from the heap
+ *
+ * Returns the new telnet_extension_t instance or NULL on failure.
 **/
-telnet_extension_t* network_new_gmcp_telnet_extension(void* context, on_gmcp_func_t on_gmcp) {
+telnet_extension_t* network_new_gmcp_telnet_extension(protocol_pools_t* pools, void* context, on_gmcp_func_t on_gmcp) {
   assert(context);
   assert(on_gmcp);
 
-  telnet_extension_t* extension = calloc(1, sizeof(telnet_extension_t));
-  gmcp_t* gmcp = calloc(1, sizeof(gmcp_t));
+  telnet_extension_t* extension = network_new_telnet_extension(pools, sizeof(gmcp_t));
+
+  if (extension == NULL) {
+    return NULL;
+  }
+
+  gmcp_t* gmcp = extension->extension;
   gmcp->context = context;
   gmcp->on_gmcp = on_gmcp;
 
-  extension->extension = gmcp;
   extension->deallocate = deallocate_gmcp_t;
   extension->initialise = initialise_gmcp;
   extension->get_option = get_option;
   extension->get_config = get_config;
   extension->subnegotiation = process_se;
+  extension->negotiated = NULL;
+  extension->encode = NULL;
+  extension->decode = NULL;
+  extension->flush = flush_coalesced;
   extension->next = NULL;
 
   return extension;
@@ -51,8 +67,16 @@ void deallocate_gmcp_t(void* value) {
   assert(value);
 
   gmcp_t* gmcp = value;
+
+  if (gmcp->coalesced != NULL) {
+    for (size_t i = 0; i < GMCP_COALESCED_TOPICS; i++) {
+      free(gmcp->coalesced[i].frame);
+    }
+
+    free(gmcp->coalesced);
+  }
   
-  free(gmcp);
+  network_protocol_free(gmcp);
 }
 
 /**
@@ -109,30 +133,91 @@ telnet_config_t* get_config(void* extension, int option) {
 }
 
 /**
- * Sends a GMCP message to a client.
+ * Sends a GMCP message to a client.  The whole frame is built first, with any IAC bytes
+ * in the topic or message escaped, and written to the client's output in one go so it
+ * is either queued whole or not at all.
  *
  * client - client_t instance of the client to send the GMCP message to
  * topic - the topic of the GMCP message
  * topic_len - the length of the topic message
  * msg - the message to be sent, may be null
  * msg_len - the length of the message to be sent
+ *
+ * Returns 0 on success or -1 on failure
 **/
-void network_send_gmcp_message(client_t* client, char* topic, size_t topic_len, char* msg, size_t msg_len) {
+int network_send_gmcp_message(client_t* client, const char* topic, size_t topic_len, const char* msg, size_t msg_len) {
   assert(client);
   assert(topic);
-  
-  char subneg_begin[] = { (char) IAC, (char) SB, (char) TELOPT_GMCP };
-  char subneg_end[] = { (char) IAC, (char) SE };
 
-  send_to_client(client, subneg_begin, 3);
-  send_to_client(client, topic, topic_len);
+  size_t len = frame_length(topic, topic_len, msg, msg_len);
+  char stack_frame[GMCP_FRAME_SIZE];
+  char* frame = stack_frame;
+
+  if (len > sizeof(stack_frame) && (frame = malloc(len)) == NULL) {
+    LOG(ERROR, "Failed to allocate [%zu] byte GMCP frame for client [%d]", len, client->fd);
+
+    return -1;
+  }
+
+  write_frame(frame, topic, topic_len, msg, msg_len);
+
+  int res = send_to_client(client, frame, len);
+
+  if (frame != stack_frame) {
+    free(frame);
+  }
+
+  return res;
+}
+
+/**
+ * Sends a GMCP message to a client the next time its output is flushed, replacing any
+ * message with the same topic still waiting to be sent.  Meant for topics sent more
+ * often than the client needs them, such as Char.Vitals, where only the latest value
+ * matters.  Messages are sent straight away if the client doesn't have GMCP or too
+ * many topics are already being coalesced.
+ *
+ * client - client_t instance of the client to send the GMCP message to
+ * topic - the topic of the GMCP message
+ * topic_len - the length of the topic message
+ * msg - the message to be sent, may be null
+ * msg_len - the length of the message to be sent
+ *
+ * Returns 0 on success or -1 on failure
+**/
+int network_send_coalesced_gmcp_message(client_t* client, const char* topic, size_t topic_len, const char* msg, size_t msg_len) {
+  assert(client);
+  assert(topic);
+
+  telnet_t* telnet = network_client_get_telnet(client);
+  gmcp_t* gmcp = telnet != NULL ? network_telnet_get_extension(telnet, TELOPT_GMCP) : NULL;
+  gmcp_coalesced_t* coalesced = gmcp != NULL ? find_coalesced(gmcp, topic, topic_len) : NULL;
+
+  if (coalesced == NULL) {
+    return network_send_gmcp_message(client, topic, topic_len, msg, msg_len);
+  }
+
+  size_t len = frame_length(topic, topic_len, msg, msg_len);
+
+  if (len > coalesced->size) {
+    char* frame = realloc(coalesced->frame, len);
+
+    if (frame == NULL) {
+      LOG(ERROR, "Failed to allocate [%zu] byte GMCP frame for client [%d]", len, client->fd);
+
+      return -1;
+    }
 
-  if (msg_len > 0) {
-    send_to_client(client, " ", 1);
-    send_to_client(client, msg, msg_len);
+    coalesced->frame = frame;
+    coalesced->size = len;
   }
 
-  send_to_client(client, subneg_end, 2);
+  coalesced->len = write_frame(coalesced->frame, topic, topic_len, msg, msg_len);
+  coalesced->pending = true;
+
+  network_client_defer_output(client);
+
+  return 0;
 }
 
 /**
@@ -155,10 +240,10 @@ void process_se(void* extension, telnet_t* telnet, client_t* client, int option,
 
   if (option == TELOPT_GMCP) {
     if (gmcp && gmcp->on_gmcp) {
-      len = len + 1; // null terminator
-
-      char copy[len];
-      strlcpy(copy, data, len);
+      // Payloads are slices of the input and aren't null terminated
+      char copy[len + 1];
+      memcpy(copy, data, len);
+      copy[len] = '\0';
 
       char* msg = strchr(copy, ' ');
       char* topic = copy;
@@ -172,3 +257,171 @@ void process_se(void* extension, telnet_t* telnet, client_t* client, int option,
     }
   }
 }
+
+/**
+ * Writes out the latest message for each coalesced topic when the client's output is
+ * flushed.
+ *
+ * extension - void pointer to gmcp_t
+ * telnet - telnet_t instance
+ * client - client_t instance representing the remote client
+ * output - the output buffer about to be sent
+ *
+ * Returns 0 on success or -1 if a message didn't fit in the output buffer
+**/
+int flush_coalesced(void* extension, telnet_t* telnet, client_t* client, output_buffer_t* output) {
+  assert(extension);
+  assert(telnet);
+  assert(client);
+  assert(output);
+
+  gmcp_t* gmcp = extension;
+  int res = 0;
+
+  if (gmcp->coalesced == NULL) {
+    return 0;
+  }
+
+  for (size_t i = 0; i < GMCP_COALESCED_TOPICS; i++) {
+    gmcp_coalesced_t* coalesced = &gmcp->coalesced[i];
+
+    if (!coalesced->pending) {
+      continue;
+    }
+
+    coalesced->pending = false;
+
+    if (network_output_buffer_append(output, coalesced->frame, coalesced->len) == -1) {
+      LOG(WARN, "Dropped coalesced GMCP [%s] for client [%d], output buffer full", coalesced->topic, client->fd);
+
+      res = -1;
+    }
+  }
+
+  return res;
+}
+
+/**
+ * Calculates the length of a GMCP frame once escaped.
+ *
+ * topic - the topic of the GMCP message
+ * topic_len - the length of the topic
+ * msg - the message, may be null
+ * msg_len - the length of the message
+ *
+ * Returns the length of the frame
+**/
+size_t frame_length(const char* topic, size_t topic_len, const char* msg, size_t msg_len) {
+  size_t len = 5 + topic_len;
+
+  for (size_t i = 0; i < topic_len; i++) {
+    len += (unsigned char)topic[i] == IAC;
+  }
+
+  if (msg != NULL && msg_len > 0) {
+    len += 1 + msg_len;
+
+    for (size_t i = 0; i < msg_len; i++) {
+      len += (unsigned char)msg[i] == IAC;
+    }
+  }
+
+  return len;
+}
+
+/**
+ * Writes a GMCP frame, IAC SB GMCP topic [space message] IAC SE, escaping any IAC bytes
+ * in the topic and message.
+ *
+ * dest - where to write the frame, at least frame_length bytes
+ * topic - the topic of the GMCP message
+ * topic_len - the length of the topic
+ * msg - the message, may be null
+ * msg_len - the length of the message
+ *
+ * Returns the length of the frame written
+**/
+size_t write_frame(char* dest, const char* topic, size_t topic_len, const char* msg, size_t msg_len) {
+  size_t len = 0;
+
+  dest[len++] = (char) IAC;
+  dest[len++] = (char) SB;
+  dest[len++] = (char) TELOPT_GMCP;
+
+  len += write_escaped(dest + len, topic, topic_len);
+
+  if (msg != NULL && msg_len > 0) {
+    dest[len++] = ' ';
+    len += write_escaped(dest + len, msg, msg_len);
+  }
+
+  dest[len++] = (char) IAC;
+  dest[len++] = (char) SE;
+
+  return len;
+}
+
+/**
+ * Copies data, doubling any IAC bytes so they aren't mistaken for telnet commands.
+ *
+ * dest - where to copy the data
+ * data - the data to copy
+ * len - the length of the data
+ *
+ * Returns the number of bytes written
+**/
+size_t write_escaped(char* dest, const char* data, size_t len) {
+  size_t written = 0;
+  const char* end = data + len;
+
+  while (data < end) {
+    const char* iac = memchr(data, IAC, (size_t)(end - data));
+    size_t run = iac != NULL ? (size_t)(iac - data) + 1 : (size_t)(end - data);
+
+    memcpy(dest + written, data, run);
+    written += run;
+    data += run;
+
+    if (iac != NULL) {
+      dest[written++] = (char) IAC;
+    }
+  }
+
+  return written;
+}
+
+/**
+ * Finds the coalesced entry for a topic, claiming a free one for topics not seen before.
+ *
+ * gmcp - the gmcp_t for the client
+ * topic - the topic of the GMCP message
+ * topic_len - the length of the topic
+ *
+ * Returns the entry or NULL if the topic is empty, too long or there are no free entries
+**/
+gmcp_coalesced_t* find_coalesced(gmcp_t* gmcp, const char* topic, size_t topic_len) {
+  if (topic_len == 0 || topic_len >= GMCP_TOPIC_SIZE) {
+    return NULL;
+  }
+
+  if (gmcp->coalesced == NULL && (gmcp->coalesced = calloc(GMCP_COALESCED_TOPICS, sizeof(gmcp_coalesced_t))) == NULL) {
+    return NULL;
+  }
+
+  for (size_t i = 0; i < GMCP_COALESCED_TOPICS; i++) {
+    gmcp_coalesced_t* coalesced = &gmcp->coalesced[i];
+
+    if (coalesced->topic[0] == '\0') {
+      memcpy(coalesced->topic, topic, topic_len);
+      coalesced->topic[topic_len] = '\0';
+
+      return coalesced;
+    }
+
+    if (strncmp(coalesced->topic, topic, topic_len) == 0 && coalesced->topic[topic_len] == '\0') {
+      return coalesced;
+    }
+  }
+
+  return NULL;
+}
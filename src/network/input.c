@@ -0,0 +1,222 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mud/log.h"
+#include "mud/network/input.h"
+
+static void compact_input_buffer(input_buffer_t* buffer);
+static const char* find_delim(const char* start, const char* end, const char* delim, size_t delim_len);
+
+/**
+ * Initialises an input buffer.  No memory is allocated until space is first
+ * reserved so idle connections don't hold an input buffer.
+ *
+ * buffer - the input_buffer_t to initialise
+ * size - the size of the buffer in bytes, including space for a null terminator
+**/
+void network_init_input_buffer(input_buffer_t* buffer, size_t size) {
+  assert(buffer);
+  assert(size > 1);
+
+  buffer->data = NULL;
+  buffer->size = size;
+  buffer->read = 0;
+  buffer->write = 0;
+  buffer->scan = 0;
+}
+
+/**
+ * Frees the memory held by an input buffer and resets it to empty.  The buffer
+ * may continue to be used and will allocate again on the next reserve.
+ *
+ * buffer - the input_buffer_t to release
+**/
+void network_release_input_buffer(input_buffer_t* buffer) {
+  assert(buffer);
+
+  free(buffer->data);
+
+  buffer->data = NULL;
+  buffer->read = 0;
+  buffer->write = 0;
+  buffer->scan = 0;
+}
+
+/**
+ * Reserves space at the write offset of the input buffer for incoming data,
+ * allocating the buffer if required.  Unread data is only moved to the start of
+ * the buffer once the write offset reaches the end, so the cost of moving data
+ * is paid at most once per buffer's worth of input.  One byte is always kept
+ * back so committed data can be null terminated.
+ *
+ * buffer - the input_buffer_t to reserve space in
+ * len - populated with the number of bytes available
+ *
+ * Returns a pointer to the reserved space or NULL if the buffer is full or
+ * couldn't be allocated
+**/
+char* network_input_buffer_reserve(input_buffer_t* buffer, size_t* len) {
+  assert(buffer);
+  assert(len);
+
+  *len = 0;
+
+  if (buffer->data == NULL && (buffer->data = calloc(1, buffer->size)) == NULL) {
+    return NULL;
+  }
+
+  if (buffer->write + 1 >= buffer->size) {
+    compact_input_buffer(buffer);
+  }
+
+  if (buffer->write + 1 >= buffer->size) {
+    return NULL;
+  }
+
+  *len = buffer->size - buffer->write - 1;
+
+  return buffer->data + buffer->write;
+}
+
+/**
+ * Commits data written into previously reserved space, advancing the write offset
+ * and null terminating the buffer.
+ *
+ * buffer - the input_buffer_t data was written into
+ * len - the number of bytes written
+**/
+void network_input_buffer_commit(input_buffer_t* buffer, size_t len) {
+  assert(buffer);
+  assert(buffer->data);
+  assert(buffer->write + len < buffer->size);
+
+  buffer->write += len;
+  buffer->data[buffer->write] = '\0';
+}
+
+/**
+ * Extracts the next complete line from the input buffer.  Scanning resumes from
+ * where the previous unsuccessful extract stopped so each byte is only examined
+ * once however the input arrives.  Lines are copied with their length rather than
+ * as strings so embedded null bytes don't truncate the buffered input.  A line
+ * too long for dest is discarded and the following line extracted instead.
+ *
+ * buffer - the input_buffer_t to extract from
+ * dest - populated with the line, without the delimiter, and null terminated
+ * dest_len - the size of dest
+ * delim - the delimiter which ends a line
+ * delim_len - the length of the delimiter
+ *
+ * Returns the length of the line extracted or -1 if there isn't a complete line
+**/
+int network_input_buffer_extract(input_buffer_t* buffer, char* dest, size_t dest_len, const char* delim, size_t delim_len) {
+  assert(buffer);
+  assert(dest);
+  assert(delim);
+  assert(delim_len > 0);
+
+  while (buffer->data != NULL && buffer->read < buffer->write) {
+    const char* start = buffer->data + buffer->read;
+    const char* end = buffer->data + buffer->write;
+    const char* found = find_delim(buffer->data + buffer->scan, end, delim, delim_len);
+
+    if (found == NULL) {
+      size_t tail = delim_len - 1;
+
+      // Leave room to find a delimiter which straddles this and the next read
+      buffer->scan = buffer->write - buffer->read > tail ? buffer->write - tail : buffer->read;
+
+      return -1;
+    }
+
+    size_t len = (size_t)(found - start);
+
+    buffer->read += len + delim_len;
+    buffer->scan = buffer->read;
+
+    if (len >= dest_len) {
+      LOG(ERROR, "Discarding input line of [%zu] bytes as it exceeds the [%zu] byte destination", len, dest_len);
+
+      continue;
+    }
+
+    memcpy(dest, start, len);
+    dest[len] = '\0';
+
+    if (buffer->read == buffer->write) {
+      buffer->read = 0;
+      buffer->write = 0;
+      buffer->scan = 0;
+      buffer->data[0] = '\0';
+    }
+
+    return (int)len;
+  }
+
+  return -1;
+}
+
+/**
+ * Determines whether the input buffer holds any unread data.
+ *
+ * buffer - the input_buffer_t to check
+ *
+ * Returns true if there is no unread data
+**/
+bool network_input_buffer_is_empty(const input_buffer_t* buffer) {
+  assert(buffer);
+
+  return buffer->read == buffer->write;
+}
+
+/**
+ * Moves unread data to the start of the input buffer.
+ *
+ * buffer - the input_buffer_t to compact
+**/
+static void compact_input_buffer(input_buffer_t* buffer) {
+  if (buffer->read == 0) {
+    return;
+  }
+
+  size_t unread = buffer->write - buffer->read;
+
+  memmove(buffer->data, buffer->data + buffer->read, unread);
+
+  buffer->scan -= buffer->read;
+  buffer->write = unread;
+  buffer->read = 0;
+  buffer->data[buffer->write] = '\0';
+}
+
+/**
+ * Finds the first occurrence of a delimiter between two pointers using memchr to
+ * skip to candidate positions.
+ *
+ * start - where to start searching
+ * end - one past the last byte to search
+ * delim - the delimiter to search for
+ * delim_len - the length of the delimiter
+ *
+ * Returns a pointer to the start of the delimiter or NULL if not found
+**/
+static const char* find_delim(const char* start, const char* end, const char* delim, size_t delim_len) {
+  const char* current = start;
+
+  while (current + delim_len <= end) {
+    current = memchr(current, delim[0], (size_t)(end - current) - (delim_len - 1));
+
+    if (current == NULL) {
+      return NULL;
+    }
+
+    if (memcmp(current, delim, delim_len) == 0) {
+      return current;
+    }
+
+    current++;
+  }
+
+  return NULL;
+}
@@ -0,0 +1,596 @@
+#include <arpa/telnet.h>
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mud/log.h"
+#include "mud/network/client.h"
+#include "mud/network/mccp.h"
+#include "mud/network/output.h"
+#include "mud/network/protocol.h"
+
+static void deallocate_mccp_t(void* value);
+static void initialise_mccp(void* extension, telnet_t* telnet, client_t* client);
+static telnet_option_t* get_option(void* extension, int option);
+static telnet_config_t* get_config(void* extension, int option);
+static void process_se(void* extension, telnet_t* telnet, client_t* client, int option, const char* data, size_t len);
+static void process_negotiated(void* extension, telnet_t* telnet, client_t* client, int option, bool local, bool enabled);
+static int encode_output(void* extension, telnet_t* telnet, client_t* client, output_buffer_t* output);
+static int decode_input(void* extension, telnet_t* telnet, client_t* client, const char* input, size_t len, char* dest, size_t size);
+
+static void start_compression(mccp_t* mccp, telnet_t* telnet, client_t* client);
+static void stop_compression(mccp_t* mccp, telnet_t* telnet);
+static void start_decompression(mccp_t* mccp, telnet_t* telnet, client_t* client);
+static void stop_decompression(mccp_t* mccp, telnet_t* telnet);
+static int deflate_data(z_stream* stream, output_buffer_t* output, const char* data, size_t len, int flush);
+static int append_pending(mccp_t* mccp, const char* data, size_t len);
+static void consume_pending(mccp_t* mccp, size_t len);
+static void end_inflate(mccp_t* mccp);
+
+static telnet_config_t mccp2_config = {TELOPT_MCCP2, false, true};
+static telnet_config_t mccp3_config = {TELOPT_MCCP3, false, true};
+
+/**
+ * Creates a new telnet_extension_t for the MCCP2 and MCCP3 extension.  MCCP2 compresses
+ * output sent to the client and MCCP3 decompresses input the client has compressed.
+ * Compression state is only allocated once the client starts compressing.
+ *
+ * pools - the protocol_pools_t to allocate from, or NULL to allocate from the heap
+ * level - the zlib compression level from 0 to 9
+ * low_memory - whether to use a smaller window and less deflate state per client at
+ *              the expense of compression ratio
+ *
+ * Returns the new telnet_extension_t instance or NULL on failure.
+**/
+telnet_extension_t* network_new_mccp_telnet_extension(protocol_pools_t* pools, int level, bool low_memory) {
+  assert(level >= Z_NO_COMPRESSION && level <= Z_BEST_COMPRESSION);
+
+  telnet_extension_t* extension = network_new_telnet_extension(pools, sizeof(mccp_t));
+
+  if (extension == NULL) {
+    return NULL;
+  }
+
+  mccp_t* mccp = extension->extension;
+  mccp->level = level;
+  mccp->low_memory = low_memory;
+
+  extension->deallocate = deallocate_mccp_t;
+  extension->initialise = initialise_mccp;
+  extension->get_option = get_option;
+  extension->get_config = get_config;
+  extension->subnegotiation = process_se;
+  extension->negotiated = process_negotiated;
+  extension->encode = encode_output;
+  extension->decode = decode_input;
+  extension->flush = NULL;
+  extension->next = NULL;
+
+  return extension;
+}
+
+/**
+ * Deallocates a void pointer to mccp_t along with any compression state
+ *
+ * value - void pointer to mccp_t
+**/
+void deallocate_mccp_t(void* value) {
+  assert(value);
+
+  mccp_t* mccp = value;
+
+  if (mccp->deflate != NULL) {
+    deflateEnd(mccp->deflate);
+    free(mccp->deflate);
+  }
+
+  if (mccp->inflate != NULL) {
+    inflateEnd(mccp->inflate);
+    free(mccp->inflate);
+  }
+
+  free(mccp->pending);
+
+  network_protocol_free(mccp);
+}
+
+/**
+ * Initialises MCCP by sending a WILL for MCCP2 and MCCP3 to the client
+ *
+ * extension - void pointer to the extension (should be mccp_t)
+ * telnet - the telnet_t instance for the client
+ * client - the client_t instance of the client
+**/
+void initialise_mccp(void* extension, telnet_t* telnet, client_t* client) {
+  assert(extension);
+  assert(telnet);
+  assert(client);
+
+  network_telnet_send_will(telnet, client, TELOPT_MCCP2);
+  network_telnet_send_will(telnet, client, TELOPT_MCCP3);
+}
+
+/**
+ * Retrieves telnet options relevant to the MCCP extension
+ *
+ * extension - void pointer to the mccp_t instance
+ * option - the option number of the option we're looking for
+ *
+ * Returns the option if MCCP2 or MCCP3 or NULL.
+**/
+telnet_option_t* get_option(void* extension, int option) {
+  assert(extension);
+
+  mccp_t* mccp = extension;
+
+  switch (option) {
+    case TELOPT_MCCP2:
+      return &mccp->mccp2;
+    case TELOPT_MCCP3:
+      return &mccp->mccp3;
+  }
+
+  return NULL;
+}
+
+/**
+ * Retrieves config options relevant to the MCCP extension
+ *
+ * extension - void pointer to the mccp_t instance
+ * option - the option number of the option we're looking for
+ *
+ * Returns the option config or NULL.
+**/
+telnet_config_t* get_config(void* extension, int option) {
+  assert(extension);
+
+  switch (option) {
+    case TELOPT_MCCP2:
+      return &mccp2_config;
+    case TELOPT_MCCP3:
+      return &mccp3_config;
+  }
+
+  return NULL;
+}
+
+/**
+ * Process a Telnet subnegotiation.  An empty MCCP3 subnegotiation from the client
+ * means everything it sends afterwards is compressed.
+ *
+ * extension - void pointer to mccp_t
+ * telnet - telnet_t instance
+ * client - client_t instance representing the remote client
+ * option - the option negotiated for
+ * data - the data for the subnegotiation
+ * len - the length of the data
+**/
+void process_se(void* extension, telnet_t* telnet, client_t* client, int option, const char* data, size_t len) {
+  assert(extension);
+  assert(telnet);
+  assert(client);
+  assert(data);
+
+  mccp_t* mccp = extension;
+
+  if (option == TELOPT_MCCP3 && mccp->mccp3.us == YES) {
+    start_decompression(mccp, telnet, client);
+  }
+}
+
+/**
+ * Starts compressing output once the client agrees to MCCP2, and finishes the stream
+ * once it no longer wants it.  Stops decompressing input if the client turns MCCP3 off.
+ *
+ * extension - void pointer to mccp_t
+ * telnet - telnet_t instance
+ * client - client_t instance representing the remote client
+ * option - the option negotiated
+ * local - whether the option is ours rather than the client's
+ * enabled - whether the option is now enabled
+**/
+void process_negotiated(void* extension, telnet_t* telnet, client_t* client, int option, bool local, bool enabled) {
+  assert(extension);
+  assert(telnet);
+  assert(client);
+
+  mccp_t* mccp = extension;
+
+  if (!local) {
+    return;
+  }
+
+  if (option == TELOPT_MCCP2) {
+    if (enabled) {
+      start_compression(mccp, telnet, client);
+    } else if (mccp->deflate != NULL) {
+      mccp->finish = true;
+    }
+  }
+
+  if (option == TELOPT_MCCP3 && !enabled) {
+    stop_decompression(mccp, telnet);
+  }
+}
+
+/**
+ * Compresses output as it's flushed.  Output is deflated straight into a new chain of
+ * segments which replaces the original, with a sync flush so the client can decompress
+ * everything it has been sent.  Output queued ahead of the start of compression is
+ * passed through as is.
+ *
+ * extension - void pointer to mccp_t
+ * telnet - telnet_t instance
+ * client - client_t instance representing the remote client
+ * output - the output buffer to compress
+ *
+ * Returns 0 on success or -1 on failure
+**/
+int encode_output(void* extension, telnet_t* telnet, client_t* client, output_buffer_t* output) {
+  assert(extension);
+  assert(telnet);
+  assert(client);
+  assert(output);
+
+  mccp_t* mccp = extension;
+
+  if (mccp->deflate == NULL) {
+    return 0;
+  }
+
+  output_buffer_t compressed;
+  network_init_output_buffer(&compressed, SIZE_MAX);
+  compressed.pool = output->pool;
+  compressed.essential = output->essential;
+
+  size_t skip = mccp->start;
+  size_t prefix = 0;
+  int res = 0;
+
+  mccp->start = 0;
+
+  for (output_segment_t* segment = output->head; segment != NULL && res == 0; segment = segment->next) {
+    size_t raw = skip < segment->len ? skip : segment->len;
+
+    skip -= raw;
+    prefix += raw;
+
+    if (raw > 0) {
+      res = network_output_buffer_append(&compressed, segment->data, raw);
+    }
+
+    if (res == 0 && raw < segment->len) {
+      res = deflate_data(mccp->deflate, &compressed, segment->data + raw, segment->len - raw, Z_NO_FLUSH);
+    }
+  }
+
+  if (res == 0) {
+    res = deflate_data(mccp->deflate, &compressed, NULL, 0, mccp->finish ? Z_FINISH : Z_SYNC_FLUSH);
+  }
+
+  if (res == -1) {
+    network_clear_output_buffer(&compressed);
+
+    return -1;
+  }
+
+  mccp->raw_bytes += output->length - prefix;
+  mccp->compressed_bytes += compressed.length - prefix;
+
+  network_output_buffer_move(output, &compressed);
+
+  if (mccp->finish) {
+    LOG(INFO, "Client [%d] stopped MCCP2 compression", client->fd);
+
+    stop_compression(mccp, telnet);
+  }
+
+  return 0;
+}
+
+/**
+ * Decompresses input from the client.  Compressed input which doesn't fit in the space
+ * available is held on to, and the client marked as holding input so it's decoded as
+ * soon as there's space rather than on the next read.  Anything following the end of
+ * the compressed stream is uncompressed and is passed through as is, held on to in the
+ * same way if it doesn't fit, after which decoding stops.
+ *
+ * extension - void pointer to mccp_t
+ * telnet - telnet_t instance
+ * client - client_t instance representing the remote client
+ * input - the compressed input
+ * len - the length of the compressed input
+ * dest - where decompressed input is written, which may overlap input
+ * size - the space available at dest
+ *
+ * Returns the length of the decompressed input or -1 on failure
+**/
+int decode_input(void* extension, telnet_t* telnet, client_t* client, const char* input, size_t len, char* dest, size_t size) {
+  assert(extension);
+  assert(telnet);
+  assert(client);
+
+  mccp_t* mccp = extension;
+  size_t decoded = 0;
+
+  if (append_pending(mccp, input, len) == -1) {
+    return -1;
+  }
+
+  if (mccp->inflate != NULL) {
+    z_stream* stream = mccp->inflate;
+    stream->next_in = (Bytef*)mccp->pending;
+    stream->avail_in = (uInt)mccp->pending_len;
+    stream->next_out = (Bytef*)dest;
+    stream->avail_out = (uInt)size;
+
+    int res = inflate(stream, Z_SYNC_FLUSH);
+
+    decoded = size - stream->avail_out;
+    consume_pending(mccp, mccp->pending_len - stream->avail_in);
+
+    if (res == Z_STREAM_END) {
+      LOG(INFO, "Client [%d] stopped MCCP3 compression", client->fd);
+
+      end_inflate(mccp);
+    } else if (res != Z_OK && res != Z_BUF_ERROR) {
+      LOG(ERROR, "MCCP3 decompression failed for client [%d]: %s", client->fd, stream->msg != NULL ? stream->msg : "unknown error");
+
+      stop_decompression(mccp, telnet);
+      network_telnet_send_wont(telnet, client, TELOPT_MCCP3);
+
+      return (int)decoded;
+    }
+  }
+
+  if (mccp->inflate == NULL) {
+    size_t plain = mccp->pending_len < size - decoded ? mccp->pending_len : size - decoded;
+
+    if (plain > 0) {
+      memcpy(dest + decoded, mccp->pending, plain);
+      decoded += plain;
+      consume_pending(mccp, plain);
+    }
+
+    if (mccp->pending_len == 0) {
+      stop_decompression(mccp, telnet);
+    }
+  }
+
+  if (decoded == size) {
+    client->input_held = true;
+  }
+
+  return (int)decoded;
+}
+
+/**
+ * Allocates a deflate stream, tells the client compression is starting and makes this
+ * extension the encoder for its output.  Everything queued after the start marker is
+ * compressed.
+ *
+ * mccp - the mccp_t instance for the client
+ * telnet - telnet_t instance
+ * client - client_t instance representing the remote client
+**/
+void start_compression(mccp_t* mccp, telnet_t* telnet, client_t* client) {
+  if (mccp->deflate != NULL) {
+    return;
+  }
+
+  z_stream* stream = calloc(1, sizeof(z_stream));
+
+  if (stream == NULL) {
+    LOG(ERROR, "Failed to allocate MCCP2 stream for client [%d]", client->fd);
+
+    return;
+  }
+
+  int window_bits = mccp->low_memory ? MCCP_LOW_MEMORY_WINDOW_BITS : MCCP_WINDOW_BITS;
+  int mem_level = mccp->low_memory ? MCCP_LOW_MEMORY_MEM_LEVEL : MCCP_MEM_LEVEL;
+
+  if (deflateInit2(stream, mccp->level, Z_DEFLATED, window_bits, mem_level, Z_DEFAULT_STRATEGY) != Z_OK) {
+    LOG(ERROR, "Failed to initialise MCCP2 stream for client [%d]", client->fd);
+    free(stream);
+
+    return;
+  }
+
+  char msg[] = { (char) IAC, (char) SB, (char) TELOPT_MCCP2, (char) IAC, (char) SE };
+
+  if (send_essential_to_client(client, msg, sizeof(msg)) == -1) {
+    LOG(ERROR, "Failed to send MCCP2 start to client [%d]", client->fd);
+    deflateEnd(stream);
+    free(stream);
+
+    return;
+  }
+
+  mccp->deflate = stream;
+  mccp->start = client->output.length;
+  mccp->finish = false;
+
+  network_telnet_set_encoder(telnet, mccp);
+
+  LOG(INFO, "Client [%d] started MCCP2 compression at level [%d]", client->fd, mccp->level);
+}
+
+/**
+ * Frees the deflate stream and stops encoding output.
+ *
+ * mccp - the mccp_t instance for the client
+ * telnet - telnet_t instance
+**/
+void stop_compression(mccp_t* mccp, telnet_t* telnet) {
+  if (mccp->deflate == NULL) {
+    return;
+  }
+
+  deflateEnd(mccp->deflate);
+  free(mccp->deflate);
+
+  mccp->deflate = NULL;
+  mccp->finish = false;
+
+  network_telnet_set_encoder(telnet, NULL);
+}
+
+/**
+ * Allocates an inflate stream and makes this extension the decoder for the client's
+ * input.
+ *
+ * mccp - the mccp_t instance for the client
+ * telnet - telnet_t instance
+ * client - client_t instance representing the remote client
+**/
+void start_decompression(mccp_t* mccp, telnet_t* telnet, client_t* client) {
+  if (mccp->inflate != NULL) {
+    return;
+  }
+
+  z_stream* stream = calloc(1, sizeof(z_stream));
+
+  if (stream == NULL) {
+    LOG(ERROR, "Failed to allocate MCCP3 stream for client [%d]", client->fd);
+
+    return;
+  }
+
+  if (inflateInit(stream) != Z_OK) {
+    LOG(ERROR, "Failed to initialise MCCP3 stream for client [%d]", client->fd);
+    free(stream);
+
+    return;
+  }
+
+  mccp->inflate = stream;
+  mccp->pending_len = 0;
+
+  network_telnet_set_decoder(telnet, mccp);
+
+  LOG(INFO, "Client [%d] started MCCP3 compression", client->fd);
+}
+
+/**
+ * Frees the inflate stream if there is one, along with any input held back, and stops
+ * decoding input.
+ *
+ * mccp - the mccp_t instance for the client
+ * telnet - telnet_t instance
+**/
+void stop_decompression(mccp_t* mccp, telnet_t* telnet) {
+  end_inflate(mccp);
+  free(mccp->pending);
+
+  mccp->pending = NULL;
+  mccp->pending_len = 0;
+  mccp->pending_size = 0;
+
+  network_telnet_set_decoder(telnet, NULL);
+}
+
+/**
+ * Deflates data straight into space reserved at the end of an output buffer.  With a
+ * flush the stream keeps being drained until zlib has nothing more to give.
+ *
+ * stream - the deflate stream
+ * output - the output buffer compressed data is written to
+ * data - the data to compress, may be NULL if len is 0
+ * len - the length of the data
+ * flush - the zlib flush mode
+ *
+ * Returns 0 on success or -1 on failure
+**/
+int deflate_data(z_stream* stream, output_buffer_t* output, const char* data, size_t len, int flush) {
+  stream->next_in = (Bytef*)data;
+  stream->avail_in = (uInt)len;
+
+  do {
+    size_t space = 0;
+    char* dest = network_output_buffer_reserve(output, &space);
+
+    if (dest == NULL) {
+      return -1;
+    }
+
+    stream->next_out = (Bytef*)dest;
+    stream->avail_out = (uInt)space;
+
+    int res = deflate(stream, flush);
+
+    if (res == Z_STREAM_ERROR) {
+      return -1;
+    }
+
+    network_output_buffer_commit(output, space - stream->avail_out);
+
+    if (res == Z_STREAM_END) {
+      break;
+    }
+  } while (stream->avail_in > 0 || stream->avail_out == 0);
+
+  return 0;
+}
+
+/**
+ * Appends compressed input to whatever is being held back from previous reads.
+ *
+ * mccp - the mccp_t instance for the client
+ * data - the compressed input
+ * len - the length of the compressed input
+ *
+ * Returns 0 on success or -1 on failure
+**/
+int append_pending(mccp_t* mccp, const char* data, size_t len) {
+  if (mccp->pending_len + len > mccp->pending_size) {
+    char* pending = realloc(mccp->pending, mccp->pending_len + len);
+
+    if (pending == NULL) {
+      return -1;
+    }
+
+    mccp->pending = pending;
+    mccp->pending_size = mccp->pending_len + len;
+  }
+
+  if (len > 0) {
+    memcpy(mccp->pending + mccp->pending_len, data, len);
+  }
+
+  mccp->pending_len += len;
+
+  return 0;
+}
+
+/**
+ * Discards input held back which has been decoded.
+ *
+ * mccp - the mccp_t instance for the client
+ * len - the number of bytes from the start of the held input to discard
+**/
+void consume_pending(mccp_t* mccp, size_t len) {
+  if (len == 0) {
+    return;
+  }
+
+  memmove(mccp->pending, mccp->pending + len, mccp->pending_len - len);
+  mccp->pending_len -= len;
+}
+
+/**
+ * Frees the inflate stream once the client's compressed stream has ended, keeping any
+ * input held back which followed it.
+ *
+ * mccp - the mccp_t instance for the client
+**/
+void end_inflate(mccp_t* mccp) {
+  if (mccp->inflate == NULL) {
+    return;
+  }
+
+  inflateEnd(mccp->inflate);
+  free(mccp->inflate);
+
+  mccp->inflate = NULL;
+}
@@ -0,0 +1,211 @@
+#include <arpa/telnet.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mud/log.h"
+#include "mud/network/capabilities.h"
+#include "mud/network/client.h"
+#include "mud/network/mssp.h"
+#include "mud/network/protocol.h"
+
+static void deallocate_mssp_t(void* value);
+static void initialise_mssp(void* extension, telnet_t* telnet, client_t* client);
+static telnet_option_t* get_option(void* extension, int option);
+static telnet_config_t* get_config(void* extension, int option);
+static void process_se(void* extension, telnet_t* telnet, client_t* client, int option, const char* data, size_t len);
+static void process_negotiated(void* extension, telnet_t* telnet, client_t* client, int option, bool local, bool enabled);
+
+static telnet_config_t mssp_config = {TELOPT_MSSP, false, true};
+
+/**
+ * Creates a new telnet_extension_t for the MSSP extension, which lets crawlers ask for
+ * information about the game.
+ *
+ * pools - the protocol_pools_t to allocate from, or NULL to allocate from the heap
+ * context - context passed to the callback
+ * on_mssp - callback made when the client asks for MSSP, should call network_send_mssp
+ *
+ * Returns the new telnet_extension_t instance or NULL on failure.
+**/
+telnet_extension_t* network_new_mssp_telnet_extension(protocol_pools_t* pools, void* context, on_mssp_func_t on_mssp) {
+  assert(on_mssp);
+
+  telnet_extension_t* extension = network_new_telnet_extension(pools, sizeof(mssp_t));
+
+  if (extension == NULL) {
+    return NULL;
+  }
+
+  mssp_t* mssp = extension->extension;
+
+  mssp->context = context;
+  mssp->on_mssp = on_mssp;
+
+  extension->deallocate = deallocate_mssp_t;
+  extension->initialise = initialise_mssp;
+  extension->get_option = get_option;
+  extension->get_config = get_config;
+  extension->subnegotiation = process_se;
+  extension->negotiated = process_negotiated;
+  extension->encode = NULL;
+  extension->decode = NULL;
+  extension->flush = NULL;
+  extension->next = NULL;
+
+  return extension;
+}
+
+/**
+ * Deallocates a void pointer to mssp_t
+ *
+ * value - void pointer to mssp_t
+**/
+void deallocate_mssp_t(void* value) {
+  assert(value);
+
+  network_protocol_free(value);
+}
+
+/**
+ * Initialises MSSP by sending a WILL to the client
+ *
+ * extension - void pointer to the extension (should be mssp_t)
+ * telnet - the telnet_t instance for the client
+ * client - the client_t instance of the client
+**/
+void initialise_mssp(void* extension, telnet_t* telnet, client_t* client) {
+  assert(extension);
+  assert(telnet);
+  assert(client);
+
+  network_telnet_send_will(telnet, client, TELOPT_MSSP);
+}
+
+/**
+ * Retrieves telnet options relevant to the MSSP extension
+ *
+ * extension - void pointer to the mssp_t instance
+ * option - the option number of the option we're looking for
+ *
+ * Returns the option if MSSP or NULL.
+**/
+telnet_option_t* get_option(void* extension, int option) {
+  assert(extension);
+
+  mssp_t* mssp = extension;
+
+  if (option == TELOPT_MSSP) {
+    return &mssp->mssp;
+  }
+
+  return NULL;
+}
+
+/**
+ * Retrieves config options relevant to the MSSP extension
+ *
+ * extension - void pointer to the mssp_t instance
+ * option - the option number of the option we're looking for
+ *
+ * Returns the option config or NULL.
+**/
+telnet_config_t* get_config(void* extension, int option) {
+  assert(extension);
+
+  if (option == TELOPT_MSSP) {
+    return &mssp_config;
+  }
+
+  return NULL;
+}
+
+/**
+ * MSSP has no subnegotiations from the client, this is a no-op.
+ *
+ * extension - void pointer to mssp_t
+ * telnet - telnet_t instance
+ * client - client_t instance representing the remote client
+ * option - the option negotiated for
+ * data - the data for the subnegotiation
+ * len - the length of the data
+**/
+void process_se(void* extension, telnet_t* telnet, client_t* client, int option, const char* data, size_t len) {
+  assert(extension);
+  assert(telnet);
+  assert(client);
+  assert(data);
+
+  (void)option;
+  (void)len;
+}
+
+/**
+ * Calls back for the game's MSSP variables once the client asks for them.
+ *
+ * extension - void pointer to mssp_t
+ * telnet - telnet_t instance
+ * client - client_t instance representing the remote client
+ * option - the option negotiated
+ * local - whether the option is ours rather than the client's
+ * enabled - whether the option is now enabled
+**/
+void process_negotiated(void* extension, telnet_t* telnet, client_t* client, int option, bool local, bool enabled) {
+  assert(extension);
+  assert(telnet);
+  assert(client);
+
+  mssp_t* mssp = extension;
+
+  if (option != TELOPT_MSSP || !local) {
+    return;
+  }
+
+  if (!enabled) {
+    client->capabilities.flags &= ~CAPABILITY_MSSP;
+
+    return;
+  }
+
+  client->capabilities.flags |= CAPABILITY_MSSP;
+  mssp->on_mssp(client, mssp->context);
+}
+
+/**
+ * Sends MSSP variables to the client as IAC SB MSSP followed by MSSP_VAR name MSSP_VAL
+ * value for each variable and finally IAC SE.  The subnegotiation is sent as essential
+ * output so backpressure never drops part of it.
+ *
+ * client - the client to send the variables to
+ * names - the names of the variables
+ * values - the values of the variables, in the same order as names
+ * count - the number of variables
+**/
+void network_send_mssp(client_t* client, const char* const* names, const char* const* values, size_t count) {
+  assert(client);
+  assert(names);
+  assert(values);
+
+  char begin[] = { (char) IAC, (char) SB, (char) TELOPT_MSSP };
+  char var[] = { (char) MSSP_VAR };
+  char val[] = { (char) MSSP_VAL };
+  char end[] = { (char) IAC, (char) SE };
+
+  int result = send_essential_to_client(client, begin, sizeof(begin));
+
+  for (size_t i = 0; i < count && result != -1; i++) {
+    assert(names[i]);
+    assert(values[i]);
+
+    if (send_essential_to_client(client, var, sizeof(var)) == -1 ||
+        send_essential_to_client(client, names[i], strlen(names[i])) == -1 ||
+        send_essential_to_client(client, val, sizeof(val)) == -1 ||
+        send_essential_to_client(client, values[i], strlen(values[i])) == -1) {
+      result = -1;
+    }
+  }
+
+  if (result == -1 || send_essential_to_client(client, end, sizeof(end)) == -1) {
+    LOG(ERROR, "Failed to send MSSP to client [%d]", client->fd);
+  }
+}
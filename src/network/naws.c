@@ -0,0 +1,185 @@
+#include <arpa/telnet.h>
+#include <assert.h>
+#include <stdlib.h>
+
+#include "mud/log.h"
+#include "mud/network/capabilities.h"
+#include "mud/network/client.h"
+#include "mud/network/naws.h"
+#include "mud/network/protocol.h"
+
+static void deallocate_naws_t(void* value);
+static void initialise_naws(void* extension, telnet_t* telnet, client_t* client);
+static telnet_option_t* get_option(void* extension, int option);
+static telnet_config_t* get_config(void* extension, int option);
+static void process_se(void* extension, telnet_t* telnet, client_t* client, int option, const char* data, size_t len);
+static void process_negotiated(void* extension, telnet_t* telnet, client_t* client, int option, bool local, bool enabled);
+
+static telnet_config_t naws_config = {TELOPT_NAWS, true, false};
+
+/**
+ * Creates a new telnet_extension_t for the NAWS extension, which records the size of
+ * the client's window in its capability profile.
+ *
+ * pools - the protocol_pools_t to allocate from, or NULL to allocate from the heap
+ *
+ * Returns the new telnet_extension_t instance or NULL on failure.
+**/
+telnet_extension_t* network_new_naws_telnet_extension(protocol_pools_t* pools) {
+  telnet_extension_t* extension = network_new_telnet_extension(pools, sizeof(naws_t));
+
+  if (extension == NULL) {
+    return NULL;
+  }
+
+  extension->deallocate = deallocate_naws_t;
+  extension->initialise = initialise_naws;
+  extension->get_option = get_option;
+  extension->get_config = get_config;
+  extension->subnegotiation = process_se;
+  extension->negotiated = process_negotiated;
+  extension->encode = NULL;
+  extension->decode = NULL;
+  extension->flush = NULL;
+  extension->next = NULL;
+
+  return extension;
+}
+
+/**
+ * Deallocates a void pointer to naws_t
+ *
+ * value - void pointer to naws_t
+**/
+void deallocate_naws_t(void* value) {
+  assert(value);
+
+  network_protocol_free(value);
+}
+
+/**
+ * Initialises NAWS by sending a DO to the client
+ *
+ * extension - void pointer to the extension (should be naws_t)
+ * telnet - the telnet_t instance for the client
+ * client - the client_t instance of the client
+**/
+void initialise_naws(void* extension, telnet_t* telnet, client_t* client) {
+  assert(extension);
+  assert(telnet);
+  assert(client);
+
+  network_telnet_send_do(telnet, client, TELOPT_NAWS);
+}
+
+/**
+ * Retrieves telnet options relevant to the NAWS extension
+ *
+ * extension - void pointer to the naws_t instance
+ * option - the option number of the option we're looking for
+ *
+ * Returns the option if NAWS or NULL.
+**/
+telnet_option_t* get_option(void* extension, int option) {
+  assert(extension);
+
+  naws_t* naws = extension;
+
+  if (option == TELOPT_NAWS) {
+    return &naws->naws;
+  }
+
+  return NULL;
+}
+
+/**
+ * Retrieves config options relevant to the NAWS extension
+ *
+ * extension - void pointer to the naws_t instance
+ * option - the option number of the option we're looking for
+ *
+ * Returns the option config or NULL.
+**/
+telnet_config_t* get_config(void* extension, int option) {
+  assert(extension);
+
+  if (option == TELOPT_NAWS) {
+    return &naws_config;
+  }
+
+  return NULL;
+}
+
+/**
+ * Records the window size whenever the client reports it.  The width and height are
+ * each sent as two bytes in network order, with 0 meaning the client doesn't know, in
+ * which case the previous size is kept.
+ *
+ * extension - void pointer to naws_t
+ * telnet - telnet_t instance
+ * client - client_t instance representing the remote client
+ * option - the option negotiated for
+ * data - the data for the subnegotiation
+ * len - the length of the data
+**/
+void process_se(void* extension, telnet_t* telnet, client_t* client, int option, const char* data, size_t len) {
+  assert(extension);
+  assert(telnet);
+  assert(client);
+  assert(data);
+
+  if (option != TELOPT_NAWS) {
+    return;
+  }
+
+  if (len < 4) {
+    LOG(WARN, "Client [%d] sent a NAWS subnegotiation of [%zu] bytes, expected 4", client->fd, len);
+
+    return;
+  }
+
+  const unsigned char* size = (const unsigned char*)data;
+  uint16_t width = (uint16_t)((size[0] << 8) | size[1]);
+  uint16_t height = (uint16_t)((size[2] << 8) | size[3]);
+
+  if (width > 0) {
+    client->capabilities.width = width;
+  }
+
+  if (height > 0) {
+    client->capabilities.height = height;
+  }
+
+  LOG(DEBUG, "Client [%d] window size is [%ux%u]", client->fd, client->capabilities.width, client->capabilities.height);
+}
+
+/**
+ * Records whether the client reports its window size and goes back to the default size
+ * if it stops.
+ *
+ * extension - void pointer to naws_t
+ * telnet - telnet_t instance
+ * client - client_t instance representing the remote client
+ * option - the option negotiated
+ * local - whether the option is ours rather than the client's
+ * enabled - whether the option is now enabled
+**/
+void process_negotiated(void* extension, telnet_t* telnet, client_t* client, int option, bool local, bool enabled) {
+  assert(extension);
+  assert(telnet);
+  assert(client);
+
+  if (option != TELOPT_NAWS || local) {
+    return;
+  }
+
+  if (enabled) {
+    client->capabilities.flags |= CAPABILITY_NAWS;
+
+    return;
+  }
+
+  client->capabilities.flags &= ~CAPABILITY_NAWS;
+  client->capabilities.width = DEFAULT_CLIENT_WIDTH;
+  client->capabilities.height = DEFAULT_CLIENT_HEIGHT;
+}
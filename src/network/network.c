@@ -1,24 +1,46 @@
 #include "mud/network/network.h"
+#include "mud/clock.h"
 #include "mud/data/linked_list/iterator.h"
 #include "mud/data/linked_list/linked_list.h"
 #include "mud/log.h"
 #include "mud/network/client.h"
 #include "mud/network/server.h"
+#include "mud/network/tls.h"
+#include "mud/network/websocket.h"
 
 #include <assert.h>
 #include <netinet/in.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <time.h>
+#include <unistd.h>
 #include <uv.h>
 
 static void on_new_connection(uv_stream_t* stream, int status);
+static client_t* new_client(network_t* network);
+static void start_client(network_t* network, client_t* client, server_t* server);
+static void on_websocket_open(client_t* client, void* context);
+static void client_connected(network_t* network, client_t* client);
 static void on_client_read(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf);
 static void alloc_buffer(uv_handle_t* handle, size_t suggested_size, uv_buf_t* buf);
+static void release_idle_input(client_t* client);
+static void receive_input(network_t* network, client_t* client);
+static void drain_held_input(network_t* network, client_t* client);
+static void flush_client(network_t* network, client_t* client);
+static void remove_dirty_client(network_t* network, client_t* client);
+static void queue_client_flush(network_t* network, client_t* client);
+static void on_coalesce_check(uv_check_t* check);
+static void on_coalesce_timer(uv_timer_t* timer);
+static void on_idle_timer(uv_timer_t* timer);
+static void on_client_idle(timer_wheel_entry_t* entry, void* context);
+static uint64_t client_idle_timeout(network_t* network, client_t* client);
 static void on_client_close(uv_handle_t* handle);
 static void on_client_close_silent(uv_handle_t* handle);
 static void on_server_close(uv_handle_t* handle);
+static void on_server_release(uv_handle_t* handle);
+static int start_tcp_listener(network_t* network, unsigned int port, unsigned int backlog, bool reuseport, bool websocket, SSL_CTX* tls);
 
 /**
  * Allocates and initialises a new network_t struct.
@@ -37,6 +59,27 @@ network_t* create_network_t(void) {
 
   network->servers = create_linked_list_t();
   network->clients = create_linked_list_t();
+  network->client_pool = create_pool_t(sizeof(client_t), CLIENT_POOL_SLAB_SIZE);
+  network->flush_queue = create_linked_list_t();
+  network->dirty_head = NULL;
+  network->dirty_tail = NULL;
+
+  network->output_limit = CLIENT_OUTPUT_LIMIT;
+  network_init_output_pool(&network->output_pool, OUTPUT_POOL_MAX_FREE);
+  network_init_protocol_pools(&network->protocol_pools);
+
+  network->pending_limit = DEFAULT_PENDING_LIMIT;
+  network->backpressure_policy = BACKPRESSURE_DROP;
+  network->backpressure_timeout = DEFAULT_BACKPRESSURE_TIMEOUT;
+
+  network->coalesce_output = false;
+  network->coalesce_latency = DEFAULT_COALESCE_LATENCY;
+
+  network->login_idle_timeout = DEFAULT_LOGIN_IDLE_TIMEOUT;
+  network->play_idle_timeout = DEFAULT_PLAY_IDLE_TIMEOUT;
+  network->keepalive_delay = DEFAULT_KEEPALIVE_DELAY;
+  network->reap_idle = false;
+  network->idle_wheel = NULL;
 
   return network;
 }
@@ -56,28 +99,174 @@ void free_network_t(network_t* network) {
   free_callback_t(network->input_callback);
   free_callback_t(network->flush_callback);
 
+  free_linked_list_t(network->flush_queue);
   free_linked_list_t(network->clients);
   free_linked_list_t(network->servers);
 
+  free_pool_t(network->client_pool);
+
+  if (network->idle_wheel != NULL) {
+    free_timer_wheel_t(network->idle_wheel);
+  }
+
+  network_clear_output_pool(&network->output_pool);
+  network_clear_protocol_pools(&network->protocol_pools);
+
   free(network);
 }
 
 /**
- * Creates a TCP server and begins listening on the given port.
+ * Creates a TCP server and begins listening on the given port using the default
+ * backlog.
  *
  * Returns -1 on failure or 0 on success.
  **/
 int start_game_server(network_t* network, unsigned int port) {
+  return network_start_tcp_server(network, port, DEFAULT_BACKLOG, 1, false, false, NULL);
+}
+
+/**
+ * Creates one or more TCP listeners on the given port.  When more than one shard
+ * is requested each listener binds its own socket with SO_REUSEPORT so the kernel
+ * spreads incoming connections across them rather than every accept contending on
+ * a single queue.
+ *
+ * network - the network_t to add the listeners to
+ * port - the port to listen on
+ * backlog - the size of the pending connection queue for each listener
+ * shards - the number of listeners to bind on the port
+ * reuseport - whether to set SO_REUSEPORT, forced on when shards is greater than one
+ * websocket - whether connections must upgrade to WebSocket
+ * tls - the TLS context connections are terminated with or NULL for plain TCP, each
+ *       listener holding its own reference so every shard shares the one context
+ *
+ * Returns -1 on failure or 0 on success.
+ **/
+int network_start_tcp_server(network_t* network, unsigned int port, unsigned int backlog, unsigned int shards, bool reuseport, bool websocket, SSL_CTX* tls) {
   assert(network);
   assert(network->loop);
   assert(port > 0);
 
+  if (shards == 0) {
+    shards = 1;
+  }
+
+#ifndef SO_REUSEPORT
+  if (shards > 1) {
+    LOG(WARN, "SO_REUSEPORT is not supported, binding a single listener on port [%d]", port);
+  }
+
+  shards = 1;
+  reuseport = false;
+#else
+  if (shards > 1) {
+    reuseport = true;
+  }
+#endif
+
+  for (unsigned int i = 0; i < shards; i++) {
+    if (start_tcp_listener(network, port, backlog, reuseport, websocket, tls) == -1) {
+      stop_game_server(network, port);
+
+      return -1;
+    }
+  }
+
+  LOG(INFO, "Successfully bound [%d] %s%slistener(s) to port [%d]", shards, tls != NULL ? "TLS " : "", websocket ? "WebSocket " : "", port);
+
+  return 0;
+}
+
+/**
+ * Creates a Unix domain socket server and begins listening on the given path.  Any
+ * stale socket file left at the path by a previous run is removed first.
+ *
+ * network - the network_t to add the listener to
+ * path - the filesystem path of the socket
+ * backlog - the size of the pending connection queue
+ *
+ * Returns -1 on failure or 0 on success.
+ **/
+int network_start_unix_server(network_t* network, const char* path, unsigned int backlog) {
+  assert(network);
+  assert(network->loop);
+  assert(path);
+
+  server_t* server = create_server_t();
+  server->type = SERVER_UNIX;
+  server->path = strdup(path);
+  server->backlog = backlog;
+  server->network = network;
+
+  int res = uv_pipe_init(network->loop, &server->handle.pipe, 0);
+
+  if (res != 0) {
+    LOG(ERROR, "uv_pipe_init failed: %s", uv_strerror(res));
+    free_server_t(server);
+
+    return -1;
+  }
+
+  server->handle.pipe.data = server;
+
+  struct stat st;
+
+  if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+    unlink(path);
+  }
+
+  res = uv_pipe_bind(&server->handle.pipe, path);
+
+  if (res != 0) {
+    LOG(ERROR, "uv_pipe_bind on path [%s] failed: %s", path, uv_strerror(res));
+    uv_close((uv_handle_t*)&server->handle, on_server_release);
+
+    return -1;
+  }
+
+  res = uv_listen((uv_stream_t*)&server->handle, (int)server->backlog, on_new_connection);
+
+  if (res != 0) {
+    LOG(ERROR, "uv_listen on path [%s] failed: %s", path, uv_strerror(res));
+    uv_close((uv_handle_t*)&server->handle, on_server_release);
+
+    return -1;
+  }
+
+  list_add(network->servers, server);
+
+  LOG(INFO, "Successfully bound to path [%s]", path);
+
+  return 0;
+}
+
+/**
+ * Creates a single dual-stack TCP listener on the given port and adds it to the
+ * network's list of servers.
+ *
+ * Returns -1 on failure or 0 on success.
+ **/
+static int start_tcp_listener(network_t* network, unsigned int port, unsigned int backlog, bool reuseport, bool websocket, SSL_CTX* tls) {
   server_t* server = create_server_t();
+  server->type = SERVER_TCP;
   server->port = port;
-  server->backlog = BACKLOG;
+  server->backlog = backlog;
+  server->reuseport = reuseport;
+  server->websocket = websocket;
+
+  if (tls != NULL) {
+    if (SSL_CTX_up_ref(tls) != 1) {
+      LOG(ERROR, "Failed to reference TLS context for port [%d]", port);
+      free_server_t(server);
+
+      return -1;
+    }
+
+    server->tls = tls;
+  }
   server->network = network;
 
-  int res = uv_tcp_init(network->loop, &server->handle);
+  int res = uv_tcp_init(network->loop, &server->handle.tcp);
 
   if (res != 0) {
     LOG(ERROR, "uv_tcp_init failed: %s", uv_strerror(res));
@@ -86,16 +275,16 @@ int start_game_server(network_t* network, unsigned int port) {
     return -1;
   }
 
-  server->handle.data = server;
+  server->handle.tcp.data = server;
 
   // Create an IPv6 socket with dual-stack support (accepts both IPv4 and IPv6
-  // connections) by disabling IPV6_V6ONLY before handing iter to libuv.
+  // connections) by disabling IPV6_V6ONLY before handing it to libuv.  SO_REUSEPORT
+  // must likewise be set before bind, which libuv offers no way to do itself.
   int sockfd = socket(AF_INET6, SOCK_STREAM, 0);
 
   if (sockfd < 0) {
     LOG(ERROR, "socket() failed for port [%d]", port);
-    uv_close((uv_handle_t*)&server->handle, NULL);
-    free_server_t(server);
+    uv_close((uv_handle_t*)&server->handle, on_server_release);
 
     return -1;
   }
@@ -103,12 +292,22 @@ int start_game_server(network_t* network, unsigned int port) {
   int ipv6only = 0;
   setsockopt(sockfd, IPPROTO_IPV6, IPV6_V6ONLY, &ipv6only, sizeof(ipv6only));
 
-  res = uv_tcp_open(&server->handle, (uv_os_sock_t)sockfd);
+#ifdef SO_REUSEPORT
+  if (reuseport) {
+    int enable = 1;
+
+    if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) != 0) {
+      LOG(WARN, "Failed to set SO_REUSEPORT on port [%d]", port);
+    }
+  }
+#endif
+
+  res = uv_tcp_open(&server->handle.tcp, (uv_os_sock_t)sockfd);
 
   if (res != 0) {
     LOG(ERROR, "uv_tcp_open failed: %s", uv_strerror(res));
-    uv_close((uv_handle_t*)&server->handle, NULL);
-    free_server_t(server);
+    close(sockfd);
+    uv_close((uv_handle_t*)&server->handle, on_server_release);
 
     return -1;
   }
@@ -116,12 +315,11 @@ int start_game_server(network_t* network, unsigned int port) {
   struct sockaddr_in6 addr;
   uv_ip6_addr("::", (int)port, &addr);
 
-  res = uv_tcp_bind(&server->handle, (const struct sockaddr*)&addr, 0);
+  res = uv_tcp_bind(&server->handle.tcp, (const struct sockaddr*)&addr, 0);
 
   if (res != 0) {
     LOG(ERROR, "uv_tcp_bind on port [%d] failed: %s", port, uv_strerror(res));
-    uv_close((uv_handle_t*)&server->handle, NULL);
-    free_server_t(server);
+    uv_close((uv_handle_t*)&server->handle, on_server_release);
 
     return -1;
   }
@@ -130,19 +328,30 @@ int start_game_server(network_t* network, unsigned int port) {
 
   if (res != 0) {
     LOG(ERROR, "uv_listen on port [%d] failed: %s", port, uv_strerror(res));
-    uv_close((uv_handle_t*)&server->handle, NULL);
-    free_server_t(server);
+    uv_close((uv_handle_t*)&server->handle, on_server_release);
 
     return -1;
   }
 
   list_add(network->servers, server);
 
-  LOG(INFO, "Successfully bound to port [%d]", port);
-
   return 0;
 }
 
+/**
+ * Resolves a client ID to the client it was issued to.
+ *
+ * network - the network_t the client is connected to
+ * id - the generation-tagged ID of the client
+ *
+ * Returns the client or NULL if it has since disconnected.
+ **/
+client_t* network_get_client(network_t* network, pool_id_t id) {
+  assert(network);
+
+  return pool_lookup(network->client_pool, id);
+}
+
 /**
  * Sets a callback to be called when a client is accepted.
  **/
@@ -196,25 +405,201 @@ void register_flush_callback(network_t* network, callback_func func, void* conte
 }
 
 /**
- * Checks all clients for pending output and flushes their buffers.
+ * Flushes the output of every client on the dirty list, so the cost is proportional
+ * to the number of clients with output rather than the number connected.  The list
+ * is detached before flushing, clients whose output is held back by backpressure,
+ * including output deferred by protocols, are marked dirty again for the next flush.
  *
  * network - network_t containing network context
  **/
 void flush_output(network_t* network) {
-  it_t iter = list_begin(network->clients);
-  client_t* client = NULL;
+  client_t* client = network->dirty_head;
 
-  while ((client = it_get(iter)) != NULL) {
-    if (client->output_length > 0) {
-      if (network->flush_callback->func) {
-        network->flush_callback->func(client, network->flush_callback->context);
-      }
+  network->dirty_head = NULL;
+  network->dirty_tail = NULL;
+
+  while (client != NULL) {
+    client_t* next = client->dirty_next;
 
-      flush_client_output(client);
+    client->dirty_prev = NULL;
+    client->dirty_next = NULL;
+
+    if (client->output.length > 0 || client->deferred) {
+      flush_client(network, client);
     }
 
-    iter = it_next(iter);
+    client->dirty = false;
+
+    if (client->output.length > 0 || client->deferred) {
+      network_mark_client_dirty(network, client);
+    }
+
+    client = next;
+  }
+}
+
+/**
+ * Adds a client to the tail of the dirty list of clients with output to flush.
+ *
+ * network - network_t the client belongs to
+ * client - the client_t which has had output queued
+ **/
+void network_mark_client_dirty(network_t* network, client_t* client) {
+  assert(network);
+  assert(client);
+
+  if (client->dirty) {
+    return;
+  }
+
+  client->dirty = true;
+  client->dirty_prev = network->dirty_tail;
+  client->dirty_next = NULL;
+
+  if (network->dirty_tail != NULL) {
+    network->dirty_tail->dirty_next = client;
+  } else {
+    network->dirty_head = client;
+  }
+
+  network->dirty_tail = client;
+}
+
+/**
+ * Enables reaping of idle connections.  Each client's idle deadline is tracked in a
+ * hashed timing wheel which is pushed back in O(1) whenever the client sends data,
+ * and the wheel is advanced once per tick so only the clients whose deadlines have
+ * passed are visited.  Clients which haven't authenticated are held to the login idle
+ * timeout and authenticated clients to the play idle timeout, where a timeout of 0
+ * never expires.
+ *
+ * network - network_t with its loop and idle timeouts set
+ *
+ * Returns 0 on success or -1 on failure
+ **/
+int network_enable_idle_reaper(network_t* network) {
+  assert(network);
+  assert(network->loop);
+
+  int res = uv_timer_init(network->loop, &network->idle_timer);
+
+  if (res != 0) {
+    LOG(ERROR, "uv_timer_init for idle reaper failed: %s", uv_strerror(res));
+
+    return -1;
+  }
+
+  network->idle_wheel = create_timer_wheel_t(IDLE_WHEEL_SLOTS, IDLE_WHEEL_RESOLUTION, clock_now(network->loop));
+  network->idle_timer.data = network;
+  network->reap_idle = true;
+
+  uv_timer_start(&network->idle_timer, on_idle_timer, IDLE_WHEEL_RESOLUTION, IDLE_WHEEL_RESOLUTION);
+  uv_unref((uv_handle_t*)&network->idle_timer);
+
+  return 0;
+}
+
+/**
+ * Advances the idle wheel and disconnects clients whose idle deadlines have passed.
+ * Called once per idle wheel tick, or more often by anything driving time itself.
+ *
+ * network - network_t with the idle reaper enabled
+ **/
+void network_reap_idle_clients(network_t* network) {
+  assert(network);
+
+  if (!network->reap_idle) {
+    return;
+  }
+
+  timer_wheel_advance(network->idle_wheel, clock_now(network->loop), on_client_idle, network);
+}
+
+/**
+ * Records activity from a client and pushes back its idle deadline.
+ *
+ * network - the network_t the client is connected to
+ * client - the client_t which was active
+ **/
+void network_touch_client(network_t* network, client_t* client) {
+  assert(network);
+  assert(client);
+
+  client->last_active = clock_now(network->loop);
+
+  if (!network->reap_idle) {
+    return;
+  }
+
+  uint64_t timeout = client_idle_timeout(network, client);
+
+  if (timeout == 0) {
+    timer_wheel_cancel(network->idle_wheel, &client->idle_entry);
+
+    return;
+  }
+
+  timer_wheel_schedule(network->idle_wheel, &client->idle_entry, client->last_active + timeout);
+}
+
+/**
+ * Marks a client as authenticated so it's held to the play idle timeout rather than
+ * the login idle timeout from now on.
+ *
+ * client - the client_t which authenticated
+ **/
+void network_client_authenticated(client_t* client) {
+  assert(client);
+  assert(client->network);
+
+  client->authenticated = true;
+
+  network_touch_client(client->network, client);
+}
+
+/**
+ * Enables coalescing of output produced in response to client input.  Rather than
+ * flushing straight after each input callback, clients are queued and flushed once
+ * per loop iteration after I/O has been processed, so a burst of input produces a
+ * single write.  With a non-zero latency, output may be held across loop iterations
+ * for up to that many milliseconds to coalesce further.
+ *
+ * network - network_t with its loop set
+ * latency - the maximum milliseconds input triggered output may be held for
+ *
+ * Returns 0 on success or -1 on failure
+ **/
+int network_enable_output_coalescing(network_t* network, unsigned int latency) {
+  assert(network);
+  assert(network->loop);
+
+  int res = uv_check_init(network->loop, &network->coalesce_check);
+
+  if (res != 0) {
+    LOG(ERROR, "uv_check_init for output coalescing failed: %s", uv_strerror(res));
+
+    return -1;
+  }
+
+  if ((res = uv_timer_init(network->loop, &network->coalesce_timer)) != 0) {
+    LOG(ERROR, "uv_timer_init for output coalescing failed: %s", uv_strerror(res));
+    uv_close((uv_handle_t*)&network->coalesce_check, NULL);
+
+    return -1;
   }
+
+  network->coalesce_check.data = network;
+  network->coalesce_timer.data = network;
+  network->coalesce_output = true;
+  network->coalesce_latency = latency;
+
+  uv_check_start(&network->coalesce_check, on_coalesce_check);
+
+  // Neither handle should keep the loop alive on its own during shutdown
+  uv_unref((uv_handle_t*)&network->coalesce_check);
+  uv_unref((uv_handle_t*)&network->coalesce_timer);
+
+  return 0;
 }
 
 /**
@@ -264,21 +649,105 @@ void network_shutdown(network_t* network) {
       uv_close((uv_handle_t*)&server->handle, on_server_close);
     }
   }
+
+  if (network->coalesce_output) {
+    network->coalesce_output = false;
+
+    uv_close((uv_handle_t*)&network->coalesce_check, NULL);
+    uv_close((uv_handle_t*)&network->coalesce_timer, NULL);
+  }
+
+  if (network->reap_idle) {
+    network->reap_idle = false;
+
+    uv_close((uv_handle_t*)&network->idle_timer, NULL);
+  }
 }
 
 /**
- * Searches our internal list of servers for one on the given port and closes iter.
+ * Parses the name of a backpressure policy.
  *
- * Returns -1 if server not found or 0 on success.
+ * value - the name of the policy, one of drop, coalesce or disconnect
+ * policy - populated with the parsed policy on success
+ *
+ * Returns 0 on success or -1 if the name isn't recognised
+ **/
+int network_parse_backpressure_policy(const char* value, backpressure_policy_t* policy) {
+  assert(value);
+  assert(policy);
+
+  if (strcmp(value, "drop") == 0) {
+    *policy = BACKPRESSURE_DROP;
+  } else if (strcmp(value, "coalesce") == 0) {
+    *policy = BACKPRESSURE_COALESCE;
+  } else if (strcmp(value, "disconnect") == 0) {
+    *policy = BACKPRESSURE_DISCONNECT;
+  } else {
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * Returns the name of a backpressure policy.
+ **/
+const char* network_backpressure_policy_name(backpressure_policy_t policy) {
+  switch (policy) {
+  case BACKPRESSURE_COALESCE:
+    return "coalesce";
+
+  case BACKPRESSURE_DISCONNECT:
+    return "disconnect";
+
+  default:
+    return "drop";
+  }
+}
+
+/**
+ * Searches our internal list of servers for any listening on the given port and
+ * closes them, including every shard bound to the port.
+ *
+ * Returns -1 if no server found or 0 on success.
  **/
 int stop_game_server(network_t* network, unsigned int port) {
   assert(network);
 
   it_t iter = list_begin(network->servers);
   server_t* server = NULL;
+  int res = -1;
 
   while ((server = (server_t*)it_get(iter)) != NULL) {
-    if (server->port == port) {
+    if (server->type == SERVER_TCP && server->port == port) {
+      if (!uv_is_closing((uv_handle_t*)&server->handle)) {
+        uv_close((uv_handle_t*)&server->handle, on_server_close);
+      }
+
+      res = 0;
+    }
+
+    iter = it_next(iter);
+  }
+
+  return res;
+}
+
+/**
+ * Searches our internal list of servers for a Unix domain socket listening on the
+ * given path and closes it.
+ *
+ * Returns -1 if server not found or 0 on success.
+ **/
+int network_stop_unix_server(network_t* network, const char* path) {
+  assert(network);
+  assert(path);
+
+  it_t iter = list_begin(network->servers);
+  server_t* server = NULL;
+
+  while ((server = (server_t*)it_get(iter)) != NULL) {
+    if (server->type == SERVER_UNIX && strcmp(server->path, path) == 0) {
       if (!uv_is_closing((uv_handle_t*)&server->handle)) {
         uv_close((uv_handle_t*)&server->handle, on_server_close);
       }
@@ -305,62 +774,193 @@ static void on_new_connection(uv_stream_t* stream, int status) {
   server_t* server = stream->data;
   network_t* network = server->network;
 
-  client_t* client = create_client_t();
-  client->network = network;
+  client_t* client = new_client(network);
+
+  if (client == NULL) {
+    return;
+  }
+
+  int res = 0;
 
-  int res = uv_tcp_init(network->loop, &client->handle);
+  if (server->type == SERVER_UNIX) {
+    res = uv_pipe_init(network->loop, &client->handle.pipe, 0);
+  } else {
+    res = uv_tcp_init(network->loop, &client->handle.tcp);
+  }
 
   if (res != 0) {
-    LOG(ERROR, "uv_tcp_init for client failed: %s", uv_strerror(res));
+    LOG(ERROR, "Handle init for client failed: %s", uv_strerror(res));
     free_client_t(client);
 
     return;
   }
 
-  client->handle.data = client;
+  ((uv_handle_t*)&client->handle)->data = client;
 
+  // The client can only be released once libuv has finished closing its handle,
+  // otherwise the slot could be handed to a new connection while still in use.
   if (uv_accept(stream, (uv_stream_t*)&client->handle) != 0) {
-    uv_close((uv_handle_t*)&client->handle, NULL);
-    free_client_t(client);
+    uv_close((uv_handle_t*)&client->handle, on_client_close_silent);
 
     return;
   }
 
+  start_client(network, client, server);
+}
+
+/**
+ * Connects a client over one end of an in-process connection such as a socket pair,
+ * rather than one accepted by a server.  The client is treated as a plain connection
+ * without TLS or WebSocket framing.
+ *
+ * network - the network_t to connect the client to
+ * fd - the descriptor of this end of the connection, owned by the client from now on
+ *
+ * Returns 0 on success or -1 on failure
+ **/
+int network_connect_local_client(network_t* network, uv_file fd) {
+  assert(network);
+  assert(network->loop);
+
+  client_t* client = new_client(network);
+
+  if (client == NULL) {
+    return -1;
+  }
+
+  int res = uv_pipe_init(network->loop, &client->handle.pipe, 0);
+
+  if (res != 0) {
+    LOG(ERROR, "Handle init for local client failed: %s", uv_strerror(res));
+    free_client_t(client);
+    close(fd);
+
+    return -1;
+  }
+
+  ((uv_handle_t*)&client->handle)->data = client;
+
+  if ((res = uv_pipe_open(&client->handle.pipe, fd)) != 0) {
+    LOG(ERROR, "uv_pipe_open for local client failed: %s", uv_strerror(res));
+    uv_close((uv_handle_t*)&client->handle, on_client_close_silent);
+    close(fd);
+
+    return -1;
+  }
+
+  start_client(network, client, NULL);
+
+  return 0;
+}
+
+/**
+ * Allocates a client for a new connection to the network.
+ *
+ * Returns the client_t or NULL if the client pool is exhausted
+ **/
+static client_t* new_client(network_t* network) {
+  client_t* client = create_client_t(network->client_pool);
+
+  if (client == NULL) {
+    LOG(ERROR, "Failed to allocate client for new connection");
+
+    return NULL;
+  }
+
+  client->network = network;
+  client->output.limit = network->output_limit;
+  client->output.pool = &network->output_pool;
+  client->idle_entry.data = client;
+
+  return client;
+}
+
+/**
+ * Adds a newly connected client to the network, sets up the protocols of the server it
+ * connected to and starts reading from it.
+ *
+ * network - the network_t the client connected to
+ * client - the client_t with its handle connected
+ * server - the server_t which accepted the client, or NULL for a local client
+ **/
+static void start_client(network_t* network, client_t* client, server_t* server) {
   uv_os_fd_t ofd;
   uv_fileno((uv_handle_t*)&client->handle, &ofd);
   client->fd = (int)ofd;
 
+  if (server != NULL && server->type == SERVER_TCP && network->keepalive_delay > 0) {
+    uv_tcp_keepalive(&client->handle.tcp, 1, network->keepalive_delay);
+  }
+
   list_add(network->clients, client);
+  network->metrics.connections++;
+  network_touch_client(network, client);
 
   LOG(INFO, "Client descriptor [%d] connected", client->fd);
 
-  if (network->connection_callback->func) {
-    network->connection_callback->func(client, network->connection_callback->context);
+  if (server != NULL && server->tls != NULL) {
+    protocol_t* tls = network_new_tls_protocol_t(&network->protocol_pools, server->tls);
+
+    if (tls == NULL) {
+      uv_close((uv_handle_t*)&client->handle, on_client_close);
+
+      return;
+    }
+
+    network_add_client_protocol(client, tls);
+  }
+
+  if (server != NULL && server->websocket) {
+    protocol_t* websocket = network_new_websocket_protocol_t(&network->protocol_pools, on_websocket_open, network);
+
+    if (websocket == NULL) {
+      uv_close((uv_handle_t*)&client->handle, on_client_close);
+
+      return;
+    }
+
+    network_add_client_protocol(client, websocket);
+  } else {
+    client_connected(network, client);
   }
 
   uv_read_start((uv_stream_t*)&client->handle, alloc_buffer, on_client_read);
 }
 
+/**
+ * Called by the WebSocket protocol once a client's connection has been upgraded, at
+ * which point it's connected as far as the game is concerned.
+ **/
+static void on_websocket_open(client_t* client, void* context) {
+  client_connected(context, client);
+}
+
+/**
+ * Marks a client as connected and notifies the application via the connection
+ * callback.  Until then the client's input, flushes and disconnection are kept from
+ * the application.
+ **/
+static void client_connected(network_t* network, client_t* client) {
+  client->connected = true;
+
+  if (network->connection_callback->func) {
+    network->connection_callback->func(client, network->connection_callback->context);
+  }
+}
+
 /**
  * Called by libuv to request a buffer for incoming data.  Reads directly into
- * the client's input buffer at the current write position.
+ * the client's input buffer at its write offset, the input buffer allocating
+ * itself first if the client doesn't currently hold one.
  **/
 static void alloc_buffer(uv_handle_t* handle, size_t suggested_size, uv_buf_t* buf) {
   (void)suggested_size;
   client_t* client = handle->data;
 
-  size_t existing = strnlen(client->input, CLIENT_BUFFER_LENGTH);
-  size_t remaining = CLIENT_BUFFER_LENGTH - existing;
+  size_t len = 0;
 
-  if (remaining == 0) {
-    buf->base = NULL;
-    buf->len = 0;
-
-    return;
-  }
-
-  buf->base = client->input + existing;
-  buf->len = remaining;
+  buf->base = network_input_buffer_reserve(&client->input, &len);
+  buf->len = len;
 }
 
 /**
@@ -388,31 +988,213 @@ static void on_client_read(uv_stream_t* stream, ssize_t nread, const uv_buf_t* b
   }
 
   if (nread == 0) {
+    release_idle_input(client);
+
     return;
   }
 
   char* data = buf->base;
   data[nread] = '\0';
 
-  network_protocol_chain_on_input(client, data, (size_t)nread);
+  client->input_held = false;
+
+  int len = network_protocol_chain_on_input(client, data, (size_t)nread, buf->len);
+
+  network_input_buffer_commit(&client->input, len > 0 ? (size_t)len : 0);
 
-  client->last_active = time(NULL);
+  network_touch_client(network, client);
 
-  if (network->input_callback->func) {
+  receive_input(network, client);
+  drain_held_input(network, client);
+  release_idle_input(client);
+
+  // Flush output immediately, or at the end of this loop iteration when coalescing,
+  // so responses reach the client without waiting for the next tick.  That includes
+  // output deferred by protocols, such as their half of a handshake.
+  if (client->output.length > 0 || client->deferred) {
+    if (network->coalesce_output) {
+      queue_client_flush(network, client);
+    } else {
+      flush_client(network, client);
+    }
+  }
+}
+
+/**
+ * Lets the application know a connected client has input waiting in its input buffer.
+ **/
+static void receive_input(network_t* network, client_t* client) {
+  if (client->connected && network->input_callback->func) {
     network->input_callback->func(client, network->input_callback->context);
   }
+}
 
-  // Flush output immediately so responses reach the client without waiting
-  // for the next tick.
-  if (client->output_length > 0) {
-    if (network->flush_callback->func) {
-      network->flush_callback->func(client, network->flush_callback->context);
+/**
+ * Passes input which protocols held back for lack of space through the protocol chain
+ * again once the application has consumed what was passed on, rather than leaving it
+ * until the client next sends something.  Protocols only hold input when they've
+ * filled the space they were given, so each pass works through more of it.
+ **/
+static void drain_held_input(network_t* network, client_t* client) {
+  while (client->input_held) {
+    size_t size = 0;
+    char* space = network_input_buffer_reserve(&client->input, &size);
+
+    if (space == NULL) {
+      break;
     }
 
-    flush_client_output(client);
+    client->input_held = false;
+
+    int len = network_protocol_chain_on_input(client, space, 0, size);
+
+    if (len <= 0) {
+      break;
+    }
+
+    network_input_buffer_commit(&client->input, (size_t)len);
+    receive_input(network, client);
+  }
+}
+
+/**
+ * Frees the input buffer of a client once all complete lines have been consumed
+ * from it so idle connections don't hold on to a full input buffer.
+ **/
+static void release_idle_input(client_t* client) {
+  if (client->input.data != NULL && network_input_buffer_is_empty(&client->input)) {
+    network_release_input_buffer(&client->input);
   }
 }
 
+/**
+ * Flushes a client's output subject to backpressure.  While a client has more output
+ * queued in libuv than the pending limit, the coalesce and disconnect policies hold
+ * its output back rather than queueing more, and the disconnect policy closes the
+ * client once it has been throttled for longer than the backpressure timeout.
+ **/
+static void flush_client(network_t* network, client_t* client) {
+  network_client_update_pending(client);
+
+  if (client->throttled) {
+    uint64_t throttled_for = clock_now(network->loop) - client->throttled_since;
+
+    if (network->backpressure_policy == BACKPRESSURE_DISCONNECT && throttled_for >= network->backpressure_timeout * 1000ULL) {
+      LOG(WARN, "Disconnecting client fd [%d] after [%u] seconds with [%zu] bytes of output pending", client->fd, network->backpressure_timeout, client->pending);
+
+      network->metrics.slow_disconnects++;
+
+      if (!uv_is_closing((uv_handle_t*)&client->handle)) {
+        uv_close((uv_handle_t*)&client->handle, on_client_close);
+      }
+
+      return;
+    }
+
+    if (network->backpressure_policy != BACKPRESSURE_DROP) {
+      client->held = true;
+
+      return;
+    }
+  }
+
+  client->held = false;
+
+  if (client->connected && network->flush_callback->func) {
+    network->flush_callback->func(client, network->flush_callback->context);
+  }
+
+  flush_client_output(client);
+
+  // Clients which have been hung up are closed once their last output is written
+  if (client->hungup && !uv_is_closing((uv_handle_t*)&client->handle)) {
+    uv_close((uv_handle_t*)&client->handle, on_client_close);
+  }
+}
+
+/**
+ * Queues a client to have its output flushed by the coalescing check handle, arming
+ * the coalescing timer so the loop wakes up in time to honour the latency bound.
+ **/
+static void queue_client_flush(network_t* network, client_t* client) {
+  if (client->flush_queued) {
+    return;
+  }
+
+  client->flush_queued = true;
+  client->flush_queued_at = clock_now(network->loop);
+
+  list_add(network->flush_queue, client);
+
+  if (network->coalesce_latency > 0 && !uv_is_active((uv_handle_t*)&network->coalesce_timer)) {
+    uv_timer_start(&network->coalesce_timer, on_coalesce_timer, network->coalesce_latency, 0);
+  }
+}
+
+/**
+ * Called by libuv once per loop iteration after I/O has been processed.  Flushes
+ * every queued client whose output has waited at least the coalescing latency.
+ * Clients are queued in order so the first one still waiting determines when the
+ * timer needs to wake the loop again.
+ **/
+static void on_coalesce_check(uv_check_t* check) {
+  network_t* network = check->data;
+  uint64_t now = clock_now(network->loop);
+
+  it_t iter = list_begin(network->flush_queue);
+  client_t* client = NULL;
+
+  while ((client = it_get(iter)) != NULL) {
+    uint64_t waited = now - client->flush_queued_at;
+
+    if (waited < network->coalesce_latency) {
+      uv_timer_start(&network->coalesce_timer, on_coalesce_timer, network->coalesce_latency - waited, 0);
+
+      return;
+    }
+
+    iter = list_remove(network->flush_queue, client);
+    client->flush_queued = false;
+
+    if (client->output.length > 0 || client->deferred) {
+      flush_client(network, client);
+    }
+  }
+}
+
+/**
+ * Called by libuv when the coalescing latency bound expires.  It only exists to
+ * wake the loop, the check handle performs the flush.
+ **/
+static void on_coalesce_timer(uv_timer_t* timer) {
+  (void)timer;
+}
+
+/**
+ * Unlinks a client from the dirty list.
+ **/
+static void remove_dirty_client(network_t* network, client_t* client) {
+  if (!client->dirty) {
+    return;
+  }
+
+  if (client->dirty_prev != NULL) {
+    client->dirty_prev->dirty_next = client->dirty_next;
+  } else if (network->dirty_head == client) {
+    network->dirty_head = client->dirty_next;
+  }
+
+  if (client->dirty_next != NULL) {
+    client->dirty_next->dirty_prev = client->dirty_prev;
+  } else if (network->dirty_tail == client) {
+    network->dirty_tail = client->dirty_prev;
+  }
+
+  client->dirty = false;
+  client->dirty_prev = NULL;
+  client->dirty_next = NULL;
+}
+
 /**
  * Called by libuv after a client handle is closed.  Notifies the application via
  * the disconnection callback then removes the client from the list and frees iter.
@@ -424,8 +1206,19 @@ static void on_client_close(uv_handle_t* handle) {
   LOG(INFO, "Client descriptor [%d] disconnected", client->fd);
 
   list_remove(network->clients, client);
+  network->metrics.disconnections++;
 
-  if (network->disconnection_callback->func) {
+  if (client->flush_queued) {
+    list_remove(network->flush_queue, client);
+  }
+
+  remove_dirty_client(network, client);
+
+  if (network->idle_wheel != NULL) {
+    timer_wheel_cancel(network->idle_wheel, &client->idle_entry);
+  }
+
+  if (client->connected && network->disconnection_callback->func) {
     network->disconnection_callback->func(client, network->disconnection_callback->context);
   }
 
@@ -441,6 +1234,17 @@ static void on_client_close_silent(uv_handle_t* handle) {
   network_t* network = client->network;
 
   list_remove(network->clients, client);
+
+  if (client->flush_queued) {
+    list_remove(network->flush_queue, client);
+  }
+
+  remove_dirty_client(network, client);
+
+  if (network->idle_wheel != NULL) {
+    timer_wheel_cancel(network->idle_wheel, &client->idle_entry);
+  }
+
   free_client_t(client);
 }
 
@@ -453,5 +1257,53 @@ static void on_server_close(uv_handle_t* handle) {
   network_t* network = server->network;
 
   list_remove(network->servers, server);
+
+  if (server->type == SERVER_UNIX) {
+    unlink(server->path);
+  }
+
   free_server_t(server);
 }
+
+/**
+ * Called by libuv after a server handle which failed to start listening is closed.
+ * The server was never added to the list so is simply freed.
+ **/
+static void on_server_release(uv_handle_t* handle) {
+  free_server_t(handle->data);
+}
+
+/**
+ * Called by libuv once per idle wheel tick to reap idle clients.
+ **/
+static void on_idle_timer(uv_timer_t* timer) {
+  network_reap_idle_clients(timer->data);
+}
+
+/**
+ * Called by the idle wheel for each client whose idle deadline has passed.
+ **/
+static void on_client_idle(timer_wheel_entry_t* entry, void* context) {
+  network_t* network = context;
+  client_t* client = entry->data;
+
+  if (uv_is_closing((uv_handle_t*)&client->handle)) {
+    return;
+  }
+
+  LOG(INFO, "Disconnecting client fd [%d] after [%d] seconds idle", client->fd, client_get_idle_seconds(client));
+
+  network->metrics.idle_disconnects++;
+
+  uv_close((uv_handle_t*)&client->handle, on_client_close);
+}
+
+/**
+ * Returns the idle timeout in milliseconds which applies to a client, or 0 if the
+ * client should never time out.
+ **/
+static uint64_t client_idle_timeout(network_t* network, client_t* client) {
+  unsigned int timeout = client->authenticated ? network->play_idle_timeout : network->login_idle_timeout;
+
+  return (uint64_t)timeout * 1000;
+}
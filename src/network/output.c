@@ -0,0 +1,575 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mud/network/output.h"
+
+static output_segment_t* acquire_output_segment(output_pool_t* pool);
+
+/**
+ * Initialises an output pool.  Segments and write requests released back to the
+ * pool are kept on free lists for reuse rather than being returned to the allocator.
+ *
+ * pool - the output_pool_t to initialise
+ * max_free - the maximum number of free segments and writes the pool will retain
+**/
+void network_init_output_pool(output_pool_t* pool, size_t max_free) {
+  assert(pool);
+
+  pool->segments = NULL;
+  pool->writes = NULL;
+  pool->free_segments = 0;
+  pool->free_writes = 0;
+  pool->max_free = max_free;
+}
+
+/**
+ * Frees all segments and write requests held on the free lists of an output pool.
+ * Anything still in use at this point is not owned by the pool and is not freed.
+ *
+ * pool - the output_pool_t to clear
+**/
+void network_clear_output_pool(output_pool_t* pool) {
+  assert(pool);
+
+  while (pool->segments != NULL) {
+    output_segment_t* next = pool->segments->next;
+
+    free(pool->segments);
+
+    pool->segments = next;
+  }
+
+  while (pool->writes != NULL) {
+    output_write_t* next = pool->writes->next;
+
+    free(pool->writes);
+
+    pool->writes = next;
+  }
+
+  pool->free_segments = 0;
+  pool->free_writes = 0;
+}
+
+/**
+ * Takes an additional reference to an output segment.
+ *
+ * segment - the output_segment_t to retain
+**/
+void network_output_segment_retain(output_segment_t* segment) {
+  assert(segment);
+
+  segment->refs++;
+}
+
+/**
+ * Drops a reference to an output segment.  Once the last reference is dropped
+ * the segment is returned to the pool, or freed if there is no pool or the pool
+ * is already holding as many free segments as it's allowed.
+ *
+ * pool - the output_pool_t the segment came from, may be NULL
+ * segment - the output_segment_t to release
+**/
+void network_output_segment_release(output_pool_t* pool, output_segment_t* segment) {
+  assert(segment);
+  assert(segment->refs > 0);
+
+  if (--segment->refs > 0) {
+    return;
+  }
+
+  if (pool == NULL || pool->free_segments >= pool->max_free) {
+    free(segment);
+
+    return;
+  }
+
+  segment->next = pool->segments;
+  pool->segments = segment;
+  pool->free_segments++;
+}
+
+/**
+ * Takes an additional reference to every segment in a chain.
+ *
+ * head - the first output_segment_t in the chain
+**/
+void network_output_segments_retain(output_segment_t* head) {
+  for (output_segment_t* segment = head; segment != NULL; segment = segment->next) {
+    network_output_segment_retain(segment);
+  }
+}
+
+/**
+ * Drops a reference to every segment in a chain.
+ *
+ * pool - the output_pool_t the segments came from, may be NULL
+ * head - the first output_segment_t in the chain
+**/
+void network_output_segments_release(output_pool_t* pool, output_segment_t* head) {
+  output_segment_t* segment = head;
+
+  while (segment != NULL) {
+    output_segment_t* next = segment->next;
+
+    network_output_segment_release(pool, segment);
+
+    segment = next;
+  }
+}
+
+/**
+ * Acquires a write request from the pool, allocating a new one if the pool has
+ * none free.
+ *
+ * pool - the output_pool_t to acquire from, may be NULL
+ *
+ * Returns the write request or NULL on failure
+**/
+output_write_t* network_output_write_acquire(output_pool_t* pool) {
+  output_write_t* write = NULL;
+
+  if (pool != NULL && pool->writes != NULL) {
+    write = pool->writes;
+    pool->writes = write->next;
+    pool->free_writes--;
+  } else if ((write = malloc(sizeof(output_write_t))) == NULL) {
+    return NULL;
+  }
+
+  write->pool = pool;
+  write->segments = NULL;
+  write->next = NULL;
+
+  return write;
+}
+
+/**
+ * Releases a write request along with its references to the segments it wrote.
+ *
+ * write - the output_write_t to release
+**/
+void network_output_write_release(output_write_t* write) {
+  assert(write);
+
+  output_pool_t* pool = write->pool;
+
+  network_output_segments_release(pool, write->segments);
+  write->segments = NULL;
+
+  if (pool == NULL || pool->free_writes >= pool->max_free) {
+    free(write);
+
+    return;
+  }
+
+  write->next = pool->writes;
+  pool->writes = write;
+  pool->free_writes++;
+}
+
+/**
+ * Initialises an output buffer with no segments.  Segments are only acquired once
+ * output is appended so an idle buffer costs nothing beyond the struct itself.
+ *
+ * buffer - the output_buffer_t to initialise
+ * limit - the high-water mark in bytes past which appends are rejected
+**/
+void network_init_output_buffer(output_buffer_t* buffer, size_t limit) {
+  assert(buffer);
+
+  buffer->pool = NULL;
+  buffer->head = NULL;
+  buffer->tail = NULL;
+  buffer->length = 0;
+  buffer->limit = limit;
+  buffer->essential = false;
+}
+
+/**
+ * Releases the buffer's references to its segments and resets it to empty.  Segments
+ * still referenced elsewhere, such as by an in-flight write, survive until they are
+ * released there.  The pool and limit are preserved.
+ *
+ * buffer - the output_buffer_t to clear
+**/
+void network_clear_output_buffer(output_buffer_t* buffer) {
+  assert(buffer);
+
+  network_output_segments_release(buffer->pool, buffer->head);
+
+  buffer->head = NULL;
+  buffer->tail = NULL;
+  buffer->length = 0;
+  buffer->essential = false;
+}
+
+/**
+ * Appends data to the output buffer, filling the tail segment before acquiring
+ * new segments as required.  Every segment the data needs is acquired before any
+ * of it is copied so a failed append leaves the buffer as it was.
+ *
+ * buffer - the output_buffer_t to append to
+ * data - the data to append
+ * len - the length of the data
+ *
+ * Returns 0 on success or -1 if the data would take the buffer past its limit or
+ * a segment couldn't be acquired
+**/
+int network_output_buffer_append(output_buffer_t* buffer, const char* data, size_t len) {
+  assert(buffer);
+  assert(data);
+
+  if (buffer->length + len > buffer->limit) {
+    return -1;
+  }
+
+  size_t space = buffer->tail == NULL ? 0 : OUTPUT_SEGMENT_SIZE - buffer->tail->len;
+  size_t needed = len > space ? (len - space + OUTPUT_SEGMENT_SIZE - 1) / OUTPUT_SEGMENT_SIZE : 0;
+  output_segment_t* head = NULL;
+  output_segment_t* last = NULL;
+
+  for (size_t i = 0; i < needed; i++) {
+    output_segment_t* segment = acquire_output_segment(buffer->pool);
+
+    if (segment == NULL) {
+      network_output_segments_release(buffer->pool, head);
+
+      return -1;
+    }
+
+    if (last == NULL) {
+      head = segment;
+    } else {
+      last->next = segment;
+    }
+
+    last = segment;
+  }
+
+  while (len > 0) {
+    if (buffer->tail == NULL || buffer->tail->len == OUTPUT_SEGMENT_SIZE) {
+      output_segment_t* segment = head;
+
+      head = segment->next;
+      segment->next = NULL;
+
+      if (buffer->tail == NULL) {
+        buffer->head = segment;
+      } else {
+        buffer->tail->next = segment;
+      }
+
+      buffer->tail = segment;
+    }
+
+    output_segment_t* tail = buffer->tail;
+    size_t count = OUTPUT_SEGMENT_SIZE - tail->len;
+
+    if (count > len) {
+      count = len;
+    }
+
+    memcpy(tail->data + tail->len, data, count);
+
+    tail->len += count;
+    buffer->length += count;
+
+    data += count;
+    len -= count;
+  }
+
+  return 0;
+}
+
+/**
+ * Reserves space at the end of the output buffer so a producer, such as a compressor,
+ * can write into it directly.  The space is at most whatever remains of the tail
+ * segment, or of a newly acquired segment if the tail is full, and must be committed
+ * before it counts towards the buffer.
+ *
+ * buffer - the output_buffer_t to reserve space in
+ * len - a pointer which receives the number of bytes reserved
+ *
+ * Returns a pointer to the reserved space or NULL if the buffer is at its limit
+**/
+char* network_output_buffer_reserve(output_buffer_t* buffer, size_t* len) {
+  assert(buffer);
+  assert(len);
+
+  *len = 0;
+
+  if (buffer->length >= buffer->limit) {
+    return NULL;
+  }
+
+  if (buffer->tail == NULL || buffer->tail->len == OUTPUT_SEGMENT_SIZE) {
+    output_segment_t* segment = acquire_output_segment(buffer->pool);
+
+    if (segment == NULL) {
+      return NULL;
+    }
+
+    if (buffer->tail == NULL) {
+      buffer->head = segment;
+    } else {
+      buffer->tail->next = segment;
+    }
+
+    buffer->tail = segment;
+  }
+
+  *len = OUTPUT_SEGMENT_SIZE - buffer->tail->len;
+
+  if (*len > buffer->limit - buffer->length) {
+    *len = buffer->limit - buffer->length;
+  }
+
+  return buffer->tail->data + buffer->tail->len;
+}
+
+/**
+ * Commits data written into space previously reserved at the end of the buffer.
+ *
+ * buffer - the output_buffer_t the space was reserved in
+ * len - the number of reserved bytes which were written
+**/
+void network_output_buffer_commit(output_buffer_t* buffer, size_t len) {
+  assert(buffer);
+  assert(buffer->tail != NULL || len == 0);
+
+  if (len == 0) {
+    return;
+  }
+
+  assert(buffer->tail->len + len <= OUTPUT_SEGMENT_SIZE);
+
+  buffer->tail->len += len;
+  buffer->length += len;
+}
+
+/**
+ * Replaces the contents of one output buffer with the segments of another, leaving
+ * the source empty.  Used to swap in a transformed copy of the output without copying
+ * it again.  The destination keeps its own pool and limit.
+ *
+ * dest - the output_buffer_t whose contents are replaced
+ * src - the output_buffer_t whose segments are moved
+**/
+void network_output_buffer_move(output_buffer_t* dest, output_buffer_t* src) {
+  assert(dest);
+  assert(src);
+
+  network_output_segments_release(dest->pool, dest->head);
+
+  dest->head = src->head;
+  dest->tail = src->tail;
+  dest->length = src->length;
+  dest->essential = src->essential;
+
+  src->head = NULL;
+  src->tail = NULL;
+  src->length = 0;
+  src->essential = false;
+}
+
+/**
+ * Moves the start of one output buffer onto the end of another.  Whole segments are
+ * unlinked from the source and linked onto the destination rather than copied, so only
+ * a segment split by the length has any of its data copied and moving all of the source
+ * takes the same time however long it is.  Both buffers are expected to share a pool.
+ *
+ * dest - the output_buffer_t to move the data onto
+ * src - the output_buffer_t to take the data from
+ * len - the number of bytes to move, no more than the length of the source
+ *
+ * Returns 0 on success or -1 if the data would take the destination past its limit
+**/
+int network_output_buffer_splice(output_buffer_t* dest, output_buffer_t* src, size_t len) {
+  assert(dest);
+  assert(src);
+  assert(len <= src->length);
+
+  if (dest->length + len > dest->limit) {
+    return -1;
+  }
+
+  while (src->head != NULL && src->head->len <= len) {
+    output_segment_t* segment = src->head;
+    bool all = len == src->length;
+
+    if (dest->tail == NULL) {
+      dest->head = segment;
+    } else {
+      dest->tail->next = segment;
+    }
+
+    if (all) {
+      dest->tail = src->tail;
+      dest->length += len;
+
+      src->head = NULL;
+      src->tail = NULL;
+      src->length = 0;
+
+      return 0;
+    }
+
+    src->head = segment->next;
+    src->length -= segment->len;
+    len -= segment->len;
+
+    if (src->head == NULL) {
+      src->tail = NULL;
+    }
+
+    segment->next = NULL;
+
+    dest->tail = segment;
+    dest->length += segment->len;
+  }
+
+  if (len == 0) {
+    return 0;
+  }
+
+  if (network_output_buffer_append(dest, src->head->data, len) == -1) {
+    return -1;
+  }
+
+  network_output_buffer_consume(src, len);
+
+  return 0;
+}
+
+/**
+ * Discards the start of an output buffer.  Segments which are consumed entirely are
+ * released and the remainder of a segment which is split is moved to its start.
+ *
+ * buffer - the output_buffer_t to consume from
+ * len - the number of bytes to discard, no more than the length of the buffer
+**/
+void network_output_buffer_consume(output_buffer_t* buffer, size_t len) {
+  assert(buffer);
+  assert(len <= buffer->length);
+
+  while (buffer->head != NULL && buffer->head->len <= len) {
+    output_segment_t* segment = buffer->head;
+
+    buffer->head = segment->next;
+    buffer->length -= segment->len;
+    len -= segment->len;
+
+    if (buffer->head == NULL) {
+      buffer->tail = NULL;
+    }
+
+    network_output_segment_release(buffer->pool, segment);
+  }
+
+  if (len > 0) {
+    output_segment_t* segment = buffer->head;
+
+    memmove(segment->data, segment->data + len, segment->len - len);
+    segment->len -= len;
+    buffer->length -= len;
+  }
+}
+
+/**
+ * Copies the contents of an output buffer into a contiguous destination.
+ *
+ * buffer - the output_buffer_t to copy from
+ * dest - the destination to copy into
+ * len - the size of the destination
+ *
+ * Returns the number of bytes copied
+**/
+size_t network_output_buffer_copy(const output_buffer_t* buffer, char* dest, size_t len) {
+  assert(buffer);
+  assert(dest);
+
+  size_t copied = 0;
+
+  for (output_segment_t* segment = buffer->head; segment != NULL && copied < len; segment = segment->next) {
+    size_t count = segment->len;
+
+    if (count > len - copied) {
+      count = len - copied;
+    }
+
+    memcpy(dest + copied, segment->data, count);
+    copied += count;
+  }
+
+  return copied;
+}
+
+/**
+ * Fills an array of uv_buf_t pointing directly at the segments of an output buffer
+ * so they can be written without copying.
+ *
+ * buffer - the output_buffer_t to describe
+ * bufs - the array of uv_buf_t to fill
+ * nbufs - the number of entries available in bufs
+ *
+ * Returns the number of entries filled
+**/
+size_t network_output_buffer_bufs(const output_buffer_t* buffer, uv_buf_t* bufs, size_t nbufs) {
+  assert(buffer);
+  assert(bufs);
+
+  size_t count = 0;
+
+  for (output_segment_t* segment = buffer->head; segment != NULL && count < nbufs; segment = segment->next) {
+    bufs[count++] = uv_buf_init(segment->data, (unsigned int)segment->len);
+  }
+
+  return count;
+}
+
+/**
+ * Counts the segments currently held by an output buffer.
+ *
+ * buffer - the output_buffer_t to count
+ *
+ * Returns the number of segments
+**/
+size_t network_output_buffer_count(const output_buffer_t* buffer) {
+  assert(buffer);
+
+  size_t count = 0;
+
+  for (output_segment_t* segment = buffer->head; segment != NULL; segment = segment->next) {
+    count++;
+  }
+
+  return count;
+}
+
+/**
+ * Acquires an empty output segment holding a single reference, reusing one from
+ * the pool where possible.
+ *
+ * pool - the output_pool_t to acquire from, may be NULL
+ *
+ * Returns the segment or NULL on failure
+**/
+static output_segment_t* acquire_output_segment(output_pool_t* pool) {
+  output_segment_t* segment = NULL;
+
+  if (pool != NULL && pool->segments != NULL) {
+    segment = pool->segments;
+    pool->segments = segment->next;
+    pool->free_segments--;
+  } else if ((segment = malloc(sizeof(output_segment_t))) == NULL) {
+    return NULL;
+  }
+
+  segment->next = NULL;
+  segment->refs = 1;
+  segment->len = 0;
+
+  return segment;
+}
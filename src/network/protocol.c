@@ -1,17 +1,107 @@
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
+#include "mud/data/pool.h"
 #include "mud/log.h"
 #include "mud/network/client.h"
+#include "mud/network/output.h"
 #include "mud/network/protocol.h"
 
+static int chain_on_output(protocol_t* protocol, client_t* client, output_buffer_t* output);
+static pool_t* find_pool(protocol_pools_t* pools, size_t size);
+
+/**
+ * Initialises a set of pools for protocol objects.  Pools are created as objects of
+ * each size are first allocated.
+ *
+ * pools - the protocol_pools_t to initialise
+**/
+void network_init_protocol_pools(protocol_pools_t* pools) {
+  assert(pools);
+
+  memset(pools, 0, sizeof(protocol_pools_t));
+}
+
+/**
+ * Frees a set of pools for protocol objects.  Should only be called once every protocol
+ * object allocated from them has been freed.
+ *
+ * pools - the protocol_pools_t to clear
+**/
+void network_clear_protocol_pools(protocol_pools_t* pools) {
+  assert(pools);
+
+  for (size_t i = 0; i < PROTOCOL_POOL_CLASSES; i++) {
+    if (pools->pools[i] != NULL) {
+      free_pool_t(pools->pools[i]);
+      pools->pools[i] = NULL;
+    }
+  }
+}
+
+/**
+ * Allocates a zeroed object for use by a protocol from a pool of objects of the same
+ * size.  Protocols, their state and extensions are created and destroyed with every
+ * connection so are pooled rather than churning the heap.  Objects are allocated from
+ * the heap instead when no pools are given, every pool is in use by another size or the
+ * pool can't grow.
+ *
+ * pools - the protocol_pools_t to allocate from, or NULL to allocate from the heap
+ * size - the size of the object to allocate
+ *
+ * Returns the allocated object or NULL on failure
+**/
+void* network_protocol_alloc(protocol_pools_t* pools, size_t size) {
+  assert(size > 0);
+
+  pool_t* pool = pools != NULL ? find_pool(pools, size) : NULL;
+  protocol_object_header_t* header = pool != NULL ? pool_acquire(pool) : NULL;
+
+  if (header == NULL) {
+    pool = NULL;
+    header = calloc(1, sizeof(protocol_object_header_t) + size);
+  }
+
+  if (header == NULL) {
+    LOG(ERROR, "Failed to allocate protocol object of size [%zu]", size);
+
+    return NULL;
+  }
+
+  header->pool = pool;
+
+  return header + 1;
+}
+
+/**
+ * Frees an object allocated by network_protocol_alloc, returning it to its pool if it
+ * came from one.
+ *
+ * object - the object to free
+**/
+void network_protocol_free(void* object) {
+  assert(object);
+
+  protocol_object_header_t* header = (protocol_object_header_t*)object - 1;
+
+  if (header->pool != NULL) {
+    pool_release(header);
+  } else {
+    free(header);
+  }
+}
+
 /**
  * Allocates a new instance of protocol_t
  *
- * Returns the allocated instance
+ * pools - the protocol_pools_t to allocate from, or NULL to allocate from the heap
+ *
+ * Returns the allocated instance or NULL on failure
 **/
-protocol_t* network_new_protocol_t() {
-  protocol_t* protocol = calloc(1, sizeof(protocol_t));
+protocol_t* network_new_protocol_t(protocol_pools_t* pools) {
+  protocol_t* protocol = network_protocol_alloc(pools, sizeof(protocol_t));
 
   return protocol;
 }
@@ -24,7 +114,7 @@ protocol_t* network_new_protocol_t() {
 void network_free_protocol_t(protocol_t* protocol) {
   assert(protocol);
 
-  free(protocol);
+  network_protocol_free(protocol);
 }
 
 /**
@@ -66,14 +156,15 @@ void network_protocol_chain_initialise(client_t* client) {
  * client - the client_t instance whose protocol chain we're walking
  * input - the input we've received
  * len - the amount of data received
+ * size - the space available at input, which protocols that expand input may fill
  *
  * Returns the length of the input string as it may have been altered by protocols
 **/
-int network_protocol_chain_on_input(client_t* client, char* input, size_t len) {
+int network_protocol_chain_on_input(client_t* client, char* input, size_t len, size_t size) {
   protocol_t* protocol = client->protocol;
 
   while (protocol != NULL) {
-    len = network_protocol_on_input(protocol, client, input, len);
+    len = network_protocol_on_input(protocol, client, input, len, size);
     protocol = protocol->next;
   }
 
@@ -81,37 +172,36 @@ int network_protocol_chain_on_input(client_t* client, char* input, size_t len) {
 }
 
 /**
- * Walks the protocol chain and calls the on output callback for each
+ * Walks the protocol chain in reverse and calls the on output callback for each.  Input
+ * passes from the first protocol in the chain to the last, so output passes from the
+ * last to the first, each protocol wrapping the output of those after it.  Each stage
+ * writes into a buffer of its own which becomes the input of the next, so a stage can
+ * grow the output as much as it needs to.  If any stage fails the rest are skipped.
  *
  * client - the client_t instance whose protocol chain we're walking
- * output - the output to be sent
- * len - the length of the output
+ * output - the output buffer to be sent, replaced by the output of the final stage
  *
- * Returns the length of the output string as it may have been altered by protocols
+ * Returns the length of the output or -1 if a protocol failed to process it
 **/
-int network_protocol_chain_on_output(client_t* client, char* output, size_t len) {
-  protocol_t* protocol = client->protocol;
-
-  while(protocol != NULL) {
-    len = network_protocol_on_output(protocol, client, output, len);
-    protocol = protocol->next;
+int network_protocol_chain_on_output(client_t* client, output_buffer_t* output) {
+  if (client->protocol == NULL) {
+    return (int)output->length;
   }
 
-  return len;
+  return chain_on_output(client->protocol, client, output);
 }
 
 /**
  * Walks the protocol chain and calls the on flush callback for each
  *
  * client - the client_t instance whose protocol chain we're walking
- * output - the output that was flushed
- * len - the length of the output
+ * output - the output buffer that was flushed
 **/
-void network_protocol_chain_on_flush(client_t* client, char* output, size_t len) {
+void network_protocol_chain_on_flush(client_t* client, output_buffer_t* output) {
   protocol_t* protocol = client->protocol;
 
   while(protocol != NULL) {
-    network_protocol_on_flush(protocol, client, output, len);
+    network_protocol_on_flush(protocol, client, output);
     protocol = protocol->next;
   }
 }
@@ -138,41 +228,55 @@ void network_protocol_initialise(protocol_t* protocol, client_t* client) {
  * client - the client making use of the protocol
  * input - the input received by the client
  * len - length of the input
+ * size - the space available at input
  *
 * Returns the length of the input string as it may have been altered by protocols
 **/
-int network_protocol_on_input(protocol_t* protocol, client_t* client, char* input, size_t len) {
+int network_protocol_on_input(protocol_t* protocol, client_t* client, char* input, size_t len, size_t size) {
   assert(protocol);
   assert(client);
   assert(input);
 
   if (protocol->on_input != NULL) {
-    return protocol->on_input(client, protocol->data, input, len);
+    return protocol->on_input(client, protocol->data, input, len, size);
   }
 
   return len;
 }
 
 /**
- * Calls the on output callback of a protocol for a client
+ * Calls the on output callback of a protocol for a client.  The protocol consumes the
+ * output given to it and writes its own into a new buffer sharing the same pool, which
+ * then replaces it.  Protocols move whatever they pass through unchanged with
+ * network_output_buffer_splice so it isn't copied.  Anything the protocol leaves in the
+ * original output is discarded.
  *
  * protocol - protocol to call the on output callback for
  * client - the client making use of the protocol
- * output - the output to be sent to the client
- * len - length of the output
+ * output - the output buffer to be sent to the client
  *
-* Returns the length of the output string as it may have been altered by protocols
+ * Returns the length of the output or -1 if the protocol failed to process it
 **/
-int network_protocol_on_output(protocol_t* protocol, client_t* client, char* output, size_t len) {
+int network_protocol_on_output(protocol_t* protocol, client_t* client, output_buffer_t* output) {
   assert(protocol);
   assert(client);
   assert(output);
 
-  if (protocol->on_output != NULL) {
-    return protocol->on_output(client, protocol->data, output, len);
+  if (protocol->on_output == NULL) {
+    return (int)output->length;
   }
 
-  return len;
+  output_buffer_t staged = { .pool = output->pool, .limit = SIZE_MAX, .essential = output->essential };
+
+  if (protocol->on_output(client, protocol->data, output, &staged) == -1) {
+    network_clear_output_buffer(&staged);
+
+    return -1;
+  }
+
+  network_output_buffer_move(output, &staged);
+
+  return (int)output->length;
 }
 
 /**
@@ -180,15 +284,59 @@ int network_protocol_on_output(protocol_t* protocol, client_t* client, char* out
  *
  * protocol - protocol to call the on flush callback for
  * client - the client making use of the protocol
- * output -the output that was flushed
- * len - length of the output
+ * output -the output buffer that was flushed
 **/
-void network_protocol_on_flush(protocol_t* protocol, client_t* client, char* output, size_t len) {
+void network_protocol_on_flush(protocol_t* protocol, client_t* client, output_buffer_t* output) {
   assert(protocol);
   assert(client);
   assert(output);
 
   if (protocol->on_flush != NULL) {
-    protocol->on_flush(client, protocol->data, output, len);
+    protocol->on_flush(client, protocol->data, output);
   }
 }
+
+/**
+ * Module internal method to call the on output callback of each protocol after the
+ * given one before its own.
+ *
+ * protocol - the protocol whose on output callback is called last
+ * client - the client making use of the protocol
+ * output - the output buffer to be sent to the client
+ *
+ * Returns the length of the output or -1 if a protocol failed to process it
+**/
+static int chain_on_output(protocol_t* protocol, client_t* client, output_buffer_t* output) {
+  if (protocol->next != NULL && chain_on_output(protocol->next, client, output) == -1) {
+    return -1;
+  }
+
+  return network_protocol_on_output(protocol, client, output);
+}
+
+/**
+ * Module internal method to find the pool for objects of a given size, creating it in
+ * the first unused class if there isn't one yet.
+ *
+ * pools - the protocol_pools_t to search
+ * size - the size of the object, not counting its header
+ *
+ * Returns the pool or NULL if every class is in use by another size
+**/
+static pool_t* find_pool(protocol_pools_t* pools, size_t size) {
+  size_t object_size = sizeof(protocol_object_header_t) + size;
+
+  for (size_t i = 0; i < PROTOCOL_POOL_CLASSES; i++) {
+    if (pools->pools[i] == NULL) {
+      pools->pools[i] = create_pool_t(object_size, PROTOCOL_POOL_SLAB_SIZE);
+
+      return pools->pools[i];
+    }
+
+    if (pools->pools[i]->object_size == object_size) {
+      return pools->pools[i];
+    }
+  }
+
+  return NULL;
+}
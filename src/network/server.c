@@ -1,5 +1,6 @@
 #include "mud/network/server.h"
 #include "mud/log.h"
+#include "mud/network/tls.h"
 
 #include <assert.h>
 #include <stdlib.h>
@@ -10,8 +11,13 @@
 server_t* create_server_t(void) {
   server_t* server = calloc(1, sizeof *server);
 
+  server->type = SERVER_TCP;
   server->port = 0;
+  server->path = NULL;
   server->backlog = 0;
+  server->reuseport = false;
+  server->websocket = false;
+  server->tls = NULL;
   server->network = NULL;
 
   return server;
@@ -23,5 +29,10 @@ server_t* create_server_t(void) {
 void free_server_t(server_t* server) {
   assert(server);
 
+  if (server->tls != NULL) {
+    network_free_tls_context(server->tls);
+  }
+
+  free(server->path);
   free(server);
 }
@@ -5,11 +5,37 @@
 
 #include "mud/log.h"
 #include "mud/network/client.h"
+#include "mud/network/output.h"
 #include "mud/network/protocol.h"
 #include "mud/network/telnet.h"
 #include "mud/util/mudstring.h"
 
-static void update_parse_state(telnet_parse_t* parse_state, char chr, int index, int* iac_index);
+/**
+ * Byte classes and actions for the telnet parser's transition table
+**/
+typedef enum telnet_byte_class {
+  TELNET_BYTE_DATA, TELNET_BYTE_IAC, TELNET_BYTE_SB, TELNET_BYTE_SE, TELNET_BYTE_NEGOTIATE, TELNET_BYTE_COMMAND,
+  TELNET_BYTE_CLASSES
+} telnet_byte_class_t;
+
+typedef enum telnet_action {
+  TELNET_DROP, TELNET_EMIT, TELNET_OP, TELNET_COMMAND, TELNET_NEGOTIATE, TELNET_SB_BEGIN, TELNET_SB_BYTE, TELNET_SB_END
+} telnet_action_t;
+
+typedef struct telnet_transition {
+  unsigned char next;
+  unsigned char action;
+} telnet_transition_t;
+
+static void process_negotiation(telnet_t* telnet, client_t* client, unsigned int op, unsigned int option);
+static void notify_negotiated(telnet_t* telnet, client_t* client, int option, bool local, bool enabled);
+static size_t decode_input(telnet_t* telnet, client_t* client, const char* input, size_t len, char* dest, size_t size);
+static void trace_output(telnet_parse_t* parse_state, output_buffer_t* output);
+static telnet_extension_t* find_extension(telnet_t* telnet, void* extension);
+static void index_options(telnet_t* telnet, telnet_extension_t* extension);
+static void add_option(telnet_t* telnet, int option, telnet_option_t* state, telnet_config_t* config, telnet_extension_t* extension);
+static telnet_option_entry_t* find_option(telnet_t* telnet, int option);
+static void append_subnegotiation(char* data, size_t* len, char chr, bool buffered);
 
 static void process_do(telnet_t* telnet, client_t* client, int option);
 static void process_dont(telnet_t* telnet, client_t* client, int option);
@@ -43,20 +69,92 @@ static char* telopts[] = {
   "ENCRYPT", "NEW_ENVIRON"
 };
 
+static const unsigned char telnet_byte_class[256] = {
+  [IAC] = TELNET_BYTE_IAC,
+  [SB] = TELNET_BYTE_SB,
+  [SE] = TELNET_BYTE_SE,
+  [WILL] = TELNET_BYTE_NEGOTIATE, [WONT] = TELNET_BYTE_NEGOTIATE, [DO] = TELNET_BYTE_NEGOTIATE, [DONT] = TELNET_BYTE_NEGOTIATE,
+  [GA] = TELNET_BYTE_COMMAND, [EL] = TELNET_BYTE_COMMAND, [EC] = TELNET_BYTE_COMMAND, [AYT] = TELNET_BYTE_COMMAND,
+  [AO] = TELNET_BYTE_COMMAND, [IP] = TELNET_BYTE_COMMAND, [BREAK] = TELNET_BYTE_COMMAND, [DM] = TELNET_BYTE_COMMAND,
+  [NOP] = TELNET_BYTE_COMMAND, [EOR] = TELNET_BYTE_COMMAND, [ABORT] = TELNET_BYTE_COMMAND, [SUSP] = TELNET_BYTE_COMMAND,
+  [xEOF] = TELNET_BYTE_COMMAND
+};
+
+// Indexed by parse state then byte class, gives the next state and what to do with the byte
+static const telnet_transition_t telnet_transitions[][TELNET_BYTE_CLASSES] = {
+  [READ_IAC] = {
+    [TELNET_BYTE_DATA] = { READ_IAC, TELNET_EMIT },
+    [TELNET_BYTE_IAC] = { READ_OP, TELNET_DROP },
+    [TELNET_BYTE_SB] = { READ_IAC, TELNET_EMIT },
+    [TELNET_BYTE_SE] = { READ_IAC, TELNET_EMIT },
+    [TELNET_BYTE_NEGOTIATE] = { READ_IAC, TELNET_EMIT },
+    [TELNET_BYTE_COMMAND] = { READ_IAC, TELNET_EMIT }
+  },
+  [READ_OP] = {
+    [TELNET_BYTE_DATA] = { READ_IAC, TELNET_DROP },
+    [TELNET_BYTE_IAC] = { READ_IAC, TELNET_EMIT }, // IAC IAC is an escaped 255 data byte
+    [TELNET_BYTE_SB] = { READ_SB_OPTION, TELNET_OP },
+    [TELNET_BYTE_SE] = { READ_IAC, TELNET_COMMAND },
+    [TELNET_BYTE_NEGOTIATE] = { READ_OP_VALUE, TELNET_OP },
+    [TELNET_BYTE_COMMAND] = { READ_IAC, TELNET_COMMAND }
+  },
+  [READ_OP_VALUE] = {
+    [TELNET_BYTE_DATA] = { READ_IAC, TELNET_NEGOTIATE },
+    [TELNET_BYTE_IAC] = { READ_IAC, TELNET_NEGOTIATE },
+    [TELNET_BYTE_SB] = { READ_IAC, TELNET_NEGOTIATE },
+    [TELNET_BYTE_SE] = { READ_IAC, TELNET_NEGOTIATE },
+    [TELNET_BYTE_NEGOTIATE] = { READ_IAC, TELNET_NEGOTIATE },
+    [TELNET_BYTE_COMMAND] = { READ_IAC, TELNET_NEGOTIATE }
+  },
+  [READ_SB_OPTION] = {
+    [TELNET_BYTE_DATA] = { READ_SE_IAC, TELNET_SB_BEGIN },
+    [TELNET_BYTE_IAC] = { READ_SE_IAC, TELNET_SB_BEGIN },
+    [TELNET_BYTE_SB] = { READ_SE_IAC, TELNET_SB_BEGIN },
+    [TELNET_BYTE_SE] = { READ_SE_IAC, TELNET_SB_BEGIN },
+    [TELNET_BYTE_NEGOTIATE] = { READ_SE_IAC, TELNET_SB_BEGIN },
+    [TELNET_BYTE_COMMAND] = { READ_SE_IAC, TELNET_SB_BEGIN }
+  },
+  [READ_SE_IAC] = {
+    [TELNET_BYTE_DATA] = { READ_SE_IAC, TELNET_SB_BYTE },
+    [TELNET_BYTE_IAC] = { READ_SE, TELNET_DROP },
+    [TELNET_BYTE_SB] = { READ_SE_IAC, TELNET_SB_BYTE },
+    [TELNET_BYTE_SE] = { READ_SE_IAC, TELNET_SB_BYTE },
+    [TELNET_BYTE_NEGOTIATE] = { READ_SE_IAC, TELNET_SB_BYTE },
+    [TELNET_BYTE_COMMAND] = { READ_SE_IAC, TELNET_SB_BYTE }
+  },
+  [READ_SE] = {
+    [TELNET_BYTE_DATA] = { READ_IAC, TELNET_DROP }, // Malformed, abandon the subnegotiation
+    [TELNET_BYTE_IAC] = { READ_SE_IAC, TELNET_SB_BYTE }, // IAC IAC is an escaped 255 payload byte
+    [TELNET_BYTE_SB] = { READ_IAC, TELNET_DROP },
+    [TELNET_BYTE_SE] = { READ_IAC, TELNET_SB_END },
+    [TELNET_BYTE_NEGOTIATE] = { READ_IAC, TELNET_DROP },
+    [TELNET_BYTE_COMMAND] = { READ_IAC, TELNET_DROP }
+  }
+};
+
 static telnet_config_t opt_config[] = {
   { TELOPT_ECHO, true, false },
-  { TELOPT_SGA, false, false },
-  { 0, false, false }
+  { TELOPT_SGA, false, false }
 };
 
 
 /**
  * Allocates a new instance of telnet_t
  *
- * Returns the allocated instance
+ * pools - the protocol_pools_t to allocate from, or NULL to allocate from the heap
+ *
+ * Returns the allocated instance or NULL on failure
 **/
-telnet_t* network_new_telnet_t() {
-  telnet_t* telnet = calloc(1, sizeof(telnet_t));
+telnet_t* network_new_telnet_t(protocol_pools_t* pools) {
+  telnet_t* telnet = network_protocol_alloc(pools, sizeof(telnet_t));
+
+  if (telnet == NULL) {
+    return NULL;
+  }
+
+  telnet->encoder = NULL;
+  telnet->decoder = NULL;
+  telnet->encoded = false;
 
   telnet->incoming.state = READ_IAC;
   telnet->incoming.op = 0;
@@ -74,6 +172,10 @@ telnet_t* network_new_telnet_t() {
   telnet->suppress_go_ahead.us = NO;
   telnet->suppress_go_ahead.them = NO;
 
+  telnet->option_count = 0;
+  add_option(telnet, TELOPT_ECHO, &telnet->echo, &opt_config[0], NULL);
+  add_option(telnet, TELOPT_SGA, &telnet->suppress_go_ahead, &opt_config[1], NULL);
+
   return telnet;
 }
 
@@ -92,12 +194,12 @@ void network_free_telnet_t(telnet_t* telnet) {
 
     ext->deallocate(ext->extension);
 
-    free(ext);
+    network_protocol_free(ext);
 
     ext = next;
   }
 
-  free(telnet);
+  network_protocol_free(telnet);
 }
 
 /**
@@ -114,13 +216,28 @@ void network_deallocate_telnet_t(void* value) {
 /**
  * Creates and configures a new instance of protocol_t for use with the telnet protocol.
  *
- * Returns the configured instance of protocol_t
+ * pools - the protocol_pools_t to allocate from, or NULL to allocate from the heap
+ *
+ * Returns the configured instance of protocol_t or NULL on failure
 **/
-protocol_t* network_new_telnet_protocol_t() {
-  protocol_t* protocol = network_new_protocol_t();
+protocol_t* network_new_telnet_protocol_t(protocol_pools_t* pools) {
+  protocol_t* protocol = network_new_protocol_t(pools);
+  telnet_t* telnet = network_new_telnet_t(pools);
+
+  if (protocol == NULL || telnet == NULL) {
+    if (protocol != NULL) {
+      network_free_protocol_t(protocol);
+    }
+
+    if (telnet != NULL) {
+      network_free_telnet_t(telnet);
+    }
+
+    return NULL;
+  }
 
   protocol->type = TELNET;
-  protocol->data = network_new_telnet_t();
+  protocol->data = telnet;
   protocol->deallocator = network_deallocate_telnet_t;
   protocol->initialiser = network_telnet_initialised;
   protocol->on_input = network_telnet_on_input;
@@ -131,12 +248,49 @@ protocol_t* network_new_telnet_protocol_t() {
 }
 
 /**
- * Allows extensions to be registered with Telnet.
+ * Allocates a zeroed telnet_extension_t along with a zeroed object of the given size for
+ * the extension's own data, which the extension's deallocator should free with
+ * network_protocol_free.
+ *
+ * pools - the protocol_pools_t to allocate from, or NULL to allocate from the heap
+ * size - the size of the extension's own data
+ *
+ * Returns the allocated extension or NULL on failure
+**/
+telnet_extension_t* network_new_telnet_extension(protocol_pools_t* pools, size_t size) {
+  telnet_extension_t* extension = network_protocol_alloc(pools, sizeof(telnet_extension_t));
+  void* data = network_protocol_alloc(pools, size);
+
+  if (extension == NULL || data == NULL) {
+    if (extension != NULL) {
+      network_protocol_free(extension);
+    }
+
+    if (data != NULL) {
+      network_protocol_free(data);
+    }
+
+    return NULL;
+  }
+
+  extension->extension = data;
+
+  return extension;
+}
+
+/**
+ * Allows extensions to be registered with Telnet.  The options the extension supports
+ * are added to the option table so negotiation never has to walk the extensions.
  *
  * telnet - a reference to the telnet_t instance to add the extension to
  * extension - the extension to be added
 **/
 void network_register_telnet_extension(telnet_t* telnet, telnet_extension_t* extension) {
+  assert(telnet);
+  assert(extension);
+
+  index_options(telnet, extension);
+
   if (telnet->extensions == NULL) {
     telnet->extensions = extension;
 
@@ -152,6 +306,88 @@ void network_register_telnet_extension(telnet_t* telnet, telnet_extension_t* ext
   ext->next = extension;
 }
 
+/**
+ * Sets the registered extension which encodes all output sent to the client, such as
+ * a compressor, or clears it when passed NULL.  Output is traced before it's encoded.
+ *
+ * telnet - the telnet_t instance the extension is registered with
+ * extension - the extension's own data as registered, or NULL
+**/
+void network_telnet_set_encoder(telnet_t* telnet, void* extension) {
+  assert(telnet);
+
+  telnet->encoder = extension != NULL ? find_extension(telnet, extension) : NULL;
+}
+
+/**
+ * Sets the registered extension which decodes all input received from the client before
+ * it's parsed, or clears it when passed NULL.  If set while input is being parsed, the
+ * remainder of that input is decoded before parsing continues.
+ *
+ * telnet - the telnet_t instance the extension is registered with
+ * extension - the extension's own data as registered, or NULL
+**/
+void network_telnet_set_decoder(telnet_t* telnet, void* extension) {
+  assert(telnet);
+
+  telnet->decoder = extension != NULL ? find_extension(telnet, extension) : NULL;
+}
+
+/**
+ * Retrieves the registered extension supporting an option, so other modules can reach
+ * an extension's own data for a client.
+ *
+ * telnet - the telnet_t instance the extension is registered with
+ * option - the option the extension supports
+ *
+ * Returns the extension's own data or NULL if no extension supports the option
+**/
+void* network_telnet_get_extension(telnet_t* telnet, int option) {
+  assert(telnet);
+
+  telnet_option_entry_t* entry = find_option(telnet, option);
+
+  if (entry == NULL || entry->extension == NULL) {
+    return NULL;
+  }
+
+  return entry->extension->extension;
+}
+
+/**
+ * Processes a DO, DONT, WILL or WONT on behalf of the client as if it had been received
+ * from them, for clients reached through another protocol which negotiates for them.
+ *
+ * telnet - the telnet_t instance for the client
+ * client - the client the negotiation is from
+ * op - the negotiation operation
+ * option - the option being negotiated
+**/
+void network_telnet_negotiate(telnet_t* telnet, client_t* client, int op, int option) {
+  assert(telnet);
+  assert(client);
+
+  process_negotiation(telnet, client, (unsigned int)op, (unsigned int)option);
+}
+
+/**
+ * Passes a subnegotiation to extensions as if it had been received from the client, for
+ * clients reached through another protocol which carries subnegotiations itself.
+ *
+ * telnet - the telnet_t instance for the client
+ * client - the client the subnegotiation is from
+ * option - the option of the subnegotiation
+ * data - the subnegotiation payload
+ * len - the length of the payload
+**/
+void network_telnet_subnegotiate(telnet_t* telnet, client_t* client, int option, const char* data, size_t len) {
+  assert(telnet);
+  assert(client);
+  assert(data);
+
+  process_se(telnet, client, option, data, len);
+}
+
 /**
  * Callback method called when the protocol is initialised
  *
@@ -178,16 +414,22 @@ void network_telnet_initialised(client_t* client, void* protocol) {
 }
 
 /**
- * Callback method called when the client has received new input.
+ * Callback method called when the client has received new input.  Input is parsed in
+ * a single pass by a table-driven state machine.  Plain data is copied forward in place
+ * over any telnet commands preceding it, so each byte moves at most once, and
+ * subnegotiation payloads are handed to extensions as slices of the input.  Only a
+ * subnegotiation which spans reads is copied into the parse state's buffer.  While a
+ * decoder is set the input is decoded into the space available before it's parsed.
  *
  * client - the client who has received input
  * protocol - a void pointer to a telnet_t instance
  * data - the data that has been received
  * len - the length of the input received
+ * size - the space available at input for decoded input
  *
  * Returns the length of the input as we may have altered it
 **/
-int network_telnet_on_input(client_t* client, void* protocol, char* input, size_t len) {
+int network_telnet_on_input(client_t* client, void* protocol, char* input, size_t len, size_t size) {
   assert(client);
   assert(protocol);
   assert(input);
@@ -195,120 +437,206 @@ int network_telnet_on_input(client_t* client, void* protocol, char* input, size_
   telnet_t* telnet = protocol;
   telnet_parse_t* parse_state = &telnet->incoming;
 
-  int move_index = 0;
-  int cmd_len = 0;
+  if (telnet->decoder != NULL) {
+    len = decode_input(telnet, client, input, len, input, size);
+  }
 
-  for (int idx = 0; idx < len; idx++) {
-    update_parse_state(parse_state, input[idx], idx, &move_index);
+  size_t out = 0;
+  size_t idx = 0;
 
-    cmd_len = parse_state->state != READ_IAC ? cmd_len + 1 : cmd_len;
+  // A subnegotiation carried over from a previous read continues in the buffer,
+  // otherwise payloads are unescaped in place within the input.
+  bool buffered = parse_state->state == READ_SE_IAC || parse_state->state == READ_SE;
+  char* sb_data = buffered ? parse_state->buffer : NULL;
+  size_t sb_len = buffered ? parse_state->len : 0;
 
-    if (parse_state->state == DONE) {
-      log_telnet_parse(parse_state, cmd_len, true);
+  while (idx < len) {
+    if (parse_state->state == READ_IAC) {
+      char* iac = memchr(input + idx, (char)IAC, len - idx);
+      size_t run = iac != NULL ? (size_t)(iac - (input + idx)) : len - idx;
 
-      switch(parse_state->op) {
-        case DO:
-          process_do(telnet, client, parse_state->option);
-          break;
+      if (out != idx) {
+        memmove(input + out, input + idx, run);
+      }
 
-        case DONT:
-          process_dont(telnet, client, parse_state->option);
-          break;
+      out += run;
+      idx += run;
 
-        case WILL:
-          process_will(telnet, client, parse_state->option);
-          break;
+      if (iac == NULL) {
+        break;
+      }
+    }
 
-        case WONT:
-          process_wont(telnet, client, parse_state->option);
-          break;
+    unsigned char chr = (unsigned char)input[idx++];
+    telnet_transition_t transition = telnet_transitions[parse_state->state][telnet_byte_class[chr]];
 
-        case SE:
-          process_se(telnet, client, parse_state->option, parse_state->buffer, parse_state->len);
-          break;
-      }
+    parse_state->state = transition.next;
 
-      parse_state->op = 0;
-      parse_state->option = 0;
+    switch (transition.action) {
+      case TELNET_EMIT:
+        input[out++] = (char)chr;
+        break;
 
-      if (parse_state->len > 0) {
-        memset(parse_state->buffer, 0, parse_state->len);
-        parse_state->len = 0;
-      }
+      case TELNET_OP:
+        parse_state->op = chr;
+        break;
+
+      case TELNET_COMMAND:
+        parse_state->op = chr;
+        log_telnet_parse(parse_state, 2, true);
+        break;
 
-      int jdx = move_index + cmd_len;
+      case TELNET_NEGOTIATE:
+        parse_state->option = chr;
+        log_telnet_parse(parse_state, 3, true);
+        process_negotiation(telnet, client, parse_state->op, parse_state->option);
+        break;
 
-      if (jdx + 1 > len) {
-        memset(input + move_index, 0, cmd_len);
-      } else {
-        memmove(input + move_index, input + jdx, len - idx);
+      case TELNET_SB_BEGIN:
+        parse_state->option = chr;
+        buffered = false;
+        sb_data = input + idx;
+        sb_len = 0;
+        break;
 
-        idx = idx - cmd_len;
+      case TELNET_SB_BYTE:
+        append_subnegotiation(sb_data, &sb_len, (char)chr, buffered);
+        break;
+
+      case TELNET_SB_END: {
+        telnet_extension_t* decoder = telnet->decoder;
+
+        parse_state->op = SE;
+        log_telnet_parse(parse_state, 3, true);
+        // A truncated buffered payload is one byte over length to mark it as already warned about
+        process_se(telnet, client, parse_state->option, sb_data, sb_len < TELNET_BUFFER_SIZE ? sb_len : TELNET_BUFFER_SIZE - 1);
+        sb_len = 0;
+
+        // A subnegotiation may start a decoder, in which case the rest of the input is
+        // encoded and is decoded over the space following the parsed data.
+        if (decoder == NULL && telnet->decoder != NULL) {
+          len = out + decode_input(telnet, client, input + idx, len - idx, input + out, size - out);
+          idx = out;
+        }
+
+        break;
       }
 
-      len = len - cmd_len;
-      cmd_len = 0;
-      move_index = 0;
+      case TELNET_DROP:
+        break;
+    }
+  }
+
+  if (parse_state->state == READ_SE_IAC || parse_state->state == READ_SE) {
+    if (!buffered) {
+      if (sb_len > TELNET_BUFFER_SIZE - 1) {
+        LOG(WARN, "Telnet Subnegotiation buffer was full and data may have been truncated");
+        sb_len = TELNET_BUFFER_SIZE - 1;
+      }
 
-      parse_state->state = READ_IAC;
+      memcpy(parse_state->buffer, sb_data, sb_len);
     }
+
+    parse_state->len = sb_len;
+  } else {
+    parse_state->len = 0;
   }
 
-  return len;
+  return (int)out;
 }
 
 /**
- * Callback method called when the client is about to send output
+ * Callback method called when the client is about to send output.  Extensions first
+ * write out anything they've batched up, then the output is passed through untouched
+ * and if an encoder is set it transforms the output last of all, after it has been
+ * traced.  Once the encoder has failed all output is discarded rather than sent, as the
+ * client would be unable to make sense of it or of anything which followed.
  *
  * client - the client who is about to send output
  * protocol - a void pointer to a telnet_t instance
- * output - the data that has been buffered for output
- * len - the length of the data buffered
+ * input - the output buffer that is about to be sent, consumed
+ * output - the output buffer the telnet output is written to
  *
- * Returns the len of the output string as we may have altered it
+ * Returns the length of the telnet output or -1 on failure
 **/
-int network_telnet_on_output(client_t* client, void* protocol, char* output, size_t len) {
+int network_telnet_on_output(client_t* client, void* protocol, output_buffer_t* input, output_buffer_t* output) {
   assert(client);
   assert(protocol);
+  assert(input);
   assert(output);
 
   telnet_t* telnet = protocol;
+  telnet_extension_t* ext = telnet->extensions;
+
+  if (telnet->encode_failed) {
+    network_clear_output_buffer(input);
+
+    return -1;
+  }
+
+  while (ext != NULL) {
+    if (ext->flush != NULL && ext->flush(ext->extension, telnet, client, input) == -1) {
+      LOG(ERROR, "Failed to flush telnet extension output for client fd [%d]", client->fd);
+    }
+
+    ext = ext->next;
+  }
 
   if (telnet->suppress_go_ahead.us != YES) {
     network_telnet_send_ga(telnet, client);
   }
 
-  return len;
+  if (network_output_buffer_splice(output, input, input->length) == -1) {
+    LOG(ERROR, "Failed to pass on telnet output for client fd [%d]", client->fd);
+
+    return -1;
+  }
+
+  telnet->encoded = telnet->encoder != NULL;
+
+  if (telnet->encoded) {
+    if (client->trace) {
+      trace_output(&telnet->outgoing, output);
+    }
+
+    if (telnet->encoder->encode(telnet->encoder->extension, telnet, client, output) == -1) {
+      LOG(ERROR, "Failed to encode output for client fd [%d]", client->fd);
+
+      network_clear_output_buffer(output);
+      telnet->encode_failed = true;
+
+      return -1;
+    }
+  }
+
+  return (int)output->length;
 }
 
 /**
- * Callback method called when the client has flushed output.
+ * Callback method called when the client has flushed output.  Output is run through
+ * the same state machine as input, purely so the commands we send can be logged, so
+ * the output isn't touched at all unless the client is being traced.  Encoded output
+ * has already been traced before it was encoded.
  *
  * client - the client who has flushed output
  * protocol - a void pointer to a telnet_t instance
- * output - the output that has been flushed
- * len - the length of the data that was flushed
+ * output - the output buffer that has been flushed
 **/
-void network_telnet_on_flush(client_t* client, void* protocol, char* output, size_t len) {
+void network_telnet_on_flush(client_t* client, void* protocol, output_buffer_t* output) {
   telnet_t* telnet = protocol;
   telnet_parse_t* parse_state = &telnet->outgoing;
 
-  int iac_index = 0;
-  int cmd_len = 0;
+  if (!client->trace) {
+    parse_state->state = READ_IAC;
 
-  for (int idx = 0; idx < len; idx++) {
-    update_parse_state(parse_state, output[idx], idx, &iac_index);
-
-    cmd_len = parse_state->state != READ_IAC ? cmd_len + 1 : cmd_len;
-
-    if (parse_state->state == DONE) {
-      log_telnet_parse(parse_state, cmd_len, false);
+    return;
+  }
 
-      parse_state->op = 0;
-      parse_state->option = 0;
-      parse_state->state = READ_IAC;
-    }
+  if (telnet->encoded) {
+    return;
   }
+
+  trace_output(parse_state, output);
 }
 
 /**
@@ -536,103 +864,176 @@ int network_telnet_send_dont(telnet_t* telnet, client_t* client, int option) {
 }
 
 /**
- * Updates the state of a parse_state_t based on a character.
+ * Dispatches a completed DO, DONT, WILL or WONT from the remote host.
  *
- * ps - the parse state to updat
- * c - the character to use to update the state
- * index - the position of the character c in the string that it was extracted
- * iac_index - a pointer to an int representing the position of the IAC byte that we update for the caller
- * cmd_len a pointer to an int representing the current length of the telnet command that we update for the
+ * telnet - telnet_t object we use to assess and update options
+ * client - client we may need to respond to
+ * op - the negotiation operation received
+ * option - the option being negotiated
 **/
-void update_parse_state(telnet_parse_t* parse_state, char chr, int index, int* iac_index) {
-  switch(parse_state->state) {
-    case READ_IAC:
-      if (chr == (char)IAC) {
-        *iac_index = index;
+void process_negotiation(telnet_t* telnet, client_t* client, unsigned int op, unsigned int option) {
+  telnet_option_t* opt = get_option(telnet, (int)option);
+  bool us = opt != NULL && opt->us == YES;
+  bool them = opt != NULL && opt->them == YES;
+
+  switch(op) {
+    case DO:
+      process_do(telnet, client, (int)option);
+      break;
 
-        parse_state->state = READ_OP;
-      }
+    case DONT:
+      process_dont(telnet, client, (int)option);
+      break;
 
+    case WILL:
+      process_will(telnet, client, (int)option);
       break;
 
-    case READ_OP:
-      parse_state->op = (unsigned int)(unsigned char)chr;
+    case WONT:
+      process_wont(telnet, client, (int)option);
+      break;
+  }
 
-      switch(parse_state->op) {
-        case WILL:
-        case WONT:
-        case DO:
-        case DONT:
-          parse_state->state = READ_OP_VALUE;
-          break;
-        case SB:
-          parse_state->state = READ_SB_OPTION;
-          break;
-        case SE:
-        case GA:
-        case EL:
-        case EC:
-        case AYT:
-        case AO:
-        case IP:
-        case BREAK:
-        case DM:
-        case NOP:
-        case EOR:
-        case ABORT:
-        case SUSP:
-        case xEOF:
-          parse_state->state = DONE;
-          break;
-        default:
-          parse_state->state = READ_IAC;
-          break;
-      }
+  if (opt == NULL) {
+    return;
+  }
 
-      break;
+  if (us != (opt->us == YES)) {
+    notify_negotiated(telnet, client, (int)option, true, opt->us == YES);
+  }
 
-    case READ_OP_VALUE:
-      parse_state->option = (unsigned int)(unsigned char) chr;
-      parse_state->state = DONE;
+  if (them != (opt->them == YES)) {
+    notify_negotiated(telnet, client, (int)option, false, opt->them == YES);
+  }
+}
 
-      break;
+/**
+ * Lets extensions know an option has been enabled or disabled by negotiation with the
+ * client.
+ *
+ * telnet - telnet_t instance containing extensions
+ * client - client_t instance the option was negotiated with
+ * option - the option negotiated
+ * local - whether the option is ours rather than the client's
+ * enabled - whether the option is now enabled
+**/
+void notify_negotiated(telnet_t* telnet, client_t* client, int option, bool local, bool enabled) {
+  telnet_extension_t* ext = telnet->extensions;
 
-    case READ_SB_OPTION:
-      parse_state->option = (unsigned int)(unsigned char) chr;
-      parse_state->state = READ_SE_IAC;
+  while (ext != NULL) {
+    if (ext->negotiated != NULL) {
+      ext->negotiated(ext->extension, telnet, client, option, local, enabled);
+    }
 
-      break;
+    ext = ext->next;
+  }
+}
+
+/**
+ * Decodes input with the decoder extension.  The decoder consumes all of the input,
+ * holding on to anything it can't yet decode, so the destination may overlap it.
+ *
+ * telnet - telnet_t instance with a decoder set
+ * client - client_t instance the input was received from
+ * input - the encoded input
+ * len - the length of the encoded input
+ * dest - where decoded input is written
+ * size - the space available at dest
+ *
+ * Returns the length of the decoded input
+**/
+size_t decode_input(telnet_t* telnet, client_t* client, const char* input, size_t len, char* dest, size_t size) {
+  telnet_extension_t* decoder = telnet->decoder;
 
-    case READ_SE_IAC:
-      if (parse_state->len == (TELNET_BUFFER_SIZE - 1)) {
-        if (chr == (char)IAC) {
-          parse_state->buffer[parse_state->len] = '\0';
-          parse_state->state = READ_SE;
+  int decoded = decoder->decode(decoder->extension, telnet, client, input, len, dest, size);
 
-          LOG(WARN, "Telnet Subnegotiation buffer was full and data may have been truncated");
+  if (decoded == -1) {
+    LOG(ERROR, "Failed to decode input for client fd [%d]", client->fd);
+
+    return 0;
+  }
+
+  return (size_t)decoded;
+}
+
+/**
+ * Runs output through the parser's state machine and logs the commands within it.
+ *
+ * parse_state - the outgoing parse state
+ * output - the output buffer to trace
+**/
+void trace_output(telnet_parse_t* parse_state, output_buffer_t* output) {
+  for (output_segment_t* segment = output->head; segment != NULL; segment = segment->next) {
+    for (size_t idx = 0; idx < segment->len; idx++) {
+      if (parse_state->state == READ_IAC) {
+        char* iac = memchr(segment->data + idx, (char)IAC, segment->len - idx);
+
+        if (iac == NULL) {
+          break;
         }
-      }
 
-      if (chr == (char)IAC) {
-        parse_state->buffer[parse_state->len] = '\0';
-        parse_state->state = READ_SE;
-        break;
+        idx = (size_t)(iac - segment->data);
       }
 
-      parse_state->buffer[parse_state->len] = chr;
-      parse_state->len = parse_state->len + 1;
+      unsigned char chr = (unsigned char)segment->data[idx];
+      telnet_transition_t transition = telnet_transitions[parse_state->state][telnet_byte_class[chr]];
 
-      break;
+      parse_state->state = transition.next;
+
+      switch (transition.action) {
+        case TELNET_OP:
+          parse_state->op = chr;
+          break;
 
-    case READ_SE:
-      parse_state->op = (unsigned int)(unsigned char)chr;
-      parse_state->state = DONE;
+        case TELNET_COMMAND:
+          parse_state->op = chr;
+          log_telnet_parse(parse_state, 2, false);
+          break;
 
-      break;
+        case TELNET_NEGOTIATE:
+        case TELNET_SB_BEGIN:
+          parse_state->option = chr;
 
-    case DONE:
-      break;
+          if (transition.action == TELNET_NEGOTIATE) {
+            log_telnet_parse(parse_state, 3, false);
+          }
+
+          break;
+
+        case TELNET_SB_END:
+          parse_state->op = SE;
+          log_telnet_parse(parse_state, 3, false);
+          break;
+
+        default:
+          break;
+      }
+    }
+  }
+}
+
+/**
+ * Appends a byte to a subnegotiation payload.  Payloads unescaped in place within the
+ * input can never outgrow it, while buffered payloads are truncated at the size of
+ * the parse state's buffer.
+ *
+ * data - the payload being built
+ * len - a pointer to the current length of the payload, updated for the caller
+ * chr - the byte to append
+ * buffered - whether the payload is held in the parse state's buffer
+**/
+void append_subnegotiation(char* data, size_t* len, char chr, bool buffered) {
+  if (buffered && *len >= TELNET_BUFFER_SIZE - 1) {
+    if (*len == TELNET_BUFFER_SIZE - 1) {
+      LOG(WARN, "Telnet Subnegotiation buffer was full and data may have been truncated");
+      *len = *len + 1;
+    }
+
+    return;
   }
+
+  data[*len] = chr;
+  *len = *len + 1;
 }
 
 /**
@@ -933,7 +1334,7 @@ void process_se(telnet_t* telnet, client_t* client, int option, const char* data
 static int send_raw_do(client_t* client, int option) {
   char msg[] = { (char) IAC, (char) DO, (char) option };
   
-  if (send_to_client(client, msg, 3) == -1) {
+  if (send_essential_to_client(client, msg, 3) == -1) {
     LOG(ERROR, "Failed to send Telnet DO [%d] to client", option);
     
     return -1;
@@ -953,7 +1354,7 @@ static int send_raw_do(client_t* client, int option) {
 static int send_raw_dont(client_t* client, int option) {
   char msg[] = { (char) IAC, (char) DONT, (char) option };
   
-  if (send_to_client(client, msg, 3) == -1) {
+  if (send_essential_to_client(client, msg, 3) == -1) {
     LOG(ERROR, "Failed to send Telnet DONT [%d] to client", option);
 
     return -1;
@@ -973,7 +1374,7 @@ static int send_raw_dont(client_t* client, int option) {
 static int send_raw_will(client_t* client, int option) {
   char msg[] = { (char) IAC, (char) WILL, (char) option };
   
-  if (send_to_client(client, msg, 3) == -1) {
+  if (send_essential_to_client(client, msg, 3) == -1) {
     LOG(ERROR, "Failed to send Telnet WILL [%d] to client", option);
 
     return -1;
@@ -993,7 +1394,7 @@ static int send_raw_will(client_t* client, int option) {
 static int send_raw_wont(client_t* client, int option) {
   char msg[] = { (char) IAC, (char) WONT, (char) option };
   
-  if (send_to_client(client, msg, 3) == -1) {
+  if (send_essential_to_client(client, msg, 3) == -1) {
     LOG(ERROR, "Failed to send Telnet WONT [%d] to client", option);
 
     return -1;
@@ -1011,25 +1412,9 @@ static int send_raw_wont(client_t* client, int option) {
  * Retrieves option if found or NULL
 **/
 telnet_option_t* get_option(telnet_t* telnet, int option) {
-  switch(option) {
-    case TELOPT_SGA:
-      return &telnet->suppress_go_ahead;
-    case TELOPT_ECHO:
-      return &telnet->echo;
-  }
-
-  telnet_extension_t* ext = telnet->extensions;
-  telnet_option_t* opt = NULL;
+  telnet_option_entry_t* entry = find_option(telnet, option);
 
-  while (ext != NULL && opt == NULL) {
-    if (ext->get_option != NULL) {
-      opt = ext->get_option(ext->extension, option);
-    }
-    
-    ext = ext->next;
-  }
-
-  return opt;
+  return entry != NULL ? entry->state : NULL;
 }
 
 /**
@@ -1077,28 +1462,101 @@ option_state_t* get_client_option(telnet_t* telnet, int option) {
  * Returns the config or NULL
 **/
 telnet_config_t* get_option_config(telnet_t* telnet, int option) {
-  telnet_config_t* config = &opt_config[0];
+  telnet_option_entry_t* entry = find_option(telnet, option);
 
-  while (config->option != 0) {
-    if (config->option == option) {
-      return config;
-    }
+  return entry != NULL ? entry->config : NULL;
+}
 
-    config++;
+/**
+ * Adds every option an extension supports to the option table.  Each option byte is
+ * offered to the extension once, when it's registered, and options already supported
+ * are left with whoever registered them first.
+ *
+ * telnet - the telnet_t instance the extension is being registered with
+ * extension - the extension being registered
+**/
+void index_options(telnet_t* telnet, telnet_extension_t* extension) {
+  if (extension->get_option == NULL) {
+    return;
   }
 
-  config = NULL;
-  telnet_extension_t* ext = telnet->extensions;
+  for (int option = 0; option < TELNET_OPTIONS; option++) {
+    if (telnet->option_index[option] != 0) {
+      continue;
+    }
+
+    telnet_option_t* state = extension->get_option(extension->extension, option);
+
+    if (state == NULL) {
+      continue;
+    }
+
+    telnet_config_t* config = NULL;
 
-  while (ext != NULL && config == NULL) {
-    if (ext->get_config != NULL) {
-      config = ext->get_config(telnet, option);
+    if (extension->get_config != NULL) {
+      config = extension->get_config(extension->extension, option);
     }
 
+    add_option(telnet, option, state, config, extension);
+  }
+}
+
+/**
+ * Adds an option to the option table.
+ *
+ * telnet - the telnet_t instance supporting the option
+ * option - the option byte
+ * state - the state of the option
+ * config - the configuration of the option, may be NULL
+ * extension - the extension supporting the option or NULL if telnet supports it
+**/
+void add_option(telnet_t* telnet, int option, telnet_option_t* state, telnet_config_t* config, telnet_extension_t* extension) {
+  if (telnet->option_count == TELNET_MAX_OPTIONS) {
+    LOG(ERROR, "Unable to support telnet option [%d], increase TELNET_MAX_OPTIONS", option);
+
+    return;
+  }
+
+  telnet_option_entry_t* entry = &telnet->options[telnet->option_count++];
+  entry->state = state;
+  entry->config = config;
+  entry->extension = extension;
+
+  telnet->option_index[option] = telnet->option_count;
+}
+
+/**
+ * Looks an option up in the option table.
+ *
+ * telnet - the telnet_t instance to look in
+ * option - the option byte
+ *
+ * Returns the option's entry or NULL if it isn't supported
+**/
+telnet_option_entry_t* find_option(telnet_t* telnet, int option) {
+  if (option < 0 || option >= TELNET_OPTIONS || telnet->option_index[option] == 0) {
+    return NULL;
+  }
+
+  return &telnet->options[telnet->option_index[option] - 1];
+}
+
+/**
+ * Finds the registered extension wrapping an extension's own data.
+ *
+ * telnet - the telnet_t instance the extension is registered with
+ * extension - the extension's own data
+ *
+ * Returns the telnet_extension_t or NULL if it isn't registered
+**/
+telnet_extension_t* find_extension(telnet_t* telnet, void* extension) {
+  telnet_extension_t* ext = telnet->extensions;
+
+  while (ext != NULL && ext->extension != extension) {
     ext = ext->next;
   }
 
-  return config;
+  return ext;
 }
 
 /**
@@ -0,0 +1,505 @@
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+#include "mud/log.h"
+#include "mud/network/client.h"
+#include "mud/network/network.h"
+#include "mud/network/output.h"
+#include "mud/network/protocol.h"
+#include "mud/network/tls.h"
+
+static int handshake(tls_t* tls, client_t* client);
+static void read_failed(tls_t* tls, client_t* client, int res);
+static void fail(tls_t* tls, client_t* client);
+static void hold_output(tls_t* tls, output_buffer_t* output);
+static int encrypt_output(tls_t* tls, const output_buffer_t* output);
+static int write_record(tls_t* tls, const char* data, size_t len);
+static int drain_output(tls_t* tls, output_buffer_t* encrypted);
+static const char* last_error(void);
+
+/**
+ * Creates the TLS context shared by every connection to a listener.  Sessions are
+ * cached by the context and session tickets issued with keys it holds, so a client
+ * reconnecting to any shard of the listener can resume its session and skip the
+ * expensive part of the handshake.
+ *
+ * certificate - path to the PEM certificate chain
+ * key - path to the PEM private key
+ *
+ * Returns the new context or NULL on failure
+**/
+SSL_CTX* network_new_tls_context(const char* certificate, const char* key) {
+  assert(certificate);
+  assert(key);
+
+  SSL_CTX* context = SSL_CTX_new(TLS_server_method());
+
+  if (context == NULL) {
+    LOG(ERROR, "Failed to create TLS context: %s", last_error());
+
+    return NULL;
+  }
+
+  if (SSL_CTX_use_certificate_chain_file(context, certificate) != 1 ||
+      SSL_CTX_use_PrivateKey_file(context, key, SSL_FILETYPE_PEM) != 1 ||
+      SSL_CTX_check_private_key(context) != 1) {
+    LOG(ERROR, "Failed to load TLS certificate [%s] and key [%s]: %s", certificate, key, last_error());
+    SSL_CTX_free(context);
+
+    return NULL;
+  }
+
+  SSL_CTX_set_min_proto_version(context, TLS1_2_VERSION);
+  SSL_CTX_set_mode(context, SSL_MODE_RELEASE_BUFFERS);
+
+  SSL_CTX_set_session_cache_mode(context, SSL_SESS_CACHE_SERVER);
+  SSL_CTX_set_session_id_context(context, (const unsigned char*)TLS_SESSION_CONTEXT, sizeof(TLS_SESSION_CONTEXT) - 1);
+  SSL_CTX_sess_set_cache_size(context, TLS_SESSION_CACHE_SIZE);
+  SSL_CTX_set_timeout(context, TLS_SESSION_TIMEOUT);
+  SSL_CTX_set_num_tickets(context, TLS_SESSION_TICKETS);
+
+  return context;
+}
+
+/**
+ * Releases a reference to a TLS context, freeing it once no listener or connection
+ * holds one.
+ *
+ * context - the context to release
+**/
+void network_free_tls_context(SSL_CTX* context) {
+  assert(context);
+
+  SSL_CTX_free(context);
+}
+
+/**
+ * Creates a new protocol_t which terminates TLS.  OpenSSL runs over a pair of memory
+ * BIOs, ciphertext read from the client being written into one and ciphertext to send
+ * read out of the other, so it never touches the socket and never blocks.
+ *
+ * pools - the protocol_pools_t to allocate from, or NULL to allocate from the heap
+ * context - the TLS context of the listener the client connected to
+ *
+ * Returns the new protocol_t instance or NULL on failure
+**/
+protocol_t* network_new_tls_protocol_t(protocol_pools_t* pools, SSL_CTX* context) {
+  assert(context);
+
+  SSL* ssl = SSL_new(context);
+  BIO* input = BIO_new(BIO_s_mem());
+  BIO* output = BIO_new(BIO_s_mem());
+
+  if (ssl == NULL || input == NULL || output == NULL) {
+    LOG(ERROR, "Failed to allocate TLS connection: %s", last_error());
+    SSL_free(ssl);
+    BIO_free(input);
+    BIO_free(output);
+
+    return NULL;
+  }
+
+  // Running out of ciphertext means waiting for more rather than end of stream
+  BIO_set_mem_eof_return(input, -1);
+  BIO_set_mem_eof_return(output, -1);
+
+  SSL_set_bio(ssl, input, output);
+  SSL_set_accept_state(ssl);
+
+  protocol_t* protocol = network_new_protocol_t(pools);
+  tls_t* tls = network_protocol_alloc(pools, sizeof(tls_t));
+
+  if (protocol == NULL || tls == NULL) {
+    SSL_free(ssl);
+
+    if (protocol != NULL) {
+      network_free_protocol_t(protocol);
+    }
+
+    if (tls != NULL) {
+      network_protocol_free(tls);
+    }
+
+    return NULL;
+  }
+
+  tls->ssl = ssl;
+  tls->input = input;
+  tls->output = output;
+  tls->established = false;
+  tls->failed = false;
+  tls->shutdown = false;
+  network_init_output_buffer(&tls->pending, SIZE_MAX);
+
+  protocol->type = TLS;
+  protocol->data = tls;
+  protocol->deallocator = network_deallocate_tls_t;
+  protocol->initialiser = network_tls_initialised;
+  protocol->on_input = network_tls_on_input;
+  protocol->on_output = network_tls_on_output;
+  protocol->on_flush = NULL;
+
+  return protocol;
+}
+
+/**
+ * Deallocates a void pointer to tls_t along with its OpenSSL state, keeping the session
+ * resumable however the connection ended unless it failed.
+ *
+ * value - void pointer to tls_t
+**/
+void network_deallocate_tls_t(void* value) {
+  assert(value);
+
+  tls_t* tls = value;
+
+  // OpenSSL drops sessions from the cache when a connection isn't shut down cleanly,
+  // but a client dropping its connection shouldn't cost it the chance to resume
+  if (tls->established && !tls->failed) {
+    SSL_set_shutdown(tls->ssl, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+  }
+
+  SSL_free(tls->ssl);
+  network_clear_output_buffer(&tls->pending);
+
+  network_protocol_free(tls);
+}
+
+/**
+ * Callback method called when the protocol is initialised.  Output held back during
+ * the handshake comes from the client's pool of segments and is bound by its limit.
+ *
+ * client - the client who has established a connection
+ * protocol - a void pointer to a tls_t instance
+**/
+void network_tls_initialised(client_t* client, void* protocol) {
+  assert(client);
+  assert(protocol);
+
+  tls_t* tls = protocol;
+
+  tls->pending.pool = client->output.pool;
+  tls->pending.limit = client->output.limit;
+}
+
+/**
+ * Callback method called when the client has received new input.  The ciphertext is
+ * handed to OpenSSL, the handshake advanced and any plaintext decrypted over the input
+ * in its place.  Plaintext which doesn't fit is left with OpenSSL and the input marked
+ * as held, so it's read on a later pass with no new ciphertext once there's space.
+ * Output is deferred whenever OpenSSL has something to send, such as the server's half
+ * of the handshake or session tickets.
+ *
+ * client - the client who has received input
+ * protocol - a void pointer to a tls_t instance
+ * input - the data that has been received
+ * len - the length of the input received
+ * size - the space available at input
+ *
+ * Returns the length of the decrypted input
+**/
+int network_tls_on_input(client_t* client, void* protocol, char* input, size_t len, size_t size) {
+  assert(client);
+  assert(protocol);
+  assert(input);
+
+  tls_t* tls = protocol;
+  size_t written = 0;
+
+  if (tls->failed) {
+    return 0;
+  }
+
+  ERR_clear_error();
+
+  if (len > 0 && BIO_write(tls->input, input, (int)len) != (int)len) {
+    LOG(ERROR, "Failed to buffer TLS input from client fd [%d]", client->fd);
+    fail(tls, client);
+
+    return 0;
+  }
+
+  if (!tls->established && handshake(tls, client) == -1) {
+    return 0;
+  }
+
+  while (tls->established && written < size) {
+    int res = SSL_read(tls->ssl, input + written, (int)(size - written));
+
+    if (res <= 0) {
+      read_failed(tls, client, res);
+
+      break;
+    }
+
+    written += (size_t)res;
+  }
+
+  if (tls->established && !tls->failed && written == size
+    && (SSL_has_pending(tls->ssl) || BIO_ctrl_pending(tls->input) > 0)) {
+    client->input_held = true;
+  }
+
+  if (BIO_ctrl_pending(tls->output) > 0) {
+    network_client_defer_output(client);
+  }
+
+  return (int)written;
+}
+
+/**
+ * Callback method called when output is about to be written to the client.  Output is
+ * held back until the handshake has completed, then encrypted in full sized records
+ * and replaced with the ciphertext OpenSSL produces.  Clients which have been hung up
+ * are sent a close_notify after their last output.  Should encryption fail the output
+ * is discarded rather than risk it being sent in the clear.
+ *
+ * client - the client whose output is being flushed
+ * protocol - a void pointer to a tls_t instance
+ * input - the plaintext to be sent, consumed
+ * output - the output buffer the ciphertext is written to
+ *
+ * Returns the length of the encrypted output
+**/
+int network_tls_on_output(client_t* client, void* protocol, output_buffer_t* input, output_buffer_t* output) {
+  assert(client);
+  assert(protocol);
+  assert(input);
+  assert(output);
+
+  tls_t* tls = protocol;
+  int res = 0;
+
+  ERR_clear_error();
+
+  if (!tls->failed && !tls->established) {
+    hold_output(tls, input);
+  } else if (!tls->failed) {
+    res = encrypt_output(tls, &tls->pending);
+    network_clear_output_buffer(&tls->pending);
+
+    if (res == 0) {
+      res = encrypt_output(tls, input);
+    }
+
+    if (res == 0 && client->hungup && !tls->shutdown) {
+      SSL_shutdown(tls->ssl);
+      tls->shutdown = true;
+    }
+  }
+
+  if (res == 0) {
+    res = drain_output(tls, output);
+  }
+
+  if (res == -1) {
+    LOG(ERROR, "Failed to encrypt output for client fd [%d]: %s", client->fd, last_error());
+    network_clear_output_buffer(output);
+    fail(tls, client);
+
+    return 0;
+  }
+
+  return (int)output->length;
+}
+
+/**
+ * Module internal method to advance the handshake with the ciphertext received so far.
+ *
+ * tls - the tls_t for the client
+ * client - the client being handshaked with
+ *
+ * Returns 0 if the handshake completed or needs more input or -1 if it failed
+**/
+static int handshake(tls_t* tls, client_t* client) {
+  int res = SSL_do_handshake(tls->ssl);
+
+  if (res != 1) {
+    int err = SSL_get_error(tls->ssl, res);
+
+    if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) {
+      if (BIO_ctrl_pending(tls->output) > 0) {
+        network_client_defer_output(client);
+      }
+
+      return 0;
+    }
+
+    LOG(INFO, "TLS handshake with client fd [%d] failed: %s", client->fd, last_error());
+    fail(tls, client);
+
+    return -1;
+  }
+
+  bool resumed = SSL_session_reused(tls->ssl) == 1;
+
+  tls->established = true;
+
+  if (client->network != NULL) {
+    client->network->metrics.tls_handshakes++;
+
+    if (resumed) {
+      client->network->metrics.tls_resumptions++;
+    }
+  }
+
+  LOG(INFO, "Client fd [%d] established %s%s", client->fd, SSL_get_version(tls->ssl), resumed ? " resuming its session" : "");
+
+  if (tls->pending.length > 0) {
+    network_client_defer_output(client);
+  }
+
+  return 0;
+}
+
+/**
+ * Module internal method to handle SSL_read returning without plaintext, which is
+ * expected once OpenSSL needs more ciphertext.  A close_notify from the client hangs
+ * it up and anything else fails the connection.
+ *
+ * tls - the tls_t for the client
+ * client - the client being read from
+ * res - the value SSL_read returned
+**/
+static void read_failed(tls_t* tls, client_t* client, int res) {
+  int err = SSL_get_error(tls->ssl, res);
+
+  if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) {
+    return;
+  }
+
+  if (err == SSL_ERROR_ZERO_RETURN) {
+    LOG(INFO, "Client fd [%d] closed its TLS session", client->fd);
+    network_client_hang_up(client);
+
+    return;
+  }
+
+  LOG(INFO, "TLS read from client fd [%d] failed: %s", client->fd, last_error());
+  fail(tls, client);
+}
+
+/**
+ * Module internal method to give up on a connection.  Any alert OpenSSL has written is
+ * still sent before the client is disconnected, but no further output.
+ *
+ * tls - the tls_t for the client
+ * client - the client to disconnect
+**/
+static void fail(tls_t* tls, client_t* client) {
+  tls->failed = true;
+
+  network_client_hang_up(client);
+}
+
+/**
+ * Module internal method to hold output back until the handshake has completed.  The
+ * output's segments are moved rather than copied.  Output beyond the client's output
+ * limit is dropped.
+ *
+ * tls - the tls_t for the client
+ * output - the output to hold back, emptied
+**/
+static void hold_output(tls_t* tls, output_buffer_t* output) {
+  if (network_output_buffer_splice(&tls->pending, output, output->length) == -1) {
+    LOG(WARN, "Dropping output held back during TLS handshake as it's over the output limit");
+  }
+}
+
+/**
+ * Module internal method to encrypt output.  Segments are gathered into full sized
+ * records so small segments don't each pay for a record of their own.
+ *
+ * tls - the tls_t for the client
+ * output - the plaintext to encrypt
+ *
+ * Returns 0 on success or -1 on failure
+**/
+static int encrypt_output(tls_t* tls, const output_buffer_t* output) {
+  char record[TLS_RECORD_SIZE];
+  size_t len = 0;
+
+  for (output_segment_t* segment = output->head; segment != NULL; segment = segment->next) {
+    size_t offset = 0;
+
+    while (offset < segment->len) {
+      size_t copy = segment->len - offset < TLS_RECORD_SIZE - len ? segment->len - offset : TLS_RECORD_SIZE - len;
+
+      memcpy(record + len, segment->data + offset, copy);
+      offset += copy;
+      len += copy;
+
+      if (len == TLS_RECORD_SIZE) {
+        if (write_record(tls, record, len) == -1) {
+          return -1;
+        }
+
+        len = 0;
+      }
+    }
+  }
+
+  return len > 0 ? write_record(tls, record, len) : 0;
+}
+
+/**
+ * Module internal method to encrypt a record.
+ *
+ * tls - the tls_t for the client
+ * data - the plaintext
+ * len - the length of the plaintext, at most a record
+ *
+ * Returns 0 on success or -1 on failure
+**/
+static int write_record(tls_t* tls, const char* data, size_t len) {
+  return SSL_write(tls->ssl, data, (int)len) == (int)len ? 0 : -1;
+}
+
+/**
+ * Module internal method to move the ciphertext OpenSSL has written straight into
+ * space reserved in an output buffer.
+ *
+ * tls - the tls_t for the client
+ * encrypted - the output buffer to write the ciphertext to
+ *
+ * Returns 0 on success or -1 on failure
+**/
+static int drain_output(tls_t* tls, output_buffer_t* encrypted) {
+  while (BIO_ctrl_pending(tls->output) > 0) {
+    size_t space = 0;
+    char* dest = network_output_buffer_reserve(encrypted, &space);
+
+    if (dest == NULL) {
+      return -1;
+    }
+
+    int res = BIO_read(tls->output, dest, (int)space);
+
+    if (res <= 0) {
+      return -1;
+    }
+
+    network_output_buffer_commit(encrypted, (size_t)res);
+  }
+
+  return 0;
+}
+
+/**
+ * Module internal method to describe the most recent OpenSSL error.
+ *
+ * Returns a description of the error
+**/
+static const char* last_error(void) {
+  unsigned long err = ERR_peek_last_error();
+
+  if (err == 0) {
+    return "unknown error";
+  }
+
+  return ERR_reason_error_string(err) != NULL ? ERR_reason_error_string(err) : "unknown error";
+}
@@ -0,0 +1,251 @@
+#include <arpa/telnet.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mud/log.h"
+#include "mud/network/capabilities.h"
+#include "mud/network/client.h"
+#include "mud/network/protocol.h"
+#include "mud/network/ttype.h"
+
+static void deallocate_ttype_t(void* value);
+static void initialise_ttype(void* extension, telnet_t* telnet, client_t* client);
+static telnet_option_t* get_option(void* extension, int option);
+static telnet_config_t* get_config(void* extension, int option);
+static void process_se(void* extension, telnet_t* telnet, client_t* client, int option, const char* data, size_t len);
+static void process_negotiated(void* extension, telnet_t* telnet, client_t* client, int option, bool local, bool enabled);
+
+static void send_request(client_t* client);
+static bool parse_mtts(const char* name, size_t len, uint32_t* mtts);
+
+static telnet_config_t ttype_config = {TELOPT_TTYPE, true, false};
+
+/**
+ * Creates a new telnet_extension_t for the TTYPE extension.  Terminal types are
+ * requested repeatedly as described by MTTS, so the client's name, its terminal type
+ * and finally the MTTS bitvector of what it supports end up in its capability profile.
+ *
+ * pools - the protocol_pools_t to allocate from, or NULL to allocate from the heap
+ *
+ * Returns the new telnet_extension_t instance or NULL on failure.
+**/
+telnet_extension_t* network_new_ttype_telnet_extension(protocol_pools_t* pools) {
+  telnet_extension_t* extension = network_new_telnet_extension(pools, sizeof(ttype_t));
+
+  if (extension == NULL) {
+    return NULL;
+  }
+
+  extension->deallocate = deallocate_ttype_t;
+  extension->initialise = initialise_ttype;
+  extension->get_option = get_option;
+  extension->get_config = get_config;
+  extension->subnegotiation = process_se;
+  extension->negotiated = process_negotiated;
+  extension->encode = NULL;
+  extension->decode = NULL;
+  extension->flush = NULL;
+  extension->next = NULL;
+
+  return extension;
+}
+
+/**
+ * Deallocates a void pointer to ttype_t
+ *
+ * value - void pointer to ttype_t
+**/
+void deallocate_ttype_t(void* value) {
+  assert(value);
+
+  network_protocol_free(value);
+}
+
+/**
+ * Initialises TTYPE by sending a DO to the client
+ *
+ * extension - void pointer to the extension (should be ttype_t)
+ * telnet - the telnet_t instance for the client
+ * client - the client_t instance of the client
+**/
+void initialise_ttype(void* extension, telnet_t* telnet, client_t* client) {
+  assert(extension);
+  assert(telnet);
+  assert(client);
+
+  network_telnet_send_do(telnet, client, TELOPT_TTYPE);
+}
+
+/**
+ * Retrieves telnet options relevant to the TTYPE extension
+ *
+ * extension - void pointer to the ttype_t instance
+ * option - the option number of the option we're looking for
+ *
+ * Returns the option if TTYPE or NULL.
+**/
+telnet_option_t* get_option(void* extension, int option) {
+  assert(extension);
+
+  ttype_t* ttype = extension;
+
+  if (option == TELOPT_TTYPE) {
+    return &ttype->ttype;
+  }
+
+  return NULL;
+}
+
+/**
+ * Retrieves config options relevant to the TTYPE extension
+ *
+ * extension - void pointer to the ttype_t instance
+ * option - the option number of the option we're looking for
+ *
+ * Returns the option config or NULL.
+**/
+telnet_config_t* get_config(void* extension, int option) {
+  assert(extension);
+
+  if (option == TELOPT_TTYPE) {
+    return &ttype_config;
+  }
+
+  return NULL;
+}
+
+/**
+ * Processes a terminal type from the client.  The first is the client's name, which is
+ * also treated as its terminal type in case it only has the one, the second its
+ * terminal type and the third, if the client supports MTTS, a bitvector of what it
+ * supports.  A client repeating itself has no more terminal types to give.
+ *
+ * extension - void pointer to ttype_t
+ * telnet - telnet_t instance
+ * client - client_t instance representing the remote client
+ * option - the option negotiated for
+ * data - the data for the subnegotiation
+ * len - the length of the data
+**/
+void process_se(void* extension, telnet_t* telnet, client_t* client, int option, const char* data, size_t len) {
+  assert(extension);
+  assert(telnet);
+  assert(client);
+  assert(data);
+
+  ttype_t* ttype = extension;
+
+  if (option != TELOPT_TTYPE || len < 1 || data[0] != TELQUAL_IS || ttype->replies >= TTYPE_MAX_REQUESTS) {
+    return;
+  }
+
+  const char* name = data + 1;
+  size_t name_len = len - 1;
+  client_capabilities_t* capabilities = &client->capabilities;
+
+  ttype->replies++;
+
+  if (ttype->replies > 1 && strlen(ttype->last) == name_len && strncmp(ttype->last, name, name_len) == 0) {
+    ttype->replies = TTYPE_MAX_REQUESTS;
+
+    return;
+  }
+
+  uint32_t mtts = 0;
+
+  if (ttype->replies == 1) {
+    network_capabilities_set_name(capabilities->client_name, name, name_len);
+    network_capabilities_set_terminal(capabilities, name, name_len);
+  } else if (parse_mtts(name, name_len, &mtts)) {
+    network_capabilities_set_mtts(capabilities, mtts);
+    ttype->replies = TTYPE_MAX_REQUESTS;
+  } else {
+    network_capabilities_set_terminal(capabilities, name, name_len);
+  }
+
+  LOG(DEBUG, "Client [%d] is [%s] on terminal [%s] with capabilities [%#x]", client->fd, capabilities->client_name, capabilities->terminal, capabilities->flags);
+
+  network_capabilities_set_name(ttype->last, name, name_len);
+
+  if (ttype->replies < TTYPE_MAX_REQUESTS) {
+    send_request(client);
+  }
+}
+
+/**
+ * Asks for the client's first terminal type once it agrees to send them.
+ *
+ * extension - void pointer to ttype_t
+ * telnet - telnet_t instance
+ * client - client_t instance representing the remote client
+ * option - the option negotiated
+ * local - whether the option is ours rather than the client's
+ * enabled - whether the option is now enabled
+**/
+void process_negotiated(void* extension, telnet_t* telnet, client_t* client, int option, bool local, bool enabled) {
+  assert(extension);
+  assert(telnet);
+  assert(client);
+
+  ttype_t* ttype = extension;
+
+  if (option != TELOPT_TTYPE || local) {
+    return;
+  }
+
+  if (!enabled) {
+    client->capabilities.flags &= ~CAPABILITY_TTYPE;
+
+    return;
+  }
+
+  client->capabilities.flags |= CAPABILITY_TTYPE;
+  ttype->replies = 0;
+  ttype->last[0] = '\0';
+
+  send_request(client);
+}
+
+/**
+ * Sends an IAC SB TTYPE SEND IAC SE to the client.
+ *
+ * client - the client to request a terminal type from
+**/
+void send_request(client_t* client) {
+  char msg[] = { (char) IAC, (char) SB, (char) TELOPT_TTYPE, (char) TELQUAL_SEND, (char) IAC, (char) SE };
+
+  if (send_essential_to_client(client, msg, sizeof(msg)) == -1) {
+    LOG(ERROR, "Failed to send TTYPE request to client [%d]", client->fd);
+  }
+}
+
+/**
+ * Parses an MTTS terminal type, which is MTTS followed by a decimal bitvector.
+ *
+ * name - the terminal type, not null terminated
+ * len - the length of the terminal type
+ * mtts - receives the bitvector
+ *
+ * Returns true if the terminal type was an MTTS bitvector
+**/
+bool parse_mtts(const char* name, size_t len, uint32_t* mtts) {
+  if (len < 6 || len > 15 || strncmp(name, "MTTS ", 5) != 0) {
+    return false;
+  }
+
+  char digits[16];
+  memcpy(digits, name + 5, len - 5);
+  digits[len - 5] = '\0';
+
+  char* end = NULL;
+  unsigned long value = strtoul(digits, &end, 10);
+
+  if (end == digits || *end != '\0') {
+    return false;
+  }
+
+  *mtts = (uint32_t)value;
+
+  return true;
+}
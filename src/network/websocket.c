@@ -0,0 +1,1095 @@
+#include <arpa/telnet.h>
+#include <assert.h>
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "mud/log.h"
+#include "mud/network/client.h"
+#include "mud/network/gmcp.h"
+#include "mud/network/output.h"
+#include "mud/network/protocol.h"
+#include "mud/network/telnet.h"
+#include "mud/network/websocket.h"
+
+#define WEBSOCKET_OUTPUT_PASSES 4 // Times output is translated while answering negotiation
+#define WEBSOCKET_KEY_SIZE 64 // Longest Sec-WebSocket-Key accepted
+
+static size_t read_request(websocket_t* websocket, client_t* client, const char* input, size_t len);
+static int upgrade(websocket_t* websocket, client_t* client);
+static void reject(websocket_t* websocket, client_t* client);
+static const char* find_header(const char* request, const char* name, size_t* len);
+static bool has_token(const char* value, size_t len, const char* token);
+
+static int read_header_size(websocket_t* websocket, client_t* client);
+static int start_frame(websocket_t* websocket, client_t* client);
+static size_t end_frame(websocket_t* websocket, client_t* client, char* input, size_t* len, size_t size, size_t written, size_t* read);
+static void process_control(websocket_t* websocket, client_t* client);
+static void fail(websocket_t* websocket, client_t* client, uint16_t code);
+static void unmask(websocket_t* websocket, char* dest, const char* src, size_t len);
+static bool receiving_gmcp(websocket_t* websocket);
+
+static int translate_output(websocket_t* websocket, client_t* client, output_buffer_t* output, output_buffer_t* framed);
+static int translate_segment(websocket_t* websocket, const char* data, size_t len, output_buffer_t* framed);
+static void queue_reply(websocket_t* websocket, unsigned char op, unsigned char option);
+static void answer_negotiation(websocket_t* websocket, client_t* client);
+static int append_frame(websocket_t* websocket, output_buffer_t* framed, websocket_opcode_t opcode, const char* data, size_t len);
+static int splice_frame(websocket_t* websocket, output_buffer_t* framed, websocket_opcode_t opcode, output_buffer_t* output, size_t len);
+static int emit_frame(websocket_t* websocket, output_buffer_t* framed);
+static int write_frame(output_buffer_t* framed, websocket_opcode_t opcode, const char* data, size_t len);
+static int write_header(output_buffer_t* framed, websocket_opcode_t opcode, uint64_t len);
+
+
+static const char bad_request[] = "HTTP/1.1 400 Bad Request\r\nSec-WebSocket-Version: 13\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+
+/**
+ * Creates a new protocol_t for WebSocket (RFC 6455) connections.  The protocol upgrades
+ * the connection from HTTP and then carries the telnet protocol after it in the chain
+ * within frames.  Game output is sent as text frames, or as binary frames alongside GMCP
+ * in text frames when the client asks for the gmcp.mudstandards.org sub-protocol, and
+ * telnet negotiation is answered on the client's behalf.
+ *
+ * pools - the protocol_pools_t to allocate from, or NULL to allocate from the heap
+ * on_open - callback made once the connection has been upgraded
+ * context - context passed to the callback
+ *
+ * Returns the new protocol_t instance or NULL on failure.
+**/
+protocol_t* network_new_websocket_protocol_t(protocol_pools_t* pools, callback_func on_open, void* context) {
+  assert(on_open);
+
+  protocol_t* protocol = network_new_protocol_t(pools);
+  websocket_t* websocket = network_protocol_alloc(pools, sizeof(websocket_t));
+
+  if (protocol == NULL || websocket == NULL) {
+    if (protocol != NULL) {
+      network_free_protocol_t(protocol);
+    }
+
+    if (websocket != NULL) {
+      network_protocol_free(websocket);
+    }
+
+    return NULL;
+  }
+
+  websocket->state = WEBSOCKET_HANDSHAKE;
+  websocket->on_open = on_open;
+  websocket->context = context;
+  websocket->header_need = 2;
+  websocket->output_state = WEBSOCKET_OUTPUT_DATA;
+  network_init_output_buffer(&websocket->frame, SIZE_MAX);
+
+  protocol->type = WEBSOCKET;
+  protocol->data = websocket;
+  protocol->deallocator = network_deallocate_websocket_t;
+  protocol->initialiser = network_websocket_initialised;
+  protocol->on_input = network_websocket_on_input;
+  protocol->on_output = network_websocket_on_output;
+  protocol->on_flush = NULL;
+
+  return protocol;
+}
+
+/**
+ * Deallocates a void pointer to websocket_t along with any partial handshake, message
+ * or frame it holds.
+ *
+ * value - void pointer to websocket_t
+**/
+void network_deallocate_websocket_t(void* value) {
+  assert(value);
+
+  websocket_t* websocket = value;
+
+  free(websocket->request);
+  free(websocket->message);
+  network_clear_output_buffer(&websocket->frame);
+
+  network_protocol_free(websocket);
+}
+
+/**
+ * Callback method called when the protocol is initialised.  Frames are built from the
+ * same pool of segments as the client's output.
+ *
+ * client - the client who has established a connection
+ * protocol - a void pointer to a websocket_t instance
+**/
+void network_websocket_initialised(client_t* client, void* protocol) {
+  assert(client);
+  assert(protocol);
+
+  websocket_t* websocket = protocol;
+
+  websocket->frame.pool = client->output.pool;
+}
+
+/**
+ * Callback method called when the client has received new input.  Until the connection
+ * is upgraded the input is read as the handshake request.  Afterwards frames are decoded
+ * in place, each payload being unmasked and moved forward over the frame headers before
+ * it so no frame is buffered, and a line ending is added to each message which doesn't
+ * already end with one.  Control frames and GMCP messages are consumed.
+ *
+ * client - the client who has received input
+ * protocol - a void pointer to a websocket_t instance
+ * input - the data that has been received
+ * len - the length of the input received
+ * size - the space available at input
+ *
+ * Returns the length of the decoded input
+**/
+int network_websocket_on_input(client_t* client, void* protocol, char* input, size_t len, size_t size) {
+  assert(client);
+  assert(protocol);
+  assert(input);
+
+  websocket_t* websocket = protocol;
+  size_t read = 0;
+  size_t written = 0;
+
+  if (websocket->state == WEBSOCKET_HANDSHAKE) {
+    read = read_request(websocket, client, input, len);
+  }
+
+  while (read < len && websocket->state == WEBSOCKET_OPEN) {
+    if (websocket->remaining == 0) {
+      websocket->header[websocket->header_len++] = (unsigned char)input[read++];
+
+      if (websocket->header_len == 2 && read_header_size(websocket, client) == -1) {
+        break;
+      }
+
+      if (websocket->header_len < websocket->header_need) {
+        continue;
+      }
+
+      if (start_frame(websocket, client) == -1) {
+        break;
+      }
+
+      if (websocket->remaining > 0) {
+        continue;
+      }
+    } else {
+      size_t n = len - read < websocket->remaining ? len - read : (size_t)websocket->remaining;
+
+      if (websocket->opcode >= WEBSOCKET_CLOSE) {
+        unmask(websocket, websocket->control + websocket->control_len, input + read, n);
+        websocket->control_len += n;
+      } else if (receiving_gmcp(websocket)) {
+        unmask(websocket, websocket->message + websocket->message_len, input + read, n);
+        websocket->message_len += n;
+      } else {
+        unmask(websocket, input + written, input + read, n);
+
+        if (n > 1) {
+          websocket->tail[0] = input[written + n - 2];
+        } else {
+          websocket->tail[0] = websocket->tail[1];
+        }
+
+        websocket->tail[1] = input[written + n - 1];
+        written += n;
+      }
+
+      read += n;
+      websocket->remaining -= n;
+
+      if (websocket->remaining > 0) {
+        continue;
+      }
+    }
+
+    written = end_frame(websocket, client, input, &len, size, written, &read);
+  }
+
+  return (int)written;
+}
+
+/**
+ * Callback method called when output is about to be written to the client.  Telnet
+ * output is split into frames, GMCP subnegotiations becoming frames of their own when
+ * the client asked for GMCP and any other telnet commands being removed.  Negotiation
+ * is answered on the client's behalf, refusing everything but GMCP, and any output the
+ * answers produce is framed in turn.  Clients which have been hung up are sent a close
+ * frame after their last output.
+ *
+ * client - the client whose output is being flushed
+ * protocol - a void pointer to a websocket_t instance
+ * input - the telnet output to be sent, consumed
+ * output - the output buffer frames are written to
+ *
+ * Returns the length of the framed output or -1 on failure
+**/
+int network_websocket_on_output(client_t* client, void* protocol, output_buffer_t* input, output_buffer_t* output) {
+  assert(client);
+  assert(protocol);
+  assert(input);
+  assert(output);
+
+  websocket_t* websocket = protocol;
+
+  size_t skip = websocket->state == WEBSOCKET_HANDSHAKE || websocket->raw > input->length ? input->length : websocket->raw;
+  int res = network_output_buffer_splice(output, input, skip);
+
+  websocket->raw = 0;
+
+  if (websocket->state == WEBSOCKET_HANDSHAKE) {
+    return res == 0 ? (int)output->length : -1;
+  }
+
+  if (res == 0 && websocket->pong_pending) {
+    res = write_frame(output, WEBSOCKET_PONG, websocket->pong, websocket->pong_len);
+    websocket->pong_pending = false;
+  }
+
+  if (res == 0 && websocket->state == WEBSOCKET_OPEN) {
+    res = translate_output(websocket, client, input, output);
+  }
+
+  if (websocket->state == WEBSOCKET_OPEN && client->hungup) {
+    websocket->state = WEBSOCKET_CLOSED;
+    websocket->close_code = WEBSOCKET_CLOSE_NORMAL;
+    websocket->close_pending = true;
+  }
+
+  if (res == 0 && websocket->close_pending) {
+    char code[] = { (char)(websocket->close_code >> 8), (char)(websocket->close_code & 0xFF) };
+
+    res = write_frame(output, WEBSOCKET_CLOSE, code, sizeof(code));
+    websocket->close_pending = false;
+  }
+
+  if (res == -1) {
+    LOG(ERROR, "Failed to frame WebSocket output for client fd [%d]", client->fd);
+
+    return -1;
+  }
+
+  return (int)output->length;
+}
+
+/**
+ * Module internal method to collect the handshake request and upgrade the connection
+ * once it's complete.
+ *
+ * websocket - the websocket_t for the client
+ * client - the client sending the request
+ * input - the input received
+ * len - the length of the input
+ *
+ * Returns the number of bytes of input which were part of the request
+**/
+static size_t read_request(websocket_t* websocket, client_t* client, const char* input, size_t len) {
+  if (websocket->request == NULL && (websocket->request = malloc(WEBSOCKET_REQUEST_SIZE + 1)) == NULL) {
+    LOG(ERROR, "Failed to allocate WebSocket handshake buffer for client fd [%d]", client->fd);
+    reject(websocket, client);
+
+    return len;
+  }
+
+  size_t previous = websocket->request_len;
+  size_t start = previous > 3 ? previous - 3 : 0;
+  size_t copy = len < WEBSOCKET_REQUEST_SIZE - previous ? len : WEBSOCKET_REQUEST_SIZE - previous;
+
+  memcpy(websocket->request + previous, input, copy);
+  websocket->request_len += copy;
+  websocket->request[websocket->request_len] = '\0';
+
+  char* end = strstr(websocket->request + start, "\r\n\r\n");
+
+  if (end == NULL) {
+    if (websocket->request_len == WEBSOCKET_REQUEST_SIZE) {
+      LOG(INFO, "Rejecting WebSocket handshake from client fd [%d] as it's too long", client->fd);
+      reject(websocket, client);
+    }
+
+    return copy;
+  }
+
+  size_t request_len = (size_t)(end - websocket->request) + 4;
+
+  websocket->request[request_len] = '\0';
+  websocket->request_len = request_len;
+
+  if (upgrade(websocket, client) == -1) {
+    reject(websocket, client);
+  }
+
+  return request_len - previous;
+}
+
+/**
+ * Module internal method to validate the handshake request and respond to it.
+ *
+ * websocket - the websocket_t for the client
+ * client - the client which sent the request
+ *
+ * Returns 0 if the connection was upgraded or -1 if the request was invalid
+**/
+static int upgrade(websocket_t* websocket, client_t* client) {
+  const char* request = websocket->request;
+  const char* value = NULL;
+  size_t len = 0;
+
+  if (strncmp(request, "GET ", 4) != 0) {
+    LOG(INFO, "Rejecting WebSocket handshake from client fd [%d] which isn't a GET", client->fd);
+
+    return -1;
+  }
+
+  if ((value = find_header(request, "Upgrade", &len)) == NULL || !has_token(value, len, "websocket") ||
+      (value = find_header(request, "Connection", &len)) == NULL || !has_token(value, len, "upgrade") ||
+      (value = find_header(request, "Sec-WebSocket-Version", &len)) == NULL || !has_token(value, len, "13")) {
+    LOG(INFO, "Rejecting WebSocket handshake from client fd [%d] without a version 13 upgrade", client->fd);
+
+    return -1;
+  }
+
+  const char* key = find_header(request, "Sec-WebSocket-Key", &len);
+
+  if (key == NULL || len == 0 || len > WEBSOCKET_KEY_SIZE) {
+    LOG(INFO, "Rejecting WebSocket handshake from client fd [%d] without a valid key", client->fd);
+
+    return -1;
+  }
+
+  unsigned char accept_key[WEBSOCKET_KEY_SIZE + sizeof(WEBSOCKET_GUID)];
+  unsigned char digest[SHA_DIGEST_LENGTH];
+  unsigned char accept[32];
+
+  memcpy(accept_key, key, len);
+  memcpy(accept_key + len, WEBSOCKET_GUID, sizeof(WEBSOCKET_GUID) - 1);
+
+  if (EVP_Digest(accept_key, len + sizeof(WEBSOCKET_GUID) - 1, digest, NULL, EVP_sha1(), NULL) != 1) {
+    LOG(ERROR, "Failed to digest WebSocket key from client fd [%d]", client->fd);
+
+    return -1;
+  }
+
+  EVP_EncodeBlock(accept, digest, sizeof(digest));
+
+  value = find_header(request, "Sec-WebSocket-Protocol", &len);
+  websocket->gmcp = value != NULL && has_token(value, len, WEBSOCKET_GMCP_PROTOCOL);
+
+  char response[256];
+  int response_len = snprintf(response, sizeof(response),
+    "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: %s\r\n%s\r\n",
+    (char*)accept, websocket->gmcp ? "Sec-WebSocket-Protocol: " WEBSOCKET_GMCP_PROTOCOL "\r\n" : "");
+
+  if (send_essential_to_client(client, response, (size_t)response_len) == -1) {
+    LOG(ERROR, "Failed to send WebSocket handshake response to client fd [%d]", client->fd);
+
+    return -1;
+  }
+
+  websocket->raw = client->output.length;
+  websocket->state = WEBSOCKET_OPEN;
+
+  free(websocket->request);
+  websocket->request = NULL;
+  websocket->request_len = 0;
+
+  LOG(INFO, "Client fd [%d] upgraded to WebSocket%s", client->fd, websocket->gmcp ? " with GMCP" : "");
+
+  websocket->on_open(client, websocket->context);
+
+  return 0;
+}
+
+/**
+ * Module internal method to refuse the handshake and disconnect the client.
+ *
+ * websocket - the websocket_t for the client
+ * client - the client to refuse
+**/
+static void reject(websocket_t* websocket, client_t* client) {
+  send_essential_to_client(client, bad_request, sizeof(bad_request) - 1);
+
+  websocket->raw = client->output.length;
+  websocket->state = WEBSOCKET_CLOSED;
+
+  free(websocket->request);
+  websocket->request = NULL;
+  websocket->request_len = 0;
+
+  network_client_hang_up(client);
+}
+
+/**
+ * Module internal method to find the value of a header in the handshake request.
+ *
+ * request - the null terminated request
+ * name - the name of the header, matched regardless of case
+ * len - populated with the length of the value
+ *
+ * Returns the start of the value with surrounding whitespace removed or NULL
+**/
+static const char* find_header(const char* request, const char* name, size_t* len) {
+  size_t name_len = strlen(name);
+  const char* line = strstr(request, "\r\n");
+
+  while (line != NULL) {
+    line += 2;
+
+    const char* end = strstr(line, "\r\n");
+
+    if (end == NULL || end == line) {
+      return NULL;
+    }
+
+    if ((size_t)(end - line) > name_len && line[name_len] == ':' && strncasecmp(line, name, name_len) == 0) {
+      const char* value = line + name_len + 1;
+      const char* value_end = end;
+
+      while (value < value_end && (*value == ' ' || *value == '\t')) {
+        value++;
+      }
+
+      while (value_end > value && (value_end[-1] == ' ' || value_end[-1] == '\t')) {
+        value_end--;
+      }
+
+      *len = (size_t)(value_end - value);
+
+      return value;
+    }
+
+    line = end;
+  }
+
+  return NULL;
+}
+
+/**
+ * Module internal method to check a comma separated header value for a token.
+ *
+ * value - the header value
+ * len - the length of the header value
+ * token - the token to look for, matched regardless of case
+ *
+ * Returns true if the token is present
+**/
+static bool has_token(const char* value, size_t len, const char* token) {
+  size_t token_len = strlen(token);
+  size_t pos = 0;
+
+  while (pos < len) {
+    while (pos < len && (value[pos] == ' ' || value[pos] == '\t' || value[pos] == ',')) {
+      pos++;
+    }
+
+    size_t start = pos;
+
+    while (pos < len && value[pos] != ',') {
+      pos++;
+    }
+
+    size_t end = pos;
+
+    while (end > start && (value[end - 1] == ' ' || value[end - 1] == '\t')) {
+      end--;
+    }
+
+    if (end - start == token_len && strncasecmp(value + start, token, token_len) == 0) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/**
+ * Module internal method to work out the size of a frame header from its first two
+ * bytes, failing the connection if the frame can't be accepted.
+ *
+ * websocket - the websocket_t for the client
+ * client - the client sending the frame
+ *
+ * Returns 0 on success or -1 if the connection was failed
+**/
+static int read_header_size(websocket_t* websocket, client_t* client) {
+  unsigned char first = websocket->header[0];
+  unsigned char second = websocket->header[1];
+
+  if (first & 0x70) {
+    LOG(INFO, "Client fd [%d] sent a WebSocket frame with reserved bits set", client->fd);
+    fail(websocket, client, WEBSOCKET_CLOSE_PROTOCOL_ERROR);
+
+    return -1;
+  }
+
+  if (!(second & 0x80)) {
+    LOG(INFO, "Client fd [%d] sent an unmasked WebSocket frame", client->fd);
+    fail(websocket, client, WEBSOCKET_CLOSE_PROTOCOL_ERROR);
+
+    return -1;
+  }
+
+  websocket->header_need = 6;
+
+  if ((second & 0x7F) == 126) {
+    websocket->header_need += 2;
+  } else if ((second & 0x7F) == 127) {
+    websocket->header_need += 8;
+  }
+
+  return 0;
+}
+
+/**
+ * Module internal method to start reading the payload of a frame once its header has
+ * been read, failing the connection if the frame can't be accepted.
+ *
+ * websocket - the websocket_t for the client
+ * client - the client sending the frame
+ *
+ * Returns 0 on success or -1 if the connection was failed
+**/
+static int start_frame(websocket_t* websocket, client_t* client) {
+  const unsigned char* header = websocket->header;
+  size_t mask = websocket->header_need - 4;
+  uint64_t len = header[1] & 0x7F;
+
+  if (len == 126) {
+    len = ((uint64_t)header[2] << 8) | header[3];
+  } else if (len == 127) {
+    len = 0;
+
+    for (size_t i = 2; i < 10; i++) {
+      len = (len << 8) | header[i];
+    }
+  }
+
+  websocket->opcode = header[0] & 0x0F;
+  websocket->fin = (header[0] & 0x80) != 0;
+  websocket->remaining = len;
+  websocket->mask_pos = 0;
+  memcpy(websocket->mask, header + mask, sizeof(websocket->mask));
+
+  websocket->header_len = 0;
+  websocket->header_need = 2;
+
+  if (websocket->opcode >= WEBSOCKET_CLOSE) {
+    if (websocket->opcode > WEBSOCKET_PONG || !websocket->fin || len > WEBSOCKET_CONTROL_SIZE) {
+      LOG(INFO, "Client fd [%d] sent an invalid WebSocket control frame", client->fd);
+      fail(websocket, client, WEBSOCKET_CLOSE_PROTOCOL_ERROR);
+
+      return -1;
+    }
+
+    websocket->control_len = 0;
+
+    return 0;
+  }
+
+  if (websocket->opcode > WEBSOCKET_BINARY || (websocket->opcode == WEBSOCKET_CONTINUATION) != (websocket->message_opcode != 0)) {
+    LOG(INFO, "Client fd [%d] sent an unexpected WebSocket data frame", client->fd);
+    fail(websocket, client, WEBSOCKET_CLOSE_PROTOCOL_ERROR);
+
+    return -1;
+  }
+
+  if (websocket->opcode != WEBSOCKET_CONTINUATION) {
+    websocket->message_opcode = websocket->opcode;
+    websocket->message_len = 0;
+    websocket->tail[0] = '\0';
+    websocket->tail[1] = '\0';
+  }
+
+  if (len > WEBSOCKET_MAX_PAYLOAD || (receiving_gmcp(websocket) && websocket->message_len + len > WEBSOCKET_MESSAGE_SIZE)) {
+    LOG(INFO, "Client fd [%d] sent a WebSocket frame of [%llu] bytes which is too big", client->fd, (unsigned long long)len);
+    fail(websocket, client, WEBSOCKET_CLOSE_TOO_BIG);
+
+    return -1;
+  }
+
+  if (receiving_gmcp(websocket) && websocket->message == NULL && (websocket->message = malloc(WEBSOCKET_MESSAGE_SIZE)) == NULL) {
+    LOG(ERROR, "Failed to allocate WebSocket message buffer for client fd [%d]", client->fd);
+    fail(websocket, client, WEBSOCKET_CLOSE_TOO_BIG);
+
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * Module internal method to finish a frame once its payload has been read.  Control
+ * frames are processed, complete GMCP messages are passed to telnet as subnegotiations
+ * and other complete messages are given a CRLF line ending if they don't end with one,
+ * moving the unread input along to make room if needed.  A bare LF ending is replaced
+ * if it was decoded in this read, otherwise it has already been passed on and a CRLF
+ * is added after it.
+ *
+ * websocket - the websocket_t for the client
+ * client - the client which sent the frame
+ * input - the input being decoded
+ * len - a pointer to the length of the input, updated if the input is moved
+ * size - the space available at input
+ * written - the length of the decoded input
+ * read - a pointer to the position of the unread input, updated if the input is moved
+ *
+ * Returns the length of the decoded input
+**/
+static size_t end_frame(websocket_t* websocket, client_t* client, char* input, size_t* len, size_t size, size_t written, size_t* read) {
+  if (websocket->opcode >= WEBSOCKET_CLOSE) {
+    process_control(websocket, client);
+
+    return written;
+  }
+
+  if (!websocket->fin) {
+    return written;
+  }
+
+  if (receiving_gmcp(websocket)) {
+    telnet_t* telnet = network_client_get_telnet(client);
+
+    if (telnet != NULL && websocket->message_len > 0) {
+      network_telnet_subnegotiate(telnet, client, TELOPT_GMCP, websocket->message, websocket->message_len);
+    }
+
+    websocket->message_opcode = 0;
+    websocket->message_len = 0;
+
+    return written;
+  }
+
+  websocket->message_opcode = 0;
+
+  if (websocket->tail[1] == '\n') {
+    if (websocket->tail[0] == '\r') {
+      return written;
+    }
+
+    if (written > 0 && input[written - 1] == '\n') {
+      written--;
+    }
+  }
+
+  size_t shift = written + 2 > *read ? written + 2 - *read : 0;
+
+  if (shift > 0) {
+    if (*len + shift > size) {
+      LOG(WARN, "No room to end WebSocket message from client fd [%d] with a new line", client->fd);
+
+      return written;
+    }
+
+    memmove(input + *read + shift, input + *read, *len - *read);
+    *read += shift;
+    *len += shift;
+  }
+
+  input[written++] = '\r';
+  input[written++] = '\n';
+
+  return written;
+}
+
+/**
+ * Module internal method to respond to a control frame from the client.
+ *
+ * websocket - the websocket_t for the client
+ * client - the client which sent the frame
+**/
+static void process_control(websocket_t* websocket, client_t* client) {
+  if (websocket->opcode == WEBSOCKET_PING) {
+    memcpy(websocket->pong, websocket->control, websocket->control_len);
+    websocket->pong_len = websocket->control_len;
+    websocket->pong_pending = true;
+
+    network_client_defer_output(client);
+
+    return;
+  }
+
+  if (websocket->opcode == WEBSOCKET_CLOSE) {
+    uint16_t code = WEBSOCKET_CLOSE_NORMAL;
+
+    if (websocket->control_len >= 2) {
+      code = (uint16_t)(((unsigned char)websocket->control[0] << 8) | (unsigned char)websocket->control[1]);
+    }
+
+    LOG(INFO, "Client fd [%d] closed its WebSocket with code [%u]", client->fd, code);
+    fail(websocket, client, code);
+  }
+}
+
+/**
+ * Module internal method to close the connection, sending a close frame with the
+ * code given and disconnecting the client once it's written.
+ *
+ * websocket - the websocket_t for the client
+ * client - the client to disconnect
+ * code - the close code
+**/
+static void fail(websocket_t* websocket, client_t* client, uint16_t code) {
+  websocket->state = WEBSOCKET_CLOSED;
+  websocket->close_code = code;
+  websocket->close_pending = true;
+
+  network_client_hang_up(client);
+}
+
+/**
+ * Module internal method to unmask payload from the client.  The destination may be
+ * the same as or before the source.
+ *
+ * websocket - the websocket_t holding the mask and position within it
+ * dest - where the unmasked payload is written
+ * src - the masked payload
+ * len - the length of the payload
+**/
+static void unmask(websocket_t* websocket, char* dest, const char* src, size_t len) {
+  const unsigned char* mask = websocket->mask;
+  size_t pos = websocket->mask_pos;
+
+  for (size_t i = 0; i < len; i++) {
+    dest[i] = (char)(src[i] ^ mask[(pos + i) & 3]);
+  }
+
+  websocket->mask_pos = (pos + len) & 3;
+}
+
+/**
+ * Module internal method to check whether the message being received is GMCP.
+ *
+ * websocket - the websocket_t for the client
+ *
+ * Returns true if the client asked for GMCP and the message is text
+**/
+static bool receiving_gmcp(websocket_t* websocket) {
+  return websocket->gmcp && websocket->message_opcode == WEBSOCKET_TEXT;
+}
+
+/**
+ * Module internal method to translate telnet output into frames, answering any
+ * negotiation and translating whatever output the answers produce.  Segments of game
+ * output with no telnet commands in them are moved into the frame whole rather than
+ * being copied.
+ *
+ * websocket - the websocket_t for the client
+ * client - the client whose output is being translated
+ * output - the telnet output, emptied as it's translated
+ * framed - the output buffer frames are written to
+ *
+ * Returns 0 on success or -1 on failure
+**/
+static int translate_output(websocket_t* websocket, client_t* client, output_buffer_t* output, output_buffer_t* framed) {
+  websocket_opcode_t game = websocket->gmcp ? WEBSOCKET_BINARY : WEBSOCKET_TEXT;
+
+  for (int pass = 0; pass < WEBSOCKET_OUTPUT_PASSES; pass++) {
+    while (output->head != NULL) {
+      output_segment_t* segment = output->head;
+      size_t len = segment->len;
+
+      if (websocket->output_state == WEBSOCKET_OUTPUT_DATA && memchr(segment->data, IAC, len) == NULL) {
+        if (splice_frame(websocket, framed, game, output, len) == -1) {
+          return -1;
+        }
+
+        continue;
+      }
+
+      if (translate_segment(websocket, segment->data, len, framed) == -1) {
+        return -1;
+      }
+
+      network_output_buffer_consume(output, len);
+    }
+
+    if (websocket->output_state < WEBSOCKET_OUTPUT_SB && emit_frame(websocket, framed) == -1) {
+      return -1;
+    }
+
+    if (websocket->reply_count == 0) {
+      break;
+    }
+
+    answer_negotiation(websocket, client);
+
+    if (output->length == 0) {
+      break;
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * Module internal method to translate a run of telnet output.  Plain data is added to
+ * the frame being built in runs between IAC bytes.
+ *
+ * websocket - the websocket_t for the client
+ * data - the telnet output
+ * len - the length of the output
+ * framed - the output buffer completed frames are written to
+ *
+ * Returns 0 on success or -1 on failure
+**/
+static int translate_segment(websocket_t* websocket, const char* data, size_t len, output_buffer_t* framed) {
+  websocket_opcode_t game = websocket->gmcp ? WEBSOCKET_BINARY : WEBSOCKET_TEXT;
+  size_t idx = 0;
+
+  while (idx < len) {
+    websocket_output_state_t state = websocket->output_state;
+
+    if (state == WEBSOCKET_OUTPUT_DATA || state == WEBSOCKET_OUTPUT_SB_DATA) {
+      const char* iac = memchr(data + idx, IAC, len - idx);
+      size_t run = iac != NULL ? (size_t)(iac - (data + idx)) : len - idx;
+
+      if (run > 0 && (state == WEBSOCKET_OUTPUT_DATA || websocket->capture)) {
+        if (append_frame(websocket, framed, state == WEBSOCKET_OUTPUT_DATA ? game : WEBSOCKET_TEXT, data + idx, run) == -1) {
+          return -1;
+        }
+      }
+
+      idx += run;
+
+      if (iac != NULL) {
+        websocket->output_state = state == WEBSOCKET_OUTPUT_DATA ? WEBSOCKET_OUTPUT_IAC : WEBSOCKET_OUTPUT_SB_IAC;
+        idx++;
+      }
+
+      continue;
+    }
+
+    unsigned char chr = (unsigned char)data[idx++];
+    const char escaped = (char)IAC;
+
+    switch (state) {
+      case WEBSOCKET_OUTPUT_IAC:
+        websocket->output_state = WEBSOCKET_OUTPUT_DATA;
+
+        if (chr == IAC && append_frame(websocket, framed, game, &escaped, 1) == -1) {
+          return -1;
+        }
+
+        if (chr >= WILL && chr <= DONT) {
+          websocket->output_op = chr;
+          websocket->output_state = WEBSOCKET_OUTPUT_OPTION;
+        } else if (chr == SB) {
+          websocket->output_state = WEBSOCKET_OUTPUT_SB;
+        }
+
+        break;
+
+      case WEBSOCKET_OUTPUT_OPTION:
+        queue_reply(websocket, websocket->output_op, chr);
+        websocket->output_state = WEBSOCKET_OUTPUT_DATA;
+
+        break;
+
+      case WEBSOCKET_OUTPUT_SB:
+        websocket->capture = websocket->gmcp && chr == TELOPT_GMCP;
+        websocket->output_state = WEBSOCKET_OUTPUT_SB_DATA;
+
+        if (websocket->capture && emit_frame(websocket, framed) == -1) {
+          return -1;
+        }
+
+        break;
+
+      case WEBSOCKET_OUTPUT_SB_IAC:
+        websocket->output_state = chr == IAC ? WEBSOCKET_OUTPUT_SB_DATA : WEBSOCKET_OUTPUT_DATA;
+
+        if (chr == IAC && websocket->capture && append_frame(websocket, framed, WEBSOCKET_TEXT, &escaped, 1) == -1) {
+          return -1;
+        }
+
+        if (chr == SE && websocket->capture && emit_frame(websocket, framed) == -1) {
+          return -1;
+        }
+
+        if (chr != IAC && chr != SE) {
+          network_clear_output_buffer(&websocket->frame);
+        }
+
+        if (chr != IAC) {
+          websocket->capture = false;
+        }
+
+        break;
+
+      default:
+        break;
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * Module internal method to queue the client's answer to a negotiation in the output.
+ * Only GMCP is accepted, and only when the client asked for it.
+ *
+ * websocket - the websocket_t for the client
+ * op - the negotiation sent to the client
+ * option - the option negotiated
+**/
+static void queue_reply(websocket_t* websocket, unsigned char op, unsigned char option) {
+  unsigned char reply = WONT;
+
+  if (op == WILL) {
+    reply = websocket->gmcp && option == TELOPT_GMCP ? DO : DONT;
+  } else if (op == WONT) {
+    reply = DONT;
+  }
+
+  if (websocket->reply_count == WEBSOCKET_REPLIES) {
+    LOG(WARN, "Dropping WebSocket answer to telnet negotiation of option [%u]", option);
+
+    return;
+  }
+
+  websocket->replies[websocket->reply_count].op = reply;
+  websocket->replies[websocket->reply_count].option = option;
+  websocket->reply_count++;
+}
+
+/**
+ * Module internal method to pass queued answers to negotiation to telnet as if the
+ * client had sent them.
+ *
+ * websocket - the websocket_t for the client
+ * client - the client being answered for
+**/
+static void answer_negotiation(websocket_t* websocket, client_t* client) {
+  websocket_reply_t replies[WEBSOCKET_REPLIES];
+  size_t count = websocket->reply_count;
+  telnet_t* telnet = network_client_get_telnet(client);
+
+  memcpy(replies, websocket->replies, sizeof(websocket_reply_t) * count);
+  websocket->reply_count = 0;
+
+  for (size_t i = 0; i < count && telnet != NULL; i++) {
+    network_telnet_negotiate(telnet, client, replies[i].op, replies[i].option);
+  }
+}
+
+/**
+ * Module internal method to add data to the frame being built, completing the frame
+ * first if it has a different opcode.
+ *
+ * websocket - the websocket_t for the client
+ * framed - the output buffer completed frames are written to
+ * opcode - the opcode of the frame the data belongs in
+ * data - the data to add
+ * len - the length of the data
+ *
+ * Returns 0 on success or -1 on failure
+**/
+static int append_frame(websocket_t* websocket, output_buffer_t* framed, websocket_opcode_t opcode, const char* data, size_t len) {
+  if (websocket->frame.length > 0 && websocket->frame_opcode != opcode && emit_frame(websocket, framed) == -1) {
+    return -1;
+  }
+
+  websocket->frame_opcode = opcode;
+
+  return network_output_buffer_append(&websocket->frame, data, len);
+}
+
+/**
+ * Module internal method to move the start of the telnet output into the frame being
+ * built, completing the frame first if it has a different opcode.
+ *
+ * websocket - the websocket_t for the client
+ * framed - the output buffer completed frames are written to
+ * opcode - the opcode of the frame the data belongs in
+ * output - the telnet output to move the data from
+ * len - the length of the data
+ *
+ * Returns 0 on success or -1 on failure
+**/
+static int splice_frame(websocket_t* websocket, output_buffer_t* framed, websocket_opcode_t opcode, output_buffer_t* output, size_t len) {
+  if (websocket->frame.length > 0 && websocket->frame_opcode != opcode && emit_frame(websocket, framed) == -1) {
+    return -1;
+  }
+
+  websocket->frame_opcode = opcode;
+
+  return network_output_buffer_splice(&websocket->frame, output, len);
+}
+
+/**
+ * Module internal method to write the frame being built, if it has any payload.  The
+ * payload's segments are moved after the header rather than being copied.
+ *
+ * websocket - the websocket_t for the client
+ * framed - the output buffer the frame is written to
+ *
+ * Returns 0 on success or -1 on failure
+**/
+static int emit_frame(websocket_t* websocket, output_buffer_t* framed) {
+  if (websocket->frame.length == 0) {
+    return 0;
+  }
+
+  int res = write_header(framed, websocket->frame_opcode, websocket->frame.length);
+
+  if (res == 0) {
+    res = network_output_buffer_splice(framed, &websocket->frame, websocket->frame.length);
+  }
+
+  network_clear_output_buffer(&websocket->frame);
+
+  return res;
+}
+
+/**
+ * Module internal method to write a complete frame.
+ *
+ * framed - the output buffer the frame is written to
+ * opcode - the opcode of the frame
+ * data - the payload
+ * len - the length of the payload
+ *
+ * Returns 0 on success or -1 on failure
+**/
+static int write_frame(output_buffer_t* framed, websocket_opcode_t opcode, const char* data, size_t len) {
+  if (write_header(framed, opcode, len) == -1) {
+    return -1;
+  }
+
+  return len > 0 ? network_output_buffer_append(framed, data, len) : 0;
+}
+
+/**
+ * Module internal method to write an unmasked frame header with the FIN bit set.
+ *
+ * framed - the output buffer the header is written to
+ * opcode - the opcode of the frame
+ * len - the length of the payload which follows
+ *
+ * Returns 0 on success or -1 on failure
+**/
+static int write_header(output_buffer_t* framed, websocket_opcode_t opcode, uint64_t len) {
+  char header[10];
+  size_t header_len = 0;
+
+  header[header_len++] = (char)(0x80 | opcode);
+
+  if (len < 126) {
+    header[header_len++] = (char)len;
+  } else if (len <= 0xFFFF) {
+    header[header_len++] = 126;
+    header[header_len++] = (char)(len >> 8);
+    header[header_len++] = (char)(len & 0xFF);
+  } else {
+    header[header_len++] = 127;
+
+    for (int shift = 56; shift >= 0; shift -= 8) {
+      header[header_len++] = (char)((len >> shift) & 0xFF);
+    }
+  }
+
+  return network_output_buffer_append(framed, header, header_len);
+}
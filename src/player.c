@@ -1,15 +1,24 @@
 #include "mud/command.h"
+#include "mud/config.h"
 #include "mud/data/hash_table.h"
 #include "mud/data/linked_list.h"
+#include "mud/data/queue.h"
 #include "mud/db.h"
 #include "mud/event.h"
 #include "mud/game.h"
 #include "mud/log.h"
 #include "mud/lua/hooks.h"
 #include "mud/lua/script.h"
+#include "mud/network/charset.h"
 #include "mud/network/client.h"
 #include "mud/network/gmcp.h"
+#include "mud/network/mccp.h"
+#include "mud/network/mssp.h"
+#include "mud/network/naws.h"
+#include "mud/network/network.h"
+#include "mud/network/protocol.h"
 #include "mud/network/telnet.h"
+#include "mud/network/ttype.h"
 #include "mud/player.h"
 #include "mud/util/mudhash.h"
 #include "mud/util/mudstring.h"
@@ -23,6 +32,9 @@
 #include <string.h>
 
 static void write_to_player(player_t* player, char* output);
+static void execute_input(player_t* player, game_t* game, const char* command);
+static bool take_command_token(player_t* player, game_t* game);
+static void register_extension(client_t* client, protocol_t* telnet, telnet_extension_t* extension);
 
 /**
  * Allocates and initialises a new player_t struct.
@@ -35,8 +47,14 @@ player_t* create_player_t() {
   player->uuid = new_uuid();
   player->username = NULL;
   player->state = NULL;
-  player->client = NULL;
+  player->network = NULL;
+  player->client = 0;
   player->command_groups = create_linked_list_t();
+  player->command_queue = create_linked_list_t();
+  player->queued_commands = 0;
+  player->command_tokens = 0;
+  player->command_tokens_tick = 0;
+  player->backlogged = false;
 
   return player;
 }
@@ -50,6 +68,14 @@ void free_player_t(player_t* player) {
   free(player->username);
   free_linked_list_t(player->command_groups);
 
+  char* command = NULL;
+
+  while ((command = queue_dequeue(player->command_queue)) != NULL) {
+    free(command);
+  }
+
+  free_linked_list_t(player->command_queue);
+
   free(player);
 }
 
@@ -71,13 +97,32 @@ void deallocate_player(void* value) {
 void player_connected(client_t* client, void* context) {
   game_t* game = (game_t*)context;
 
-  protocol_t* telnet = network_new_telnet_protocol_t();
-  network_register_telnet_extension(telnet->data, network_new_gmcp_telnet_extension(game, player_gmcp));
+  protocol_pools_t* pools = &game->network->protocol_pools;
+  protocol_t* telnet = network_new_telnet_protocol_t(pools);
+
+  if (telnet != NULL) {
+    register_extension(client, telnet, network_new_gmcp_telnet_extension(pools, game, player_gmcp));
+    register_extension(client, telnet, network_new_naws_telnet_extension(pools));
+    register_extension(client, telnet, network_new_ttype_telnet_extension(pools));
+    register_extension(client, telnet, network_new_charset_telnet_extension(pools));
+    register_extension(client, telnet, network_new_mssp_telnet_extension(pools, game, player_mssp));
 
-  network_add_client_protocol(client, telnet);
+    if (game->config->mccp) {
+      register_extension(client, telnet, network_new_mccp_telnet_extension(pools, (int)game->config->mccp_compression_level, game->config->mccp_low_memory));
+    }
+
+    network_add_client_protocol(client, telnet);
+  } else {
+    LOG(ERROR, "Failed to allocate telnet for client fd [%d], hanging up", client->fd);
+
+    network_client_hang_up(client);
+  }
 
   player_t* player = create_player_t();
-  player->client = client;
+  player->network = game->network;
+  player->client = client->id;
+  player->command_tokens = game->config->command_burst;
+  player->command_tokens_tick = game->tick;
   client->userdata = player;
 
   hash_table_insert(game->players, uuid_str(&player->uuid), player);
@@ -92,11 +137,18 @@ void player_disconnected(client_t* client, void* context) {
   player_t* player = client->userdata;
 
   lua_call_player_disconnected_hook(game->lua_state, player);
+
+  if (player->backlogged) {
+    list_remove(game->backlog, player);
+  }
+
   hash_table_delete(game->players, uuid_str(&player->uuid));
 }
 
 /**
- * Callback from the network module when a client receives input.
+ * Callback from the network module when a client receives input.  Commands are
+ * executed straight away while the player has command tokens and nothing already
+ * queued, otherwise they are queued to be drained fairly across players each tick.
  **/
 void player_input(client_t* client, void* context) {
   game_t* game = (game_t*)context;
@@ -105,13 +157,104 @@ void player_input(client_t* client, void* context) {
   char command[COMMAND_SIZE];
 
   while (extract_from_input(client, command, sizeof(command), "\r\n") != -1) {
-    if (strnlen(command, sizeof(command) - 1) > 0) {
-      lua_call_player_input_hook(game->lua_state, player, command);
-      lua_call_state_input_hook(game->lua_state, player, player->state, command);
+    if (strnlen(command, sizeof(command) - 1) == 0) {
+      continue;
+    }
+
+    if (!player->backlogged && take_command_token(player, game)) {
+      execute_input(player, game, command);
+
+      continue;
+    }
+
+    if (player->queued_commands >= COMMAND_QUEUE_LIMIT) {
+      LOG(WARN, "Discarding command from player [%s] as their command queue is full", uuid_str(&player->uuid));
+
+      continue;
+    }
+
+    queue_enqueue(player->command_queue, strdup(command));
+    player->queued_commands++;
+
+    if (!player->backlogged) {
+      player->backlogged = true;
+      list_add(game->backlog, player);
+    }
+  }
+}
+
+/**
+ * Drains queued commands from players with a backlog.  Players take turns executing
+ * a single command each, round-robin, until every player has either run out of
+ * command tokens for this tick or emptied their queue, so one player's backlog
+ * can't hold up everyone else.
+ *
+ * game - the game_t whose backlog is being drained
+ **/
+void player_drain_commands(game_t* game) {
+  assert(game);
+
+  bool executed = true;
+
+  while (executed) {
+    executed = false;
+
+    it_t iter = list_begin(game->backlog);
+    player_t* player = NULL;
+
+    while ((player = it_get(iter)) != NULL) {
+      if (take_command_token(player, game)) {
+        char* command = queue_dequeue(player->command_queue);
+        player->queued_commands--;
+
+        execute_input(player, game, command);
+        free(command);
+
+        executed = true;
+      }
+
+      if (player->queued_commands == 0) {
+        player->backlogged = false;
+        iter = list_remove(game->backlog, player);
+
+        continue;
+      }
+
+      iter = it_next(iter);
     }
   }
 }
 
+/**
+ * Passes a command to the player input hook and the input hook of the player's state.
+ **/
+static void execute_input(player_t* player, game_t* game, const char* command) {
+  lua_call_player_input_hook(game->lua_state, player, command);
+  lua_call_state_input_hook(game->lua_state, player, player->state, command);
+}
+
+/**
+ * Takes a command token from the player's token bucket.  The bucket is refilled at
+ * commands_per_tick for each tick since it was last refilled, up to command_burst.
+ *
+ * Returns true if a token was available
+ **/
+static bool take_command_token(player_t* player, game_t* game) {
+  uint64_t ticks = game->tick - player->command_tokens_tick;
+  uint64_t tokens = player->command_tokens + (ticks * game->config->commands_per_tick);
+
+  player->command_tokens = tokens > game->config->command_burst ? game->config->command_burst : (unsigned int)tokens;
+  player->command_tokens_tick = game->tick;
+
+  if (player->command_tokens == 0) {
+    return false;
+  }
+
+  player->command_tokens--;
+
+  return true;
+}
+
 /**
  * Callback from the network module to indicate this client is about to be flushed.
  **/
@@ -119,7 +262,7 @@ void player_output(client_t* client, void* context) {
   game_t* game = (game_t*)context;
   player_t* player = client->userdata;
 
-  if (lua_call_state_output_hook(game->lua_state, player, player->state, client->output) == -1) {
+  if (lua_call_state_output_hook(game->lua_state, player, player->state, &client->output) == -1) {
     LOG(ERROR, "Error calling state output hook");
   };
 }
@@ -145,6 +288,54 @@ void player_gmcp(client_t* client, void* context, const char* topic, const char*
   }
 }
 
+/**
+ * Callback when the MSSP extension has been asked for information about the game.  The
+ * variables from the mssp configuration table are sent along with the number of
+ * players and when the game started.
+ *
+ * client - the client asking for MSSP
+ * context - void pointer to a game_t instance
+**/
+void player_mssp(client_t* client, void* context) {
+  assert(client);
+  assert(context);
+
+  game_t* game = context;
+  linked_list_t* variables = game->config->mssp_variables;
+  size_t count = (size_t)list_size(variables) + 2;
+
+  const char** names = calloc(count, sizeof(char*));
+  const char** values = calloc(count, sizeof(char*));
+  size_t i = 0;
+
+  it_t iter = list_begin(variables);
+  mssp_variable_config_t* variable = NULL;
+
+  while ((variable = (mssp_variable_config_t*)it_get(iter)) != NULL) {
+    names[i] = variable->name;
+    values[i] = variable->value;
+    i++;
+
+    iter = it_next(iter);
+  }
+
+  char players[32];
+  char uptime[32];
+
+  snprintf(players, sizeof(players), "%d", hash_table_size(game->players));
+  snprintf(uptime, sizeof(uptime), "%lld", (long long)game->started);
+
+  names[i] = "PLAYERS";
+  values[i++] = players;
+  names[i] = "UPTIME";
+  values[i++] = uptime;
+
+  network_send_mssp(client, names, values, i);
+
+  free(names);
+  free(values);
+}
+
 /**
  * Function which attempts to find a state from persistence and assign iter to the player.
  *
@@ -215,6 +406,12 @@ int player_authenticate(player_t* player, game_t* game, const char* username, co
     return -1;
   }
 
+  client_t* client = player_get_client(player);
+
+  if (client != NULL) {
+    network_client_authenticated(client);
+  }
+
   return 0;
 }
 
@@ -255,10 +452,11 @@ int player_narrate(player_t* player, game_t* game, event_t* event) {
  * Returns 0 on success
 **/
 int player_request_disable_echo(player_t* player) {
-  if (network_client_has_protocol(player->client, TELNET)) {
-    telnet_t* telnet = network_client_get_protocol(player->client, TELNET);
+  client_t* client = player_get_client(player);
+  telnet_t* telnet = client != NULL ? network_client_get_telnet(client) : NULL;
 
-    network_telnet_send_will(telnet, player->client, TELOPT_ECHO);
+  if (telnet != NULL) {
+    network_telnet_send_will(telnet, client, TELOPT_ECHO);
   }
 
   return 0;
@@ -274,15 +472,72 @@ int player_request_disable_echo(player_t* player) {
  * Returns 0 on success
 **/
 int player_request_enable_echo(player_t* player) {
-  if (network_client_has_protocol(player->client, TELNET)) {
-    telnet_t* telnet = network_client_get_protocol(player->client, TELNET);
+  client_t* client = player_get_client(player);
+  telnet_t* telnet = client != NULL ? network_client_get_telnet(client) : NULL;
+
+  if (telnet != NULL) {
+    network_telnet_send_wont(telnet, client, TELOPT_ECHO);
+  }
+
+  return 0;
+}
+
+/**
+ * Switches protocol tracing on or off for the player's connection, logging the telnet
+ * commands sent to and received from their client.
+ *
+ * player - the player whose connection should be traced
+ * trace - whether tracing should be enabled
+ *
+ * Returns 0 on success or -1 if the player has disconnected
+**/
+int player_set_protocol_trace(player_t* player, bool trace) {
+  assert(player);
+
+  client_t* client = player_get_client(player);
 
-    network_telnet_send_wont(telnet, player->client, TELOPT_ECHO);
+  if (client == NULL) {
+    return -1;
   }
 
+  network_client_set_trace(client, trace);
+
   return 0;
 }
 
+/**
+ * Resolves the player's client from its ID, so a player who outlives their connection
+ * never reaches a client which has since been freed or handed to someone else.
+ *
+ * player - the player whose client is wanted
+ *
+ * Returns the player's client or NULL if they have disconnected
+**/
+client_t* player_get_client(player_t* player) {
+  assert(player);
+
+  if (player->network == NULL || player->client == 0) {
+    return NULL;
+  }
+
+  return network_get_client(player->network, player->client);
+}
+
+/**
+ * Retrieves what the player's client has negotiated and reported about itself.
+ *
+ * player - the player whose client capabilities are wanted
+ *
+ * Returns the capability profile of the player's client or NULL if they have disconnected
+**/
+const client_capabilities_t* player_get_capabilities(player_t* player) {
+  assert(player);
+
+  client_t* client = player_get_client(player);
+
+  return client != NULL ? &client->capabilities : NULL;
+}
+
 /**
  * Adds a command group to the players command repository.
  *
@@ -434,14 +689,42 @@ void send_gmcp_to_player(player_t* player, char* topic, char* msg) {
   assert(player);
   assert(topic);
 
-  if (!network_client_has_protocol(player->client, TELNET)) {
+  client_t* client = player_get_client(player);
+
+  if (client == NULL || !network_client_has_protocol(client, TELNET)) {
     return;
   }
 
   size_t topic_len = strnlen(topic, TOPIC_LEN);
   size_t msg_len = msg != NULL ? strnlen(msg, MSG_LEN) : 0;
 
-  network_send_gmcp_message(player->client, topic, topic_len, msg, msg_len);
+  network_send_gmcp_message(client, topic, topic_len, msg, msg_len);
+}
+
+/**
+ * Sends a GMCP message to a player when their output is next flushed, replacing any
+ * message with the same topic not yet sent.  Suits topics sent more often than the
+ * client needs, such as Char.Vitals.  If the player client does not have the telnet
+ * protocol with the GMCP extension this is a no-op.
+ *
+ * player - player to send the gmcp message to
+ * topic - null terminated string containing the topic of the gmcp message
+ * msg - null terminated string containing the msg of the gmcp message, may be NULL
+**/
+void send_coalesced_gmcp_to_player(player_t* player, char* topic, char* msg) {
+  assert(player);
+  assert(topic);
+
+  client_t* client = player_get_client(player);
+
+  if (client == NULL || !network_client_has_protocol(client, TELNET)) {
+    return;
+  }
+
+  size_t topic_len = strnlen(topic, TOPIC_LEN);
+  size_t msg_len = msg != NULL ? strnlen(msg, MSG_LEN) : 0;
+
+  network_send_coalesced_gmcp_message(client, topic, topic_len, msg, msg_len);
 }
 
 void send_to_players(linked_list_t* players, const char* fmt, ...) {
@@ -512,8 +795,10 @@ static void write_to_player(player_t* player, char* output) {
   assert(player);
   assert(output);
 
-  if (player->client == NULL) {
-    LOG(WARN, "Could not write to player [%s] as client has disconnected", player->uuid);
+  client_t* client = player_get_client(player);
+
+  if (client == NULL) {
+    LOG(WARN, "Could not write to player [%s] as client has disconnected", uuid_str(&player->uuid));
 
     return;
   }
@@ -527,9 +812,27 @@ static void write_to_player(player_t* player, char* output) {
 
   size_t len = strnlen(chosen_output, SEND_SIZE);
 
-  if (send_to_client(player->client, chosen_output, len) != 0) {
+  if (send_to_client(client, chosen_output, len) != 0) {
     LOG(WARN, "Send to player failed, unable to write to client [%s]", uuid_str(&player->uuid));
 
     return;
   }
 }
+
+/**
+ * Registers a telnet extension with a player's telnet protocol.  An extension which
+ * couldn't be allocated is left out, the client simply doesn't get that option.
+ *
+ * client - the client_t the protocol belongs to
+ * telnet - the telnet protocol_t to register the extension with
+ * extension - the extension, or NULL if it couldn't be allocated
+ **/
+static void register_extension(client_t* client, protocol_t* telnet, telnet_extension_t* extension) {
+  if (extension == NULL) {
+    LOG(WARN, "Failed to allocate telnet extension for client fd [%d]", client->fd);
+
+    return;
+  }
+
+  network_register_telnet_extension(telnet->data, extension);
+}
@@ -0,0 +1,553 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "mud/clock.h"
+#include "mud/config.h"
+#include "mud/data/hash_table.h"
+#include "mud/data/linked_list.h"
+#include "mud/game.h"
+#include "mud/log.h"
+#include "mud/network/client.h"
+#include "mud/network/network.h"
+#include "mud/sim.h"
+
+#define NANOSECONDS_PER_MICROSECOND 1000ULL
+#define NANOSECONDS_PER_MILLISECOND 1000000ULL
+
+static void run_due_steps(sim_t* sim);
+static void run_step(sim_t* sim, sim_step_t* step);
+static void connect_client(sim_t* sim, const char* name);
+static void send_input(sim_t* sim, sim_client_t* client, const char* text);
+static void write_pending_input(sim_t* sim, sim_client_t* client);
+static void send_pending_input(sim_t* sim);
+static void disconnect_client(sim_client_t* client);
+static void drain_clients(sim_t* sim);
+static uint64_t elapsed(sim_t* sim);
+static void write_timing(FILE* file, const char* name, const tick_timing_t* timing);
+static void free_sim_step_t(void* value);
+static void free_sim_client_t(void* value);
+
+/**
+ * Allocates a new sim_t to simulate virtual clients playing a game.
+ *
+ * game - the game to simulate
+ *
+ * Returns the newly allocated sim_t
+ **/
+sim_t* sim_new_sim_t(game_t* game) {
+  assert(game);
+
+  sim_t* sim = calloc(1, sizeof(sim_t));
+
+  sim->game = game;
+
+  sim->steps = create_linked_list_t();
+  sim->steps->deallocator = free_sim_step_t;
+
+  sim->clients = create_hash_table_t();
+  sim->clients->deallocator = free_sim_client_t;
+
+  return sim;
+}
+
+/**
+ * Frees an allocated sim_t, hanging up any virtual clients still connected.
+ **/
+void sim_free_sim_t(sim_t* sim) {
+  assert(sim);
+
+  free_linked_list_t(sim->steps);
+  free_hash_table_t(sim->clients);
+
+  free(sim);
+}
+
+/**
+ * Loads a script of virtual client traffic.  Each line of the script is a step, made up
+ * of the milliseconds of virtual time into the simulation it runs at and an action,
+ * with steps in the order they run.  Blank lines and lines starting with # are ignored.
+ *
+ *   0 alice connect
+ *   250 alice send look
+ *   60000 alice disconnect
+ *   3600000 end
+ *
+ * The simulation ends at the time of the end step, or of the last step if there's none.
+ * Nothing may follow the end step.
+ *
+ * sim - the sim_t to load the steps into
+ * filename - the script to load
+ *
+ * Returns 0 on success or -1 on failure
+ **/
+int sim_load_script(sim_t* sim, const char* filename) {
+  assert(sim);
+  assert(filename);
+
+  FILE* file = fopen(filename, "r");
+
+  if (file == NULL) {
+    LOG(ERROR, "Unable to open simulation script [%s]: %s", filename, strerror(errno));
+
+    return -1;
+  }
+
+  char line[SIM_MAX_LINE_LENGTH];
+  unsigned int number = 0;
+  uint64_t last = 0;
+  bool ended = false;
+
+  while (fgets(line, sizeof(line), file) != NULL) {
+    number++;
+
+    line[strcspn(line, "\r\n")] = '\0';
+
+    char* start = line + strspn(line, " \t");
+
+    if (*start == '\0' || *start == '#') {
+      continue;
+    }
+
+    sim_step_t* step = calloc(1, sizeof(sim_step_t));
+
+    if (sim_parse_step(start, step) == -1 || step->at < last || ended) {
+      LOG(ERROR, "Invalid step on line [%u] of simulation script [%s]", number, filename);
+
+      free_sim_step_t(step);
+      fclose(file);
+
+      return -1;
+    }
+
+    last = step->at;
+    ended = step->action == SIM_END;
+    sim->end = step->at;
+
+    list_add(sim->steps, step);
+  }
+
+  fclose(file);
+
+  LOG(INFO, "Loaded [%d] steps from simulation script [%s]", list_size(sim->steps), filename);
+
+  return 0;
+}
+
+/**
+ * Parses a line of a simulation script into a step.
+ *
+ * line - the line, without its line ending
+ * step - the sim_step_t to populate, its client and text being allocated
+ *
+ * Returns 0 on success or -1 if the line isn't a valid step
+ **/
+int sim_parse_step(const char* line, sim_step_t* step) {
+  assert(line);
+  assert(step);
+
+  char* end = NULL;
+
+  errno = 0;
+  step->at = strtoull(line, &end, BASE_10);
+
+  if (end == line || errno != 0 || (*end != ' ' && *end != '\t')) {
+    return -1;
+  }
+
+  line = end + strspn(end, " \t");
+
+  size_t len = strcspn(line, " \t");
+
+  if (len == strlen(SIM_END_STEP) && strncmp(line, SIM_END_STEP, len) == 0) {
+    step->action = SIM_END;
+
+    return line[len + strspn(line + len, " \t")] == '\0' ? 0 : -1;
+  }
+
+  if (len == 0) {
+    return -1;
+  }
+
+  step->client = strndup(line, len);
+
+  line += len + strspn(line + len, " \t");
+  len = strcspn(line, " \t");
+
+  if (len == strlen("connect") && strncmp(line, "connect", len) == 0) {
+    step->action = SIM_CONNECT;
+  } else if (len == strlen("send") && strncmp(line, "send", len) == 0) {
+    step->action = SIM_SEND;
+  } else if (len == strlen("disconnect") && strncmp(line, "disconnect", len) == 0) {
+    step->action = SIM_DISCONNECT;
+  } else {
+    return -1;
+  }
+
+  line += len;
+
+  if (step->action == SIM_SEND) {
+    step->text = strdup(*line == '\0' ? line : line + 1);
+
+    return 0;
+  }
+
+  return line[strspn(line, " \t")] == '\0' ? 0 : -1;
+}
+
+/**
+ * Runs the game on virtual time as fast as it will go, with virtual clients connected
+ * over in-process socket pairs carrying out the steps of the script.  Before each tick
+ * the clock jumps to the time the tick is due and the steps due by then are run, so the
+ * game sees the same traffic at the same virtual times however long each tick takes.
+ * Once the last step has run and the tick it fell due in is over, the game is shut down.
+ * The clock must already be on virtual time.
+ *
+ * sim - the sim_t with its script loaded
+ * func - called to run each tick
+ *
+ * Returns 0 on success
+ **/
+int sim_run(sim_t* sim, tick_func_t func) {
+  assert(sim);
+  assert(func);
+
+  game_t* game = sim->game;
+  tick_scheduler_t* scheduler = &game->scheduler;
+
+  assert(clock_is_virtual());
+
+  sim->start = clock_hrtime();
+  uint64_t began = uv_hrtime();
+
+  LOG(INFO, "Simulating [%llu] ms of virtual time", (unsigned long long)sim->end);
+
+  tick_drive_scheduler(scheduler, func, game);
+
+  while (scheduler->running) {
+    clock_advance_to(scheduler->due);
+
+    run_due_steps(sim);
+
+    uv_run(game->loop, UV_RUN_NOWAIT);
+    send_pending_input(sim);
+    network_reap_idle_clients(game->network);
+
+    tick_step_scheduler(scheduler);
+
+    uv_run(game->loop, UV_RUN_NOWAIT);
+    send_pending_input(sim);
+    drain_clients(sim);
+
+    if (list_size(sim->steps) == 0 && elapsed(sim) >= sim->end) {
+      game->shutdown = 1;
+    }
+  }
+
+  sim->wall = uv_hrtime() - began;
+
+  LOG(INFO, "Simulated [%llu] ms of virtual time in [%llu] ms",
+    (unsigned long long)elapsed(sim), (unsigned long long)(sim->wall / NANOSECONDS_PER_MILLISECOND));
+
+  return 0;
+}
+
+/**
+ * Writes the tick time profile of a finished simulation, one measurement per line as a
+ * name followed by its value, so profiles from different builds can be compared.  Times
+ * are in microseconds of real time.
+ *
+ * sim - the sim_t which has run
+ * file - the file to write the profile to
+ **/
+void sim_write_report(sim_t* sim, FILE* file) {
+  assert(sim);
+  assert(file);
+
+  tick_scheduler_t* scheduler = &sim->game->scheduler;
+
+  fprintf(file, "virtual_ms %llu\n", (unsigned long long)elapsed(sim));
+  fprintf(file, "wall_ms %llu\n", (unsigned long long)(sim->wall / NANOSECONDS_PER_MILLISECOND));
+  fprintf(file, "ticks %llu\n", (unsigned long long)scheduler->ticks);
+
+  write_timing(file, "tick", &scheduler->duration);
+
+  for (tick_phase_t phase = 0; phase < TICK_PHASES; phase++) {
+    write_timing(file, tick_phase_name(phase), &scheduler->phases[phase]);
+  }
+
+  fprintf(file, "steps %llu\n", (unsigned long long)sim->steps_run);
+  fprintf(file, "connections %llu\n", (unsigned long long)sim->connections);
+  fprintf(file, "bytes_sent %llu\n", (unsigned long long)sim->bytes_sent);
+  fprintf(file, "bytes_received %llu\n", (unsigned long long)sim->bytes_received);
+}
+
+/**
+ * Module internal method to run every step which has fallen due.
+ *
+ * sim - the sim_t to run the steps of
+ **/
+static void run_due_steps(sim_t* sim) {
+  sim_step_t* step = NULL;
+
+  while ((step = it_get(list_begin(sim->steps))) != NULL && step->at <= elapsed(sim)) {
+    run_step(sim, step);
+
+    list_remove(sim->steps, step);
+  }
+}
+
+/**
+ * Module internal method to run a step of the script.
+ *
+ * sim - the sim_t running the step
+ * step - the step to run
+ **/
+static void run_step(sim_t* sim, sim_step_t* step) {
+  sim->steps_run++;
+
+  if (step->action == SIM_END) {
+    return;
+  }
+
+  if (step->action == SIM_CONNECT) {
+    connect_client(sim, step->client);
+
+    return;
+  }
+
+  sim_client_t* client = hash_table_get(sim->clients, step->client);
+
+  if (client == NULL || client->fd == -1) {
+    LOG(WARN, "Virtual client [%s] isn't connected at [%llu] ms", step->client, (unsigned long long)step->at);
+
+    return;
+  }
+
+  if (step->action == SIM_SEND) {
+    send_input(sim, client, step->text);
+  } else {
+    disconnect_client(client);
+  }
+}
+
+/**
+ * Module internal method to connect a virtual client over a socket pair, one end of
+ * which the network adopts as a client connection.
+ *
+ * sim - the sim_t the client belongs to
+ * name - the name of the virtual client
+ **/
+static void connect_client(sim_t* sim, const char* name) {
+  sim_client_t* client = hash_table_get(sim->clients, name);
+
+  if (client != NULL && client->fd != -1) {
+    LOG(WARN, "Virtual client [%s] is already connected", name);
+
+    return;
+  }
+
+  uv_os_sock_t fds[2];
+  int res = uv_socketpair(SOCK_STREAM, 0, fds, 0, UV_NONBLOCK_PIPE);
+
+  if (res != 0) {
+    LOG(ERROR, "uv_socketpair for virtual client [%s] failed: %s", name, uv_strerror(res));
+
+    return;
+  }
+
+  if (network_connect_local_client(sim->game->network, fds[0]) == -1) {
+    close(fds[1]);
+
+    return;
+  }
+
+  if (client == NULL) {
+    client = calloc(1, sizeof(sim_client_t));
+    client->name = strdup(name);
+
+    hash_table_insert(sim->clients, name, client);
+  }
+
+  client->fd = fds[1];
+  sim->connections++;
+}
+
+/**
+ * Module internal method to send a line of input from a virtual client.  The line is
+ * queued behind any input still waiting to be sent, so lines arrive in order.
+ *
+ * sim - the sim_t the client belongs to
+ * client - the virtual client sending input
+ * text - the line of input, without a line ending
+ **/
+static void send_input(sim_t* sim, sim_client_t* client, const char* text) {
+  size_t len = strlen(text);
+  char* pending = realloc(client->pending, client->pending_len + len + DELIM_SIZE);
+
+  if (pending == NULL) {
+    LOG(ERROR, "Unable to allocate input for virtual client [%s]", client->name);
+
+    return;
+  }
+
+  memcpy(pending + client->pending_len, text, len);
+  memcpy(pending + client->pending_len + len, "\r\n", DELIM_SIZE);
+
+  client->pending = pending;
+  client->pending_len += len + DELIM_SIZE;
+
+  write_pending_input(sim, client);
+}
+
+/**
+ * Module internal method to write as much of a virtual client's pending input as its
+ * connection will take.  Whatever doesn't fit is kept to be written after the game has
+ * read from the connection, and is only dropped should the connection fail.
+ *
+ * sim - the sim_t the client belongs to
+ * client - the virtual client with input to send
+ **/
+static void write_pending_input(sim_t* sim, sim_client_t* client) {
+  size_t sent = 0;
+  bool failed = false;
+
+  while (sent < client->pending_len) {
+    ssize_t written = write(client->fd, client->pending + sent, client->pending_len - sent);
+
+    if (written < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        LOG(WARN, "Virtual client [%s] couldn't send input: %s", client->name, strerror(errno));
+        failed = true;
+      }
+
+      break;
+    }
+
+    sent += (size_t)written;
+  }
+
+  client->sent += sent;
+  sim->bytes_sent += sent;
+
+  if (failed) {
+    client->pending_len = 0;
+
+    return;
+  }
+
+  memmove(client->pending, client->pending + sent, client->pending_len - sent);
+  client->pending_len -= sent;
+}
+
+/**
+ * Module internal method to retry the pending input of every connected virtual client.
+ *
+ * sim - the sim_t the clients belong to
+ **/
+static void send_pending_input(sim_t* sim) {
+  h_it_t it = hash_table_iterator(sim->clients);
+  sim_client_t* client = NULL;
+
+  while ((client = h_it_get(it)) != NULL) {
+    it = h_it_next(it);
+
+    if (client->fd != -1 && client->pending_len > 0) {
+      write_pending_input(sim, client);
+    }
+  }
+}
+
+/**
+ * Module internal method to hang up a virtual client's end of its connection.
+ *
+ * client - the virtual client to disconnect
+ **/
+static void disconnect_client(sim_client_t* client) {
+  close(client->fd);
+
+  client->fd = -1;
+  client->pending_len = 0;
+}
+
+/**
+ * Module internal method to read and discard everything the game has sent to the
+ * virtual clients.  A client whose connection the game has closed is disconnected.
+ *
+ * sim - the sim_t the clients belong to
+ **/
+static void drain_clients(sim_t* sim) {
+  h_it_t it = hash_table_iterator(sim->clients);
+  sim_client_t* client = NULL;
+
+  while ((client = h_it_get(it)) != NULL) {
+    it = h_it_next(it);
+
+    if (client->fd == -1) {
+      continue;
+    }
+
+    ssize_t nread = 0;
+
+    while ((nread = read(client->fd, sim->buffer, sizeof(sim->buffer))) > 0) {
+      client->received += (size_t)nread;
+      sim->bytes_received += (size_t)nread;
+    }
+
+    if (nread == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+      disconnect_client(client);
+    }
+  }
+}
+
+/**
+ * Module internal method to return the milliseconds of virtual time since the simulation
+ * started.
+ **/
+static uint64_t elapsed(sim_t* sim) {
+  return (clock_hrtime() - sim->start) / NANOSECONDS_PER_MILLISECOND;
+}
+
+/**
+ * Module internal method to write a timing to a simulation report.
+ *
+ * file - the file the report is written to
+ * name - the name of what was timed
+ * timing - the tick_timing_t to write
+ **/
+static void write_timing(FILE* file, const char* name, const tick_timing_t* timing) {
+  uint64_t average = timing->count > 0 ? timing->total / timing->count : 0;
+
+  fprintf(file, "%s_avg_us %llu\n", name, (unsigned long long)(average / NANOSECONDS_PER_MICROSECOND));
+  fprintf(file, "%s_max_us %llu\n", name, (unsigned long long)(timing->max / NANOSECONDS_PER_MICROSECOND));
+}
+
+/**
+ * Module internal deallocator for the steps of a simulation.
+ **/
+static void free_sim_step_t(void* value) {
+  sim_step_t* step = value;
+
+  free(step->client);
+  free(step->text);
+  free(step);
+}
+
+/**
+ * Module internal deallocator for the virtual clients of a simulation.
+ **/
+static void free_sim_client_t(void* value) {
+  sim_client_t* client = value;
+
+  if (client->fd != -1) {
+    close(client->fd);
+  }
+
+  free(client->name);
+  free(client->pending);
+  free(client);
+}
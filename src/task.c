@@ -3,40 +3,86 @@
 #include <string.h>
 #include <uv.h>
 
-#include "mud/data/linked_list.h"
+#include "mud/clock.h"
+#include "mud/data/hash_table.h"
+#include "mud/event.h"
 #include "mud/game.h"
 #include "mud/log.h"
 #include "mud/lua/hooks.h"
 #include "mud/lua/ref.h"
 #include "mud/task.h"
 
-static void on_task_timer(uv_timer_t* timer);
-static void on_task_close(uv_handle_t* handle);
+static void on_task_due(timer_wheel_entry_t* entry, void* context);
+static void on_task_shutdown(timer_wheel_entry_t* entry, void* context);
+static void on_each_pending(timer_wheel_entry_t* entry, void* context);
+static void run_task(game_t* game, task_t* task);
+static void resume_task(game_t* game, task_t* task);
+static void discard_task(game_t* game, task_t* task);
+static void stop_waiting(task_t* task);
+
+typedef struct task_each_context {
+  task_func_t func;
+  void* context;
+} task_each_context_t;
 
 /**
- * Allocates a new task_t and initialises iter.  The task is not scheduled until
+ * Allocates a new task_t and initialises it.  The task is not scheduled until
  * task_schedule_task is called.
  *
+ * game - game instance owning the task wheel
+ * name - name of the task
+ * interval - milliseconds between runs of a repeating task, 0 to run once
+ * ref - Lua reference to the function the task runs
+ *
  * Returns the newly allocated task_t.
  **/
-task_t* task_new_task_t(game_t* game, const char* name, int execute_in, lua_ref_t* ref) {
+task_t* task_new_task_t(game_t* game, const char* name, uint64_t interval, lua_ref_t* ref) {
   task_t* task = calloc(1, sizeof(task_t));
 
   task->uuid = new_uuid();
   task->name = strdup(name);
-  task->execute_in = execute_in;
+  task->interval = interval;
   task->game = game;
   task->ref = ref;
+  task->entry.data = task;
+
+  return task;
+}
+
+/**
+ * Allocates a new task_t which runs a Lua coroutine.  Each time the task falls due the
+ * coroutine is resumed until it next yields, so a script can wait on time or events
+ * with lunac.api.game.wait and wait_event rather than chaining callbacks.  The task is
+ * not scheduled until task_schedule_task is called.
+ *
+ * game - game instance owning the task wheel
+ * name - name of the task
+ * thread - the coroutine, with the function it runs on its stack
+ * ref - Lua reference to the coroutine, keeping it from being collected
+ *
+ * Returns the newly allocated task_t.
+ **/
+task_t* task_new_coroutine_task_t(game_t* game, const char* name, lua_State* thread, lua_ref_t* ref) {
+  assert(thread);
+
+  task_t* task = task_new_task_t(game, name, 0, ref);
+
+  task->thread = thread;
 
   return task;
 }
 
 /**
- * Frees an allocated task_t.  The uv timer must be closed before this is called.
+ * Frees an allocated task_t.  The task must not be scheduled or waiting for an event
+ * when this is called.
  **/
 void task_free_task_t(task_t* task) {
   assert(task);
 
+  if (task->event.state != NULL) {
+    lua_release_lua_ref_t(&task->event);
+  }
+
   free(task->name);
   lua_free_lua_ref_t(task->ref);
 
@@ -56,106 +102,365 @@ void task_deallocate_task_t(void* value) {
 }
 
 /**
- * Adds a task to the task list and starts its libuv timer.
+ * Schedules a task in the game's task wheel.  Tasks are run by task_run_due_tasks on
+ * the first game tick after they fall due, so scheduling and cancelling a task is
+ * O(1) and however many tasks fall due between ticks they run as one batch.
  *
  * Parameters
- *  game - game instance owning the task list and event loop
+ *  game - game instance owning the task wheel and event loop
  *  task - the task to be scheduled
+ *  delay - milliseconds before the task runs
  *
- * Returns 0 on success or -1 on failure
+ * Returns 0 on success
  **/
-int task_schedule_task(game_t* game, task_t* task) {
+int task_schedule_task(game_t* game, task_t* task, uint64_t delay) {
   assert(game);
   assert(task);
 
-  int res = uv_timer_init(game->loop, &task->timer);
+  task->execute_at = clock_now(game->loop) + delay;
+
+  timer_wheel_schedule(game->task_wheel, &task->entry, task->execute_at);
+
+  return 0;
+}
+
+/**
+ * Cancels a task that is pending execution and frees it.  A task cancelled while it
+ * is running, such as a repeating task cancelling itself, is freed once it returns.
+ *
+ * game - game instance owning the task wheel
+ * task - task to be cancelled
+ *
+ * Returns 0 on success
+ **/
+int task_cancel_task(game_t* game, task_t* task) {
+  assert(game);
+  assert(task);
 
-  if (res != 0) {
-    LOG(ERROR, "uv_timer_init failed for task [%s]: %s", task->name, uv_strerror(res));
+  if (task->running) {
+    task->cancelled = true;
 
-    return -1;
+    return 0;
   }
 
-  task->timer.data = task;
+  discard_task(game, task);
 
-  uint64_t timeout_ms = (uint64_t)task->execute_in * 1000;
+  return 0;
+}
 
-  res = uv_timer_start(&task->timer, on_task_timer, timeout_ms, 0);
+/**
+ * Runs every task which has fallen due since the last call.  Called once per game tick.
+ *
+ * game - game instance owning the task wheel
+ *
+ * Returns the number of tasks run
+ **/
+size_t task_run_due_tasks(game_t* game) {
+  assert(game);
+
+  return timer_wheel_advance(game->task_wheel, clock_now(game->loop), on_task_due, game);
+}
+
+/**
+ * Calls a function with every task which is scheduled or waiting for an event.
+ *
+ * game - game instance owning the task wheel
+ * func - called with each task
+ * context - passed to func
+ **/
+void task_each_pending(game_t* game, task_func_t func, void* context) {
+  assert(game);
+  assert(func);
+
+  task_each_context_t each = { func, context };
 
-  if (res != 0) {
-    LOG(ERROR, "uv_timer_start failed for task [%s]: %s", task->name, uv_strerror(res));
+  timer_wheel_each(game->task_wheel, on_each_pending, &each);
 
-    return -1;
+  h_it_t it = hash_table_iterator(game->task_waiters);
+  task_waiters_t* waiters = NULL;
+
+  while ((waiters = h_it_get(it)) != NULL) {
+    it = h_it_next(it);
+
+    for (task_t* task = waiters->head; task != NULL; task = task->next_waiter) {
+      if (!task->entry.active) {
+        func(task, context);
+      }
+    }
   }
+}
 
-  if (list_add(game->tasks, task) != 0) {
-    LOG(ERROR, "Unable to add task [%s] to task list", task->name);
-    uv_timer_stop(&task->timer);
+/**
+ * Frees all pending and waiting tasks during engine shutdown.
+ *
+ * game - game instance owning the task wheel
+ **/
+void task_shutdown(game_t* game) {
+  assert(game);
 
-    return -1;
+  h_it_t it = hash_table_iterator(game->task_waiters);
+  task_waiters_t* waiters = NULL;
+
+  while ((waiters = h_it_get(it)) != NULL) {
+    it = h_it_next(it);
+
+    while (waiters->head != NULL) {
+      discard_task(game, waiters->head);
+    }
   }
 
-  return 0;
+  timer_wheel_each(game->task_wheel, on_task_shutdown, game);
 }
 
 /**
- * Cancels a task that is pending execution by stopping its timer.
+ * Suspends a coroutine task until a number of milliseconds have passed.  Called while
+ * the task is running, just before its coroutine yields.  A task which waits for no
+ * time at all resumes on the next tick.
  *
- * game - game instance owning the task list
- * task - task to be cancelled
+ * game - game instance owning the task wheel
+ * task - the coroutine task which is waiting
+ * delay - milliseconds before the task resumes
  *
  * Returns 0 on success
  **/
-int task_cancel_task(game_t* game, task_t* task) {
+int task_wait(game_t* game, task_t* task, uint64_t delay) {
   assert(game);
   assert(task);
+  assert(task->thread);
+
+  return task_schedule_task(game, task, delay < TASK_WHEEL_RESOLUTION ? TASK_WHEEL_RESOLUTION : delay);
+}
+
+/**
+ * Suspends a coroutine task until an event of a given type is dispatched, or until a
+ * timeout passes.  Waiting tasks are kept in a list per event type so dispatching an
+ * event only touches the tasks waiting for it.  The task resumes with the event as the
+ * result of wait_event, or with nothing if the timeout passed first.
+ *
+ * game - game instance owning the task wheel
+ * task - the coroutine task which is waiting
+ * type - the type of event to wait for
+ * timeout - milliseconds before the task resumes anyway, 0 to wait indefinitely
+ *
+ * Returns 0 on success
+ **/
+int task_wait_event(game_t* game, task_t* task, const char* type, uint64_t timeout) {
+  assert(game);
+  assert(task);
+  assert(task->thread);
+  assert(type);
+
+  task_waiters_t* waiters = hash_table_get(game->task_waiters, type);
 
-  uv_timer_stop(&task->timer);
-  uv_close((uv_handle_t*)&task->timer, on_task_close);
+  if (waiters == NULL) {
+    waiters = calloc(1, sizeof(task_waiters_t));
+    hash_table_insert(game->task_waiters, type, waiters);
+  }
+
+  task->waiting = waiters;
+  task->prev_waiter = NULL;
+  task->next_waiter = waiters->head;
+
+  if (waiters->head != NULL) {
+    waiters->head->prev_waiter = task;
+  }
+
+  waiters->head = task;
+
+  if (timeout > 0) {
+    task_schedule_task(game, task, timeout);
+  }
 
   return 0;
 }
 
 /**
- * Closes all pending task timers during engine shutdown.
+ * Wakes every task waiting for the type of a dispatched event.  Woken tasks are put
+ * in the task wheel to resume with the event in the tasks phase of the current tick.
  *
- * game - game instance owning the task list
+ * game - game instance owning the task wheel
+ * event - the event being dispatched
  **/
-void task_shutdown(game_t* game) {
+void task_on_event(game_t* game, event_t* event) {
   assert(game);
+  assert(event);
+
+  if (event->type != LUA_EVENT) {
+    return;
+  }
 
-  it_t iter = list_begin(game->tasks);
-  task_t* task = NULL;
+  const char* type = lua_get_event_type(game->lua_state, event->data);
 
-  while ((task = (task_t*)it_get(iter)) != NULL) {
-    iter = it_next(iter);
+  if (type == NULL) {
+    return;
+  }
 
-    if (!uv_is_closing((uv_handle_t*)&task->timer)) {
-      uv_timer_stop(&task->timer);
-      uv_close((uv_handle_t*)&task->timer, on_task_close);
-    }
+  task_waiters_t* waiters = hash_table_get(game->task_waiters, type);
+
+  if (waiters == NULL) {
+    return;
+  }
+
+  uint64_t now = clock_now(game->loop);
+
+  while (waiters->head != NULL) {
+    task_t* task = waiters->head;
+
+    stop_waiting(task);
+    lua_dup_lua_ref_t(&task->event, event->data);
+
+    task->execute_at = now;
+    timer_wheel_schedule(game->task_wheel, &task->entry, now);
   }
 }
 
 /**
- * Called by libuv when a task timer fires.  Executes the Lua callback then
- * closes the timer to trigger cleanup.
+ * Module internal method called by the task wheel when a task falls due.
+ *
+ * entry - the task's wheel entry
+ * context - the game instance
  **/
-static void on_task_timer(uv_timer_t* timer) {
-  task_t* task = timer->data;
+static void on_task_due(timer_wheel_entry_t* entry, void* context) {
+  task_t* task = entry->data;
+  game_t* game = context;
+
+  if (task->thread != NULL) {
+    resume_task(game, task);
+  } else {
+    run_task(game, task);
+  }
+}
+
+/**
+ * Module internal method to run a callback task.  Executes the Lua callback then frees
+ * the task, or schedules its next run if it repeats.  A repeating task which has fallen
+ * more than an interval behind skips the runs it missed rather than running several
+ * times in one tick.
+ *
+ * game - game instance owning the task wheel
+ * task - the task which has fallen due
+ **/
+static void run_task(game_t* game, task_t* task) {
+  task->running = true;
+  lua_call_task_execute_hook(game->lua_state, task);
+  task->running = false;
+
+  if (task->interval == 0 || task->cancelled) {
+    task_free_task_t(task);
+
+    return;
+  }
+
+  uint64_t now = clock_now(game->loop);
 
-  lua_call_task_execute_hook(task->game->lua_state, task);
+  task->execute_at += task->interval;
 
-  uv_close((uv_handle_t*)timer, on_task_close);
+  if (task->execute_at <= now) {
+    task->execute_at = now + task->interval - (now - task->execute_at) % task->interval;
+  }
+
+  timer_wheel_schedule(game->task_wheel, &task->entry, task->execute_at);
 }
 
 /**
- * Called by libuv after a task timer handle is closed.  Removes the task from
- * the game task list and frees iter.
+ * Module internal method to cancel and free a pending task during shutdown.
+ *
+ * entry - the task's wheel entry
+ * context - the game instance
  **/
-static void on_task_close(uv_handle_t* handle) {
-  task_t* task = handle->data;
+static void on_task_shutdown(timer_wheel_entry_t* entry, void* context) {
+  task_cancel_task(context, entry->data);
+}
+
+/**
+ * Module internal method to pass a pending task from the task wheel to the function
+ * given to task_each_pending.
+ *
+ * entry - the task's wheel entry
+ * context - the task_each_context_t holding the function
+ **/
+static void on_each_pending(timer_wheel_entry_t* entry, void* context) {
+  task_each_context_t* each = context;
+
+  each->func(entry->data, each->context);
+}
+
+/**
+ * Module internal method to resume a coroutine task until it next yields.  A task which
+ * was waiting for an event and timed out stops waiting first.  A task which yields
+ * without waiting on anything resumes on the next tick, while one which finishes,
+ * fails or is cancelled is freed.
+ *
+ * game - game instance owning the task wheel
+ * task - the task which has fallen due
+ **/
+static void resume_task(game_t* game, task_t* task) {
+  stop_waiting(task);
+
+  task_t* current = game->current_task;
+
+  game->current_task = task;
+  task->running = true;
+
+  int res = lua_resume_task_hook(game->lua_state, task);
+
+  task->running = false;
+  game->current_task = current;
+
+  if (task->event.state != NULL) {
+    lua_release_lua_ref_t(&task->event);
+    task->event.state = NULL;
+  }
+
+  if (res != 1 || task->cancelled) {
+    discard_task(game, task);
+
+    return;
+  }
+
+  if (!task->entry.active && task->waiting == NULL) {
+    task_schedule_task(game, task, TASK_WHEEL_RESOLUTION);
+  }
+}
+
+/**
+ * Module internal method to remove a task from the task wheel and any event it is
+ * waiting for, then free it.
+ *
+ * game - game instance owning the task wheel
+ * task - the task to discard
+ **/
+static void discard_task(game_t* game, task_t* task) {
+  timer_wheel_cancel(game->task_wheel, &task->entry);
+  stop_waiting(task);
 
-  list_remove(task->game->tasks, task);
   task_free_task_t(task);
 }
+
+/**
+ * Module internal method to remove a task from the list of tasks waiting for an event
+ * type, if it is in one.
+ *
+ * task - the task which is no longer waiting
+ **/
+static void stop_waiting(task_t* task) {
+  task_waiters_t* waiters = task->waiting;
+
+  if (waiters == NULL) {
+    return;
+  }
+
+  if (task->prev_waiter != NULL) {
+    task->prev_waiter->next_waiter = task->next_waiter;
+  } else {
+    waiters->head = task->next_waiter;
+  }
+
+  if (task->next_waiter != NULL) {
+    task->next_waiter->prev_waiter = task->prev_waiter;
+  }
+
+  task->waiting = NULL;
+  task->prev_waiter = NULL;
+  task->next_waiter = NULL;
+}
@@ -0,0 +1,351 @@
+#include <assert.h>
+#include <string.h>
+#include <uv.h>
+
+#include "mud/clock.h"
+#include "mud/log.h"
+#include "mud/tick.h"
+
+#define NANOSECONDS_PER_SECOND 1000000000ULL
+#define NANOSECONDS_PER_MILLISECOND 1000000ULL
+
+static void on_tick_timer(uv_timer_t* timer);
+static void run_due_ticks(tick_scheduler_t* scheduler);
+static uint64_t run_tick(tick_scheduler_t* scheduler);
+static void overrun(tick_scheduler_t* scheduler, uint64_t now);
+static void arm_timer(tick_scheduler_t* scheduler);
+
+/**
+ * Initialises a tick scheduler.  Ticks are scheduled on a fixed grid of intervals rather
+ * than a repeating timer, so time spent running a tick doesn't push the ticks after it
+ * back, and ticks which can't run on time are handled according to the policy.
+ *
+ * scheduler - the tick_scheduler_t to initialise
+ * ticks_per_second - the number of ticks to run each second
+ * policy - how ticks which fall due while a tick overruns are handled
+ * catch_up_limit - overdue ticks run back to back under the catch up policy
+**/
+void tick_init_scheduler(tick_scheduler_t* scheduler, unsigned int ticks_per_second, tick_policy_t policy, unsigned int catch_up_limit) {
+  assert(scheduler);
+  assert(ticks_per_second > 0);
+
+  memset(scheduler, 0, sizeof(tick_scheduler_t));
+
+  scheduler->interval = NANOSECONDS_PER_SECOND / ticks_per_second;
+  scheduler->policy = policy;
+  scheduler->catch_up_limit = catch_up_limit;
+}
+
+/**
+ * Starts running ticks, the first of which is due one interval from now.
+ *
+ * scheduler - the tick_scheduler_t to start
+ * loop - the loop to run ticks on
+ * func - called to run each tick
+ * context - passed to func
+ *
+ * Returns 0 on success or -1 on failure
+**/
+int tick_start_scheduler(tick_scheduler_t* scheduler, uv_loop_t* loop, tick_func_t func, void* context) {
+  assert(scheduler);
+  assert(loop);
+  assert(func);
+
+  int res = uv_timer_init(loop, &scheduler->timer);
+
+  if (res != 0) {
+    LOG(ERROR, "uv_timer_init for tick scheduler failed: %s", uv_strerror(res));
+
+    return -1;
+  }
+
+  scheduler->timer.data = scheduler;
+  scheduler->func = func;
+  scheduler->context = context;
+  scheduler->running = true;
+  scheduler->due = clock_hrtime() + scheduler->interval;
+
+  arm_timer(scheduler);
+
+  return 0;
+}
+
+/**
+ * Starts running ticks without a timer, the first of which is due one interval from
+ * now.  Each tick is run by a call to tick_step_scheduler, so whatever calls it decides
+ * how quickly ticks run, as a simulation on virtual time does.
+ *
+ * scheduler - the tick_scheduler_t to start
+ * func - called to run each tick
+ * context - passed to func
+**/
+void tick_drive_scheduler(tick_scheduler_t* scheduler, tick_func_t func, void* context) {
+  assert(scheduler);
+  assert(func);
+
+  scheduler->func = func;
+  scheduler->context = context;
+  scheduler->running = true;
+  scheduler->manual = true;
+  scheduler->due = clock_hrtime() + scheduler->interval;
+}
+
+/**
+ * Runs the tick which is due next on a scheduler started by tick_drive_scheduler,
+ * applying the policy if it overruns just as a timer driven scheduler would.
+ *
+ * scheduler - the tick_scheduler_t to run a tick of
+**/
+void tick_step_scheduler(tick_scheduler_t* scheduler) {
+  assert(scheduler);
+  assert(scheduler->manual);
+
+  if (scheduler->running) {
+    run_due_ticks(scheduler);
+  }
+}
+
+/**
+ * Stops running ticks and closes the scheduler's timer.  May be called from within a
+ * tick, in which case no more ticks are run.
+ *
+ * scheduler - the tick_scheduler_t to stop
+**/
+void tick_stop_scheduler(tick_scheduler_t* scheduler) {
+  assert(scheduler);
+
+  if (!scheduler->running) {
+    return;
+  }
+
+  scheduler->running = false;
+
+  if (scheduler->manual) {
+    return;
+  }
+
+  uv_timer_stop(&scheduler->timer);
+  uv_close((uv_handle_t*)&scheduler->timer, NULL);
+}
+
+/**
+ * Records the time since the tick started, or since the last phase was recorded, as
+ * the time taken by a phase of the tick.  Time taken is always measured in real time,
+ * even while the clock is virtual.
+ *
+ * scheduler - the tick_scheduler_t running the tick
+ * phase - the phase which has just finished
+**/
+void tick_record_phase(tick_scheduler_t* scheduler, tick_phase_t phase) {
+  assert(scheduler);
+  assert(phase < TICK_PHASES);
+
+  uint64_t now = uv_hrtime();
+
+  tick_record_timing(&scheduler->phases[phase], now - scheduler->mark);
+  scheduler->mark = now;
+}
+
+/**
+ * Adds a measurement to a timing.
+ *
+ * timing - the tick_timing_t to add to
+ * elapsed - nanoseconds taken
+**/
+void tick_record_timing(tick_timing_t* timing, uint64_t elapsed) {
+  assert(timing);
+
+  timing->last = elapsed;
+  timing->max = elapsed > timing->max ? elapsed : timing->max;
+  timing->total += elapsed;
+  timing->count++;
+}
+
+/**
+ * Parses the name of a tick policy.
+ *
+ * value - the name of the policy, one of skip, catch-up or stretch
+ * policy - populated with the parsed policy on success
+ *
+ * Returns 0 on success or -1 if the name isn't recognised
+**/
+int tick_parse_policy(const char* value, tick_policy_t* policy) {
+  assert(value);
+  assert(policy);
+
+  if (strcmp(value, "skip") == 0) {
+    *policy = TICK_POLICY_SKIP;
+  } else if (strcmp(value, "catch-up") == 0) {
+    *policy = TICK_POLICY_CATCH_UP;
+  } else if (strcmp(value, "stretch") == 0) {
+    *policy = TICK_POLICY_STRETCH;
+  } else {
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * Returns the name of a tick policy.
+**/
+const char* tick_policy_name(tick_policy_t policy) {
+  switch (policy) {
+  case TICK_POLICY_CATCH_UP:
+    return "catch-up";
+
+  case TICK_POLICY_STRETCH:
+    return "stretch";
+
+  default:
+    return "skip";
+  }
+}
+
+/**
+ * Returns the name of a tick phase.
+**/
+const char* tick_phase_name(tick_phase_t phase) {
+  switch (phase) {
+  case TICK_PHASE_COMMANDS:
+    return "commands";
+
+  case TICK_PHASE_TASKS:
+    return "tasks";
+
+  case TICK_PHASE_SYSTEMS:
+    return "systems";
+
+  case TICK_PHASE_FLUSH:
+    return "flush";
+
+  default:
+    return "events";
+  }
+}
+
+/**
+ * Module internal method called by libuv when the next tick is due.  Runs the tick then
+ * arms the timer for the next.
+ *
+ * timer - the scheduler's timer
+**/
+static void on_tick_timer(uv_timer_t* timer) {
+  tick_scheduler_t* scheduler = timer->data;
+
+  run_due_ticks(scheduler);
+
+  if (scheduler->running) {
+    arm_timer(scheduler);
+  }
+}
+
+/**
+ * Module internal method to run the tick which is due.  Once the tick has run, if the
+ * tick after it is already due the tick has overrun and the policy decides what happens
+ * to the overdue ticks.
+ *
+ * scheduler - the tick_scheduler_t to run ticks of
+**/
+static void run_due_ticks(tick_scheduler_t* scheduler) {
+  uint64_t now = clock_hrtime();
+  unsigned int caught_up = 0;
+
+  scheduler->lag = now > scheduler->due ? now - scheduler->due : 0;
+
+  for (;;) {
+    now = run_tick(scheduler);
+
+    if (!scheduler->running) {
+      return;
+    }
+
+    scheduler->due += scheduler->interval;
+
+    if (now < scheduler->due) {
+      scheduler->overrunning = false;
+
+      break;
+    }
+
+    overrun(scheduler, now);
+
+    if (scheduler->policy == TICK_POLICY_CATCH_UP && caught_up < scheduler->catch_up_limit) {
+      caught_up++;
+      scheduler->caught_up++;
+
+      continue;
+    }
+
+    if (scheduler->policy == TICK_POLICY_STRETCH) {
+      scheduler->stretched += now + scheduler->interval - scheduler->due;
+      scheduler->due = now + scheduler->interval;
+    } else {
+      uint64_t missed = (now - scheduler->due) / scheduler->interval + 1;
+
+      scheduler->skipped += missed;
+      scheduler->due += missed * scheduler->interval;
+    }
+
+    break;
+  }
+}
+
+/**
+ * Module internal method to run a tick and record how long it took.
+ *
+ * scheduler - the tick_scheduler_t running the tick
+ *
+ * Returns clock_hrtime the tick finished at
+**/
+static uint64_t run_tick(tick_scheduler_t* scheduler) {
+  uint64_t start = uv_hrtime();
+
+  scheduler->ticks++;
+  scheduler->mark = start;
+
+  scheduler->func(scheduler, scheduler->context);
+
+  tick_record_timing(&scheduler->duration, uv_hrtime() - start);
+
+  return clock_hrtime();
+}
+
+/**
+ * Module internal method to record a tick which finished after the next was due.  Only
+ * the first of a run of overruns is logged so a struggling game doesn't flood the log.
+ *
+ * scheduler - the tick_scheduler_t whose tick overran
+ * now - clock_hrtime the tick finished at
+**/
+static void overrun(tick_scheduler_t* scheduler, uint64_t now) {
+  scheduler->overruns++;
+
+  if (!scheduler->overrunning) {
+    LOG(WARN, "Tick [%llu] took [%llu] ms and overran the next by [%llu] ms, applying the %s policy",
+      (unsigned long long)scheduler->ticks, (unsigned long long)(scheduler->duration.last / NANOSECONDS_PER_MILLISECOND),
+      (unsigned long long)((now - scheduler->due) / NANOSECONDS_PER_MILLISECOND), tick_policy_name(scheduler->policy));
+  }
+
+  scheduler->overrunning = true;
+}
+
+/**
+ * Module internal method to arm the timer for the next tick.  libuv timers count whole
+ * milliseconds from the time the loop last updated, so the loop's time is updated first
+ * and the wait rounded up so the timer doesn't fire before the tick is due.
+ *
+ * scheduler - the tick_scheduler_t to arm
+**/
+static void arm_timer(tick_scheduler_t* scheduler) {
+  uv_update_time(scheduler->timer.loop);
+
+  uint64_t now = clock_hrtime();
+  uint64_t wait = scheduler->due > now ? (scheduler->due - now + NANOSECONDS_PER_MILLISECOND - 1) / NANOSECONDS_PER_MILLISECOND : 0;
+
+  int res = uv_timer_start(&scheduler->timer, on_tick_timer, wait, 0);
+
+  if (res != 0) {
+    LOG(ERROR, "uv_timer_start for tick scheduler failed: %s", uv_strerror(res));
+  }
+}
@@ -0,0 +1,132 @@
+#include <arpa/telnet.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "mud/log.h"
+#include "mud/network/client.h"
+#include "mud/network/mccp.h"
+#include "mud/network/output.h"
+#include "mud/network/protocol.h"
+#include "mud/network/telnet.h"
+
+/**
+ * Measures the CPU cost of MCCP2 compression per MB of output against the bandwidth it
+ * saves, at a range of compression levels in both the default and low memory modes.
+ * Output is flushed in small chunks with a sync flush each time, as it would be while
+ * a player is playing, rather than compressed in one go.
+ *
+ * Usage: bench_mccp [megabytes] [flush size]
+**/
+
+#define DEFAULT_MEGABYTES 16
+#define DEFAULT_FLUSH_SIZE 512
+
+static const char* lines[] = {
+  "\x1b[1;36mThe Town Square\x1b[0m\r\n",
+  "You are standing in the bustling town square. A fountain bubbles quietly in the centre.\r\n",
+  "Merchants call out their wares from stalls lining the northern and eastern edges.\r\n",
+  "\x1b[33mObvious exits: north, east, south, west\x1b[0m\r\n",
+  "A town guard is standing here, watching the crowd.\r\n",
+  "\x1b[32mAragorn says, 'Has anyone seen the blacksmith today?'\x1b[0m\r\n",
+  "You hit the goblin with your sword. The goblin is badly wounded.\r\n",
+  "The goblin misses you.\r\n",
+};
+
+// Logging is silenced so it doesn't skew the timings
+void mlog(log_level_t level, const char* function, const int line, const char* format, ...) {
+}
+
+int send_to_client(client_t* client, const char* data, size_t len) {
+  return network_output_buffer_append(&client->output, data, len);
+}
+
+int send_essential_to_client(client_t* client, const char* data, size_t len) {
+  return network_output_buffer_append(&client->output, data, len);
+}
+
+/**
+ * Compresses the given amount of output at a level and mode, printing the results.
+ *
+ * level - the zlib compression level
+ * low_memory - whether to use the low memory mode
+ * total - the number of bytes of output to compress
+ * flush_size - the number of bytes of output per flush
+**/
+static void run(int level, bool low_memory, size_t total, size_t flush_size) {
+  output_pool_t pool;
+  network_init_output_pool(&pool, OUTPUT_POOL_MAX_FREE);
+
+  client_t client;
+  memset(&client, 0, sizeof(client));
+  network_init_output_buffer(&client.output, flush_size + OUTPUT_SEGMENT_SIZE);
+  client.output.pool = &pool;
+
+  telnet_t* telnet = network_new_telnet_t(NULL);
+  telnet->suppress_go_ahead.us = YES;
+
+  telnet_extension_t* extension = network_new_mccp_telnet_extension(NULL, level, low_memory);
+  network_register_telnet_extension(telnet, extension);
+  mccp_t* mccp = extension->extension;
+
+  char negotiate[] = { (char)IAC, (char)DO, (char)TELOPT_MCCP2 };
+  mccp->mccp2.us = WANT_YES;
+  network_telnet_on_input(&client, telnet, negotiate, sizeof(negotiate), sizeof(negotiate));
+  network_clear_output_buffer(&client.output);
+  mccp->start = 0;
+
+  size_t line = 0;
+  size_t written = 0;
+  clock_t begin = clock();
+
+  while (written < total) {
+    while (client.output.length < flush_size) {
+      const char* text = lines[(line * 7919) % (sizeof(lines) / sizeof(lines[0]))];
+      network_output_buffer_append(&client.output, text, strlen(text));
+
+      // A prompt whose numbers change keeps the output from being a simple repeat
+      char prompt[64];
+      int len = snprintf(prompt, sizeof(prompt), "<\x1b[31m%zu\x1b[0mhp \x1b[34m%zu\x1b[0mmp %zuxp> ", (line * 37) % 500, (line * 13) % 300, line);
+      network_output_buffer_append(&client.output, prompt, (size_t)len);
+
+      line++;
+    }
+
+    written += client.output.length;
+
+    output_buffer_t output;
+    network_init_output_buffer(&output, SIZE_MAX);
+    output.pool = &pool;
+
+    network_telnet_on_output(&client, telnet, &client.output, &output);
+    network_clear_output_buffer(&output);
+  }
+
+  double seconds = (double)(clock() - begin) / CLOCKS_PER_SEC;
+  double megabytes = (double)mccp->raw_bytes / (1024.0 * 1024.0);
+  double saved = 100.0 * (1.0 - (double)mccp->compressed_bytes / (double)mccp->raw_bytes);
+
+  printf("%-5d %-10s %10.2f %12.1f %10.2f%%\n", level, low_memory ? "low" : "default", seconds * 1000.0 / megabytes, (double)mccp->compressed_bytes / 1024.0 / megabytes, saved);
+
+  network_free_telnet_t(telnet);
+  network_clear_output_pool(&pool);
+}
+
+int main(int argc, char* argv[]) {
+  size_t megabytes = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_MEGABYTES;
+  size_t flush_size = argc > 2 ? strtoul(argv[2], NULL, 10) : DEFAULT_FLUSH_SIZE;
+  int levels[] = { 1, 3, 6, 9 };
+
+  printf("MCCP2 over %zu MB of output in %zu byte flushes\n\n", megabytes, flush_size);
+  printf("%-5s %-10s %10s %12s %11s\n", "level", "mode", "cpu ms/MB", "KB sent/MB", "saved");
+
+  for (size_t i = 0; i < sizeof(levels) / sizeof(levels[0]); i++) {
+    run(levels[i], false, megabytes * 1024 * 1024, flush_size);
+    run(levels[i], true, megabytes * 1024 * 1024, flush_size);
+  }
+
+
+  return 0;
+}
@@ -0,0 +1,204 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "mud/log.h"
+#include "mud/network/client.h"
+#include "mud/network/output.h"
+#include "mud/network/protocol.h"
+#include "mud/network/telnet.h"
+#include "mud/network/websocket.h"
+
+/**
+ * Measures the cost of passing output through a chain of protocols.  A three stage
+ * chain of telnet, WebSocket framing and a stage which passes output straight through,
+ * standing in for TLS without the cost of encryption, is compared against a single
+ * stage which copies the output as every protocol used to, and against three of them.
+ * The time taken to fill and clear the output with no protocols at all is measured
+ * first and taken off the rest so only the time spent in the chain is counted.
+ *
+ * Usage: bench_protocol_chain [megabytes] [flush size]
+**/
+
+#define DEFAULT_MEGABYTES 256
+#define DEFAULT_FLUSH_SIZE 8192
+
+static const char* lines[] = {
+  "\x1b[1;36mThe Town Square\x1b[0m\r\n",
+  "You are standing in the bustling town square. A fountain bubbles quietly in the centre.\r\n",
+  "Merchants call out their wares from stalls lining the northern and eastern edges.\r\n",
+  "\x1b[33mObvious exits: north, east, south, west\x1b[0m\r\n",
+  "A town guard is standing here, watching the crowd.\r\n",
+  "You hit the goblin with your sword. The goblin is badly wounded.\r\n",
+};
+
+// Logging is silenced so it doesn't skew the timings
+void mlog(log_level_t level, const char* function, const int line, const char* format, ...) {
+}
+
+int send_to_client(client_t* client, const char* data, size_t len) {
+  return network_output_buffer_append(&client->output, data, len);
+}
+
+int send_essential_to_client(client_t* client, const char* data, size_t len) {
+  return network_output_buffer_append(&client->output, data, len);
+}
+
+void network_client_defer_output(client_t* client) {
+  client->deferred = true;
+}
+
+void network_client_hang_up(client_t* client) {
+  client->hungup = 1;
+}
+
+telnet_t* network_client_get_telnet(client_t* client) {
+  return NULL;
+}
+
+/**
+ * Stage which copies its input into its output, as protocols did before output was
+ * passed between stages in buffers of their own.
+**/
+static int copy_stage(client_t* client, void* data, output_buffer_t* input, output_buffer_t* output) {
+  for (output_segment_t* segment = input->head; segment != NULL; segment = segment->next) {
+    if (network_output_buffer_append(output, segment->data, segment->len) == -1) {
+      return -1;
+    }
+  }
+
+  return (int)output->length;
+}
+
+/**
+ * Stage which passes its input through untouched.
+**/
+static int pass_stage(client_t* client, void* data, output_buffer_t* input, output_buffer_t* output) {
+  return network_output_buffer_splice(output, input, input->length) == -1 ? -1 : (int)output->length;
+}
+
+static protocol_t* new_stage(protocol_output_func_t on_output) {
+  protocol_t* protocol = network_new_protocol_t(NULL);
+  protocol->on_output = on_output;
+
+  return protocol;
+}
+
+static protocol_t* new_websocket_stage(void) {
+  protocol_t* protocol = network_new_websocket_protocol_t(NULL, (callback_func)network_client_defer_output, NULL);
+  websocket_t* websocket = protocol->data;
+
+  websocket->state = WEBSOCKET_OPEN;
+
+  return protocol;
+}
+
+static double elapsed(const struct timespec* begin, const struct timespec* end) {
+  return (double)(end->tv_sec - begin->tv_sec) * 1e9 + (double)(end->tv_nsec - begin->tv_nsec);
+}
+
+/**
+ * Passes the given amount of output through a chain of protocols.
+ *
+ * chain - the first protocol in the chain, or NULL for none
+ * total - the number of bytes of output to pass through the chain
+ * flush_size - the number of bytes of output per flush
+ * sent - populated with the number of bytes of output the chain produced
+ *
+ * Returns the number of nanoseconds taken
+**/
+static double run(protocol_t* chain, size_t total, size_t flush_size, size_t* sent) {
+  output_pool_t pool;
+  network_init_output_pool(&pool, OUTPUT_POOL_MAX_FREE);
+
+  client_t client;
+  memset(&client, 0, sizeof(client));
+  network_init_output_buffer(&client.output, SIZE_MAX);
+  client.output.pool = &pool;
+  client.protocol = chain;
+
+  network_protocol_chain_initialise(&client);
+
+  size_t line = 0;
+  size_t written = 0;
+
+  *sent = 0;
+
+  struct timespec begin;
+  struct timespec end;
+
+  clock_gettime(CLOCK_MONOTONIC, &begin);
+
+  while (written < total) {
+    while (client.output.length < flush_size) {
+      const char* text = lines[(line * 7919) % (sizeof(lines) / sizeof(lines[0]))];
+      network_output_buffer_append(&client.output, text, strlen(text));
+      line++;
+    }
+
+    written += client.output.length;
+
+    network_protocol_chain_on_output(&client, &client.output);
+    *sent += client.output.length;
+
+    network_clear_output_buffer(&client.output);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  if (chain != NULL) {
+    network_deallocate_protocol_chain(chain);
+  }
+
+  network_clear_output_pool(&pool);
+
+  return elapsed(&begin, &end);
+}
+
+/**
+ * Passes output through a chain of protocols and prints the time taken per KB over the
+ * time taken with no protocols.
+ *
+ * name - the name of the chain
+ * chain - the first protocol in the chain
+ * total - the number of bytes of output to pass through the chain
+ * flush_size - the number of bytes of output per flush
+ * baseline - the nanoseconds taken with no protocols
+**/
+static void report(const char* name, protocol_t* chain, size_t total, size_t flush_size, double baseline) {
+  size_t sent = 0;
+  double nanoseconds = run(chain, total, flush_size, &sent);
+  double kilobytes = (double)total / 1024.0;
+
+  printf("%-24s %10.1f %14.1f\n", name, (nanoseconds - baseline) / kilobytes, (double)sent / kilobytes);
+}
+
+int main(int argc, char* argv[]) {
+  size_t megabytes = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_MEGABYTES;
+  size_t flush_size = argc > 2 ? strtoul(argv[2], NULL, 10) : DEFAULT_FLUSH_SIZE;
+  size_t total = megabytes * 1024 * 1024;
+
+  printf("Protocol chain over %zu MB of output in %zu byte flushes\n\n", megabytes, flush_size);
+  printf("%-24s %10s %14s\n", "chain", "ns/KB", "bytes sent/KB");
+
+  size_t sent = 0;
+  double baseline = run(NULL, total, flush_size, &sent);
+
+  protocol_t* single = new_stage(copy_stage);
+  report("single copying pass", single, total, flush_size, baseline);
+
+  protocol_t* copies = new_stage(copy_stage);
+  copies->next = new_stage(copy_stage);
+  copies->next->next = new_stage(copy_stage);
+  report("three copying stages", copies, total, flush_size, baseline);
+
+  protocol_t* chain = new_stage(pass_stage);
+  chain->next = new_websocket_stage();
+  chain->next->next = network_new_telnet_protocol_t(NULL);
+  report("pass, websocket, telnet", chain, total, flush_size, baseline);
+
+
+  return 0;
+}
@@ -0,0 +1,91 @@
+#include <stdint.h>
+#include <time.h>
+
+#include "fff.h"
+#include "unity.h"
+
+#include "mud/clock.h"
+
+#define MS 1000000ULL
+#define SECOND 1000000000ULL
+#define EPOCH 946684800ULL
+
+DEFINE_FFF_GLOBALS;
+FAKE_VALUE_FUNC(uint64_t, uv_hrtime);
+FAKE_VALUE_FUNC(uint64_t, uv_now, const uv_loop_t*);
+
+static uv_loop_t loop;
+
+void setUp(void) {
+  RESET_FAKE(uv_hrtime);
+  RESET_FAKE(uv_now);
+  FFF_RESET_HISTORY();
+
+  uv_hrtime_fake.return_val = 5 * SECOND;
+  uv_now_fake.return_val = 2000;
+}
+
+void tearDown(void) {
+  clock_use_real_time();
+}
+
+/* Real time passes straight through to libuv. */
+void test_clock_real_time_reads_libuv(void) {
+  TEST_ASSERT_FALSE(clock_is_virtual());
+  TEST_ASSERT_EQUAL_UINT64(5 * SECOND, clock_hrtime());
+  TEST_ASSERT_EQUAL_UINT64(2000, clock_now(&loop));
+}
+
+/* Virtual time starts at the epoch given, whatever the real time, and stands still. */
+void test_clock_virtual_time_starts_at_epoch(void) {
+  clock_use_virtual_time(EPOCH);
+
+  uv_hrtime_fake.return_val = 60 * SECOND;
+  uv_now_fake.return_val = 57000;
+
+  TEST_ASSERT_TRUE(clock_is_virtual());
+  TEST_ASSERT_EQUAL_UINT64(EPOCH * SECOND, clock_hrtime());
+  TEST_ASSERT_EQUAL_UINT64(EPOCH * 1000, clock_now(&loop));
+  TEST_ASSERT_EQUAL_INT64(EPOCH, clock_time());
+}
+
+/* Advancing virtual time moves every view of the clock by the same amount. */
+void test_clock_advance_moves_all_views(void) {
+  clock_use_virtual_time(EPOCH);
+
+  clock_advance_to(EPOCH * SECOND + 3500 * MS);
+
+  TEST_ASSERT_EQUAL_UINT64(EPOCH * SECOND + 3500 * MS, clock_hrtime());
+  TEST_ASSERT_EQUAL_UINT64(EPOCH * 1000 + 3500, clock_now(&loop));
+  TEST_ASSERT_EQUAL_INT64(EPOCH + 3, clock_time());
+}
+
+/* Virtual time never moves backwards. */
+void test_clock_advance_ignores_past_times(void) {
+  clock_use_virtual_time(EPOCH);
+
+  clock_advance_to(EPOCH * SECOND + 6 * SECOND);
+  clock_advance_to(EPOCH * SECOND + 4 * SECOND);
+
+  TEST_ASSERT_EQUAL_UINT64(EPOCH * SECOND + 6 * SECOND, clock_hrtime());
+}
+
+/* Switching back to real time reads libuv again. */
+void test_clock_use_real_time_restores_libuv(void) {
+  clock_use_virtual_time(EPOCH);
+  clock_advance_to(9 * SECOND);
+  clock_use_real_time();
+
+  TEST_ASSERT_FALSE(clock_is_virtual());
+  TEST_ASSERT_EQUAL_UINT64(5 * SECOND, clock_hrtime());
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_clock_real_time_reads_libuv);
+  RUN_TEST(test_clock_virtual_time_starts_at_epoch);
+  RUN_TEST(test_clock_advance_moves_all_views);
+  RUN_TEST(test_clock_advance_ignores_past_times);
+  RUN_TEST(test_clock_use_real_time_restores_libuv);
+  return UNITY_END();
+}
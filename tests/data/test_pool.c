@@ -0,0 +1,161 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "unity.h"
+
+#include "mud/data/pool/pool.h"
+
+typedef struct pooled {
+  int value;
+  char name[24];
+} pooled_t;
+
+/* A newly created pool holds no slabs until something is acquired. */
+void test_pool_create_is_empty(void) {
+  pool_t* pool = create_pool_t(sizeof(pooled_t), 4);
+
+  TEST_ASSERT_NOT_NULL(pool);
+  TEST_ASSERT_EQUAL_size_t(0, pool_used(pool));
+  TEST_ASSERT_EQUAL_size_t(0, pool_capacity(pool));
+
+  free_pool_t(pool);
+}
+
+/* Acquired objects are zeroed and counted as in use. */
+void test_pool_acquire_returns_zeroed_object(void) {
+  pool_t* pool = create_pool_t(sizeof(pooled_t), 4);
+
+  pooled_t* object = pool_acquire(pool);
+  TEST_ASSERT_NOT_NULL(object);
+  TEST_ASSERT_EQUAL_INT(0, object->value);
+  TEST_ASSERT_EQUAL_size_t(1, pool_used(pool));
+  TEST_ASSERT_EQUAL_size_t(4, pool_capacity(pool));
+
+  object->value = 42;
+  strcpy(object->name, "dirty");
+  pool_release(object);
+
+  object = pool_acquire(pool);
+  TEST_ASSERT_EQUAL_INT(0, object->value);
+  TEST_ASSERT_EQUAL_STRING("", object->name);
+
+  pool_release(object);
+  free_pool_t(pool);
+}
+
+/* Acquired objects are suitably aligned for any type. */
+void test_pool_objects_are_aligned(void) {
+  pool_t* pool = create_pool_t(3, 4);
+
+  for (int i = 0; i < 4; i++) {
+    void* object = pool_acquire(pool);
+    TEST_ASSERT_EQUAL_UINT(0, (uintptr_t)object % _Alignof(max_align_t));
+  }
+
+  free_pool_t(pool);
+}
+
+/* A released slot is reused by the next acquire rather than allocating. */
+void test_pool_release_reuses_slot(void) {
+  pool_t* pool = create_pool_t(sizeof(pooled_t), 4);
+
+  pooled_t* first = pool_acquire(pool);
+  pool_release(first);
+
+  pooled_t* second = pool_acquire(pool);
+  TEST_ASSERT_EQUAL_PTR(first, second);
+  TEST_ASSERT_EQUAL_size_t(4, pool_capacity(pool));
+
+  pool_release(second);
+  free_pool_t(pool);
+}
+
+/* The pool grows by a slab once every slot is in use, leaving earlier objects in place. */
+void test_pool_grows_by_slab(void) {
+  pool_t* pool = create_pool_t(sizeof(pooled_t), 2);
+
+  pooled_t* objects[5];
+
+  for (int i = 0; i < 5; i++) {
+    objects[i] = pool_acquire(pool);
+    objects[i]->value = i;
+  }
+
+  TEST_ASSERT_EQUAL_size_t(5, pool_used(pool));
+  TEST_ASSERT_EQUAL_size_t(6, pool_capacity(pool));
+
+  for (int i = 0; i < 5; i++) {
+    TEST_ASSERT_EQUAL_INT(i, objects[i]->value);
+    pool_release(objects[i]);
+  }
+
+  TEST_ASSERT_EQUAL_size_t(0, pool_used(pool));
+
+  free_pool_t(pool);
+}
+
+/* An object's ID resolves back to the object while it is held. */
+void test_pool_lookup_resolves_id(void) {
+  pool_t* pool = create_pool_t(sizeof(pooled_t), 2);
+
+  pooled_t* first = pool_acquire(pool);
+  pooled_t* second = pool_acquire(pool);
+  pooled_t* third = pool_acquire(pool);
+
+  TEST_ASSERT_NOT_EQUAL(POOL_INVALID_ID, pool_id(first));
+  TEST_ASSERT_EQUAL_PTR(first, pool_lookup(pool, pool_id(first)));
+  TEST_ASSERT_EQUAL_PTR(second, pool_lookup(pool, pool_id(second)));
+  TEST_ASSERT_EQUAL_PTR(third, pool_lookup(pool, pool_id(third)));
+
+  free_pool_t(pool);
+}
+
+/* An ID taken before release no longer resolves once its slot is reused. */
+void test_pool_lookup_rejects_stale_id(void) {
+  pool_t* pool = create_pool_t(sizeof(pooled_t), 2);
+
+  pooled_t* object = pool_acquire(pool);
+  pool_id_t stale = pool_id(object);
+
+  pool_release(object);
+  TEST_ASSERT_NULL(pool_lookup(pool, stale));
+
+  pooled_t* reused = pool_acquire(pool);
+  TEST_ASSERT_EQUAL_PTR(object, reused);
+  TEST_ASSERT_NOT_EQUAL(stale, pool_id(reused));
+  TEST_ASSERT_NULL(pool_lookup(pool, stale));
+  TEST_ASSERT_EQUAL_PTR(reused, pool_lookup(pool, pool_id(reused)));
+
+  pool_release(reused);
+  free_pool_t(pool);
+}
+
+/* IDs which were never issued don't resolve. */
+void test_pool_lookup_rejects_unknown_id(void) {
+  pool_t* pool = create_pool_t(sizeof(pooled_t), 2);
+
+  TEST_ASSERT_NULL(pool_lookup(pool, POOL_INVALID_ID));
+  TEST_ASSERT_NULL(pool_lookup(pool, ((pool_id_t)1 << 32) | 100));
+
+  free_pool_t(pool);
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_pool_create_is_empty);
+  RUN_TEST(test_pool_acquire_returns_zeroed_object);
+  RUN_TEST(test_pool_objects_are_aligned);
+  RUN_TEST(test_pool_release_reuses_slot);
+  RUN_TEST(test_pool_grows_by_slab);
+  RUN_TEST(test_pool_lookup_resolves_id);
+  RUN_TEST(test_pool_lookup_rejects_stale_id);
+  RUN_TEST(test_pool_lookup_rejects_unknown_id);
+  return UNITY_END();
+}
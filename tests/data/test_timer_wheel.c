@@ -0,0 +1,219 @@
+#include <stdlib.h>
+
+#include "unity.h"
+
+#include "mud/data/timer_wheel/timer_wheel.h"
+
+static int expired_count = 0;
+static timer_wheel_entry_t* last_expired = NULL;
+
+static void count_expired(timer_wheel_entry_t* entry, void* context) {
+  (void)context;
+  expired_count++;
+  last_expired = entry;
+}
+
+static void reschedule_expired(timer_wheel_entry_t* entry, void* context) {
+  timer_wheel_t* wheel = context;
+  expired_count++;
+  timer_wheel_schedule(wheel, entry, entry->deadline + 100);
+}
+
+static void cancel_other(timer_wheel_entry_t* entry, void* context) {
+  timer_wheel_t* wheel = context;
+  expired_count++;
+  timer_wheel_cancel(wheel, entry->data);
+}
+
+static void cancel_visited(timer_wheel_entry_t* entry, void* context) {
+  timer_wheel_t* wheel = context;
+  expired_count++;
+  timer_wheel_cancel(wheel, entry);
+}
+
+static void each_during_advance(timer_wheel_entry_t* entry, void* context) {
+  timer_wheel_t* wheel = context;
+  expired_count++;
+  timer_wheel_each(wheel, count_expired, NULL);
+}
+
+/* An entry doesn't expire before its deadline and expires once it has passed. */
+void test_timer_wheel_expires_at_deadline(void) {
+  timer_wheel_t* wheel = create_timer_wheel_t(8, 10, 0);
+  timer_wheel_entry_t entry = { 0 };
+
+  timer_wheel_schedule(wheel, &entry, 50);
+
+  TEST_ASSERT_EQUAL_size_t(0, timer_wheel_advance(wheel, 40, count_expired, NULL));
+  TEST_ASSERT_TRUE(entry.active);
+  TEST_ASSERT_EQUAL_size_t(1, timer_wheel_advance(wheel, 50, count_expired, NULL));
+  TEST_ASSERT_EQUAL_PTR(&entry, last_expired);
+  TEST_ASSERT_FALSE(entry.active);
+  TEST_ASSERT_EQUAL_size_t(0, wheel->active);
+
+  free_timer_wheel_t(wheel);
+}
+
+/* Deadlines beyond a full rotation wait for the rotation they fall in. */
+void test_timer_wheel_handles_multiple_rotations(void) {
+  timer_wheel_t* wheel = create_timer_wheel_t(4, 10, 0);
+  timer_wheel_entry_t entry = { 0 };
+
+  timer_wheel_schedule(wheel, &entry, 130);
+
+  for (uint64_t now = 10; now < 130; now += 10) {
+    TEST_ASSERT_EQUAL_size_t(0, timer_wheel_advance(wheel, now, count_expired, NULL));
+  }
+
+  TEST_ASSERT_EQUAL_size_t(1, timer_wheel_advance(wheel, 130, count_expired, NULL));
+
+  free_timer_wheel_t(wheel);
+}
+
+/* Rescheduling an entry moves its deadline rather than adding it twice. */
+void test_timer_wheel_reschedule_moves_entry(void) {
+  timer_wheel_t* wheel = create_timer_wheel_t(8, 10, 0);
+  timer_wheel_entry_t entry = { 0 };
+
+  timer_wheel_schedule(wheel, &entry, 30);
+  timer_wheel_schedule(wheel, &entry, 60);
+
+  TEST_ASSERT_EQUAL_size_t(1, wheel->active);
+  TEST_ASSERT_EQUAL_size_t(0, timer_wheel_advance(wheel, 50, count_expired, NULL));
+  TEST_ASSERT_EQUAL_size_t(1, timer_wheel_advance(wheel, 60, count_expired, NULL));
+
+  free_timer_wheel_t(wheel);
+}
+
+/* A cancelled entry never expires and cancelling twice is harmless. */
+void test_timer_wheel_cancel_prevents_expiry(void) {
+  timer_wheel_t* wheel = create_timer_wheel_t(8, 10, 0);
+  timer_wheel_entry_t entry = { 0 };
+
+  timer_wheel_schedule(wheel, &entry, 20);
+  timer_wheel_cancel(wheel, &entry);
+  timer_wheel_cancel(wheel, &entry);
+
+  TEST_ASSERT_EQUAL_size_t(0, wheel->active);
+  TEST_ASSERT_EQUAL_size_t(0, timer_wheel_advance(wheel, 100, count_expired, NULL));
+
+  free_timer_wheel_t(wheel);
+}
+
+/* A wheel which falls more than a rotation behind expires everything that is due. */
+void test_timer_wheel_catches_up_after_stall(void) {
+  timer_wheel_t* wheel = create_timer_wheel_t(4, 10, 0);
+  timer_wheel_entry_t entries[6] = { 0 };
+
+  for (int i = 0; i < 6; i++) {
+    timer_wheel_schedule(wheel, &entries[i], (uint64_t)(i + 1) * 10);
+  }
+
+  TEST_ASSERT_EQUAL_size_t(6, timer_wheel_advance(wheel, 1000, count_expired, NULL));
+  TEST_ASSERT_EQUAL_size_t(0, wheel->active);
+
+  free_timer_wheel_t(wheel);
+}
+
+/* Deadlines which have already passed expire on the next advance. */
+void test_timer_wheel_past_deadline_expires_next_advance(void) {
+  timer_wheel_t* wheel = create_timer_wheel_t(8, 10, 100);
+  timer_wheel_entry_t entry = { 0 };
+
+  timer_wheel_schedule(wheel, &entry, 50);
+
+  TEST_ASSERT_EQUAL_size_t(1, timer_wheel_advance(wheel, 110, count_expired, NULL));
+
+  free_timer_wheel_t(wheel);
+}
+
+/* An expiry callback may reschedule the entry that expired. */
+void test_timer_wheel_callback_may_reschedule(void) {
+  timer_wheel_t* wheel = create_timer_wheel_t(8, 10, 0);
+  timer_wheel_entry_t entry = { 0 };
+
+  timer_wheel_schedule(wheel, &entry, 10);
+
+  TEST_ASSERT_EQUAL_size_t(1, timer_wheel_advance(wheel, 10, reschedule_expired, wheel));
+  TEST_ASSERT_TRUE(entry.active);
+  TEST_ASSERT_EQUAL_UINT64(110, entry.deadline);
+  TEST_ASSERT_EQUAL_size_t(1, timer_wheel_advance(wheel, 110, reschedule_expired, wheel));
+
+  timer_wheel_cancel(wheel, &entry);
+  free_timer_wheel_t(wheel);
+}
+
+/* An expiry callback may cancel another entry due in the same slot. */
+void test_timer_wheel_callback_may_cancel_other(void) {
+  timer_wheel_t* wheel = create_timer_wheel_t(8, 10, 0);
+  timer_wheel_entry_t first = { 0 };
+  timer_wheel_entry_t second = { 0 };
+
+  first.data = &second;
+  second.data = &first;
+
+  timer_wheel_schedule(wheel, &first, 20);
+  timer_wheel_schedule(wheel, &second, 20);
+
+  TEST_ASSERT_EQUAL_size_t(1, timer_wheel_advance(wheel, 20, cancel_other, wheel));
+  TEST_ASSERT_FALSE(first.active);
+  TEST_ASSERT_FALSE(second.active);
+
+  free_timer_wheel_t(wheel);
+}
+
+/* Each visits every scheduled entry and may cancel the entry it's given. */
+void test_timer_wheel_each_visits_every_entry(void) {
+  timer_wheel_t* wheel = create_timer_wheel_t(4, 10, 0);
+  timer_wheel_entry_t entries[3] = { { 0 } };
+
+  timer_wheel_schedule(wheel, &entries[0], 20);
+  timer_wheel_schedule(wheel, &entries[1], 20);
+  timer_wheel_schedule(wheel, &entries[2], 300);
+
+  timer_wheel_each(wheel, cancel_visited, wheel);
+
+  TEST_ASSERT_EQUAL_INT(3, expired_count);
+  TEST_ASSERT_EQUAL_size_t(0, wheel->active);
+  TEST_ASSERT_FALSE(entries[2].active);
+
+  free_timer_wheel_t(wheel);
+}
+
+/* Visiting the entries from an expiry callback doesn't disturb the advance. */
+void test_timer_wheel_each_during_advance(void) {
+  timer_wheel_t* wheel = create_timer_wheel_t(8, 10, 0);
+  timer_wheel_entry_t first = { 0 };
+  timer_wheel_entry_t second = { 0 };
+
+  timer_wheel_schedule(wheel, &first, 20);
+  timer_wheel_schedule(wheel, &second, 20);
+
+  TEST_ASSERT_EQUAL_size_t(2, timer_wheel_advance(wheel, 20, each_during_advance, wheel));
+  TEST_ASSERT_EQUAL_INT(3, expired_count);
+
+  free_timer_wheel_t(wheel);
+}
+
+void setUp(void) {
+  expired_count = 0;
+  last_expired = NULL;
+}
+
+void tearDown(void) {
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_timer_wheel_expires_at_deadline);
+  RUN_TEST(test_timer_wheel_handles_multiple_rotations);
+  RUN_TEST(test_timer_wheel_reschedule_moves_entry);
+  RUN_TEST(test_timer_wheel_cancel_prevents_expiry);
+  RUN_TEST(test_timer_wheel_catches_up_after_stall);
+  RUN_TEST(test_timer_wheel_past_deadline_expires_next_advance);
+  RUN_TEST(test_timer_wheel_callback_may_reschedule);
+  RUN_TEST(test_timer_wheel_callback_may_cancel_other);
+  RUN_TEST(test_timer_wheel_each_visits_every_entry);
+  RUN_TEST(test_timer_wheel_each_during_advance);
+  return UNITY_END();
+}
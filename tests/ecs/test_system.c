@@ -0,0 +1,217 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "fff.h"
+#include "unity.h"
+
+#include "mud/data/linked_list.h"
+#include "mud/ecs/system.h"
+#include "mud/game.h"
+
+#define MS 1000000ULL
+
+DEFINE_FFF_GLOBALS;
+FAKE_VALUE_FUNC(uint64_t, uv_hrtime);
+FAKE_VALUE_FUNC(int, lua_call_system_execute_hook, lua_State*, system_t*);
+FAKE_VOID_FUNC(lua_free_lua_ref_t, lua_ref_t*);
+FAKE_VALUE_FUNC(mud_uuid_t, new_uuid);
+FAKE_VOID_FUNC(tick_record_timing, tick_timing_t*, uint64_t);
+
+static game_t game;
+
+static uint64_t now = 0;
+static uint64_t cost = 0;
+
+static uint64_t fake_hrtime(void) {
+  return now;
+}
+
+static int fake_execute(lua_State* lua, system_t* system) {
+  now += cost;
+
+  return 0;
+}
+
+static system_t* add_system(unsigned int interval, uint64_t budget) {
+  system_t* system = ecs_new_system_t("test", NULL);
+  ecs_set_system_schedule(system, interval, budget);
+
+  list_add(game.systems, system);
+  ecs_stagger_system(&game, system);
+
+  return system;
+}
+
+/**
+ * Runs the given number of ticks and returns how many times systems were executed.
+**/
+static int run_ticks(int ticks) {
+  int before = lua_call_system_execute_hook_fake.call_count;
+
+  for (int i = 0; i < ticks; i++) {
+    game.tick++;
+    ecs_update_systems(&game);
+  }
+
+  return lua_call_system_execute_hook_fake.call_count - before;
+}
+
+void setUp(void) {
+  RESET_FAKE(uv_hrtime);
+  RESET_FAKE(lua_call_system_execute_hook);
+  RESET_FAKE(lua_free_lua_ref_t);
+  RESET_FAKE(new_uuid);
+  RESET_FAKE(tick_record_timing);
+  FFF_RESET_HISTORY();
+
+  uv_hrtime_fake.custom_fake = fake_hrtime;
+  lua_call_system_execute_hook_fake.custom_fake = fake_execute;
+
+  memset(&game, 0, sizeof(game));
+  game.systems = create_linked_list_t();
+  game.systems->deallocator = ecs_deallocate_system_t;
+  game.tick = 100;
+
+  now = 0;
+  cost = 1 * MS;
+}
+
+void tearDown(void) {
+  free_linked_list_t(game.systems);
+}
+
+/* A system with no schedule runs every tick. */
+void test_system_runs_every_tick_by_default(void) {
+  system_t* system = ecs_new_system_t("test", NULL);
+  list_add(game.systems, system);
+  ecs_stagger_system(&game, system);
+
+  TEST_ASSERT_EQUAL_INT(5, run_ticks(5));
+  TEST_ASSERT_EQUAL_UINT64(5, system->runs);
+}
+
+/* A system with an interval runs once per interval. */
+void test_system_runs_once_per_interval(void) {
+  system_t* system = add_system(3, 0);
+
+  TEST_ASSERT_EQUAL_INT(3, run_ticks(9));
+  TEST_ASSERT_EQUAL_UINT64(3, system->runs);
+}
+
+/* A disabled system doesn't run. */
+void test_system_disabled_does_not_run(void) {
+  system_t* system = add_system(1, 0);
+  ecs_disable_system(system);
+
+  TEST_ASSERT_EQUAL_INT(0, run_ticks(3));
+}
+
+/* Systems sharing an interval are spread across its ticks. */
+void test_system_stagger_spreads_shared_interval(void) {
+  system_t* first = add_system(3, 0);
+  system_t* second = add_system(3, 0);
+  system_t* third = add_system(3, 0);
+
+  TEST_ASSERT_EQUAL_UINT64(101, first->due);
+  TEST_ASSERT_EQUAL_UINT64(102, second->due);
+  TEST_ASSERT_EQUAL_UINT64(103, third->due);
+
+  for (int i = 0; i < 6; i++) {
+    TEST_ASSERT_EQUAL_INT(1, run_ticks(1));
+  }
+}
+
+/* Once every tick of an interval has a system the next shares the soonest. */
+void test_system_stagger_shares_soonest_tick_when_full(void) {
+  add_system(2, 0);
+  add_system(2, 0);
+  system_t* third = add_system(2, 0);
+
+  TEST_ASSERT_EQUAL_UINT64(101, third->due);
+}
+
+/* Systems with different intervals don't affect each other's stagger. */
+void test_system_stagger_ignores_other_intervals(void) {
+  add_system(3, 0);
+  system_t* other = add_system(4, 0);
+
+  TEST_ASSERT_EQUAL_UINT64(101, other->due);
+}
+
+/* Systems with the longest interval are staggered without regard to its length. */
+void test_system_stagger_longest_interval(void) {
+  system_t* first = add_system(MAX_SYSTEM_INTERVAL, 0);
+  system_t* second = add_system(MAX_SYSTEM_INTERVAL, 0);
+
+  TEST_ASSERT_EQUAL_UINT64(101, first->due);
+  TEST_ASSERT_EQUAL_UINT64(102, second->due);
+  TEST_ASSERT_EQUAL_INT(1, run_ticks(1));
+  TEST_ASSERT_EQUAL_INT(1, run_ticks(1));
+  TEST_ASSERT_EQUAL_INT(0, run_ticks(10));
+}
+
+/* A system within its budget is not deferred. */
+void test_system_within_budget_not_deferred(void) {
+  system_t* system = add_system(1, 5 * MS);
+
+  TEST_ASSERT_EQUAL_INT(4, run_ticks(4));
+  TEST_ASSERT_EQUAL_UINT64(0, system->overruns);
+  TEST_ASSERT_FALSE(system->over_budget);
+  TEST_ASSERT_EQUAL_INT(4, tick_record_timing_fake.call_count);
+  TEST_ASSERT_EQUAL_UINT64(1 * MS, tick_record_timing_fake.arg1_val);
+}
+
+/* A system over its budget skips a run for every whole budget it took. */
+void test_system_over_budget_deferred(void) {
+  system_t* system = add_system(2, 10 * MS);
+
+  cost = 25 * MS;
+  TEST_ASSERT_EQUAL_INT(1, run_ticks(1));
+
+  TEST_ASSERT_TRUE(system->over_budget);
+  TEST_ASSERT_EQUAL_UINT64(1, system->overruns);
+  TEST_ASSERT_EQUAL_UINT64(2, system->deferred);
+  TEST_ASSERT_EQUAL_UINT64(107, system->due);
+
+  cost = 1 * MS;
+  TEST_ASSERT_EQUAL_INT(0, run_ticks(5));
+  TEST_ASSERT_EQUAL_INT(1, run_ticks(1));
+  TEST_ASSERT_FALSE(system->over_budget);
+}
+
+/* A system far over its budget is deferred by at most MAX_SYSTEM_DEFERRAL runs. */
+void test_system_deferral_capped(void) {
+  system_t* system = add_system(1, 1 * MS);
+
+  cost = 100 * MS;
+  run_ticks(1);
+
+  TEST_ASSERT_EQUAL_UINT64(MAX_SYSTEM_DEFERRAL, system->deferred);
+  TEST_ASSERT_EQUAL_UINT64(102 + MAX_SYSTEM_DEFERRAL, system->due);
+}
+
+/* A system without a budget is never deferred however long it takes. */
+void test_system_without_budget_never_deferred(void) {
+  system_t* system = add_system(1, 0);
+
+  cost = 100 * MS;
+
+  TEST_ASSERT_EQUAL_INT(3, run_ticks(3));
+  TEST_ASSERT_EQUAL_UINT64(0, system->deferred);
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_system_runs_every_tick_by_default);
+  RUN_TEST(test_system_runs_once_per_interval);
+  RUN_TEST(test_system_disabled_does_not_run);
+  RUN_TEST(test_system_stagger_spreads_shared_interval);
+  RUN_TEST(test_system_stagger_shares_soonest_tick_when_full);
+  RUN_TEST(test_system_stagger_ignores_other_intervals);
+  RUN_TEST(test_system_stagger_longest_interval);
+  RUN_TEST(test_system_within_budget_not_deferred);
+  RUN_TEST(test_system_over_budget_deferred);
+  RUN_TEST(test_system_deferral_capped);
+  RUN_TEST(test_system_without_budget_never_deferred);
+  return UNITY_END();
+}
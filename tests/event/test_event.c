@@ -6,9 +6,11 @@
 #include "mud/data/hash_table.h"
 #include "mud/event.h"
 #include "mud/player.h"
+#include "mud/task.h"
 
 DEFINE_FFF_GLOBALS;
 FAKE_VOID_FUNC(player_on_event, player_t*, game_t*, event_t*);
+FAKE_VOID_FUNC(task_on_event, game_t*, event_t*);
 
 static int deallocator_call_count = 0;
 
@@ -192,6 +194,25 @@ void test_event_dispatch_no_players_no_calls(void) {
   free_hash_table_t(players);
 }
 
+/* Waiting tasks are offered each event once, even when there are no players. */
+void test_event_dispatch_wakes_tasks_once_per_event(void) {
+  RESET_FAKE(task_on_event);
+
+  event_broker_t* broker = event_new_event_broker_t();
+  hash_table_t* entities = create_hash_table_t();
+  hash_table_t* players = create_hash_table_t();
+
+  event_submit_event(broker, event_new_event_t(LUA_EVENT, NULL, NULL));
+  event_submit_event(broker, event_new_event_t(LUA_EVENT, NULL, NULL));
+  event_dispatch_events(broker, NULL, entities, players);
+
+  TEST_ASSERT_EQUAL_INT(2, task_on_event_fake.call_count);
+
+  event_free_event_broker_t(broker);
+  free_hash_table_t(entities);
+  free_hash_table_t(players);
+}
+
 void setUp(void) {
 }
 
@@ -214,5 +235,6 @@ int main(void) {
   RUN_TEST(test_event_dispatch_calls_each_player);
   RUN_TEST(test_event_dispatch_calls_once_per_event);
   RUN_TEST(test_event_dispatch_no_players_no_calls);
+  RUN_TEST(test_event_dispatch_wakes_tasks_once_per_event);
   return UNITY_END();
 }
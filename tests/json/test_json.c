@@ -0,0 +1,200 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "unity.h"
+
+#include "mud/json.h"
+
+static char trace[1024];
+static size_t trace_len = 0;
+static const char* last_str = NULL;
+static int fail_at_number = 0;
+
+static int record(const char* format, ...) __attribute__((format(printf, 1, 2)));
+
+static int record(const char* format, ...) {
+  va_list args;
+
+  if (trace_len >= sizeof(trace) - 1) {
+    return 0;
+  }
+
+  va_start(args, format);
+  int written = vsnprintf(trace + trace_len, sizeof(trace) - trace_len, format, args);
+  va_end(args);
+
+  trace_len += (size_t)written < sizeof(trace) - trace_len ? (size_t)written : sizeof(trace) - trace_len - 1;
+
+  return 0;
+}
+
+static int on_object_start(void* context) { (void)context; return record("{"); }
+static int on_object_end(void* context) { (void)context; return record("}"); }
+static int on_array_start(void* context) { (void)context; return record("["); }
+static int on_array_end(void* context) { (void)context; return record("]"); }
+static int on_boolean(void* context, bool boolean) { (void)context; return record(boolean ? "T" : "F"); }
+static int on_null(void* context) { (void)context; return record("N"); }
+
+static int on_key(void* context, const char* key, size_t len) {
+  (void)context;
+
+  return record("k%.*s:", (int)len, key);
+}
+
+static int on_string(void* context, const char* str, size_t len) {
+  (void)context;
+  last_str = str;
+
+  return record("s%.*s;", (int)len, str);
+}
+
+static int on_number(void* context, double number) {
+  (void)context;
+
+  if (fail_at_number != 0 && number == fail_at_number) {
+    return -1;
+  }
+
+  return record("n%g;", number);
+}
+
+static const json_visitor_t visitor = {
+  on_object_start, on_object_end, on_array_start, on_array_end, on_key, on_string, on_number, on_boolean, on_null
+};
+
+static int parse(const char* json) {
+  return json_parse(json, strlen(json), &visitor, NULL);
+}
+
+/* Every part of a document is visited in order, whatever the whitespace. */
+void test_json_parse_visits_in_order(void) {
+  const char* json = " {\"name\": \"Bob\",\n \"hp\" : -12.5e1, \"tags\":[true,false,null,[]],\t\"room\":{}} ";
+
+  TEST_ASSERT_EQUAL_INT(0, parse(json));
+  TEST_ASSERT_EQUAL_STRING("{kname:sBob;khp:n-125;ktags:[TFN[]]kroom:{}}", trace);
+}
+
+/* Documents needn't be objects. */
+void test_json_parse_scalar_document(void) {
+  TEST_ASSERT_EQUAL_INT(0, parse("42"));
+  TEST_ASSERT_EQUAL_INT(0, parse("\"hello\""));
+  TEST_ASSERT_EQUAL_STRING("n42;shello;", trace);
+}
+
+/* Strings without escapes are handed back in place rather than copied. */
+void test_json_parse_unescaped_string_in_place(void) {
+  const char* json = "[\"plain\"]";
+
+  TEST_ASSERT_EQUAL_INT(0, parse(json));
+  TEST_ASSERT_EQUAL_PTR(json + 2, last_str);
+}
+
+/* Escapes are decoded, with unicode escapes and surrogate pairs encoded as UTF-8. */
+void test_json_parse_decodes_escapes(void) {
+  TEST_ASSERT_EQUAL_INT(0, parse("\"a\\\"b\\\\c\\/d\\te\\u00e9\\u20ac\\ud83d\\ude00\""));
+  TEST_ASSERT_EQUAL_STRING("sa\"b\\c/d\te\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80;", trace);
+}
+
+/* Malformed documents are rejected. */
+void test_json_parse_rejects_invalid(void) {
+  TEST_ASSERT_EQUAL_INT(-1, parse(""));
+  TEST_ASSERT_EQUAL_INT(-1, parse("{\"a\":1"));
+  TEST_ASSERT_EQUAL_INT(-1, parse("{\"a\" 1}"));
+  TEST_ASSERT_EQUAL_INT(-1, parse("[1,]"));
+  TEST_ASSERT_EQUAL_INT(-1, parse("[1 2]"));
+  TEST_ASSERT_EQUAL_INT(-1, parse("{} {}"));
+  TEST_ASSERT_EQUAL_INT(-1, parse("01"));
+  TEST_ASSERT_EQUAL_INT(-1, parse("1."));
+  TEST_ASSERT_EQUAL_INT(-1, parse("tru"));
+  TEST_ASSERT_EQUAL_INT(-1, parse("\"open"));
+  TEST_ASSERT_EQUAL_INT(-1, parse("\"\\x\""));
+  TEST_ASSERT_EQUAL_INT(-1, parse("\"\\ud83d\""));
+  TEST_ASSERT_EQUAL_INT(-1, parse("\"\\ude00\""));
+  TEST_ASSERT_EQUAL_INT(-1, parse("\"tab\there\""));
+}
+
+/* Nesting beyond the depth limit is refused before it can recurse further. */
+void test_json_parse_depth_limit(void) {
+  char json[JSON_MAX_DEPTH * 2 + 3];
+
+  memset(json, '[', JSON_MAX_DEPTH);
+  memset(json + JSON_MAX_DEPTH, ']', JSON_MAX_DEPTH);
+  TEST_ASSERT_EQUAL_INT(0, json_parse(json, JSON_MAX_DEPTH * 2, &visitor, NULL));
+
+  memset(json, '[', JSON_MAX_DEPTH + 1);
+  memset(json + JSON_MAX_DEPTH + 1, ']', JSON_MAX_DEPTH + 1);
+  TEST_ASSERT_EQUAL_INT(-1, json_parse(json, JSON_MAX_DEPTH * 2 + 2, &visitor, NULL));
+}
+
+/* Documents with too many values are refused. */
+void test_json_parse_value_limit(void) {
+  static char json[JSON_MAX_VALUES * 2 + 2];
+  size_t len = 0;
+
+  json[len++] = '[';
+
+  for (int i = 0; i < JSON_MAX_VALUES; i++) {
+    json[len++] = '0';
+    json[len++] = ',';
+  }
+
+  json[len - 1] = ']';
+
+  TEST_ASSERT_EQUAL_INT(-1, json_parse(json, len, &visitor, NULL));
+
+  json[len - 3] = ']';
+  TEST_ASSERT_EQUAL_INT(0, json_parse(json, len - 2, &visitor, NULL));
+}
+
+/* Strings longer than the limit are refused whether or not they're escaped. */
+void test_json_parse_string_limit(void) {
+  static char json[JSON_MAX_STRING_LENGTH + 8];
+
+  memset(json, 'x', sizeof(json));
+  json[0] = '"';
+  json[JSON_MAX_STRING_LENGTH + 1] = '"';
+  TEST_ASSERT_EQUAL_INT(0, json_parse(json, JSON_MAX_STRING_LENGTH + 2, &visitor, NULL));
+
+  json[JSON_MAX_STRING_LENGTH + 1] = 'x';
+  json[JSON_MAX_STRING_LENGTH + 2] = '"';
+  TEST_ASSERT_EQUAL_INT(-1, json_parse(json, JSON_MAX_STRING_LENGTH + 3, &visitor, NULL));
+
+  json[1] = '\\';
+  json[2] = 'n';
+  json[JSON_MAX_STRING_LENGTH + 2] = 'x';
+  json[JSON_MAX_STRING_LENGTH + 3] = '"';
+  TEST_ASSERT_EQUAL_INT(-1, json_parse(json, JSON_MAX_STRING_LENGTH + 4, &visitor, NULL));
+}
+
+/* A failing callback stops the parse. */
+void test_json_parse_callback_failure_stops(void) {
+  fail_at_number = 2;
+
+  TEST_ASSERT_EQUAL_INT(-1, parse("[1,2,3]"));
+  TEST_ASSERT_EQUAL_STRING("[n1;", trace);
+}
+
+void setUp(void) {
+  trace[0] = '\0';
+  trace_len = 0;
+  last_str = NULL;
+  fail_at_number = 0;
+}
+
+void tearDown(void) {
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_json_parse_visits_in_order);
+  RUN_TEST(test_json_parse_scalar_document);
+  RUN_TEST(test_json_parse_unescaped_string_in_place);
+  RUN_TEST(test_json_parse_decodes_escapes);
+  RUN_TEST(test_json_parse_rejects_invalid);
+  RUN_TEST(test_json_parse_depth_limit);
+  RUN_TEST(test_json_parse_value_limit);
+  RUN_TEST(test_json_parse_string_limit);
+  RUN_TEST(test_json_parse_callback_failure_stops);
+  return UNITY_END();
+}
@@ -0,0 +1,86 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "fixture.h"
+
+#include "mud/network/output.h"
+#include "mud/network/protocol.h"
+
+DEFINE_FAKE_VALUE_FUNC(int, send_to_client, client_t*, const char*, size_t);
+DEFINE_FAKE_VALUE_FUNC(int, send_essential_to_client, client_t*, const char*, size_t);
+
+client_t client;
+telnet_t* telnet = NULL;
+
+/**
+ * Resets the client and the fakes output is sent through.  Called from setUp.
+ **/
+void fixture_set_up(void) {
+  RESET_FAKE(send_to_client);
+  RESET_FAKE(send_essential_to_client);
+
+  send_to_client_fake.custom_fake = append_output;
+  send_essential_to_client_fake.custom_fake = append_output;
+
+  memset(&client, 0, sizeof(client));
+  network_init_output_buffer(&client.output, 1024 * 64);
+
+  telnet = NULL;
+}
+
+/**
+ * Frees the output left in the client's output buffer.  Called from tearDown.
+ **/
+void fixture_tear_down(void) {
+  network_clear_output_buffer(&client.output);
+}
+
+/**
+ * Creates a telnet_t for the tests to register extensions with and parse input through.
+ **/
+void fixture_new_telnet(void) {
+  // Suppress go ahead so flushed output is exactly what was queued
+  telnet = network_new_telnet_t(NULL);
+  telnet->suppress_go_ahead.us = YES;
+}
+
+/**
+ * Appends output to the client's output buffer in place of sending it.
+ **/
+int append_output(client_t* cli, const char* data, size_t len) {
+  return network_output_buffer_append(&cli->output, data, len);
+}
+
+/**
+ * Copies the client's queued output into dest and empties the output buffer.
+ *
+ * Returns the number of bytes copied
+ **/
+size_t take_output(char* dest, size_t len) {
+  size_t copied = network_output_buffer_copy(&client.output, dest, len);
+  network_clear_output_buffer(&client.output);
+
+  return copied;
+}
+
+/**
+ * Flushes the client's queued output as the network would before taking it, through
+ * the client's protocol chain or, for tests without one, the fixture's telnet_t.
+ *
+ * Returns the number of bytes copied
+ **/
+size_t flush_output(char* dest, size_t len) {
+  if (client.protocol != NULL) {
+    network_protocol_chain_on_output(&client, &client.output);
+
+    return take_output(dest, len);
+  }
+
+  output_buffer_t output;
+  network_init_output_buffer(&output, SIZE_MAX);
+
+  network_telnet_on_output(&client, telnet, &client.output, &output);
+  network_output_buffer_move(&client.output, &output);
+
+  return take_output(dest, len);
+}
@@ -0,0 +1,29 @@
+#ifndef TESTS_NETWORK_FIXTURE_H
+#define TESTS_NETWORK_FIXTURE_H
+
+#include <stddef.h>
+
+#include "fff.h"
+
+#include "mud/network/client.h"
+#include "mud/network/telnet.h"
+
+/**
+ * Shared fixture for the network protocol tests.  Output sent to the client is appended
+ * to its output buffer, where the tests take it from, rather than being written out.
+ **/
+DECLARE_FAKE_VALUE_FUNC(int, send_to_client, client_t*, const char*, size_t);
+DECLARE_FAKE_VALUE_FUNC(int, send_essential_to_client, client_t*, const char*, size_t);
+
+extern client_t client;
+extern telnet_t* telnet;
+
+void fixture_set_up(void);
+void fixture_tear_down(void);
+void fixture_new_telnet(void);
+
+int append_output(client_t* cli, const char* data, size_t len);
+size_t take_output(char* dest, size_t len);
+size_t flush_output(char* dest, size_t len);
+
+#endif
@@ -0,0 +1,227 @@
+#include <arpa/telnet.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fff.h"
+#include "fixture.h"
+#include "unity.h"
+
+#include "mud/network/capabilities.h"
+#include "mud/network/charset.h"
+#include "mud/network/client.h"
+#include "mud/network/naws.h"
+#include "mud/network/output.h"
+#include "mud/network/protocol.h"
+#include "mud/network/telnet.h"
+#include "mud/network/ttype.h"
+
+DEFINE_FFF_GLOBALS;
+
+static naws_t* naws = NULL;
+static ttype_t* ttype = NULL;
+static charset_t* charset = NULL;
+
+static void parse(const char* input, size_t len) {
+  char buffer[128];
+  memcpy(buffer, input, len);
+
+  network_telnet_on_input(&client, telnet, buffer, len, sizeof(buffer));
+}
+
+static void negotiate(unsigned char op, unsigned char option) {
+  char input[] = { (char)IAC, (char)op, (char)option };
+
+  parse(input, sizeof(input));
+}
+
+static void subnegotiate(unsigned char option, const char* data, size_t len) {
+  char input[128] = { (char)IAC, (char)SB, (char)option };
+
+  memcpy(input + 3, data, len);
+  input[len + 3] = (char)IAC;
+  input[len + 4] = (char)SE;
+
+  parse(input, len + 5);
+}
+
+static void send_terminal_type(const char* name) {
+  char data[64] = { (char)TELQUAL_IS };
+  size_t len = strlen(name);
+
+  memcpy(data + 1, name, len);
+  subnegotiate(TELOPT_TTYPE, data, len + 1);
+}
+
+/* Terminal types imply what the client supports until MTTS says otherwise. */
+void test_terminal_type_infers_colours(void) {
+  client_capabilities_t capabilities;
+
+  network_init_capabilities(&capabilities);
+  TEST_ASSERT_EQUAL_UINT(0, network_capabilities_colours(&capabilities));
+  TEST_ASSERT_EQUAL_UINT(DEFAULT_CLIENT_WIDTH, capabilities.width);
+
+  network_capabilities_set_terminal(&capabilities, "xterm-256color", 14);
+  TEST_ASSERT_EQUAL_STRING("xterm-256color", capabilities.terminal);
+  TEST_ASSERT_EQUAL_UINT(256, network_capabilities_colours(&capabilities));
+
+  network_capabilities_set_terminal(&capabilities, "ANSI-TRUECOLOR", 14);
+  TEST_ASSERT_EQUAL_UINT(16777216, network_capabilities_colours(&capabilities));
+
+  network_capabilities_set_mtts(&capabilities, CAPABILITY_ANSI | CAPABILITY_UTF8);
+  TEST_ASSERT_EQUAL_UINT(16, network_capabilities_colours(&capabilities));
+  TEST_ASSERT_TRUE(capabilities.flags & CAPABILITY_UTF8);
+}
+
+/* Names from the client are truncated and cleaned of anything unprintable. */
+void test_names_are_truncated_and_printable(void) {
+  char name[CAPABILITY_NAME_LENGTH];
+  char long_name[64];
+
+  memset(long_name, 'A', sizeof(long_name));
+  network_capabilities_set_name(name, long_name, sizeof(long_name));
+  TEST_ASSERT_EQUAL_UINT(CAPABILITY_NAME_LENGTH - 1, strlen(name));
+
+  network_capabilities_set_name(name, "MUD\x1b[0m", 7);
+  TEST_ASSERT_EQUAL_STRING("MUD?[0m", name);
+}
+
+/* NAWS records the window size reported and ignores unknown dimensions. */
+void test_naws_records_window_size(void) {
+  const char size[] = { 0, (char)132, 0, 50 };
+  const char unknown_height[] = { 0, 100, 0, 0 };
+
+  naws->naws.them = WANT_YES;
+  negotiate(WILL, TELOPT_NAWS);
+  TEST_ASSERT_TRUE(client.capabilities.flags & CAPABILITY_NAWS);
+
+  subnegotiate(TELOPT_NAWS, size, sizeof(size));
+  TEST_ASSERT_EQUAL_UINT(132, client.capabilities.width);
+  TEST_ASSERT_EQUAL_UINT(50, client.capabilities.height);
+
+  subnegotiate(TELOPT_NAWS, unknown_height, sizeof(unknown_height));
+  TEST_ASSERT_EQUAL_UINT(100, client.capabilities.width);
+  TEST_ASSERT_EQUAL_UINT(50, client.capabilities.height);
+
+  negotiate(WONT, TELOPT_NAWS);
+  TEST_ASSERT_FALSE(client.capabilities.flags & CAPABILITY_NAWS);
+  TEST_ASSERT_EQUAL_UINT(DEFAULT_CLIENT_WIDTH, client.capabilities.width);
+}
+
+/* TTYPE cycles through the client name, terminal type and MTTS bitvector. */
+void test_ttype_cycles_to_mtts(void) {
+  const char request[] = { (char)IAC, (char)SB, (char)TELOPT_TTYPE, (char)TELQUAL_SEND, (char)IAC, (char)SE };
+  char output[64];
+
+  ttype->ttype.them = WANT_YES;
+  negotiate(WILL, TELOPT_TTYPE);
+
+  TEST_ASSERT_TRUE(client.capabilities.flags & CAPABILITY_TTYPE);
+  TEST_ASSERT_EQUAL_UINT(sizeof(request), take_output(output, sizeof(output)));
+  TEST_ASSERT_EQUAL_MEMORY(request, output, sizeof(request));
+
+  send_terminal_type("MUDLET");
+  TEST_ASSERT_EQUAL_STRING("MUDLET", client.capabilities.client_name);
+  TEST_ASSERT_EQUAL_UINT(sizeof(request), take_output(output, sizeof(output)));
+
+  send_terminal_type("XTERM-256COLOR");
+  TEST_ASSERT_EQUAL_STRING("XTERM-256COLOR", client.capabilities.terminal);
+  TEST_ASSERT_EQUAL_UINT(256, network_capabilities_colours(&client.capabilities));
+  TEST_ASSERT_EQUAL_UINT(sizeof(request), take_output(output, sizeof(output)));
+
+  send_terminal_type("MTTS 333");
+  TEST_ASSERT_EQUAL_UINT(0, take_output(output, sizeof(output)));
+  TEST_ASSERT_EQUAL_UINT(333, client.capabilities.flags & CAPABILITY_MTTS_MASK);
+  TEST_ASSERT_EQUAL_UINT(16777216, network_capabilities_colours(&client.capabilities));
+  TEST_ASSERT_TRUE(client.capabilities.flags & CAPABILITY_SCREEN_READER);
+}
+
+/* A client repeating its terminal type has no more to give and isn't asked again. */
+void test_ttype_stops_on_repeat(void) {
+  char output[64];
+
+  ttype->ttype.them = WANT_YES;
+  negotiate(WILL, TELOPT_TTYPE);
+  take_output(output, sizeof(output));
+
+  send_terminal_type("VT100");
+  take_output(output, sizeof(output));
+
+  send_terminal_type("VT100");
+  TEST_ASSERT_EQUAL_UINT(0, take_output(output, sizeof(output)));
+  TEST_ASSERT_EQUAL_UINT(16, network_capabilities_colours(&client.capabilities));
+}
+
+/* CHARSET offers our charsets once agreed and records the one accepted. */
+void test_charset_records_accepted(void) {
+  const char request[] = { (char)IAC, (char)SB, (char)TELOPT_CHARSET, (char)CHARSET_REQUEST };
+  const char accepted[] = { (char)CHARSET_ACCEPTED, 'U', 'T', 'F', '-', '8' };
+  char output[64];
+
+  charset->charset.us = WANT_YES;
+  negotiate(DO, TELOPT_CHARSET);
+
+  size_t len = take_output(output, sizeof(output));
+  TEST_ASSERT_EQUAL_UINT(sizeof(request) + strlen(CHARSET_OFFERED) + 2, len);
+  TEST_ASSERT_EQUAL_MEMORY(request, output, sizeof(request));
+  TEST_ASSERT_EQUAL_MEMORY(CHARSET_OFFERED, output + sizeof(request), strlen(CHARSET_OFFERED));
+
+  subnegotiate(TELOPT_CHARSET, accepted, sizeof(accepted));
+  TEST_ASSERT_EQUAL_STRING("UTF-8", client.capabilities.charset);
+  TEST_ASSERT_TRUE(client.capabilities.flags & CAPABILITY_CHARSET);
+  TEST_ASSERT_TRUE(client.capabilities.flags & CAPABILITY_UTF8);
+}
+
+/* A charset request from the client is accepted only if it offers UTF-8. */
+void test_charset_answers_client_request(void) {
+  const char offer[] = { (char)CHARSET_REQUEST, ' ', 'C', 'P', '4', '3', '7', ' ', 'u', 't', 'f', '-', '8' };
+  const char reject[] = { (char)CHARSET_REQUEST, ';', 'C', 'P', '4', '3', '7' };
+  const char accepted[] = { (char)IAC, (char)SB, (char)TELOPT_CHARSET, (char)CHARSET_ACCEPTED, 'U', 'T', 'F', '-', '8', (char)IAC, (char)SE };
+  const char rejected[] = { (char)IAC, (char)SB, (char)TELOPT_CHARSET, (char)CHARSET_REJECTED, (char)IAC, (char)SE };
+  char output[64];
+
+  subnegotiate(TELOPT_CHARSET, reject, sizeof(reject));
+  TEST_ASSERT_EQUAL_UINT(sizeof(rejected), take_output(output, sizeof(output)));
+  TEST_ASSERT_EQUAL_MEMORY(rejected, output, sizeof(rejected));
+  TEST_ASSERT_FALSE(client.capabilities.flags & CAPABILITY_CHARSET);
+
+  subnegotiate(TELOPT_CHARSET, offer, sizeof(offer));
+  TEST_ASSERT_EQUAL_UINT(sizeof(accepted), take_output(output, sizeof(output)));
+  TEST_ASSERT_EQUAL_MEMORY(accepted, output, sizeof(accepted));
+  TEST_ASSERT_TRUE(client.capabilities.flags & CAPABILITY_UTF8);
+}
+
+void setUp(void) {
+  fixture_set_up();
+  network_init_capabilities(&client.capabilities);
+
+  telnet = network_new_telnet_t(NULL);
+
+  telnet_extension_t* extension = network_new_naws_telnet_extension(NULL);
+  network_register_telnet_extension(telnet, extension);
+  naws = extension->extension;
+
+  extension = network_new_ttype_telnet_extension(NULL);
+  network_register_telnet_extension(telnet, extension);
+  ttype = extension->extension;
+
+  extension = network_new_charset_telnet_extension(NULL);
+  network_register_telnet_extension(telnet, extension);
+  charset = extension->extension;
+}
+
+void tearDown(void) {
+  network_free_telnet_t(telnet);
+  fixture_tear_down();
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_terminal_type_infers_colours);
+  RUN_TEST(test_names_are_truncated_and_printable);
+  RUN_TEST(test_naws_records_window_size);
+  RUN_TEST(test_ttype_cycles_to_mtts);
+  RUN_TEST(test_ttype_stops_on_repeat);
+  RUN_TEST(test_charset_records_accepted);
+  RUN_TEST(test_charset_answers_client_request);
+  return UNITY_END();
+}
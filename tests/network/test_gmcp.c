@@ -0,0 +1,133 @@
+#include <arpa/telnet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fff.h"
+#include "fixture.h"
+#include "unity.h"
+
+#include "mud/network/client.h"
+#include "mud/network/gmcp.h"
+#include "mud/network/output.h"
+#include "mud/network/protocol.h"
+#include "mud/network/telnet.h"
+
+DEFINE_FFF_GLOBALS;
+FAKE_VALUE_FUNC(telnet_t*, network_client_get_telnet, client_t*);
+FAKE_VOID_FUNC(network_client_defer_output, client_t*);
+
+static void on_gmcp(client_t* cli, void* context, const char* topic, const char* message) {
+  (void)cli;
+  (void)context;
+  (void)topic;
+  (void)message;
+}
+
+/* A message is framed and written with a single call, with IAC bytes escaped. */
+void test_gmcp_frame_written_whole(void) {
+  const char msg[] = { '{', (char)IAC, '}' };
+  const char frame[] = { (char)IAC, (char)SB, (char)TELOPT_GMCP, 'C', 'o', 'r', 'e', ' ', '{', (char)IAC, (char)IAC, '}', (char)IAC, (char)SE };
+  char output[64];
+
+  TEST_ASSERT_EQUAL_INT(0, network_send_gmcp_message(&client, "Core", 4, msg, sizeof(msg)));
+  TEST_ASSERT_EQUAL_UINT(1, send_to_client_fake.call_count);
+  TEST_ASSERT_EQUAL_size_t(sizeof(frame), take_output(output, sizeof(output)));
+  TEST_ASSERT_EQUAL_MEMORY(frame, output, sizeof(frame));
+}
+
+/* A message without a payload has no separating space. */
+void test_gmcp_frame_without_message(void) {
+  const char frame[] = { (char)IAC, (char)SB, (char)TELOPT_GMCP, 'C', 'o', 'r', 'e', '.', 'P', 'i', 'n', 'g', (char)IAC, (char)SE };
+  char output[64];
+
+  network_send_gmcp_message(&client, "Core.Ping", 9, NULL, 0);
+
+  TEST_ASSERT_EQUAL_size_t(sizeof(frame), take_output(output, sizeof(output)));
+  TEST_ASSERT_EQUAL_MEMORY(frame, output, sizeof(frame));
+}
+
+/* A frame which doesn't fit leaves nothing half written. */
+void test_gmcp_frame_not_split(void) {
+  char msg[GMCP_FRAME_SIZE * 2];
+
+  memset(msg, 'x', sizeof(msg));
+  client.output.limit = GMCP_FRAME_SIZE;
+
+  TEST_ASSERT_EQUAL_INT(-1, network_send_gmcp_message(&client, "Room.Info", 9, msg, sizeof(msg)));
+  TEST_ASSERT_EQUAL_size_t(0, client.output.length);
+}
+
+/* Only the latest message for a coalesced topic is sent when output is flushed. */
+void test_gmcp_coalesced_latest_wins(void) {
+  const char latest[] = "\xff\xfa\xc9" "Char.Vitals {\"hp\":7}" "\xff\xf0";
+  char output[128];
+
+  network_send_coalesced_gmcp_message(&client, "Char.Vitals", 11, "{\"hp\":9}", 8);
+  network_send_coalesced_gmcp_message(&client, "Char.Vitals", 11, "{\"hp\":8}", 8);
+  network_send_coalesced_gmcp_message(&client, "Char.Vitals", 11, "{\"hp\":7}", 8);
+
+  TEST_ASSERT_EQUAL_UINT(0, send_to_client_fake.call_count);
+  TEST_ASSERT_EQUAL_UINT(3, network_client_defer_output_fake.call_count);
+
+  TEST_ASSERT_EQUAL_size_t(sizeof(latest) - 1, flush_output(output, sizeof(output)));
+  TEST_ASSERT_EQUAL_MEMORY(latest, output, sizeof(latest) - 1);
+
+  TEST_ASSERT_EQUAL_size_t(0, flush_output(output, sizeof(output)));
+}
+
+/* Each coalesced topic is sent once per flush alongside anything else queued. */
+void test_gmcp_coalesced_topics_batched(void) {
+  const char expected[] = "text" "\xff\xfa\xc9" "Char.Vitals 1" "\xff\xf0" "\xff\xfa\xc9" "Char.Status 2" "\xff\xf0";
+  char output[128];
+
+  network_send_coalesced_gmcp_message(&client, "Char.Vitals", 11, "1", 1);
+  network_send_coalesced_gmcp_message(&client, "Char.Status", 11, "2", 1);
+  append_output(&client, "text", 4);
+
+  TEST_ASSERT_EQUAL_size_t(sizeof(expected) - 1, flush_output(output, sizeof(output)));
+  TEST_ASSERT_EQUAL_MEMORY(expected, output, sizeof(expected) - 1);
+}
+
+/* Messages are sent straight away once every coalesced topic is taken. */
+void test_gmcp_coalesced_topics_exhausted(void) {
+  char topic[16];
+
+  for (int i = 0; i < GMCP_COALESCED_TOPICS; i++) {
+    int len = snprintf(topic, sizeof(topic), "Topic.%d", i);
+    network_send_coalesced_gmcp_message(&client, topic, (size_t)len, "x", 1);
+  }
+
+  TEST_ASSERT_EQUAL_UINT(0, send_to_client_fake.call_count);
+
+  network_send_coalesced_gmcp_message(&client, "Topic.Extra", 11, "x", 1);
+
+  TEST_ASSERT_EQUAL_UINT(1, send_to_client_fake.call_count);
+}
+
+void setUp(void) {
+  RESET_FAKE(network_client_get_telnet);
+  RESET_FAKE(network_client_defer_output);
+
+  fixture_set_up();
+  fixture_new_telnet();
+  network_register_telnet_extension(telnet, network_new_gmcp_telnet_extension(NULL, &client, on_gmcp));
+
+  network_client_get_telnet_fake.return_val = telnet;
+}
+
+void tearDown(void) {
+  network_free_telnet_t(telnet);
+  fixture_tear_down();
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_gmcp_frame_written_whole);
+  RUN_TEST(test_gmcp_frame_without_message);
+  RUN_TEST(test_gmcp_frame_not_split);
+  RUN_TEST(test_gmcp_coalesced_latest_wins);
+  RUN_TEST(test_gmcp_coalesced_topics_batched);
+  RUN_TEST(test_gmcp_coalesced_topics_exhausted);
+  return UNITY_END();
+}
@@ -0,0 +1,149 @@
+#include <string.h>
+
+#include "unity.h"
+
+#include "mud/network/input.h"
+
+static input_buffer_t buffer;
+
+static void write_input(const char* data, size_t len) {
+  size_t available = 0;
+  char* dest = network_input_buffer_reserve(&buffer, &available);
+
+  TEST_ASSERT_NOT_NULL(dest);
+  TEST_ASSERT_TRUE(available >= len);
+
+  memcpy(dest, data, len);
+  network_input_buffer_commit(&buffer, len);
+}
+
+/* A freshly initialised buffer holds no memory and is empty. */
+void test_input_init_is_empty(void) {
+  TEST_ASSERT_NULL(buffer.data);
+  TEST_ASSERT_TRUE(network_input_buffer_is_empty(&buffer));
+}
+
+/* Reserving space allocates the buffer and keeps a byte back for the null terminator. */
+void test_input_reserve_allocates(void) {
+  size_t available = 0;
+
+  TEST_ASSERT_NOT_NULL(network_input_buffer_reserve(&buffer, &available));
+  TEST_ASSERT_EQUAL_size_t(31, available);
+}
+
+/* A complete line is extracted without its delimiter. */
+void test_input_extract_line(void) {
+  char line[32];
+  write_input("look\r\n", 6);
+
+  TEST_ASSERT_EQUAL_INT(4, network_input_buffer_extract(&buffer, line, sizeof(line), "\r\n", 2));
+  TEST_ASSERT_EQUAL_STRING("look", line);
+  TEST_ASSERT_TRUE(network_input_buffer_is_empty(&buffer));
+}
+
+/* Extracting without a complete line returns -1 and leaves the input buffered. */
+void test_input_extract_incomplete_line(void) {
+  char line[32];
+  write_input("loo", 3);
+
+  TEST_ASSERT_EQUAL_INT(-1, network_input_buffer_extract(&buffer, line, sizeof(line), "\r\n", 2));
+  TEST_ASSERT_FALSE(network_input_buffer_is_empty(&buffer));
+}
+
+/* A delimiter split across two reads is still found. */
+void test_input_extract_split_delimiter(void) {
+  char line[32];
+  write_input("north\r", 6);
+
+  TEST_ASSERT_EQUAL_INT(-1, network_input_buffer_extract(&buffer, line, sizeof(line), "\r\n", 2));
+
+  write_input("\n", 1);
+
+  TEST_ASSERT_EQUAL_INT(5, network_input_buffer_extract(&buffer, line, sizeof(line), "\r\n", 2));
+  TEST_ASSERT_EQUAL_STRING("north", line);
+}
+
+/* Several lines arriving in a single read are extracted in order. */
+void test_input_extract_multiple_lines(void) {
+  char line[32];
+  write_input("n\r\ns\r\ne", 7);
+
+  TEST_ASSERT_EQUAL_INT(1, network_input_buffer_extract(&buffer, line, sizeof(line), "\r\n", 2));
+  TEST_ASSERT_EQUAL_STRING("n", line);
+  TEST_ASSERT_EQUAL_INT(1, network_input_buffer_extract(&buffer, line, sizeof(line), "\r\n", 2));
+  TEST_ASSERT_EQUAL_STRING("s", line);
+  TEST_ASSERT_EQUAL_INT(-1, network_input_buffer_extract(&buffer, line, sizeof(line), "\r\n", 2));
+}
+
+/* Embedded null bytes don't truncate the buffered input. */
+void test_input_extract_embedded_null(void) {
+  char line[32];
+  write_input("a\0b\r\nc\r\n", 8);
+
+  TEST_ASSERT_EQUAL_INT(3, network_input_buffer_extract(&buffer, line, sizeof(line), "\r\n", 2));
+  TEST_ASSERT_EQUAL_MEMORY("a\0b", line, 3);
+  TEST_ASSERT_EQUAL_INT(1, network_input_buffer_extract(&buffer, line, sizeof(line), "\r\n", 2));
+  TEST_ASSERT_EQUAL_STRING("c", line);
+}
+
+/* A line too long for the destination is discarded and the next line returned. */
+void test_input_extract_skips_long_line(void) {
+  char line[4];
+  write_input("toolong\r\nok\r\n", 13);
+
+  TEST_ASSERT_EQUAL_INT(2, network_input_buffer_extract(&buffer, line, sizeof(line), "\r\n", 2));
+  TEST_ASSERT_EQUAL_STRING("ok", line);
+}
+
+/* Unread input is moved to the start of the buffer once the end is reached. */
+void test_input_reserve_compacts(void) {
+  char line[32];
+  write_input("0123456789012345678901234\r\nabc", 30);
+
+  TEST_ASSERT_EQUAL_INT(25, network_input_buffer_extract(&buffer, line, sizeof(line), "\r\n", 2));
+
+  size_t available = 0;
+  network_input_buffer_reserve(&buffer, &available);
+  TEST_ASSERT_EQUAL_size_t(1, available);
+
+  write_input("d", 1);
+
+  network_input_buffer_reserve(&buffer, &available);
+  TEST_ASSERT_EQUAL_size_t(27, available);
+  TEST_ASSERT_EQUAL_size_t(0, buffer.read);
+  TEST_ASSERT_EQUAL_MEMORY("abcd", buffer.data, 4);
+}
+
+/* Reserving fails once the buffer is full of unread input. */
+void test_input_reserve_full(void) {
+  char data[31];
+  memset(data, 'x', sizeof(data));
+  write_input(data, sizeof(data));
+
+  size_t available = 1;
+  TEST_ASSERT_NULL(network_input_buffer_reserve(&buffer, &available));
+  TEST_ASSERT_EQUAL_size_t(0, available);
+}
+
+void setUp(void) {
+  network_init_input_buffer(&buffer, 32);
+}
+
+void tearDown(void) {
+  network_release_input_buffer(&buffer);
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_input_init_is_empty);
+  RUN_TEST(test_input_reserve_allocates);
+  RUN_TEST(test_input_extract_line);
+  RUN_TEST(test_input_extract_incomplete_line);
+  RUN_TEST(test_input_extract_split_delimiter);
+  RUN_TEST(test_input_extract_multiple_lines);
+  RUN_TEST(test_input_extract_embedded_null);
+  RUN_TEST(test_input_extract_skips_long_line);
+  RUN_TEST(test_input_reserve_compacts);
+  RUN_TEST(test_input_reserve_full);
+  return UNITY_END();
+}
@@ -0,0 +1,299 @@
+#include <arpa/telnet.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "fff.h"
+#include "fixture.h"
+#include "unity.h"
+
+#include "mud/network/client.h"
+#include "mud/network/mccp.h"
+#include "mud/network/output.h"
+#include "mud/network/protocol.h"
+#include "mud/network/telnet.h"
+
+DEFINE_FFF_GLOBALS;
+
+static mccp_t* mccp = NULL;
+static z_stream input_stream;
+
+static int parse(char* input, size_t len, size_t size) {
+  return network_telnet_on_input(&client, telnet, input, len, size);
+}
+
+static void negotiate(unsigned char op, unsigned char option) {
+  char input[] = { (char)IAC, (char)op, (char)option };
+
+  parse(input, sizeof(input), sizeof(input));
+}
+
+static size_t compress_input(const char* data, size_t len, char* dest, size_t size, int flush) {
+  if (input_stream.state == NULL) {
+    deflateInit(&input_stream, Z_DEFAULT_COMPRESSION);
+  }
+
+  input_stream.next_in = (Bytef*)data;
+  input_stream.avail_in = (uInt)len;
+  input_stream.next_out = (Bytef*)dest;
+  input_stream.avail_out = (uInt)size;
+  deflate(&input_stream, flush);
+
+  return size - input_stream.avail_out;
+}
+
+static void start_mccp2(void) {
+  // As if the WILL sent when the extension initialised is being answered
+  mccp->mccp2.us = WANT_YES;
+  negotiate(DO, TELOPT_MCCP2);
+
+  TEST_ASSERT_EQUAL_PTR(mccp, telnet->encoder->extension);
+}
+
+/* The client agreeing to MCCP2 sends the start marker uncompressed and compresses what follows. */
+void test_mccp2_compresses_after_start(void) {
+  const char start[] = { (char)IAC, (char)SB, (char)TELOPT_MCCP2, (char)IAC, (char)SE };
+  const char text[] = "You are standing in an open field west of a white house.\r\n";
+
+  start_mccp2();
+  append_output(&client, text, strlen(text));
+
+  char wire[512];
+  size_t len = flush_output(wire, sizeof(wire));
+
+  TEST_ASSERT_EQUAL_MEMORY(start, wire, sizeof(start));
+
+  z_stream stream = { 0 };
+  char plain[512];
+  inflateInit(&stream);
+  stream.next_in = (Bytef*)wire + sizeof(start);
+  stream.avail_in = (uInt)(len - sizeof(start));
+  stream.next_out = (Bytef*)plain;
+  stream.avail_out = sizeof(plain);
+
+  TEST_ASSERT_EQUAL_INT(Z_OK, inflate(&stream, Z_SYNC_FLUSH));
+  TEST_ASSERT_EQUAL_size_t(strlen(text), sizeof(plain) - stream.avail_out);
+  TEST_ASSERT_EQUAL_MEMORY(text, plain, strlen(text));
+  TEST_ASSERT_EQUAL_UINT64(strlen(text), mccp->raw_bytes);
+
+  inflateEnd(&stream);
+}
+
+/* The client turning MCCP2 off ends the stream on the next flush and stops encoding. */
+void test_mccp2_finishes_stream_when_disabled(void) {
+  char wire[512];
+
+  start_mccp2();
+  size_t len = flush_output(wire, sizeof(wire));
+
+  z_stream stream = { 0 };
+  char plain[512];
+  inflateInit(&stream);
+  stream.next_in = (Bytef*)wire + 5;
+  stream.avail_in = (uInt)(len - 5);
+  stream.next_out = (Bytef*)plain;
+  stream.avail_out = sizeof(plain);
+  inflate(&stream, Z_SYNC_FLUSH);
+
+  negotiate(DONT, TELOPT_MCCP2);
+  len = flush_output(wire, sizeof(wire));
+
+  stream.next_in = (Bytef*)wire;
+  stream.avail_in = (uInt)len;
+
+  TEST_ASSERT_EQUAL_INT(Z_STREAM_END, inflate(&stream, Z_SYNC_FLUSH));
+  TEST_ASSERT_NULL(telnet->encoder);
+  TEST_ASSERT_NULL(mccp->deflate);
+
+  inflateEnd(&stream);
+}
+
+/* Input following the MCCP3 start marker in the same read is decompressed before parsing. */
+void test_mccp3_decompresses_rest_of_read(void) {
+  char input[256] = { (char)IAC, (char)SB, (char)TELOPT_MCCP3, (char)IAC, (char)SE };
+  const char text[] = "look north\r\n";
+
+  negotiate(DO, TELOPT_MCCP3);
+
+  size_t len = 5 + compress_input(text, strlen(text), input + 5, sizeof(input) - 5, Z_SYNC_FLUSH);
+  int parsed = parse(input, len, sizeof(input));
+
+  TEST_ASSERT_EQUAL_INT((int)strlen(text), parsed);
+  TEST_ASSERT_EQUAL_MEMORY(text, input, strlen(text));
+  TEST_ASSERT_EQUAL_PTR(mccp, telnet->decoder->extension);
+}
+
+/* Compressed input split across reads is held on to until it can be decompressed. */
+void test_mccp3_input_spans_reads(void) {
+  char start[] = { (char)IAC, (char)SB, (char)TELOPT_MCCP3, (char)IAC, (char)SE };
+  char compressed[256];
+  char input[256];
+  const char text[] = "say hello\r\n";
+
+  negotiate(DO, TELOPT_MCCP3);
+  parse(start, sizeof(start), sizeof(start));
+
+  size_t len = compress_input(text, strlen(text), compressed, sizeof(compressed), Z_SYNC_FLUSH);
+
+  memcpy(input, compressed, 3);
+  TEST_ASSERT_EQUAL_INT(0, parse(input, 3, sizeof(input)));
+
+  memcpy(input, compressed + 3, len - 3);
+  TEST_ASSERT_EQUAL_INT((int)strlen(text), parse(input, len - 3, sizeof(input)));
+  TEST_ASSERT_EQUAL_MEMORY(text, input, strlen(text));
+}
+
+/* Input after the end of the client's compressed stream is passed through as is. */
+void test_mccp3_stream_end_passes_through(void) {
+  char start[] = { (char)IAC, (char)SB, (char)TELOPT_MCCP3, (char)IAC, (char)SE };
+  char input[256];
+
+  negotiate(DO, TELOPT_MCCP3);
+  parse(start, sizeof(start), sizeof(start));
+
+  size_t len = compress_input("north\r\n", 7, input, sizeof(input), Z_SYNC_FLUSH);
+  len += compress_input(NULL, 0, input + len, sizeof(input) - len, Z_FINISH);
+  memcpy(input + len, "south\r\n", 7);
+
+  TEST_ASSERT_EQUAL_INT(14, parse(input, len + 7, sizeof(input)));
+  TEST_ASSERT_EQUAL_MEMORY("north\r\nsouth\r\n", input, 14);
+  TEST_ASSERT_NULL(telnet->decoder);
+}
+
+/**
+ * Parses input held by the decoder until there is none left, appending it to dest.
+**/
+static size_t drain_held(char* dest, size_t len) {
+  while (client.input_held) {
+    char space[64];
+
+    client.input_held = false;
+
+    int parsed = parse(space, 0, sizeof(space));
+    memcpy(dest + len, space, (size_t)parsed);
+    len += (size_t)parsed;
+  }
+
+  return len;
+}
+
+/* Decompressed input which doesn't fit is held and decoded once there's space. */
+void test_mccp3_holds_input_which_does_not_fit(void) {
+  char start[] = { (char)IAC, (char)SB, (char)TELOPT_MCCP3, (char)IAC, (char)SE };
+  char text[302];
+  char input[512];
+  char received[512];
+
+  memset(text, 'l', sizeof(text) - 2);
+  memcpy(text + sizeof(text) - 2, "\r\n", 2);
+
+  negotiate(DO, TELOPT_MCCP3);
+  parse(start, sizeof(start), sizeof(start));
+
+  size_t len = compress_input(text, sizeof(text), input, sizeof(input), Z_SYNC_FLUSH);
+  int parsed = parse(input, len, 64);
+
+  TEST_ASSERT_EQUAL_INT(64, parsed);
+  TEST_ASSERT_TRUE(client.input_held);
+
+  memcpy(received, input, 64);
+
+  TEST_ASSERT_EQUAL_size_t(sizeof(text), drain_held(received, 64));
+  TEST_ASSERT_EQUAL_MEMORY(text, received, sizeof(text));
+  TEST_ASSERT_NOT_NULL(telnet->decoder);
+}
+
+/* Input after the end of the compressed stream which doesn't fit is carried over. */
+void test_mccp3_stream_end_carries_over_plain_input(void) {
+  char start[] = { (char)IAC, (char)SB, (char)TELOPT_MCCP3, (char)IAC, (char)SE };
+  char text[209];
+  char input[512];
+  char received[512];
+
+  memset(text, 'n', 200);
+  memcpy(text + 200, "\r\nsouth\r\n", 9);
+
+  negotiate(DO, TELOPT_MCCP3);
+  parse(start, sizeof(start), sizeof(start));
+
+  size_t len = compress_input(text, 202, input, sizeof(input), Z_SYNC_FLUSH);
+  len += compress_input(NULL, 0, input + len, sizeof(input) - len, Z_FINISH);
+  memcpy(input + len, "south\r\n", 7);
+  len += 7;
+
+  int parsed = parse(input, len, len);
+
+  TEST_ASSERT_EQUAL_INT((int)len, parsed);
+  TEST_ASSERT_TRUE(client.input_held);
+
+  memcpy(received, input, len);
+
+  TEST_ASSERT_EQUAL_size_t(sizeof(text), drain_held(received, len));
+  TEST_ASSERT_EQUAL_MEMORY(text, received, sizeof(text));
+  TEST_ASSERT_NULL(telnet->decoder);
+}
+
+/* Compressed output from the low memory mode still round trips. */
+void test_mccp2_low_memory_round_trips(void) {
+  telnet_extension_t* extension = network_new_mccp_telnet_extension(NULL, Z_BEST_COMPRESSION, true);
+  char text[4096];
+  char wire[8192];
+  char plain[8192];
+
+  network_free_telnet_t(telnet);
+  telnet = network_new_telnet_t(NULL);
+  telnet->suppress_go_ahead.us = YES;
+  network_register_telnet_extension(telnet, extension);
+  mccp = extension->extension;
+
+  for (size_t i = 0; i < sizeof(text); i++) {
+    text[i] = "abcdefgh \r\n"[i % 11];
+  }
+
+  start_mccp2();
+  append_output(&client, text, sizeof(text));
+  size_t len = flush_output(wire, sizeof(wire));
+
+  z_stream stream = { 0 };
+  inflateInit(&stream);
+  stream.next_in = (Bytef*)wire + 5;
+  stream.avail_in = (uInt)(len - 5);
+  stream.next_out = (Bytef*)plain;
+  stream.avail_out = sizeof(plain);
+
+  TEST_ASSERT_EQUAL_INT(Z_OK, inflate(&stream, Z_SYNC_FLUSH));
+  TEST_ASSERT_EQUAL_MEMORY(text, plain, sizeof(text));
+  TEST_ASSERT_LESS_THAN_size_t(sizeof(text) / 4, len);
+
+  inflateEnd(&stream);
+}
+
+void setUp(void) {
+  fixture_set_up();
+  fixture_new_telnet();
+
+  telnet_extension_t* extension = network_new_mccp_telnet_extension(NULL, DEFAULT_MCCP_COMPRESSION_LEVEL, false);
+  network_register_telnet_extension(telnet, extension);
+  mccp = extension->extension;
+}
+
+void tearDown(void) {
+  deflateEnd(&input_stream);
+  memset(&input_stream, 0, sizeof(input_stream));
+
+  network_free_telnet_t(telnet);
+  fixture_tear_down();
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_mccp2_compresses_after_start);
+  RUN_TEST(test_mccp2_finishes_stream_when_disabled);
+  RUN_TEST(test_mccp3_decompresses_rest_of_read);
+  RUN_TEST(test_mccp3_input_spans_reads);
+  RUN_TEST(test_mccp3_stream_end_passes_through);
+  RUN_TEST(test_mccp3_holds_input_which_does_not_fit);
+  RUN_TEST(test_mccp3_stream_end_carries_over_plain_input);
+  RUN_TEST(test_mccp2_low_memory_round_trips);
+  return UNITY_END();
+}
@@ -0,0 +1,450 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "fff.h"
+#include "unity.h"
+
+#include "mud/clock.h"
+#include "mud/network/client.h"
+#include "mud/network/network.h"
+#include "mud/network/server.h"
+#include "mud/network/tls.h"
+#include "mud/network/websocket.h"
+
+#define MAX_CLOSING 8
+
+DEFINE_FFF_GLOBALS;
+FAKE_VALUE_FUNC(uint64_t, clock_now, const uv_loop_t*);
+FAKE_VALUE_FUNC(server_t*, create_server_t);
+FAKE_VOID_FUNC(free_server_t, server_t*);
+FAKE_VALUE_FUNC(protocol_t*, network_new_tls_protocol_t, protocol_pools_t*, SSL_CTX*);
+FAKE_VALUE_FUNC(protocol_t*, network_new_websocket_protocol_t, protocol_pools_t*, callback_func, void*);
+FAKE_VALUE_FUNC(int, uv_pipe_init, uv_loop_t*, uv_pipe_t*, int);
+FAKE_VALUE_FUNC(int, uv_pipe_open, uv_pipe_t*, uv_file);
+FAKE_VALUE_FUNC(int, uv_fileno, const uv_handle_t*, uv_os_fd_t*);
+FAKE_VALUE_FUNC(int, uv_read_start, uv_stream_t*, uv_alloc_cb, uv_read_cb);
+FAKE_VOID_FUNC(uv_close, uv_handle_t*, uv_close_cb);
+FAKE_VALUE_FUNC(int, uv_is_closing, const uv_handle_t*);
+FAKE_VALUE_FUNC(int, uv_is_active, const uv_handle_t*);
+FAKE_VALUE_FUNC(size_t, uv_stream_get_write_queue_size, const uv_stream_t*);
+FAKE_VALUE_FUNC(int, uv_try_write, uv_stream_t*, const uv_buf_t*, unsigned int);
+FAKE_VALUE_FUNC(int, uv_write, uv_write_t*, uv_stream_t*, const uv_buf_t*, unsigned int, uv_write_cb);
+FAKE_VALUE_FUNC(int, uv_check_init, uv_loop_t*, uv_check_t*);
+FAKE_VALUE_FUNC(int, uv_check_start, uv_check_t*, uv_check_cb);
+FAKE_VALUE_FUNC(int, uv_timer_init, uv_loop_t*, uv_timer_t*);
+FAKE_VALUE_FUNC(int, uv_timer_start, uv_timer_t*, uv_timer_cb, uint64_t, uint64_t);
+FAKE_VOID_FUNC(uv_unref, uv_handle_t*);
+
+static uv_loop_t loop;
+static network_t* network = NULL;
+static uint64_t now = 0;
+static size_t queued = 0;
+static int next_fd = 0;
+
+static char written[1024];
+static size_t written_len = 0;
+
+static client_t* flushed[8];
+static size_t flushed_count = 0;
+
+static uv_handle_t* closing[MAX_CLOSING];
+static uv_close_cb closing_cbs[MAX_CLOSING];
+static size_t closing_count = 0;
+
+static uint64_t fake_now(const uv_loop_t* loop) {
+  return now;
+}
+
+static int fake_fileno(const uv_handle_t* handle, uv_os_fd_t* fd) {
+  *fd = next_fd++;
+
+  return 0;
+}
+
+static size_t fake_write_queue_size(const uv_stream_t* stream) {
+  return queued;
+}
+
+/* Accepts everything written to a client as though the socket had room for it. */
+static int fake_try_write(uv_stream_t* stream, const uv_buf_t* bufs, unsigned int nbufs) {
+  size_t total = 0;
+
+  for (unsigned int i = 0; i < nbufs; i++) {
+    memcpy(written + written_len, bufs[i].base, bufs[i].len);
+    written_len += bufs[i].len;
+    total += bufs[i].len;
+  }
+
+  return (int)total;
+}
+
+/* Holds close callbacks back until run_closes as libuv defers them to the next loop iteration. */
+static void fake_close(uv_handle_t* handle, uv_close_cb cb) {
+  closing[closing_count] = handle;
+  closing_cbs[closing_count] = cb;
+  closing_count++;
+}
+
+static void run_closes(void) {
+  for (size_t i = 0; i < closing_count; i++) {
+    if (closing_cbs[i] != NULL) {
+      closing_cbs[i](closing[i]);
+    }
+  }
+
+  closing_count = 0;
+}
+
+static client_t* connect_client(void) {
+  TEST_ASSERT_EQUAL_INT(0, network_connect_local_client(network, next_fd));
+
+  return uv_read_start_fake.arg0_val->data;
+}
+
+/* Passes data to a client as though libuv had read it from the client's handle. */
+static void receive(client_t* client, const char* data) {
+  uv_buf_t buf;
+  size_t len = strlen(data);
+
+  uv_read_start_fake.arg1_val((uv_handle_t*)&client->handle, len, &buf);
+  memcpy(buf.base, data, len);
+  uv_read_start_fake.arg2_val((uv_stream_t*)&client->handle, (ssize_t)len, &buf);
+}
+
+/* Closes a client as though libuv had read the end of its stream. */
+static void disconnect(client_t* client) {
+  char data[1];
+  uv_buf_t buf = uv_buf_init(data, 0);
+
+  uv_read_start_fake.arg2_val((uv_stream_t*)&client->handle, UV_EOF, &buf);
+  run_closes();
+}
+
+static void respond(client_t* client, void* context) {
+  char line[64];
+
+  extract_from_input(client, line, sizeof(line), "\r\n");
+  send_to_client(client, "ok", 2);
+}
+
+static void count_flush(client_t* client, void* context) {
+  flushed[flushed_count++] = client;
+}
+
+static void run_check(void) {
+  uv_check_start_fake.arg1_val(&network->coalesce_check);
+}
+
+static void assert_written(const char* expected) {
+  TEST_ASSERT_EQUAL_size_t(strlen(expected), written_len);
+  TEST_ASSERT_EQUAL_MEMORY(expected, written, written_len);
+}
+
+/* Flushes a client's output while its write queue is over the pending limit. */
+static void throttle(client_t* client) {
+  send_to_client(client, "x", 1);
+
+  queued = network->pending_limit + 1;
+  flush_output(network);
+
+  TEST_ASSERT_TRUE(client->throttled);
+}
+
+void setUp(void) {
+  RESET_FAKE(clock_now);
+  RESET_FAKE(create_server_t);
+  RESET_FAKE(free_server_t);
+  RESET_FAKE(network_new_tls_protocol_t);
+  RESET_FAKE(network_new_websocket_protocol_t);
+  RESET_FAKE(uv_pipe_init);
+  RESET_FAKE(uv_pipe_open);
+  RESET_FAKE(uv_fileno);
+  RESET_FAKE(uv_read_start);
+  RESET_FAKE(uv_close);
+  RESET_FAKE(uv_is_closing);
+  RESET_FAKE(uv_is_active);
+  RESET_FAKE(uv_stream_get_write_queue_size);
+  RESET_FAKE(uv_try_write);
+  RESET_FAKE(uv_write);
+  RESET_FAKE(uv_check_init);
+  RESET_FAKE(uv_check_start);
+  RESET_FAKE(uv_timer_init);
+  RESET_FAKE(uv_timer_start);
+  RESET_FAKE(uv_unref);
+  FFF_RESET_HISTORY();
+
+  clock_now_fake.custom_fake = fake_now;
+  uv_fileno_fake.custom_fake = fake_fileno;
+  uv_close_fake.custom_fake = fake_close;
+  uv_stream_get_write_queue_size_fake.custom_fake = fake_write_queue_size;
+  uv_try_write_fake.custom_fake = fake_try_write;
+
+  now = 1000;
+  queued = 0;
+  next_fd = 10;
+  written_len = 0;
+  flushed_count = 0;
+  closing_count = 0;
+
+  network = create_network_t();
+  network->loop = &loop;
+}
+
+void tearDown(void) {
+  run_closes();
+  disconnect_clients(network);
+  run_closes();
+
+  free_network_t(network);
+}
+
+static void test_network_drop_policy_drops_output_while_throttled(void) {
+  client_t* client = connect_client();
+  network->backpressure_policy = BACKPRESSURE_DROP;
+
+  throttle(client);
+
+  TEST_ASSERT_EQUAL_INT(0, send_to_client(client, "hello", 5));
+  TEST_ASSERT_EQUAL_size_t(0, client->output.length);
+  TEST_ASSERT_EQUAL_size_t(5, network->metrics.dropped_bytes);
+}
+
+static void test_network_drop_policy_sends_again_once_drained(void) {
+  client_t* client = connect_client();
+  network->backpressure_policy = BACKPRESSURE_DROP;
+
+  throttle(client);
+
+  queued = 0;
+  network_client_update_pending(client);
+  written_len = 0;
+
+  send_to_client(client, "hello", 5);
+  flush_output(network);
+
+  TEST_ASSERT_FALSE(client->throttled);
+  assert_written("hello");
+  TEST_ASSERT_EQUAL_size_t(0, network->metrics.dropped_bytes);
+}
+
+static void test_network_coalesce_policy_holds_output_while_throttled(void) {
+  client_t* client = connect_client();
+  network->backpressure_policy = BACKPRESSURE_COALESCE;
+
+  throttle(client);
+
+  TEST_ASSERT_TRUE(client->held);
+  TEST_ASSERT_EQUAL_size_t(1, client->output.length);
+  TEST_ASSERT_EQUAL_size_t(0, written_len);
+  TEST_ASSERT_TRUE(client->dirty);
+}
+
+static void test_network_coalesce_policy_sends_only_latest_output(void) {
+  client_t* client = connect_client();
+  network->backpressure_policy = BACKPRESSURE_COALESCE;
+
+  throttle(client);
+
+  send_to_client(client, "hello", 5);
+
+  TEST_ASSERT_EQUAL_size_t(5, client->output.length);
+  TEST_ASSERT_EQUAL_size_t(1, network->metrics.dropped_bytes);
+  TEST_ASSERT_EQUAL_size_t(1, network->metrics.coalesced_flushes);
+
+  queued = 0;
+  flush_output(network);
+
+  assert_written("hello");
+}
+
+static void test_network_coalesce_policy_keeps_essential_output(void) {
+  client_t* client = connect_client();
+  network->backpressure_policy = BACKPRESSURE_COALESCE;
+
+  queued = network->pending_limit + 1;
+  send_essential_to_client(client, "essential", 9);
+  flush_output(network);
+
+  TEST_ASSERT_TRUE(client->held);
+
+  send_to_client(client, "hello", 5);
+
+  TEST_ASSERT_EQUAL_size_t(0, network->metrics.coalesced_flushes);
+
+  queued = 0;
+  flush_output(network);
+
+  assert_written("essentialhello");
+}
+
+static void test_network_disconnect_policy_holds_output_until_timeout(void) {
+  client_t* client = connect_client();
+  network->backpressure_policy = BACKPRESSURE_DISCONNECT;
+  network->backpressure_timeout = 30;
+
+  throttle(client);
+
+  now += 30 * 1000 - 1;
+  flush_output(network);
+
+  TEST_ASSERT_TRUE(client->held);
+  TEST_ASSERT_EQUAL_INT(0, uv_close_fake.call_count);
+  TEST_ASSERT_EQUAL_size_t(0, network->metrics.slow_disconnects);
+}
+
+static void test_network_disconnect_policy_hangs_up_after_timeout(void) {
+  client_t* client = connect_client();
+  network->backpressure_policy = BACKPRESSURE_DISCONNECT;
+  network->backpressure_timeout = 30;
+
+  throttle(client);
+
+  now += 30 * 1000;
+  flush_output(network);
+
+  TEST_ASSERT_EQUAL_INT(1, uv_close_fake.call_count);
+  TEST_ASSERT_EQUAL_PTR(&client->handle, uv_close_fake.arg0_val);
+  TEST_ASSERT_EQUAL_size_t(1, network->metrics.slow_disconnects);
+
+  run_closes();
+
+  TEST_ASSERT_EQUAL_size_t(1, network->metrics.disconnections);
+  TEST_ASSERT_NULL(network->dirty_head);
+}
+
+static void test_network_coalesced_output_waits_for_end_of_loop_iteration(void) {
+  client_t* client = connect_client();
+  register_input_callback(network, respond, network);
+  network_enable_output_coalescing(network, 0);
+
+  receive(client, "look\r\n");
+
+  TEST_ASSERT_EQUAL_size_t(0, written_len);
+  TEST_ASSERT_TRUE(client->flush_queued);
+  TEST_ASSERT_EQUAL_INT(0, uv_timer_start_fake.call_count);
+
+  run_check();
+
+  assert_written("ok");
+  TEST_ASSERT_FALSE(client->flush_queued);
+}
+
+static void test_network_coalesced_output_waits_for_latency(void) {
+  client_t* client = connect_client();
+  register_input_callback(network, respond, network);
+  network_enable_output_coalescing(network, 50);
+
+  receive(client, "look\r\n");
+
+  TEST_ASSERT_EQUAL_INT(1, uv_timer_start_fake.call_count);
+  TEST_ASSERT_EQUAL_UINT64(50, uv_timer_start_fake.arg2_val);
+
+  now += 20;
+  run_check();
+
+  TEST_ASSERT_EQUAL_size_t(0, written_len);
+  TEST_ASSERT_EQUAL_INT(2, uv_timer_start_fake.call_count);
+  TEST_ASSERT_EQUAL_UINT64(30, uv_timer_start_fake.arg2_val);
+
+  now += 30;
+  run_check();
+
+  assert_written("ok");
+}
+
+static void test_network_uncoalesced_output_is_sent_immediately(void) {
+  client_t* client = connect_client();
+  register_input_callback(network, respond, network);
+
+  receive(client, "look\r\n");
+
+  assert_written("ok");
+  TEST_ASSERT_FALSE(client->flush_queued);
+}
+
+static void test_network_client_is_marked_dirty_once(void) {
+  client_t* client = connect_client();
+
+  send_to_client(client, "hello", 5);
+  send_to_client(client, "hello", 5);
+  network_mark_client_dirty(network, client);
+
+  TEST_ASSERT_EQUAL_PTR(client, network->dirty_head);
+  TEST_ASSERT_EQUAL_PTR(client, network->dirty_tail);
+  TEST_ASSERT_NULL(client->dirty_prev);
+  TEST_ASSERT_NULL(client->dirty_next);
+}
+
+static void test_network_disconnect_unlinks_dirty_client(void) {
+  client_t* first = connect_client();
+  client_t* second = connect_client();
+  client_t* third = connect_client();
+
+  send_to_client(first, "hello", 5);
+  send_to_client(second, "hello", 5);
+  send_to_client(third, "hello", 5);
+
+  disconnect(second);
+
+  TEST_ASSERT_EQUAL_PTR(first, network->dirty_head);
+  TEST_ASSERT_EQUAL_PTR(third, first->dirty_next);
+  TEST_ASSERT_EQUAL_PTR(first, third->dirty_prev);
+  TEST_ASSERT_EQUAL_PTR(third, network->dirty_tail);
+
+  flush_output(network);
+
+  assert_written("hellohello");
+}
+
+static void test_network_disconnect_unlinks_only_dirty_client(void) {
+  client_t* first = connect_client();
+  client_t* second = connect_client();
+
+  send_to_client(second, "hello", 5);
+
+  disconnect(second);
+
+  TEST_ASSERT_NULL(network->dirty_head);
+  TEST_ASSERT_NULL(network->dirty_tail);
+  TEST_ASSERT_FALSE(first->dirty);
+}
+
+static void test_network_flush_visits_only_dirty_clients(void) {
+  register_flush_callback(network, count_flush, network);
+
+  connect_client();
+  client_t* dirty = connect_client();
+  connect_client();
+
+  send_to_client(dirty, "hello", 5);
+  flush_output(network);
+
+  TEST_ASSERT_EQUAL_size_t(1, flushed_count);
+  TEST_ASSERT_EQUAL_PTR(dirty, flushed[0]);
+  TEST_ASSERT_EQUAL_INT(1, uv_try_write_fake.call_count);
+  TEST_ASSERT_FALSE(dirty->dirty);
+  TEST_ASSERT_NULL(network->dirty_head);
+
+  flush_output(network);
+
+  TEST_ASSERT_EQUAL_size_t(1, flushed_count);
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_network_drop_policy_drops_output_while_throttled);
+  RUN_TEST(test_network_drop_policy_sends_again_once_drained);
+  RUN_TEST(test_network_coalesce_policy_holds_output_while_throttled);
+  RUN_TEST(test_network_coalesce_policy_sends_only_latest_output);
+  RUN_TEST(test_network_coalesce_policy_keeps_essential_output);
+  RUN_TEST(test_network_disconnect_policy_holds_output_until_timeout);
+  RUN_TEST(test_network_disconnect_policy_hangs_up_after_timeout);
+  RUN_TEST(test_network_coalesced_output_waits_for_end_of_loop_iteration);
+  RUN_TEST(test_network_coalesced_output_waits_for_latency);
+  RUN_TEST(test_network_uncoalesced_output_is_sent_immediately);
+  RUN_TEST(test_network_client_is_marked_dirty_once);
+  RUN_TEST(test_network_disconnect_unlinks_dirty_client);
+  RUN_TEST(test_network_disconnect_unlinks_only_dirty_client);
+  RUN_TEST(test_network_flush_visits_only_dirty_clients);
+  return UNITY_END();
+}
@@ -0,0 +1,358 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "unity.h"
+
+#include "mud/network/output.h"
+
+/* A freshly initialised buffer is empty and stores its limit. */
+void test_output_init_is_empty(void) {
+  output_buffer_t buffer;
+  network_init_output_buffer(&buffer, 128);
+
+  TEST_ASSERT_NULL(buffer.head);
+  TEST_ASSERT_NULL(buffer.tail);
+  TEST_ASSERT_EQUAL_size_t(0, buffer.length);
+  TEST_ASSERT_EQUAL_size_t(128, buffer.limit);
+}
+
+/* Appending data increases the buffer length and the data can be copied back out. */
+void test_output_append_then_copy(void) {
+  output_buffer_t buffer;
+  network_init_output_buffer(&buffer, 128);
+
+  TEST_ASSERT_EQUAL_INT(0, network_output_buffer_append(&buffer, "hello ", 6));
+  TEST_ASSERT_EQUAL_INT(0, network_output_buffer_append(&buffer, "world", 5));
+  TEST_ASSERT_EQUAL_size_t(11, buffer.length);
+
+  char dest[16] = { 0 };
+  TEST_ASSERT_EQUAL_size_t(11, network_output_buffer_copy(&buffer, dest, sizeof(dest)));
+  TEST_ASSERT_EQUAL_STRING("hello world", dest);
+
+  network_clear_output_buffer(&buffer);
+}
+
+/* Data larger than a single segment is spread across several segments in order. */
+void test_output_append_spans_segments(void) {
+  size_t len = OUTPUT_SEGMENT_SIZE * 2 + 10;
+  char* data = malloc(len);
+  char* dest = malloc(len);
+
+  for (size_t i = 0; i < len; i++) {
+    data[i] = (char)(i % 251);
+  }
+
+  output_buffer_t buffer;
+  network_init_output_buffer(&buffer, len);
+
+  TEST_ASSERT_EQUAL_INT(0, network_output_buffer_append(&buffer, data, len));
+  TEST_ASSERT_NOT_EQUAL(buffer.head, buffer.tail);
+  TEST_ASSERT_EQUAL_size_t(len, network_output_buffer_copy(&buffer, dest, len));
+  TEST_ASSERT_EQUAL_MEMORY(data, dest, len);
+
+  network_clear_output_buffer(&buffer);
+  free(data);
+  free(dest);
+}
+
+/* Appends which would take the buffer past its limit are rejected and leave it untouched. */
+void test_output_append_past_limit_fails(void) {
+  output_buffer_t buffer;
+  network_init_output_buffer(&buffer, 8);
+
+  TEST_ASSERT_EQUAL_INT(0, network_output_buffer_append(&buffer, "12345", 5));
+  TEST_ASSERT_EQUAL_INT(-1, network_output_buffer_append(&buffer, "6789", 4));
+  TEST_ASSERT_EQUAL_size_t(5, buffer.length);
+
+  network_clear_output_buffer(&buffer);
+}
+
+/* Clearing a buffer releases its segments but preserves the limit. */
+void test_output_clear_resets_buffer(void) {
+  output_buffer_t buffer;
+  network_init_output_buffer(&buffer, 64);
+
+  network_output_buffer_append(&buffer, "data", 4);
+  network_clear_output_buffer(&buffer);
+
+  TEST_ASSERT_NULL(buffer.head);
+  TEST_ASSERT_NULL(buffer.tail);
+  TEST_ASSERT_EQUAL_size_t(0, buffer.length);
+  TEST_ASSERT_EQUAL_size_t(64, buffer.limit);
+}
+
+/* Copying into a destination smaller than the buffer copies only what fits. */
+void test_output_copy_truncates_to_destination(void) {
+  output_buffer_t buffer;
+  network_init_output_buffer(&buffer, 64);
+
+  network_output_buffer_append(&buffer, "abcdef", 6);
+
+  char dest[4] = { 0 };
+  TEST_ASSERT_EQUAL_size_t(3, network_output_buffer_copy(&buffer, dest, 3));
+  TEST_ASSERT_EQUAL_STRING("abc", dest);
+
+  network_clear_output_buffer(&buffer);
+}
+
+/* Buffers point uv_buf_t entries straight at their segments without copying. */
+void test_output_bufs_point_at_segments(void) {
+  output_buffer_t buffer;
+  network_init_output_buffer(&buffer, OUTPUT_SEGMENT_SIZE * 4);
+
+  char data[OUTPUT_SEGMENT_SIZE + 1];
+  memset(data, 'x', sizeof(data));
+  network_output_buffer_append(&buffer, data, sizeof(data));
+
+  uv_buf_t bufs[4];
+  TEST_ASSERT_EQUAL_size_t(2, network_output_buffer_count(&buffer));
+  TEST_ASSERT_EQUAL_size_t(2, network_output_buffer_bufs(&buffer, bufs, 4));
+  TEST_ASSERT_EQUAL_PTR(buffer.head->data, bufs[0].base);
+  TEST_ASSERT_EQUAL_size_t(OUTPUT_SEGMENT_SIZE, bufs[0].len);
+  TEST_ASSERT_EQUAL_PTR(buffer.tail->data, bufs[1].base);
+  TEST_ASSERT_EQUAL_size_t(1, bufs[1].len);
+
+  network_clear_output_buffer(&buffer);
+}
+
+/* Segments released by a cleared buffer are recycled by the pool on the next append. */
+void test_output_pool_recycles_segments(void) {
+  output_pool_t pool;
+  network_init_output_pool(&pool, 8);
+
+  output_buffer_t buffer;
+  network_init_output_buffer(&buffer, 64);
+  buffer.pool = &pool;
+
+  network_output_buffer_append(&buffer, "first", 5);
+  output_segment_t* segment = buffer.head;
+  network_clear_output_buffer(&buffer);
+
+  TEST_ASSERT_EQUAL_size_t(1, pool.free_segments);
+
+  network_output_buffer_append(&buffer, "second", 6);
+  TEST_ASSERT_EQUAL_PTR(segment, buffer.head);
+  TEST_ASSERT_EQUAL_size_t(0, pool.free_segments);
+  TEST_ASSERT_EQUAL_size_t(6, buffer.head->len);
+
+  network_clear_output_buffer(&buffer);
+  network_clear_output_pool(&pool);
+}
+
+/* Segments retained by a write survive the buffer being cleared until the write is released. */
+void test_output_write_retains_segments(void) {
+  output_pool_t pool;
+  network_init_output_pool(&pool, 8);
+
+  output_buffer_t buffer;
+  network_init_output_buffer(&buffer, 64);
+  buffer.pool = &pool;
+
+  network_output_buffer_append(&buffer, "pending", 7);
+
+  output_write_t* write = network_output_write_acquire(&pool);
+  write->segments = buffer.head;
+  network_output_segments_retain(write->segments);
+
+  network_clear_output_buffer(&buffer);
+  TEST_ASSERT_EQUAL_size_t(0, pool.free_segments);
+  TEST_ASSERT_EQUAL_MEMORY("pending", write->segments->data, 7);
+
+  network_output_write_release(write);
+  TEST_ASSERT_EQUAL_size_t(1, pool.free_segments);
+  TEST_ASSERT_EQUAL_size_t(1, pool.free_writes);
+
+  network_clear_output_pool(&pool);
+}
+
+/* A pool never holds more free segments than its maximum. */
+void test_output_pool_respects_max_free(void) {
+  output_pool_t pool;
+  network_init_output_pool(&pool, 1);
+
+  output_buffer_t buffer;
+  network_init_output_buffer(&buffer, OUTPUT_SEGMENT_SIZE * 3);
+  buffer.pool = &pool;
+
+  char data[OUTPUT_SEGMENT_SIZE * 3];
+  memset(data, 'y', sizeof(data));
+  network_output_buffer_append(&buffer, data, sizeof(data));
+  network_clear_output_buffer(&buffer);
+
+  TEST_ASSERT_EQUAL_size_t(1, pool.free_segments);
+
+  network_clear_output_pool(&pool);
+}
+
+/* Space reserved at the end of the buffer only counts towards it once committed. */
+void test_output_reserve_then_commit(void) {
+  output_buffer_t buffer;
+  network_init_output_buffer(&buffer, OUTPUT_SEGMENT_SIZE * 2);
+
+  network_output_buffer_append(&buffer, "abc", 3);
+
+  size_t len = 0;
+  char* dest = network_output_buffer_reserve(&buffer, &len);
+
+  TEST_ASSERT_EQUAL_PTR(buffer.tail->data + 3, dest);
+  TEST_ASSERT_EQUAL_size_t(OUTPUT_SEGMENT_SIZE - 3, len);
+  TEST_ASSERT_EQUAL_size_t(3, buffer.length);
+
+  memcpy(dest, "def", 3);
+  network_output_buffer_commit(&buffer, 3);
+
+  char copy[8] = { 0 };
+  TEST_ASSERT_EQUAL_size_t(6, network_output_buffer_copy(&buffer, copy, sizeof(copy)));
+  TEST_ASSERT_EQUAL_STRING("abcdef", copy);
+
+  network_clear_output_buffer(&buffer);
+}
+
+/* Reservations never extend past the buffer's limit. */
+void test_output_reserve_respects_limit(void) {
+  output_buffer_t buffer;
+  network_init_output_buffer(&buffer, 8);
+
+  size_t len = 0;
+  TEST_ASSERT_NOT_NULL(network_output_buffer_reserve(&buffer, &len));
+  TEST_ASSERT_EQUAL_size_t(8, len);
+
+  network_output_buffer_commit(&buffer, 8);
+  TEST_ASSERT_NULL(network_output_buffer_reserve(&buffer, &len));
+  TEST_ASSERT_EQUAL_size_t(0, len);
+
+  network_clear_output_buffer(&buffer);
+}
+
+/* Moving a buffer hands its segments to the destination and empties the source. */
+void test_output_move_replaces_contents(void) {
+  output_buffer_t dest;
+  output_buffer_t src;
+  network_init_output_buffer(&dest, 64);
+  network_init_output_buffer(&src, 128);
+
+  network_output_buffer_append(&dest, "old", 3);
+  network_output_buffer_append(&src, "new data", 8);
+  src.essential = true;
+
+  output_segment_t* segment = src.head;
+  network_output_buffer_move(&dest, &src);
+
+  TEST_ASSERT_EQUAL_PTR(segment, dest.head);
+  TEST_ASSERT_EQUAL_size_t(8, dest.length);
+  TEST_ASSERT_EQUAL_size_t(64, dest.limit);
+  TEST_ASSERT_TRUE(dest.essential);
+  TEST_ASSERT_NULL(src.head);
+  TEST_ASSERT_EQUAL_size_t(0, src.length);
+
+  network_clear_output_buffer(&dest);
+}
+
+/* Splicing moves whole segments across without copying them and copies only a split segment. */
+void test_output_splice_links_whole_segments(void) {
+  size_t len = OUTPUT_SEGMENT_SIZE + 10;
+  char* data = malloc(len);
+  char* copy = malloc(len);
+
+  for (size_t i = 0; i < len; i++) {
+    data[i] = (char)(i % 251);
+  }
+
+  output_buffer_t dest;
+  output_buffer_t src;
+  network_init_output_buffer(&dest, len);
+  network_init_output_buffer(&src, len);
+
+  network_output_buffer_append(&dest, "hdr", 3);
+  network_output_buffer_append(&src, data, len);
+
+  output_segment_t* segment = src.head;
+
+  TEST_ASSERT_EQUAL_INT(0, network_output_buffer_splice(&dest, &src, OUTPUT_SEGMENT_SIZE + 4));
+  TEST_ASSERT_EQUAL_PTR(segment, dest.head->next);
+  TEST_ASSERT_EQUAL_size_t(OUTPUT_SEGMENT_SIZE + 7, dest.length);
+  TEST_ASSERT_EQUAL_size_t(6, src.length);
+  TEST_ASSERT_EQUAL_PTR(src.head, src.tail);
+
+  TEST_ASSERT_EQUAL_size_t(3, network_output_buffer_copy(&dest, copy, 3));
+  TEST_ASSERT_EQUAL_MEMORY("hdr", copy, 3);
+  network_output_buffer_consume(&dest, 3);
+  TEST_ASSERT_EQUAL_size_t(OUTPUT_SEGMENT_SIZE + 4, network_output_buffer_copy(&dest, copy, len));
+  TEST_ASSERT_EQUAL_size_t(6, network_output_buffer_copy(&src, copy + OUTPUT_SEGMENT_SIZE + 4, len));
+  TEST_ASSERT_EQUAL_MEMORY(data, copy, len);
+
+  network_clear_output_buffer(&dest);
+  network_clear_output_buffer(&src);
+  free(data);
+  free(copy);
+}
+
+/* Splices which would take the destination past its limit are rejected and leave both untouched. */
+void test_output_splice_past_limit_fails(void) {
+  output_buffer_t dest;
+  output_buffer_t src;
+  network_init_output_buffer(&dest, 4);
+  network_init_output_buffer(&src, 64);
+
+  network_output_buffer_append(&src, "too long", 8);
+
+  TEST_ASSERT_EQUAL_INT(-1, network_output_buffer_splice(&dest, &src, 8));
+  TEST_ASSERT_EQUAL_size_t(0, dest.length);
+  TEST_ASSERT_EQUAL_size_t(8, src.length);
+
+  network_clear_output_buffer(&src);
+}
+
+/* Consuming the start of a buffer releases the segments it empties. */
+void test_output_consume_releases_segments(void) {
+  output_pool_t pool;
+  network_init_output_pool(&pool, OUTPUT_POOL_MAX_FREE);
+
+  output_buffer_t buffer;
+  network_init_output_buffer(&buffer, OUTPUT_SEGMENT_SIZE * 2);
+  buffer.pool = &pool;
+
+  char data[OUTPUT_SEGMENT_SIZE] = { 0 };
+  network_output_buffer_append(&buffer, data, sizeof(data));
+  network_output_buffer_append(&buffer, "abcdef", 6);
+
+  network_output_buffer_consume(&buffer, OUTPUT_SEGMENT_SIZE + 2);
+
+  TEST_ASSERT_EQUAL_size_t(1, pool.free_segments);
+  TEST_ASSERT_EQUAL_size_t(4, buffer.length);
+  TEST_ASSERT_EQUAL_PTR(buffer.head, buffer.tail);
+
+  char copy[8] = { 0 };
+  TEST_ASSERT_EQUAL_size_t(4, network_output_buffer_copy(&buffer, copy, sizeof(copy)));
+  TEST_ASSERT_EQUAL_STRING("cdef", copy);
+
+  network_clear_output_buffer(&buffer);
+  network_clear_output_pool(&pool);
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_output_init_is_empty);
+  RUN_TEST(test_output_append_then_copy);
+  RUN_TEST(test_output_append_spans_segments);
+  RUN_TEST(test_output_append_past_limit_fails);
+  RUN_TEST(test_output_clear_resets_buffer);
+  RUN_TEST(test_output_copy_truncates_to_destination);
+  RUN_TEST(test_output_bufs_point_at_segments);
+  RUN_TEST(test_output_pool_recycles_segments);
+  RUN_TEST(test_output_write_retains_segments);
+  RUN_TEST(test_output_pool_respects_max_free);
+  RUN_TEST(test_output_reserve_then_commit);
+  RUN_TEST(test_output_reserve_respects_limit);
+  RUN_TEST(test_output_move_replaces_contents);
+  RUN_TEST(test_output_splice_links_whole_segments);
+  RUN_TEST(test_output_splice_past_limit_fails);
+  RUN_TEST(test_output_consume_releases_segments);
+  return UNITY_END();
+}
@@ -0,0 +1,97 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "fff.h"
+#include "unity.h"
+
+#include "mud/network/protocol.h"
+
+DEFINE_FFF_GLOBALS;
+
+static protocol_pools_t pools;
+
+static protocol_object_header_t* header_of(void* object) {
+  return (protocol_object_header_t*)object - 1;
+}
+
+/* Objects allocated from pools are zeroed and reused once freed. */
+void test_protocol_alloc_pooled_reuses_objects(void) {
+  char* first = network_protocol_alloc(&pools, 48);
+
+  TEST_ASSERT_NOT_NULL(first);
+  TEST_ASSERT_NOT_NULL(header_of(first)->pool);
+
+  memset(first, 0xFF, 48);
+  network_protocol_free(first);
+
+  char* second = network_protocol_alloc(&pools, 48);
+
+  TEST_ASSERT_EQUAL_PTR(first, second);
+
+  for (size_t i = 0; i < 48; i++) {
+    TEST_ASSERT_EQUAL_CHAR(0, second[i]);
+  }
+
+  network_protocol_free(second);
+}
+
+/* Objects are allocated from the heap when no pools are given. */
+void test_protocol_alloc_without_pools_uses_heap(void) {
+  char* object = network_protocol_alloc(NULL, 48);
+
+  TEST_ASSERT_NOT_NULL(object);
+  TEST_ASSERT_NULL(header_of(object)->pool);
+  TEST_ASSERT_EQUAL_CHAR(0, object[47]);
+
+  network_protocol_free(object);
+}
+
+/* Once every class is in use objects of a new size come from the heap. */
+void test_protocol_alloc_falls_back_when_classes_run_out(void) {
+  void* objects[PROTOCOL_POOL_CLASSES];
+
+  for (size_t i = 0; i < PROTOCOL_POOL_CLASSES; i++) {
+    objects[i] = network_protocol_alloc(&pools, 16 * (i + 1));
+
+    TEST_ASSERT_NOT_NULL(header_of(objects[i])->pool);
+  }
+
+  void* extra = network_protocol_alloc(&pools, 16 * (PROTOCOL_POOL_CLASSES + 1));
+
+  TEST_ASSERT_NOT_NULL(extra);
+  TEST_ASSERT_NULL(header_of(extra)->pool);
+
+  network_protocol_free(extra);
+
+  for (size_t i = 0; i < PROTOCOL_POOL_CLASSES; i++) {
+    network_protocol_free(objects[i]);
+  }
+}
+
+/* A new protocol comes from the pools it's given. */
+void test_protocol_new_protocol_from_pools(void) {
+  protocol_t* protocol = network_new_protocol_t(&pools);
+
+  TEST_ASSERT_NOT_NULL(protocol);
+  TEST_ASSERT_NULL(protocol->next);
+  TEST_ASSERT_EQUAL_size_t(1, pool_used(header_of(protocol)->pool));
+
+  network_free_protocol_t(protocol);
+}
+
+void setUp(void) {
+  network_init_protocol_pools(&pools);
+}
+
+void tearDown(void) {
+  network_clear_protocol_pools(&pools);
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_protocol_alloc_pooled_reuses_objects);
+  RUN_TEST(test_protocol_alloc_without_pools_uses_heap);
+  RUN_TEST(test_protocol_alloc_falls_back_when_classes_run_out);
+  RUN_TEST(test_protocol_new_protocol_from_pools);
+  return UNITY_END();
+}
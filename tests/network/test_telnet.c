@@ -0,0 +1,335 @@
+#include <arpa/telnet.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fff.h"
+#include "unity.h"
+
+#include "mud/network/client.h"
+#include "mud/network/gmcp.h"
+#include "mud/network/output.h"
+#include "mud/network/protocol.h"
+#include "mud/network/telnet.h"
+
+DEFINE_FFF_GLOBALS;
+FAKE_VALUE_FUNC(int, send_to_client, client_t*, const char*, size_t);
+FAKE_VALUE_FUNC(int, send_essential_to_client, client_t*, const char*, size_t);
+
+static client_t client;
+static telnet_t* telnet = NULL;
+static telnet_extension_t extension;
+
+static int se_count = 0;
+static int se_option = 0;
+static char se_data[TELNET_BUFFER_SIZE * 2];
+static size_t se_len = 0;
+
+static void capture_se(void* ext, telnet_t* tel, client_t* cli, int option, const char* data, size_t len) {
+  (void)ext;
+  (void)tel;
+  (void)cli;
+
+  se_count++;
+  se_option = option;
+  se_len = len;
+  memcpy(se_data, data, len);
+}
+
+static char sent[16];
+static size_t sent_len = 0;
+
+static telnet_option_t first_state;
+static telnet_option_t second_state;
+static telnet_config_t test_config = { 201, false, true };
+
+static int capture_sent(client_t* cli, const char* data, size_t len) {
+  (void)cli;
+
+  memcpy(sent + sent_len, data, len);
+  sent_len += len;
+
+  return 0;
+}
+
+static telnet_option_t* first_option(void* ext, int option) {
+  (void)ext;
+
+  return option == 201 ? &first_state : NULL;
+}
+
+static telnet_option_t* second_option(void* ext, int option) {
+  (void)ext;
+
+  return option == 201 ? &second_state : NULL;
+}
+
+static telnet_config_t* option_config(void* ext, int option) {
+  (void)ext;
+
+  return option == 201 ? &test_config : NULL;
+}
+
+static int parse(char* input, size_t len) {
+  return network_telnet_on_input(&client, telnet, input, len, len);
+}
+
+/* Input without any telnet commands is left untouched. */
+void test_telnet_plain_input_unchanged(void) {
+  char input[] = "look north\r\n";
+
+  TEST_ASSERT_EQUAL_INT(12, parse(input, 12));
+  TEST_ASSERT_EQUAL_MEMORY("look north\r\n", input, 12);
+}
+
+/* Negotiations are stripped and the surrounding data closed up around them. */
+void test_telnet_strips_negotiation(void) {
+  char input[] = { 'a', 'b', (char)IAC, (char)WONT, (char)TELOPT_NAWS, 'c', 'd' };
+
+  TEST_ASSERT_EQUAL_INT(4, parse(input, sizeof(input)));
+  TEST_ASSERT_EQUAL_MEMORY("abcd", input, 4);
+}
+
+/* Several commands in one read are all stripped in a single pass. */
+void test_telnet_strips_many_commands(void) {
+  char input[300];
+  size_t len = 0;
+
+  for (int i = 0; i < 50; i++) {
+    input[len++] = (char)('a' + (i % 26));
+    input[len++] = (char)IAC;
+    input[len++] = (char)NOP;
+    input[len++] = (char)IAC;
+    input[len++] = (char)WONT;
+    input[len++] = (char)TELOPT_TTYPE;
+  }
+
+  TEST_ASSERT_EQUAL_INT(50, parse(input, len));
+
+  for (int i = 0; i < 50; i++) {
+    TEST_ASSERT_EQUAL_CHAR('a' + (i % 26), input[i]);
+  }
+}
+
+/* An escaped IAC becomes a single 255 data byte. */
+void test_telnet_unescapes_iac(void) {
+  char input[] = { 'x', (char)IAC, (char)IAC, 'y' };
+
+  TEST_ASSERT_EQUAL_INT(3, parse(input, sizeof(input)));
+  TEST_ASSERT_EQUAL_CHAR('x', input[0]);
+  TEST_ASSERT_EQUAL_CHAR((char)IAC, input[1]);
+  TEST_ASSERT_EQUAL_CHAR('y', input[2]);
+}
+
+/* A command split across reads is still recognised and stripped. */
+void test_telnet_command_spans_reads(void) {
+  char first[] = { 'a', (char)IAC };
+  char second[] = { (char)WONT, (char)TELOPT_NAWS, 'b' };
+
+  TEST_ASSERT_EQUAL_INT(1, parse(first, sizeof(first)));
+  TEST_ASSERT_EQUAL_CHAR('a', first[0]);
+  TEST_ASSERT_EQUAL_INT(1, parse(second, sizeof(second)));
+  TEST_ASSERT_EQUAL_CHAR('b', second[0]);
+}
+
+/* Subnegotiation payloads are handed to extensions and stripped from the input. */
+void test_telnet_subnegotiation_dispatched(void) {
+  char input[] = { 'x', (char)IAC, (char)SB, (char)TELOPT_GMCP, 'C', 'o', 'r', 'e', (char)IAC, (char)SE, 'y' };
+
+  TEST_ASSERT_EQUAL_INT(2, parse(input, sizeof(input)));
+  TEST_ASSERT_EQUAL_MEMORY("xy", input, 2);
+  TEST_ASSERT_EQUAL_INT(1, se_count);
+  TEST_ASSERT_EQUAL_INT(TELOPT_GMCP, se_option);
+  TEST_ASSERT_EQUAL_size_t(4, se_len);
+  TEST_ASSERT_EQUAL_MEMORY("Core", se_data, 4);
+}
+
+/* Escaped IACs within a subnegotiation payload are unescaped. */
+void test_telnet_subnegotiation_unescapes_iac(void) {
+  char input[] = { (char)IAC, (char)SB, (char)TELOPT_GMCP, 'a', (char)IAC, (char)IAC, 'b', (char)IAC, (char)SE };
+
+  TEST_ASSERT_EQUAL_INT(0, parse(input, sizeof(input)));
+  TEST_ASSERT_EQUAL_size_t(3, se_len);
+  TEST_ASSERT_EQUAL_CHAR('a', se_data[0]);
+  TEST_ASSERT_EQUAL_CHAR((char)IAC, se_data[1]);
+  TEST_ASSERT_EQUAL_CHAR('b', se_data[2]);
+}
+
+/* A subnegotiation split across reads is delivered whole once it completes. */
+void test_telnet_subnegotiation_spans_reads(void) {
+  char first[] = { 'a', (char)IAC, (char)SB, (char)TELOPT_GMCP, 'C', 'o' };
+  char second[] = { 'r', 'e', (char)IAC };
+  char third[] = { (char)SE, 'b' };
+
+  TEST_ASSERT_EQUAL_INT(1, parse(first, sizeof(first)));
+  TEST_ASSERT_EQUAL_INT(0, parse(second, sizeof(second)));
+  TEST_ASSERT_EQUAL_INT(0, se_count);
+  TEST_ASSERT_EQUAL_INT(1, parse(third, sizeof(third)));
+  TEST_ASSERT_EQUAL_CHAR('b', third[0]);
+  TEST_ASSERT_EQUAL_INT(1, se_count);
+  TEST_ASSERT_EQUAL_size_t(4, se_len);
+  TEST_ASSERT_EQUAL_MEMORY("Core", se_data, 4);
+}
+
+/* Buffered subnegotiations longer than the buffer are truncated rather than overflowing. */
+void test_telnet_subnegotiation_truncated(void) {
+  char first[] = { (char)IAC, (char)SB, (char)TELOPT_GMCP };
+  char payload[TELNET_BUFFER_SIZE + 100];
+  char last[] = { (char)IAC, (char)SE };
+
+  memset(payload, 'p', sizeof(payload));
+
+  parse(first, sizeof(first));
+  parse(payload, sizeof(payload));
+  parse(last, sizeof(last));
+
+  TEST_ASSERT_EQUAL_INT(1, se_count);
+  TEST_ASSERT_EQUAL_size_t(TELNET_BUFFER_SIZE - 1, se_len);
+}
+
+/* Options nothing supports are refused without consulting the extensions. */
+void test_telnet_unsupported_option_refused(void) {
+  const char wont[] = { (char)IAC, (char)WONT, (char)200 };
+  char input[] = { (char)IAC, (char)DO, (char)200 };
+
+  TEST_ASSERT_EQUAL_INT(0, parse(input, sizeof(input)));
+  TEST_ASSERT_EQUAL_size_t(sizeof(wont), sent_len);
+  TEST_ASSERT_EQUAL_MEMORY(wont, sent, sizeof(wont));
+}
+
+/* Options are resolved to the first extension registered which supports them. */
+void test_telnet_extension_options_indexed(void) {
+  static telnet_extension_t first;
+  static telnet_extension_t second;
+  const char will[] = { (char)IAC, (char)WILL, (char)201 };
+  char input[] = { (char)IAC, (char)DO, (char)201 };
+
+  memset(&first, 0, sizeof(first));
+  memset(&second, 0, sizeof(second));
+  memset(&first_state, 0, sizeof(first_state));
+  memset(&second_state, 0, sizeof(second_state));
+
+  first.get_option = first_option;
+  first.get_config = option_config;
+  second.get_option = second_option;
+  second.get_config = option_config;
+
+  network_register_telnet_extension(telnet, &first);
+  network_register_telnet_extension(telnet, &second);
+
+  TEST_ASSERT_EQUAL_INT(0, parse(input, sizeof(input)));
+  TEST_ASSERT_EQUAL_MEMORY(will, sent, sizeof(will));
+  TEST_ASSERT_EQUAL_INT(YES, first_state.us);
+  TEST_ASSERT_EQUAL_INT(NO, second_state.us);
+}
+
+static void flush_bytes(const char* data, size_t len) {
+  static output_segment_t segment;
+  output_buffer_t output = { 0 };
+
+  memcpy(segment.data, data, len);
+  segment.len = len;
+  segment.next = NULL;
+
+  output.head = &segment;
+  output.tail = &segment;
+  output.length = len;
+
+  network_telnet_on_flush(&client, telnet, &output);
+}
+
+/* Flushed output isn't parsed unless the client is being traced. */
+void test_telnet_flush_untraced_skips_output(void) {
+  char output[] = { 'a', (char)IAC };
+
+  flush_bytes(output, sizeof(output));
+
+  TEST_ASSERT_EQUAL_INT(READ_IAC, telnet->outgoing.state);
+}
+
+/* Flushed output is parsed while the client is being traced. */
+void test_telnet_flush_traced_parses_output(void) {
+  char output[] = { 'a', (char)IAC, (char)WILL };
+
+  client.trace = true;
+  flush_bytes(output, sizeof(output));
+
+  TEST_ASSERT_EQUAL_INT(READ_OP_VALUE, telnet->outgoing.state);
+  TEST_ASSERT_EQUAL_UINT(WILL, telnet->outgoing.op);
+}
+
+static int fail_encode(void* ext, telnet_t* tel, client_t* cli, output_buffer_t* output) {
+  return -1;
+}
+
+/* Once the encoder fails no more output is sent, encoded or not. */
+void test_telnet_encode_failure_discards_output(void) {
+  output_buffer_t input;
+  output_buffer_t output;
+
+  network_init_output_buffer(&input, SIZE_MAX);
+  network_init_output_buffer(&output, SIZE_MAX);
+
+  extension.extension = &extension;
+  extension.encode = fail_encode;
+  network_telnet_set_encoder(telnet, &extension);
+  telnet->suppress_go_ahead.us = YES;
+
+  network_output_buffer_append(&input, "hello\r\n", 7);
+
+  TEST_ASSERT_EQUAL_INT(-1, network_telnet_on_output(&client, telnet, &input, &output));
+  TEST_ASSERT_EQUAL_size_t(0, output.length);
+  TEST_ASSERT_NULL(output.head);
+
+  extension.encode = NULL;
+  network_telnet_set_encoder(telnet, NULL);
+  network_output_buffer_append(&input, "look\r\n", 6);
+
+  TEST_ASSERT_EQUAL_INT(-1, network_telnet_on_output(&client, telnet, &input, &output));
+  TEST_ASSERT_EQUAL_size_t(0, output.length);
+  TEST_ASSERT_EQUAL_size_t(0, input.length);
+}
+
+void setUp(void) {
+  RESET_FAKE(send_to_client);
+  RESET_FAKE(send_essential_to_client);
+
+  memset(&client, 0, sizeof(client));
+  memset(&extension, 0, sizeof(extension));
+
+  se_count = 0;
+  se_option = 0;
+  se_len = 0;
+  sent_len = 0;
+
+  send_essential_to_client_fake.custom_fake = capture_sent;
+
+  extension.subnegotiation = capture_se;
+
+  telnet = network_new_telnet_t(NULL);
+  telnet->extensions = &extension;
+}
+
+void tearDown(void) {
+  telnet->extensions = NULL;
+  network_free_telnet_t(telnet);
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_telnet_plain_input_unchanged);
+  RUN_TEST(test_telnet_strips_negotiation);
+  RUN_TEST(test_telnet_strips_many_commands);
+  RUN_TEST(test_telnet_unescapes_iac);
+  RUN_TEST(test_telnet_command_spans_reads);
+  RUN_TEST(test_telnet_subnegotiation_dispatched);
+  RUN_TEST(test_telnet_subnegotiation_unescapes_iac);
+  RUN_TEST(test_telnet_subnegotiation_spans_reads);
+  RUN_TEST(test_telnet_subnegotiation_truncated);
+  RUN_TEST(test_telnet_unsupported_option_refused);
+  RUN_TEST(test_telnet_extension_options_indexed);
+  RUN_TEST(test_telnet_flush_untraced_skips_output);
+  RUN_TEST(test_telnet_flush_traced_parses_output);
+  RUN_TEST(test_telnet_encode_failure_discards_output);
+  return UNITY_END();
+}
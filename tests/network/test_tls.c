@@ -0,0 +1,379 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+
+#include "fff.h"
+#include "unity.h"
+
+#include "mud/network/client.h"
+#include "mud/network/network.h"
+#include "mud/network/output.h"
+#include "mud/network/protocol.h"
+#include "mud/network/tls.h"
+
+DEFINE_FFF_GLOBALS;
+FAKE_VOID_FUNC(network_client_defer_output, client_t*);
+FAKE_VOID_FUNC(network_client_hang_up, client_t*);
+
+static char certificate_path[] = "/tmp/test_tls_cert_XXXXXX";
+static char key_path[] = "/tmp/test_tls_key_XXXXXX";
+
+static SSL_CTX* server_context = NULL;
+static SSL_CTX* client_context = NULL;
+
+static network_t network;
+static client_t client;
+static protocol_t* protocol = NULL;
+static tls_t* tls = NULL;
+
+static SSL* peer = NULL;
+static BIO* peer_input = NULL;
+static BIO* peer_output = NULL;
+
+static char received[1024];
+static size_t received_len = 0;
+static char peer_received[1024];
+static size_t peer_received_len = 0;
+
+static void defer_output(client_t* cli) {
+  cli->deferred = true;
+}
+
+static void hang_up(client_t* cli) {
+  cli->hungup = 1;
+  cli->deferred = true;
+}
+
+/* Writes a self-signed certificate for localhost and its key to temporary files. */
+static void create_certificate(void) {
+  EVP_PKEY* key = EVP_EC_gen("P-256");
+  X509* certificate = X509_new();
+
+  X509_set_version(certificate, 2);
+  ASN1_INTEGER_set(X509_get_serialNumber(certificate), 1);
+  X509_gmtime_adj(X509_getm_notBefore(certificate), 0);
+  X509_gmtime_adj(X509_getm_notAfter(certificate), 60 * 60);
+  X509_set_pubkey(certificate, key);
+
+  X509_NAME* name = X509_get_subject_name(certificate);
+  X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char*)"localhost", -1, -1, 0);
+  X509_set_issuer_name(certificate, name);
+  X509_sign(certificate, key, EVP_sha256());
+
+  FILE* file = fdopen(mkstemp(certificate_path), "w");
+  PEM_write_X509(file, certificate);
+  fclose(file);
+
+  file = fdopen(mkstemp(key_path), "w");
+  PEM_write_PrivateKey(file, key, NULL, NULL, 0, NULL, NULL);
+  fclose(file);
+
+  X509_free(certificate);
+  EVP_PKEY_free(key);
+}
+
+/* Connects a new peer which trusts the test certificate, optionally resuming a session. */
+static void connect_peer(SSL_SESSION* session) {
+  protocol = network_new_tls_protocol_t(NULL, server_context);
+  tls = protocol->data;
+  network_protocol_initialise(protocol, &client);
+
+  peer = SSL_new(client_context);
+  peer_input = BIO_new(BIO_s_mem());
+  peer_output = BIO_new(BIO_s_mem());
+  BIO_set_mem_eof_return(peer_input, -1);
+  BIO_set_mem_eof_return(peer_output, -1);
+  SSL_set_bio(peer, peer_input, peer_output);
+  SSL_set_connect_state(peer);
+  SSL_set1_host(peer, "localhost");
+
+  if (session != NULL) {
+    SSL_set_session(peer, session);
+  }
+}
+
+static void disconnect_peer(void) {
+  if (protocol != NULL) {
+    network_deallocate_protocol_chain(protocol);
+    protocol = NULL;
+  }
+
+  if (peer != NULL) {
+    SSL_set_shutdown(peer, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+    SSL_free(peer);
+    peer = NULL;
+  }
+}
+
+/* Shuttles ciphertext between the peer and the protocol until neither has more to say. */
+static void pump(void) {
+  for (int i = 0; i < 16; i++) {
+    char buffer[1024 * 32];
+    int progress = 0;
+
+    SSL_do_handshake(peer);
+
+    int len = 0;
+
+    while ((len = BIO_read(peer_output, buffer, sizeof(buffer))) > 0) {
+      int res = network_tls_on_input(&client, tls, buffer, (size_t)len, sizeof(buffer));
+
+      memcpy(received + received_len, buffer, (size_t)res);
+      received_len += (size_t)res;
+      progress = 1;
+    }
+
+    if (client.output.length > 0 || client.deferred) {
+      client.deferred = false;
+      network_protocol_on_output(protocol, &client, &client.output);
+
+      size_t out = network_output_buffer_copy(&client.output, buffer, sizeof(buffer));
+
+      BIO_write(peer_input, buffer, (int)out);
+      network_clear_output_buffer(&client.output);
+      progress = progress || out > 0;
+    }
+
+    while ((len = SSL_read(peer, peer_received + peer_received_len, (int)(sizeof(peer_received) - peer_received_len))) > 0) {
+      peer_received_len += (size_t)len;
+    }
+
+    if (!progress) {
+      break;
+    }
+  }
+}
+
+static void send_output(const char* data) {
+  network_output_buffer_append(&client.output, data, strlen(data));
+}
+
+/* The handshake completes and plaintext flows in both directions. */
+void test_tls_handshake_and_exchange(void) {
+  connect_peer(NULL);
+  pump();
+
+  TEST_ASSERT_TRUE(tls->established);
+  TEST_ASSERT_EQUAL_INT(1, SSL_is_init_finished(peer));
+  TEST_ASSERT_EQUAL_size_t(1, network.metrics.tls_handshakes);
+
+  SSL_write(peer, "look\r\n", 6);
+  send_output("You see a room.\r\n");
+  pump();
+
+  TEST_ASSERT_EQUAL_size_t(6, received_len);
+  TEST_ASSERT_EQUAL_MEMORY("look\r\n", received, 6);
+  TEST_ASSERT_EQUAL_size_t(17, peer_received_len);
+  TEST_ASSERT_EQUAL_MEMORY("You see a room.\r\n", peer_received, 17);
+}
+
+/* Output queued before the handshake completes is held back, never sent in the clear. */
+void test_tls_output_held_until_established(void) {
+  char output[64];
+
+  connect_peer(NULL);
+  send_output("Welcome!");
+
+  network_protocol_on_output(protocol, &client, &client.output);
+
+  TEST_ASSERT_EQUAL_size_t(0, client.output.length);
+  TEST_ASSERT_EQUAL_size_t(8, tls->pending.length);
+
+  pump();
+
+  TEST_ASSERT_EQUAL_size_t(0, tls->pending.length);
+  TEST_ASSERT_EQUAL_size_t(8, peer_received_len);
+  TEST_ASSERT_EQUAL_MEMORY("Welcome!", peer_received, 8);
+  TEST_ASSERT_EQUAL_size_t(0, network_output_buffer_copy(&client.output, output, sizeof(output)));
+}
+
+/* Output larger than a record is split across records and arrives intact. */
+void test_tls_output_spans_records(void) {
+  static char large[TLS_RECORD_SIZE + 100];
+  static char seen[TLS_RECORD_SIZE + 100];
+  size_t seen_len = 0;
+
+  connect_peer(NULL);
+  pump();
+
+  memset(large, 'x', sizeof(large));
+  network_output_buffer_append(&client.output, large, sizeof(large));
+  network_protocol_on_output(protocol, &client, &client.output);
+
+  char buffer[1024 * 32];
+  size_t out = network_output_buffer_copy(&client.output, buffer, sizeof(buffer));
+  BIO_write(peer_input, buffer, (int)out);
+  network_clear_output_buffer(&client.output);
+
+  int len = 0;
+
+  while ((len = SSL_read(peer, seen + seen_len, (int)(sizeof(seen) - seen_len))) > 0) {
+    seen_len += (size_t)len;
+  }
+
+  TEST_ASSERT_EQUAL_size_t(sizeof(large), seen_len);
+  TEST_ASSERT_EQUAL_MEMORY(large, seen, sizeof(large));
+}
+
+/* A client reconnecting with the session from its last connection resumes it. */
+static void assert_session_resumed(void) {
+  connect_peer(NULL);
+  pump();
+
+  SSL_SESSION* session = SSL_get1_session(peer);
+
+  TEST_ASSERT_NOT_NULL(session);
+  TEST_ASSERT_EQUAL_INT(0, SSL_session_reused(tls->ssl));
+
+  disconnect_peer();
+  connect_peer(session);
+  pump();
+
+  TEST_ASSERT_TRUE(tls->established);
+  TEST_ASSERT_EQUAL_INT(1, SSL_session_reused(tls->ssl));
+  TEST_ASSERT_EQUAL_INT(1, SSL_session_reused(peer));
+  TEST_ASSERT_EQUAL_size_t(2, network.metrics.tls_handshakes);
+  TEST_ASSERT_EQUAL_size_t(1, network.metrics.tls_resumptions);
+
+  SSL_SESSION_free(session);
+}
+
+void test_tls_session_resumed(void) {
+  assert_session_resumed();
+}
+
+void test_tls_session_resumed_tls12(void) {
+  SSL_CTX_set_max_proto_version(client_context, TLS1_2_VERSION);
+
+  assert_session_resumed();
+
+  SSL_CTX_set_max_proto_version(client_context, 0);
+}
+
+/* Plaintext which doesn't fit is held by OpenSSL and read once there's space. */
+void test_tls_holds_plaintext_which_does_not_fit(void) {
+  char buffer[1024];
+
+  connect_peer(NULL);
+  pump();
+
+  SSL_write(peer, "north\r\n", 7);
+  SSL_write(peer, "south\r\n", 7);
+
+  int len = BIO_read(peer_output, buffer, sizeof(buffer));
+  int res = network_tls_on_input(&client, tls, buffer, (size_t)len, 10);
+
+  TEST_ASSERT_EQUAL_INT(10, res);
+  TEST_ASSERT_TRUE(client.input_held);
+  TEST_ASSERT_EQUAL_MEMORY("north\r\nsou", buffer, 10);
+
+  client.input_held = false;
+  res = network_tls_on_input(&client, tls, buffer, 0, sizeof(buffer));
+
+  TEST_ASSERT_EQUAL_INT(4, res);
+  TEST_ASSERT_FALSE(client.input_held);
+  TEST_ASSERT_EQUAL_MEMORY("th\r\n", buffer, 4);
+}
+
+/* Input which isn't TLS fails the connection. */
+void test_tls_garbage_fails(void) {
+  char input[] = "GET / HTTP/1.1\r\n\r\n";
+
+  connect_peer(NULL);
+
+  TEST_ASSERT_EQUAL_INT(0, network_tls_on_input(&client, tls, input, sizeof(input) - 1, sizeof(input)));
+  TEST_ASSERT_TRUE(tls->failed);
+  TEST_ASSERT_EQUAL_UINT(1, network_client_hang_up_fake.call_count);
+
+  send_output("secret");
+  network_protocol_on_output(protocol, &client, &client.output);
+
+  char output[64];
+  size_t out = network_output_buffer_copy(&client.output, output, sizeof(output));
+
+  for (size_t i = 0; i + 6 <= out; i++) {
+    TEST_ASSERT_NOT_EQUAL(0, memcmp(output + i, "secret", 6));
+  }
+}
+
+/* A client hung up by the game is sent a close_notify after its last output. */
+void test_tls_hang_up_sends_close_notify(void) {
+  connect_peer(NULL);
+  pump();
+
+  send_output("Goodbye.");
+  client.hungup = 1;
+  pump();
+
+  TEST_ASSERT_EQUAL_size_t(8, peer_received_len);
+  TEST_ASSERT_EQUAL_INT(SSL_RECEIVED_SHUTDOWN, SSL_get_shutdown(peer) & SSL_RECEIVED_SHUTDOWN);
+}
+
+/* A close_notify from the client hangs it up. */
+void test_tls_close_notify_hangs_up(void) {
+  connect_peer(NULL);
+  pump();
+
+  SSL_shutdown(peer);
+  pump();
+
+  TEST_ASSERT_EQUAL_UINT(1, network_client_hang_up_fake.call_count);
+  TEST_ASSERT_FALSE(tls->failed);
+}
+
+void setUp(void) {
+  RESET_FAKE(network_client_defer_output);
+  RESET_FAKE(network_client_hang_up);
+
+  network_client_defer_output_fake.custom_fake = defer_output;
+  network_client_hang_up_fake.custom_fake = hang_up;
+
+  memset(&network, 0, sizeof(network));
+  memset(&client, 0, sizeof(client));
+  network_init_output_buffer(&client.output, 1024 * 64);
+  client.fd = 1;
+  client.network = &network;
+
+  received_len = 0;
+  peer_received_len = 0;
+}
+
+void tearDown(void) {
+  disconnect_peer();
+  network_clear_output_buffer(&client.output);
+}
+
+int main(void) {
+  create_certificate();
+
+  server_context = network_new_tls_context(certificate_path, key_path);
+  client_context = SSL_CTX_new(TLS_client_method());
+  SSL_CTX_load_verify_locations(client_context, certificate_path, NULL);
+  SSL_CTX_set_verify(client_context, SSL_VERIFY_PEER, NULL);
+  SSL_CTX_set_session_cache_mode(client_context, SSL_SESS_CACHE_CLIENT);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_tls_handshake_and_exchange);
+  RUN_TEST(test_tls_output_held_until_established);
+  RUN_TEST(test_tls_output_spans_records);
+  RUN_TEST(test_tls_session_resumed);
+  RUN_TEST(test_tls_session_resumed_tls12);
+  RUN_TEST(test_tls_holds_plaintext_which_does_not_fit);
+  RUN_TEST(test_tls_garbage_fails);
+  RUN_TEST(test_tls_hang_up_sends_close_notify);
+  RUN_TEST(test_tls_close_notify_hangs_up);
+  int res = UNITY_END();
+
+  SSL_CTX_free(client_context);
+  network_free_tls_context(server_context);
+  unlink(certificate_path);
+  unlink(key_path);
+
+  return res;
+}
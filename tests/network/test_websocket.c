@@ -0,0 +1,395 @@
+#include <arpa/telnet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fff.h"
+#include "fixture.h"
+#include "unity.h"
+
+#include "mud/network/client.h"
+#include "mud/network/gmcp.h"
+#include "mud/network/output.h"
+#include "mud/network/protocol.h"
+#include "mud/network/telnet.h"
+#include "mud/network/websocket.h"
+
+DEFINE_FFF_GLOBALS;
+FAKE_VALUE_FUNC(telnet_t*, network_client_get_telnet, client_t*);
+FAKE_VOID_FUNC(network_client_defer_output, client_t*);
+FAKE_VOID_FUNC(network_client_hang_up, client_t*);
+
+#define REQUEST "GET /mud HTTP/1.1\r\nHost: localhost\r\nUpgrade: websocket\r\nConnection: keep-alive, Upgrade\r\n" \
+  "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n"
+#define GMCP_REQUEST REQUEST "Sec-WebSocket-Protocol: chat, gmcp.mudstandards.org\r\n"
+
+static protocol_t* websocket_protocol = NULL;
+static protocol_t* telnet_protocol = NULL;
+static websocket_t* websocket = NULL;
+static gmcp_t* gmcp = NULL;
+static int opened = 0;
+static char gmcp_received[64];
+
+static const unsigned char mask[4] = { 0x37, 0xfa, 0x21, 0x3d };
+
+static void on_gmcp(client_t* cli, void* context, const char* topic, const char* message) {
+  (void)cli;
+  (void)context;
+
+  snprintf(gmcp_received, sizeof(gmcp_received), "%s|%s", topic, message ? message : "");
+}
+
+/* Links telnet in after the WebSocket as the game does once a client connects. */
+static void on_open(client_t* cli, void* context) {
+  (void)context;
+
+  telnet_extension_t* extension = network_new_gmcp_telnet_extension(NULL, cli, on_gmcp);
+
+  gmcp = extension->extension;
+  telnet_protocol = network_new_telnet_protocol_t(NULL);
+  telnet = telnet_protocol->data;
+  network_register_telnet_extension(telnet, extension);
+  network_client_get_telnet_fake.return_val = telnet;
+
+  websocket_protocol->next = telnet_protocol;
+  network_protocol_initialise(telnet_protocol, cli);
+
+  opened++;
+}
+
+static int read_input(char* input, size_t len, size_t size) {
+  return network_protocol_on_input(websocket_protocol, &client, input, len, size);
+}
+
+/* Builds a masked frame as a browser would send it. */
+static size_t client_frame(char* dest, unsigned char first, const char* payload, size_t len) {
+  size_t pos = 0;
+
+  dest[pos++] = (char)first;
+
+  if (len < 126) {
+    dest[pos++] = (char)(0x80 | len);
+  } else {
+    dest[pos++] = (char)(0x80 | 126);
+    dest[pos++] = (char)(len >> 8);
+    dest[pos++] = (char)(len & 0xFF);
+  }
+
+  memcpy(dest + pos, mask, sizeof(mask));
+  pos += sizeof(mask);
+
+  for (size_t i = 0; i < len; i++) {
+    dest[pos++] = (char)(payload[i] ^ mask[i & 3]);
+  }
+
+  return pos;
+}
+
+static void open_connection(const char* request) {
+  char input[1024];
+  char output[1024];
+  size_t len = (size_t)snprintf(input, sizeof(input), "%s\r\n", request);
+
+  TEST_ASSERT_EQUAL_INT(0, read_input(input, len, sizeof(input)));
+  TEST_ASSERT_EQUAL_INT(1, opened);
+
+  // Answers the negotiation telnet starts with and discards the handshake response
+  flush_output(output, sizeof(output));
+}
+
+/* The handshake is answered with the accept key from RFC 6455 and opens the connection. */
+void test_websocket_handshake_accepted(void) {
+  const char accept[] = "Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n";
+  char input[512];
+  char output[512];
+  size_t len = (size_t)snprintf(input, sizeof(input), "%s\r\n", REQUEST);
+
+  TEST_ASSERT_EQUAL_INT(0, read_input(input, len, sizeof(input)));
+  TEST_ASSERT_EQUAL_INT(WEBSOCKET_OPEN, websocket->state);
+  TEST_ASSERT_EQUAL_INT(1, opened);
+
+  size_t out = flush_output(output, sizeof(output) - 1);
+  output[out] = '\0';
+
+  TEST_ASSERT_EQUAL_INT(0, strncmp(output, "HTTP/1.1 101 Switching Protocols\r\n", 34));
+  TEST_ASSERT_NOT_NULL(strstr(output, accept));
+  TEST_ASSERT_NULL(strstr(output, "Sec-WebSocket-Protocol"));
+}
+
+/* A request split across reads is collected and a frame following it is decoded. */
+void test_websocket_handshake_split(void) {
+  char input[512];
+  size_t len = (size_t)snprintf(input, sizeof(input), "%s", REQUEST);
+
+  TEST_ASSERT_EQUAL_INT(0, read_input(input, len, sizeof(input)));
+  TEST_ASSERT_EQUAL_INT(0, opened);
+
+  len = (size_t)snprintf(input, sizeof(input), "\r\n");
+  len += client_frame(input + len, 0x81, "look", 4);
+
+  TEST_ASSERT_EQUAL_INT(6, read_input(input, len, sizeof(input)));
+  TEST_ASSERT_EQUAL_MEMORY("look\r\n", input, 6);
+  TEST_ASSERT_EQUAL_INT(1, opened);
+}
+
+/* A request which isn't an upgrade is refused and the client disconnected. */
+void test_websocket_handshake_rejected(void) {
+  char input[] = "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n";
+  char output[256];
+
+  TEST_ASSERT_EQUAL_INT(0, read_input(input, sizeof(input) - 1, sizeof(input)));
+  TEST_ASSERT_EQUAL_INT(WEBSOCKET_CLOSED, websocket->state);
+  TEST_ASSERT_EQUAL_INT(0, opened);
+  TEST_ASSERT_EQUAL_UINT(1, network_client_hang_up_fake.call_count);
+
+  size_t out = flush_output(output, sizeof(output));
+
+  TEST_ASSERT_EQUAL_INT(0, strncmp(output, "HTTP/1.1 400 Bad Request\r\n", out < 26 ? out : 26));
+}
+
+/* Frames split across reads are unmasked in place, fragments joining into one line. */
+void test_websocket_frames_split_across_reads(void) {
+  char frames[64];
+  char input[64];
+
+  open_connection(REQUEST);
+
+  size_t len = client_frame(frames, 0x01, "lo", 2);
+  len += client_frame(frames + len, 0x80, "ok\r\n", 4);
+
+  memcpy(input, frames, 3);
+  TEST_ASSERT_EQUAL_INT(0, read_input(input, 3, sizeof(input)));
+
+  memcpy(input, frames + 3, 6);
+  TEST_ASSERT_EQUAL_INT(2, read_input(input, 6, sizeof(input)));
+  TEST_ASSERT_EQUAL_MEMORY("lo", input, 2);
+
+  memcpy(input, frames + 9, len - 9);
+  TEST_ASSERT_EQUAL_INT(4, read_input(input, len - 9, sizeof(input)));
+  TEST_ASSERT_EQUAL_MEMORY("ok\r\n", input, 4);
+}
+
+/* Several short messages in one read each end up on their own CRLF terminated line. */
+void test_websocket_messages_become_lines(void) {
+  char input[64];
+
+  open_connection(REQUEST);
+
+  size_t len = client_frame(input, 0x81, "n", 1);
+  len += client_frame(input + len, 0x81, "s\n", 2);
+
+  TEST_ASSERT_EQUAL_INT(6, read_input(input, len, sizeof(input)));
+  TEST_ASSERT_EQUAL_MEMORY("n\r\ns\r\n", input, 6);
+}
+
+/* A final frame read on its own after an LF ending was passed on adds a CRLF without backing up. */
+void test_websocket_final_frame_after_line_feed(void) {
+  char frames[64];
+  char buffer[65];
+  char* input = buffer + 1;
+
+  open_connection(REQUEST);
+
+  size_t first = client_frame(frames, 0x01, "look\n", 5);
+  size_t len = first + client_frame(frames + first, 0x80, "", 0);
+
+  buffer[0] = 'x';
+  memcpy(input, frames, first);
+  TEST_ASSERT_EQUAL_INT(5, read_input(input, first, sizeof(buffer) - 1));
+  TEST_ASSERT_EQUAL_MEMORY("look\n", input, 5);
+
+  memcpy(input, frames + first, len - first);
+  TEST_ASSERT_EQUAL_INT(2, read_input(input, len - first, sizeof(buffer) - 1));
+  TEST_ASSERT_EQUAL_MEMORY("\r\n", input, 2);
+  TEST_ASSERT_EQUAL_CHAR('x', buffer[0]);
+}
+
+/* Telnet output is sent as a text frame with escaping and commands removed. */
+void test_websocket_output_framed(void) {
+  const char text[] = { 'H', 'i', (char)IAC, (char)IAC, '!', (char)IAC, (char)GA };
+  const char expected[] = { (char)0x81, 4, 'H', 'i', (char)IAC, '!' };
+  char output[64];
+
+  open_connection(REQUEST);
+  append_output(&client, text, sizeof(text));
+
+  TEST_ASSERT_EQUAL_size_t(sizeof(expected), flush_output(output, sizeof(output)));
+  TEST_ASSERT_EQUAL_MEMORY(expected, output, sizeof(expected));
+}
+
+/* Long output is framed with an extended length. */
+void test_websocket_output_extended_length(void) {
+  char text[300];
+  char output[512];
+
+  open_connection(REQUEST);
+  memset(text, 'x', sizeof(text));
+  append_output(&client, text, sizeof(text));
+
+  TEST_ASSERT_EQUAL_size_t(sizeof(text) + 4, flush_output(output, sizeof(output)));
+  TEST_ASSERT_EQUAL_HEX8(0x81, (unsigned char)output[0]);
+  TEST_ASSERT_EQUAL_HEX8(126, (unsigned char)output[1]);
+  TEST_ASSERT_EQUAL_UINT(sizeof(text), ((unsigned char)output[2] << 8) | (unsigned char)output[3]);
+}
+
+/* Whole segments of game output are moved into the frame rather than being copied. */
+void test_websocket_output_segments_not_copied(void) {
+  static char text[OUTPUT_SEGMENT_SIZE * 2];
+  static char output[OUTPUT_SEGMENT_SIZE * 3];
+
+  open_connection(REQUEST);
+  memset(text, 'x', sizeof(text));
+  append_output(&client, text, sizeof(text));
+
+  output_segment_t* first = client.output.head;
+  output_segment_t* second = first->next;
+
+  network_protocol_chain_on_output(&client, &client.output);
+
+  TEST_ASSERT_EQUAL_PTR(first, client.output.head->next);
+  TEST_ASSERT_EQUAL_PTR(second, first->next);
+  TEST_ASSERT_EQUAL_size_t(sizeof(text) + 4, take_output(output, sizeof(output)));
+  TEST_ASSERT_EQUAL_HEX8(126, (unsigned char)output[1]);
+  TEST_ASSERT_EQUAL_MEMORY(text, output + 4, sizeof(text));
+}
+
+/* With the GMCP sub-protocol, GMCP is enabled for the client and sent as text frames. */
+void test_websocket_gmcp_output(void) {
+  const char expected[] = "\x82\x04text" "\x81\x09" "Core.Ping";
+  char output[64];
+
+  open_connection(GMCP_REQUEST);
+
+  TEST_ASSERT_TRUE(websocket->gmcp);
+  TEST_ASSERT_EQUAL_INT(YES, gmcp->gmcp.us);
+
+  append_output(&client, "text", 4);
+  network_send_gmcp_message(&client, "Core.Ping", 9, NULL, 0);
+
+  TEST_ASSERT_EQUAL_size_t(sizeof(expected) - 1, flush_output(output, sizeof(output)));
+  TEST_ASSERT_EQUAL_MEMORY(expected, output, sizeof(expected) - 1);
+}
+
+/* With the GMCP sub-protocol, text frames from the client are GMCP messages. */
+void test_websocket_gmcp_input(void) {
+  const char message[] = "Core.Hello {\"client\":\"web\"}";
+  char input[128];
+
+  open_connection(GMCP_REQUEST);
+
+  size_t len = client_frame(input, 0x81, message, sizeof(message) - 1);
+  len += client_frame(input + len, 0x82, "look", 4);
+
+  TEST_ASSERT_EQUAL_INT(6, network_protocol_chain_on_input(&client, input, len, sizeof(input)));
+  TEST_ASSERT_EQUAL_STRING("Core.Hello|{\"client\":\"web\"}", gmcp_received);
+}
+
+/* A ping is answered with a pong carrying the same payload. */
+void test_websocket_ping_answered(void) {
+  const char expected[] = { (char)0x8A, 2, 'h', 'i' };
+  char input[32];
+  char output[32];
+
+  open_connection(REQUEST);
+
+  size_t len = client_frame(input, 0x89, "hi", 2);
+
+  TEST_ASSERT_EQUAL_INT(0, read_input(input, len, sizeof(input)));
+  TEST_ASSERT_EQUAL_UINT(1, network_client_defer_output_fake.call_count);
+
+  TEST_ASSERT_EQUAL_size_t(sizeof(expected), flush_output(output, sizeof(output)));
+  TEST_ASSERT_EQUAL_MEMORY(expected, output, sizeof(expected));
+}
+
+/* A close from the client is echoed and the client disconnected. */
+void test_websocket_close_echoed(void) {
+  const char code[] = { 0x03, (char)0xE8 };
+  const char expected[] = { (char)0x88, 2, 0x03, (char)0xE8 };
+  char input[32];
+  char output[32];
+
+  open_connection(REQUEST);
+
+  size_t len = client_frame(input, 0x88, code, sizeof(code));
+
+  TEST_ASSERT_EQUAL_INT(0, read_input(input, len, sizeof(input)));
+  TEST_ASSERT_EQUAL_UINT(1, network_client_hang_up_fake.call_count);
+
+  append_output(&client, "bye", 3);
+
+  TEST_ASSERT_EQUAL_size_t(sizeof(expected), flush_output(output, sizeof(output)));
+  TEST_ASSERT_EQUAL_MEMORY(expected, output, sizeof(expected));
+}
+
+/* A client hung up by the game is sent a close frame after its last output. */
+void test_websocket_hang_up_closes(void) {
+  const char expected[] = { (char)0x81, 3, 'b', 'y', 'e', (char)0x88, 2, 0x03, (char)0xE8 };
+  char output[32];
+
+  open_connection(REQUEST);
+
+  append_output(&client, "bye", 3);
+  client.hungup = 1;
+
+  TEST_ASSERT_EQUAL_size_t(sizeof(expected), flush_output(output, sizeof(output)));
+  TEST_ASSERT_EQUAL_MEMORY(expected, output, sizeof(expected));
+}
+
+/* An unmasked frame fails the connection with a protocol error. */
+void test_websocket_unmasked_frame_fails(void) {
+  char input[] = { (char)0x81, 4, 'l', 'o', 'o', 'k' };
+  const char expected[] = { (char)0x88, 2, 0x03, (char)0xEA };
+  char output[32];
+
+  open_connection(REQUEST);
+
+  TEST_ASSERT_EQUAL_INT(0, read_input(input, sizeof(input), sizeof(input)));
+  TEST_ASSERT_EQUAL_INT(WEBSOCKET_CLOSED, websocket->state);
+  TEST_ASSERT_EQUAL_UINT(1, network_client_hang_up_fake.call_count);
+
+  TEST_ASSERT_EQUAL_size_t(sizeof(expected), flush_output(output, sizeof(output)));
+  TEST_ASSERT_EQUAL_MEMORY(expected, output, sizeof(expected));
+}
+
+void setUp(void) {
+  RESET_FAKE(network_client_get_telnet);
+  RESET_FAKE(network_client_defer_output);
+  RESET_FAKE(network_client_hang_up);
+
+  fixture_set_up();
+  client.fd = 1;
+
+  opened = 0;
+  gmcp_received[0] = '\0';
+  telnet_protocol = NULL;
+
+  websocket_protocol = network_new_websocket_protocol_t(NULL, on_open, NULL);
+  websocket = websocket_protocol->data;
+  client.protocol = websocket_protocol;
+  network_protocol_initialise(websocket_protocol, &client);
+}
+
+void tearDown(void) {
+  network_deallocate_protocol_chain(client.protocol);
+  fixture_tear_down();
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_websocket_handshake_accepted);
+  RUN_TEST(test_websocket_handshake_split);
+  RUN_TEST(test_websocket_handshake_rejected);
+  RUN_TEST(test_websocket_frames_split_across_reads);
+  RUN_TEST(test_websocket_messages_become_lines);
+  RUN_TEST(test_websocket_final_frame_after_line_feed);
+  RUN_TEST(test_websocket_output_framed);
+  RUN_TEST(test_websocket_output_extended_length);
+  RUN_TEST(test_websocket_output_segments_not_copied);
+  RUN_TEST(test_websocket_gmcp_output);
+  RUN_TEST(test_websocket_gmcp_input);
+  RUN_TEST(test_websocket_ping_answered);
+  RUN_TEST(test_websocket_close_echoed);
+  RUN_TEST(test_websocket_hang_up_closes);
+  RUN_TEST(test_websocket_unmasked_frame_fails);
+  return UNITY_END();
+}
@@ -0,0 +1,311 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fff.h"
+#include "unity.h"
+
+#include "mud/config.h"
+#include "mud/data/hash_table.h"
+#include "mud/data/linked_list.h"
+#include "mud/db.h"
+#include "mud/event.h"
+#include "mud/game.h"
+#include "mud/lua/hooks.h"
+#include "mud/lua/script.h"
+#include "mud/network/client.h"
+#include "mud/network/gmcp.h"
+#include "mud/network/mssp.h"
+#include "mud/network/network.h"
+#include "mud/network/output.h"
+#include "mud/network/protocol.h"
+#include "mud/network/telnet.h"
+#include "mud/player.h"
+#include "mud/util/mudhash.h"
+#include "mud/util/muduuid.h"
+
+DEFINE_FFF_GLOBALS;
+FAKE_VALUE_FUNC(mud_uuid_t, new_uuid);
+FAKE_VALUE_FUNC(const char*, uuid_str, const mud_uuid_t*);
+FAKE_VALUE_FUNC(int, extract_from_input, client_t*, char*, size_t, const char*);
+FAKE_VALUE_FUNC(int, lua_call_player_input_hook, lua_State*, player_t*, const char*);
+FAKE_VALUE_FUNC(int, lua_call_state_input_hook, lua_State*, player_t*, lua_ref_t*, const char*);
+FAKE_VALUE_FUNC(int, lua_call_player_connected_hook, lua_State*, player_t*);
+FAKE_VALUE_FUNC(int, lua_call_player_disconnected_hook, lua_State*, player_t*);
+FAKE_VALUE_FUNC(int, lua_call_narrate_event_hook, lua_State*, player_t*, lua_ref_t*, lua_ref_t*);
+FAKE_VALUE_FUNC(int, lua_call_state_enter_hook, lua_State*, player_t*, lua_ref_t*);
+FAKE_VALUE_FUNC(int, lua_call_state_exit_hook, lua_State*, player_t*, lua_ref_t*);
+FAKE_VALUE_FUNC(int, lua_call_state_event_hook, lua_State*, player_t*, lua_ref_t*, event_t*);
+FAKE_VALUE_FUNC(int, lua_call_state_gmcp_hook, lua_State*, player_t*, lua_ref_t*, const char*, const char*);
+FAKE_VALUE_FUNC(int, lua_call_state_output_hook, lua_State*, player_t*, lua_ref_t*, const output_buffer_t*);
+FAKE_VALUE_FUNC(int, db_user_authenticate, sqlite3*, const char*, const char*);
+FAKE_VALUE_FUNC(int, db_user_load_by_username, sqlite3*, const char*, player_t*);
+FAKE_VOID_FUNC(mudhash_sha256, const char*, char*);
+FAKE_VALUE_FUNC(int, script_run_command_script, game_t*, const char*, player_t*, const char*);
+FAKE_VALUE_FUNC(int, send_to_client, client_t*, const char*, size_t);
+FAKE_VALUE_FUNC(int, network_add_client_protocol, client_t*, protocol_t*);
+FAKE_VOID_FUNC(network_client_authenticated, client_t*);
+FAKE_VALUE_FUNC(telnet_t*, network_client_get_telnet, client_t*);
+FAKE_VOID_FUNC(network_client_hang_up, client_t*);
+FAKE_VALUE_FUNC(bool, network_client_has_protocol, client_t*, protocol_type_t);
+FAKE_VOID_FUNC(network_client_set_trace, client_t*, bool);
+FAKE_VALUE_FUNC(protocol_t*, network_new_telnet_protocol_t, protocol_pools_t*);
+FAKE_VALUE_FUNC(telnet_extension_t*, network_new_charset_telnet_extension, protocol_pools_t*);
+FAKE_VALUE_FUNC(telnet_extension_t*, network_new_gmcp_telnet_extension, protocol_pools_t*, void*, on_gmcp_func_t);
+FAKE_VALUE_FUNC(telnet_extension_t*, network_new_mccp_telnet_extension, protocol_pools_t*, int, bool);
+FAKE_VALUE_FUNC(telnet_extension_t*, network_new_mssp_telnet_extension, protocol_pools_t*, void*, on_mssp_func_t);
+FAKE_VALUE_FUNC(telnet_extension_t*, network_new_naws_telnet_extension, protocol_pools_t*);
+FAKE_VALUE_FUNC(telnet_extension_t*, network_new_ttype_telnet_extension, protocol_pools_t*);
+FAKE_VOID_FUNC(network_register_telnet_extension, telnet_t*, telnet_extension_t*);
+FAKE_VALUE_FUNC(int, network_send_gmcp_message, client_t*, const char*, size_t, const char*, size_t);
+FAKE_VALUE_FUNC(int, network_send_coalesced_gmcp_message, client_t*, const char*, size_t, const char*, size_t);
+FAKE_VOID_FUNC(network_send_mssp, client_t*, const char* const*, const char* const*, size_t);
+FAKE_VALUE_FUNC(int, network_telnet_send_will, telnet_t*, client_t*, int);
+FAKE_VALUE_FUNC(int, network_telnet_send_wont, telnet_t*, client_t*, int);
+FAKE_VALUE_FUNC(client_t*, network_get_client, network_t*, pool_id_t);
+
+#define MAX_EXECUTED 512
+
+static game_t game;
+static config_t config;
+static network_t network;
+
+static const char* input[MAX_EXECUTED];
+static size_t input_count = 0;
+static size_t input_read = 0;
+
+static player_t* executed[MAX_EXECUTED];
+static size_t executed_count = 0;
+
+static const char* fake_uuid_str(const mud_uuid_t* uuid) {
+  return "player";
+}
+
+static int fake_extract(client_t* client, char* dest, size_t dest_len, const char* delim) {
+  if (input_read == input_count) {
+    return -1;
+  }
+
+  strncpy(dest, input[input_read++], dest_len - 1);
+  dest[dest_len - 1] = '\0';
+
+  return 0;
+}
+
+static int record_input(lua_State* l, player_t* player, const char* command) {
+  if (executed_count < MAX_EXECUTED) {
+    executed[executed_count++] = player;
+  }
+
+  return 0;
+}
+
+static char mssp_players[32];
+
+static void record_mssp(client_t* client, const char* const* names, const char* const* values, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    if (strcmp(names[i], "PLAYERS") == 0) {
+      snprintf(mssp_players, sizeof(mssp_players), "%s", values[i]);
+    }
+  }
+}
+
+typedef struct test_player {
+  client_t client;
+  player_t* player;
+} test_player_t;
+
+static void connect_player(test_player_t* test) {
+  memset(&test->client, 0, sizeof(test->client));
+
+  test->player = create_player_t();
+  test->player->client = test->client.id;
+  test->player->command_tokens = config.command_burst;
+  test->player->command_tokens_tick = game.tick;
+  test->client.userdata = test->player;
+}
+
+/**
+ * Sends the same command from a player the given number of times in a single read.
+**/
+static void send_commands(test_player_t* test, size_t count) {
+  input_count = 0;
+  input_read = 0;
+
+  for (size_t i = 0; i < count && i < MAX_EXECUTED; i++) {
+    input[input_count++] = "look";
+  }
+
+  player_input(&test->client, &game);
+}
+
+/* Tokens refill for each tick passed but never beyond the burst. */
+void test_player_command_tokens_refill_up_to_burst(void) {
+  test_player_t a;
+  connect_player(&a);
+
+  send_commands(&a, 5);
+
+  TEST_ASSERT_EQUAL_size_t(3, executed_count);
+  TEST_ASSERT_EQUAL_UINT(2, a.player->queued_commands);
+  TEST_ASSERT_TRUE(a.player->backlogged);
+
+  game.tick += 10;
+  player_drain_commands(&game);
+
+  TEST_ASSERT_EQUAL_size_t(5, executed_count);
+  TEST_ASSERT_EQUAL_UINT(1, a.player->command_tokens);
+
+  free_player_t(a.player);
+}
+
+/* Commands beyond the queue limit are discarded. */
+void test_player_command_queue_limit(void) {
+  test_player_t a;
+  connect_player(&a);
+
+  send_commands(&a, COMMAND_QUEUE_LIMIT + 3 + 10);
+
+  TEST_ASSERT_EQUAL_size_t(3, executed_count);
+  TEST_ASSERT_EQUAL_UINT(COMMAND_QUEUE_LIMIT, a.player->queued_commands);
+  TEST_ASSERT_EQUAL_INT(COMMAND_QUEUE_LIMIT, list_size(a.player->command_queue));
+
+  free_player_t(a.player);
+}
+
+/* Players with a backlog take turns running a command each. */
+void test_player_drain_commands_round_robin(void) {
+  test_player_t a;
+  test_player_t b;
+  connect_player(&a);
+  connect_player(&b);
+
+  send_commands(&a, 6);
+  send_commands(&b, 6);
+  executed_count = 0;
+
+  game.tick += 2;
+  player_drain_commands(&game);
+
+  TEST_ASSERT_EQUAL_size_t(4, executed_count);
+  TEST_ASSERT_EQUAL_PTR(a.player, executed[0]);
+  TEST_ASSERT_EQUAL_PTR(b.player, executed[1]);
+  TEST_ASSERT_EQUAL_PTR(a.player, executed[2]);
+  TEST_ASSERT_EQUAL_PTR(b.player, executed[3]);
+  TEST_ASSERT_EQUAL_INT(2, list_size(game.backlog));
+
+  free_player_t(a.player);
+  free_player_t(b.player);
+}
+
+/* A player leaves the backlog as soon as their queue empties while others carry on. */
+void test_player_drain_commands_removes_emptied_queues(void) {
+  test_player_t a;
+  test_player_t b;
+  connect_player(&a);
+  connect_player(&b);
+
+  send_commands(&a, 4);
+  send_commands(&b, 6);
+  executed_count = 0;
+
+  game.tick += 3;
+  player_drain_commands(&game);
+
+  TEST_ASSERT_EQUAL_size_t(4, executed_count);
+  TEST_ASSERT_EQUAL_PTR(a.player, executed[0]);
+  TEST_ASSERT_EQUAL_PTR(b.player, executed[1]);
+  TEST_ASSERT_EQUAL_PTR(b.player, executed[2]);
+  TEST_ASSERT_EQUAL_PTR(b.player, executed[3]);
+  TEST_ASSERT_FALSE(a.player->backlogged);
+  TEST_ASSERT_FALSE(b.player->backlogged);
+  TEST_ASSERT_EQUAL_INT(0, list_size(game.backlog));
+
+  free_player_t(a.player);
+  free_player_t(b.player);
+}
+
+/* A player whose connection has closed is no longer sent anything. */
+void test_player_send_after_disconnect(void) {
+  test_player_t a;
+  connect_player(&a);
+
+  a.player->network = &network;
+  a.player->client = 1;
+
+  send_to_player(a.player, "Hello");
+
+  TEST_ASSERT_EQUAL_UINT(1, network_get_client_fake.call_count);
+  TEST_ASSERT_EQUAL_UINT64(1, network_get_client_fake.arg1_val);
+  TEST_ASSERT_EQUAL_UINT(0, send_to_client_fake.call_count);
+  TEST_ASSERT_NULL(player_get_capabilities(a.player));
+
+  free_player_t(a.player);
+}
+
+/* MSSP reports the players in the game rather than every open connection. */
+void test_player_mssp_reports_players(void) {
+  client_t client;
+  player_t* a = create_player_t();
+  player_t* b = create_player_t();
+
+  memset(&client, 0, sizeof(client));
+
+  game.players = create_hash_table_t();
+  hash_table_insert(game.players, "a", a);
+  hash_table_insert(game.players, "b", b);
+  config.mssp_variables = create_linked_list_t();
+
+  player_mssp(&client, &game);
+
+  TEST_ASSERT_EQUAL_UINT(1, network_send_mssp_fake.call_count);
+  TEST_ASSERT_EQUAL_STRING("2", mssp_players);
+
+  free_hash_table_t(game.players);
+  free_linked_list_t(config.mssp_variables);
+  free_player_t(a);
+  free_player_t(b);
+}
+
+void setUp(void) {
+  RESET_FAKE(uuid_str);
+  RESET_FAKE(extract_from_input);
+  RESET_FAKE(lua_call_player_input_hook);
+  RESET_FAKE(lua_call_state_input_hook);
+  RESET_FAKE(network_get_client);
+  RESET_FAKE(send_to_client);
+  RESET_FAKE(network_send_mssp);
+  FFF_RESET_HISTORY();
+
+  uuid_str_fake.custom_fake = fake_uuid_str;
+  extract_from_input_fake.custom_fake = fake_extract;
+  lua_call_player_input_hook_fake.custom_fake = record_input;
+  network_send_mssp_fake.custom_fake = record_mssp;
+
+  memset(&config, 0, sizeof(config));
+  config.commands_per_tick = 1;
+  config.command_burst = 3;
+
+  memset(&game, 0, sizeof(game));
+  game.config = &config;
+  game.backlog = create_linked_list_t();
+  game.tick = 100;
+
+  executed_count = 0;
+}
+
+void tearDown(void) {
+  free_linked_list_t(game.backlog);
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_player_command_tokens_refill_up_to_burst);
+  RUN_TEST(test_player_command_queue_limit);
+  RUN_TEST(test_player_drain_commands_round_robin);
+  RUN_TEST(test_player_drain_commands_removes_emptied_queues);
+  RUN_TEST(test_player_send_after_disconnect);
+  RUN_TEST(test_player_mssp_reports_players);
+  return UNITY_END();
+}
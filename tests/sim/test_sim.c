@@ -0,0 +1,223 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "fff.h"
+#include "unity.h"
+
+#include "mud/clock.h"
+#include "mud/data/hash_table.h"
+#include "mud/data/linked_list.h"
+#include "mud/game.h"
+#include "mud/network/client.h"
+#include "mud/network/network.h"
+#include "mud/sim.h"
+#include "mud/tick.h"
+
+DEFINE_FFF_GLOBALS;
+FAKE_VALUE_FUNC(uint64_t, clock_hrtime);
+FAKE_VALUE_FUNC(bool, clock_is_virtual);
+FAKE_VOID_FUNC(clock_advance_to, uint64_t);
+FAKE_VALUE_FUNC(int, network_connect_local_client, network_t*, uv_file);
+FAKE_VOID_FUNC(network_reap_idle_clients, network_t*);
+FAKE_VOID_FUNC(tick_drive_scheduler, tick_scheduler_t*, tick_func_t, void*);
+FAKE_VOID_FUNC(tick_step_scheduler, tick_scheduler_t*);
+FAKE_VALUE_FUNC(const char*, tick_phase_name, tick_phase_t);
+FAKE_VALUE_FUNC(uint64_t, uv_hrtime);
+FAKE_VALUE_FUNC(int, uv_run, uv_loop_t*, uv_run_mode);
+FAKE_VALUE_FUNC(const char*, uv_strerror, int);
+
+#define LARGE_INPUT (1024 * 1024)
+
+static game_t game;
+static sim_t* sim = NULL;
+static sim_step_t step;
+
+static char script_path[64];
+
+static uv_file peer = -1;
+static size_t peer_received = 0;
+static char peer_buffer[1024 * 64];
+
+int uv_socketpair(int type, int protocol, uv_os_sock_t socket_vector[2], int flags0, int flags1) {
+  return socketpair(AF_UNIX, type | SOCK_NONBLOCK, protocol, socket_vector);
+}
+
+static int fake_connect(network_t* network, uv_file fd) {
+  peer = fd;
+
+  return 0;
+}
+
+static void fake_drive(tick_scheduler_t* scheduler, tick_func_t func, void* context) {
+  scheduler->running = true;
+}
+
+/**
+ * Reads what the virtual client has sent, as the network would, stopping the simulation
+ * once all of the large input has arrived.
+**/
+static void fake_step(tick_scheduler_t* scheduler) {
+  ssize_t nread = 0;
+
+  while ((nread = read(peer, peer_buffer, sizeof(peer_buffer))) > 0) {
+    peer_received += (size_t)nread;
+  }
+
+  if (peer_received == LARGE_INPUT + DELIM_SIZE || tick_step_scheduler_fake.call_count > 1000) {
+    scheduler->running = false;
+  }
+}
+
+static void fake_tick(tick_scheduler_t* scheduler, void* context) {
+}
+
+/**
+ * Writes a simulation script to a temporary file and loads it.
+**/
+static int load_script(const char* script) {
+  snprintf(script_path, sizeof(script_path), "/tmp/test_sim_XXXXXX");
+
+  FILE* file = fdopen(mkstemp(script_path), "w");
+  fputs(script, file);
+  fclose(file);
+
+  int res = sim_load_script(sim, script_path);
+
+  unlink(script_path);
+
+  return res;
+}
+
+/* The end step takes no client and nothing after it. */
+void test_sim_parse_end(void) {
+  TEST_ASSERT_EQUAL_INT(0, sim_parse_step("3600000 end", &step));
+  TEST_ASSERT_EQUAL_UINT64(3600000, step.at);
+  TEST_ASSERT_EQUAL_INT(SIM_END, step.action);
+  TEST_ASSERT_NULL(step.client);
+
+  TEST_ASSERT_EQUAL_INT(-1, sim_parse_step("3600000 end now", &step));
+}
+
+/* Everything after send is the text sent, spaces included. */
+void test_sim_parse_send_multiple_words(void) {
+  TEST_ASSERT_EQUAL_INT(0, sim_parse_step("250 alice send look at the  sword", &step));
+  TEST_ASSERT_EQUAL_UINT64(250, step.at);
+  TEST_ASSERT_EQUAL_INT(SIM_SEND, step.action);
+  TEST_ASSERT_EQUAL_STRING("alice", step.client);
+  TEST_ASSERT_EQUAL_STRING("look at the  sword", step.text);
+}
+
+/* A send without text sends an empty line. */
+void test_sim_parse_send_empty(void) {
+  TEST_ASSERT_EQUAL_INT(0, sim_parse_step("250 alice send", &step));
+  TEST_ASSERT_EQUAL_INT(SIM_SEND, step.action);
+  TEST_ASSERT_EQUAL_STRING("", step.text);
+}
+
+/* Unknown actions and malformed times aren't steps. */
+void test_sim_parse_invalid(void) {
+  TEST_ASSERT_EQUAL_INT(-1, sim_parse_step("0 alice dance", &step));
+  free(step.client);
+  memset(&step, 0, sizeof(step));
+
+  TEST_ASSERT_EQUAL_INT(-1, sim_parse_step("0 alice", &step));
+  free(step.client);
+  memset(&step, 0, sizeof(step));
+
+  TEST_ASSERT_EQUAL_INT(-1, sim_parse_step("0 alice connect now", &step));
+  free(step.client);
+  memset(&step, 0, sizeof(step));
+
+  TEST_ASSERT_EQUAL_INT(-1, sim_parse_step("soon alice connect", &step));
+  TEST_ASSERT_EQUAL_INT(-1, sim_parse_step("0", &step));
+}
+
+/* Comments and blank lines are skipped and the end step sets when the simulation stops. */
+void test_sim_load_script(void) {
+  TEST_ASSERT_EQUAL_INT(0, load_script("# warm up\n0 alice connect\n\n250 alice send look\n1000 end\n"));
+  TEST_ASSERT_EQUAL_INT(3, list_size(sim->steps));
+  TEST_ASSERT_EQUAL_UINT64(1000, sim->end);
+}
+
+/* Steps must be in the order they run. */
+void test_sim_load_script_rejects_steps_out_of_order(void) {
+  TEST_ASSERT_EQUAL_INT(-1, load_script("100 alice connect\n50 alice send look\n"));
+}
+
+/* Nothing may follow the end step, so the script can't run past it. */
+void test_sim_load_script_rejects_steps_after_end(void) {
+  TEST_ASSERT_EQUAL_INT(-1, load_script("0 alice connect\n1000 end\n2000 alice send look\n"));
+  TEST_ASSERT_EQUAL_INT(-1, load_script("0 alice connect\n1000 end\n1000 end\n"));
+}
+
+/* Input the connection has no room for is sent once the game has read what came before. */
+void test_sim_run_sends_input_which_does_not_fit(void) {
+  TEST_ASSERT_EQUAL_INT(0, load_script("0 alice connect\n"));
+
+  sim_step_t* send = calloc(1, sizeof(sim_step_t));
+  send->action = SIM_SEND;
+  send->client = strdup("alice");
+  send->text = malloc(LARGE_INPUT + 1);
+  memset(send->text, 'x', LARGE_INPUT);
+  send->text[LARGE_INPUT] = '\0';
+  list_add(sim->steps, send);
+
+  sim_run(sim, fake_tick);
+
+  sim_client_t* client = hash_table_get(sim->clients, "alice");
+
+  TEST_ASSERT_EQUAL_size_t(LARGE_INPUT + DELIM_SIZE, peer_received);
+  TEST_ASSERT_EQUAL_size_t(LARGE_INPUT + DELIM_SIZE, client->sent);
+  TEST_ASSERT_EQUAL_size_t(0, client->pending_len);
+  TEST_ASSERT_GREATER_THAN_UINT(1, tick_step_scheduler_fake.call_count);
+}
+
+void setUp(void) {
+  RESET_FAKE(clock_hrtime);
+  RESET_FAKE(clock_is_virtual);
+  RESET_FAKE(network_connect_local_client);
+  RESET_FAKE(tick_drive_scheduler);
+  RESET_FAKE(tick_step_scheduler);
+  RESET_FAKE(uv_run);
+  FFF_RESET_HISTORY();
+
+  clock_is_virtual_fake.return_val = true;
+  network_connect_local_client_fake.custom_fake = fake_connect;
+  tick_drive_scheduler_fake.custom_fake = fake_drive;
+  tick_step_scheduler_fake.custom_fake = fake_step;
+
+  memset(&game, 0, sizeof(game));
+  memset(&step, 0, sizeof(step));
+
+  sim = sim_new_sim_t(&game);
+  peer = -1;
+  peer_received = 0;
+}
+
+void tearDown(void) {
+  sim_free_sim_t(sim);
+
+  free(step.client);
+  free(step.text);
+
+  if (peer != -1) {
+    close(peer);
+  }
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_sim_parse_end);
+  RUN_TEST(test_sim_parse_send_multiple_words);
+  RUN_TEST(test_sim_parse_send_empty);
+  RUN_TEST(test_sim_parse_invalid);
+  RUN_TEST(test_sim_load_script);
+  RUN_TEST(test_sim_load_script_rejects_steps_out_of_order);
+  RUN_TEST(test_sim_load_script_rejects_steps_after_end);
+  RUN_TEST(test_sim_run_sends_input_which_does_not_fit);
+  return UNITY_END();
+}
@@ -0,0 +1,426 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fff.h"
+#include "unity.h"
+
+#include "mud/clock.h"
+#include "mud/data/hash_table.h"
+#include "mud/data/timer_wheel.h"
+#include "mud/event.h"
+#include "mud/game.h"
+#include "mud/task.h"
+
+DEFINE_FFF_GLOBALS;
+FAKE_VALUE_FUNC(uint64_t, clock_now, const uv_loop_t*);
+FAKE_VALUE_FUNC(int, lua_call_task_execute_hook, lua_State*, task_t*);
+FAKE_VALUE_FUNC(int, lua_resume_task_hook, lua_State*, task_t*);
+FAKE_VALUE_FUNC(const char*, lua_get_event_type, lua_State*, lua_ref_t*);
+FAKE_VALUE_FUNC(lua_ref_t*, lua_dup_lua_ref_t, lua_ref_t*, lua_ref_t*);
+FAKE_VOID_FUNC(lua_release_lua_ref_t, lua_ref_t*);
+FAKE_VOID_FUNC(lua_free_lua_ref_t, lua_ref_t*);
+FAKE_VALUE_FUNC(mud_uuid_t, new_uuid);
+
+static game_t game;
+static uint64_t now = 0;
+static lua_State* thread = (lua_State*)&now;
+static lua_ref_t woken_by;
+static bool resumed_with_event = false;
+static task_t* resumed[8];
+static size_t resumed_count = 0;
+
+static uint64_t fake_now(const uv_loop_t* loop) {
+  return now;
+}
+
+static int cancel_self(lua_State* lua, task_t* task) {
+  task_cancel_task(&game, task);
+
+  return 0;
+}
+
+static bool first_resume(task_t* task) {
+  for (size_t i = 0; i < resumed_count; i++) {
+    if (resumed[i] == task) {
+      return false;
+    }
+  }
+
+  resumed[resumed_count++] = task;
+
+  return true;
+}
+
+static int wait_half_second(lua_State* lua, task_t* task) {
+  task_wait(&game, task, 500);
+
+  return 1;
+}
+
+static int wait_for_arrival(lua_State* lua, task_t* task) {
+  resumed_with_event = task->event.state != NULL;
+
+  if (!first_resume(task)) {
+    return 0;
+  }
+
+  task_wait_event(&game, task, "arrive", 0);
+
+  return 1;
+}
+
+static int wait_for_arrival_or_timeout(lua_State* lua, task_t* task) {
+  resumed_with_event = task->event.state != NULL;
+
+  if (!first_resume(task)) {
+    return 0;
+  }
+
+  task_wait_event(&game, task, "arrive", 200);
+
+  return 1;
+}
+
+static lua_ref_t* dup_ref(lua_ref_t* reference, lua_ref_t* ref) {
+  reference->state = thread;
+  reference->ref = ref->ref;
+
+  return reference;
+}
+
+static void arrive(void) {
+  event_t event = { LUA_EVENT, &woken_by, NULL };
+
+  task_on_event(&game, &event);
+}
+
+static task_t* schedule(uint64_t delay, uint64_t interval) {
+  task_t* task = task_new_task_t(&game, "test", interval, NULL);
+  task_schedule_task(&game, task, delay);
+
+  return task;
+}
+
+static task_t* spawn(void) {
+  task_t* task = task_new_coroutine_task_t(&game, "test", thread, NULL);
+  task_schedule_task(&game, task, 0);
+
+  return task;
+}
+
+void setUp(void) {
+  RESET_FAKE(clock_now);
+  RESET_FAKE(lua_call_task_execute_hook);
+  RESET_FAKE(lua_resume_task_hook);
+  RESET_FAKE(lua_get_event_type);
+  RESET_FAKE(lua_dup_lua_ref_t);
+  RESET_FAKE(lua_release_lua_ref_t);
+  RESET_FAKE(lua_free_lua_ref_t);
+  RESET_FAKE(new_uuid);
+  FFF_RESET_HISTORY();
+
+  clock_now_fake.custom_fake = fake_now;
+  lua_get_event_type_fake.return_val = "arrive";
+  lua_dup_lua_ref_t_fake.custom_fake = dup_ref;
+  resumed_with_event = false;
+  resumed_count = 0;
+
+  now = 1000;
+
+  memset(&game, 0, sizeof(game));
+  game.task_wheel = create_timer_wheel_t(TASK_WHEEL_SLOTS, TASK_WHEEL_RESOLUTION, now);
+  game.task_waiters = create_hash_table_t();
+  game.task_waiters->deallocator = free;
+}
+
+void tearDown(void) {
+  task_shutdown(&game);
+  free_timer_wheel_t(game.task_wheel);
+  free_hash_table_t(game.task_waiters);
+}
+
+/* A task runs on the first call after its delay has passed and is then freed. */
+void test_task_runs_once_after_delay(void) {
+  schedule(500, 0);
+
+  now = 1499;
+  TEST_ASSERT_EQUAL_size_t(0, task_run_due_tasks(&game));
+
+  now = 1500;
+  TEST_ASSERT_EQUAL_size_t(1, task_run_due_tasks(&game));
+  TEST_ASSERT_EQUAL_INT(1, lua_call_task_execute_hook_fake.call_count);
+  TEST_ASSERT_EQUAL_INT(1, lua_free_lua_ref_t_fake.call_count);
+  TEST_ASSERT_EQUAL_size_t(0, game.task_wheel->active);
+}
+
+/* Every task which fell due since the last call runs in the same batch. */
+void test_task_due_tasks_run_as_one_batch(void) {
+  for (uint64_t delay = 1; delay <= 200; delay++) {
+    schedule(delay, 0);
+  }
+
+  schedule(201, 0);
+
+  now = 1200;
+  TEST_ASSERT_EQUAL_size_t(200, task_run_due_tasks(&game));
+  TEST_ASSERT_EQUAL_size_t(1, game.task_wheel->active);
+}
+
+/* Tasks further away than a full rotation of the wheel still run on time. */
+void test_task_beyond_rotation_runs_on_time(void) {
+  schedule(TASK_WHEEL_SLOTS * 3 + 10, 0);
+
+  for (now = 1200; now < 1000 + TASK_WHEEL_SLOTS * 3 + 10; now += 200) {
+    TEST_ASSERT_EQUAL_size_t(0, task_run_due_tasks(&game));
+  }
+
+  TEST_ASSERT_EQUAL_size_t(1, task_run_due_tasks(&game));
+}
+
+/* A cancelled task doesn't run and is freed straight away. */
+void test_task_cancel_prevents_run(void) {
+  task_t* task = schedule(100, 0);
+
+  task_cancel_task(&game, task);
+
+  TEST_ASSERT_EQUAL_INT(1, lua_free_lua_ref_t_fake.call_count);
+
+  now = 2000;
+  TEST_ASSERT_EQUAL_size_t(0, task_run_due_tasks(&game));
+  TEST_ASSERT_EQUAL_INT(0, lua_call_task_execute_hook_fake.call_count);
+}
+
+/* A repeating task runs every interval until cancelled. */
+void test_task_repeating_runs_every_interval(void) {
+  task_t* task = schedule(100, 100);
+
+  for (now = 1100; now <= 1500; now += 100) {
+    TEST_ASSERT_EQUAL_size_t(1, task_run_due_tasks(&game));
+  }
+
+  TEST_ASSERT_EQUAL_INT(5, lua_call_task_execute_hook_fake.call_count);
+  TEST_ASSERT_EQUAL_UINT64(1600, task->execute_at);
+
+  task_cancel_task(&game, task);
+
+  now = 1600;
+  TEST_ASSERT_EQUAL_size_t(0, task_run_due_tasks(&game));
+}
+
+/* A repeating task which falls behind skips the runs it missed and keeps its phase. */
+void test_task_repeating_skips_missed_runs(void) {
+  task_t* task = schedule(100, 100);
+
+  now = 1450;
+  TEST_ASSERT_EQUAL_size_t(1, task_run_due_tasks(&game));
+  TEST_ASSERT_EQUAL_INT(1, lua_call_task_execute_hook_fake.call_count);
+  TEST_ASSERT_EQUAL_UINT64(1500, task->execute_at);
+}
+
+/* A repeating task may cancel itself while it runs. */
+void test_task_repeating_may_cancel_itself(void) {
+  lua_call_task_execute_hook_fake.custom_fake = cancel_self;
+
+  schedule(100, 100);
+
+  now = 1100;
+  TEST_ASSERT_EQUAL_size_t(1, task_run_due_tasks(&game));
+  TEST_ASSERT_EQUAL_INT(1, lua_free_lua_ref_t_fake.call_count);
+  TEST_ASSERT_EQUAL_size_t(0, game.task_wheel->active);
+}
+
+/* Shutting down frees every pending task. */
+void test_task_shutdown_frees_pending(void) {
+  schedule(100, 0);
+  schedule(100000, 0);
+  schedule(50, 50);
+
+  task_shutdown(&game);
+
+  TEST_ASSERT_EQUAL_INT(3, lua_free_lua_ref_t_fake.call_count);
+  TEST_ASSERT_EQUAL_size_t(0, game.task_wheel->active);
+}
+
+/* A coroutine task which yields without waiting resumes on each tick until it finishes. */
+void test_task_coroutine_resumes_each_tick_until_finished(void) {
+  int results[] = { 1, 1, 0 };
+  SET_RETURN_SEQ(lua_resume_task_hook, results, 3);
+
+  spawn();
+
+  for (now = 1001; now <= 1003; now++) {
+    TEST_ASSERT_EQUAL_size_t(1, task_run_due_tasks(&game));
+  }
+
+  TEST_ASSERT_EQUAL_INT(3, lua_resume_task_hook_fake.call_count);
+  TEST_ASSERT_EQUAL_INT(1, lua_free_lua_ref_t_fake.call_count);
+  TEST_ASSERT_EQUAL_size_t(0, game.task_wheel->active);
+}
+
+/* A coroutine task which waits isn't resumed until the time has passed. */
+void test_task_coroutine_wait_resumes_after_delay(void) {
+  lua_resume_task_hook_fake.custom_fake = wait_half_second;
+
+  task_t* task = spawn();
+
+  now = 1001;
+  TEST_ASSERT_EQUAL_size_t(1, task_run_due_tasks(&game));
+  TEST_ASSERT_EQUAL_UINT64(1501, task->execute_at);
+
+  now = 1500;
+  TEST_ASSERT_EQUAL_size_t(0, task_run_due_tasks(&game));
+
+  now = 1501;
+  TEST_ASSERT_EQUAL_size_t(1, task_run_due_tasks(&game));
+  TEST_ASSERT_EQUAL_INT(2, lua_resume_task_hook_fake.call_count);
+}
+
+/* A coroutine task waiting for an event resumes with it on the tick it's dispatched. */
+void test_task_coroutine_wait_event_resumes_with_event(void) {
+  lua_resume_task_hook_fake.custom_fake = wait_for_arrival;
+
+  spawn();
+
+  now = 1001;
+  TEST_ASSERT_EQUAL_size_t(1, task_run_due_tasks(&game));
+  TEST_ASSERT_EQUAL_size_t(0, game.task_wheel->active);
+
+  now = 60000;
+  TEST_ASSERT_EQUAL_size_t(0, task_run_due_tasks(&game));
+
+  now = 60100;
+  arrive();
+  TEST_ASSERT_EQUAL_size_t(1, task_run_due_tasks(&game));
+  TEST_ASSERT_TRUE(resumed_with_event);
+  TEST_ASSERT_EQUAL_INT(1, lua_release_lua_ref_t_fake.call_count);
+  TEST_ASSERT_EQUAL_INT(1, lua_free_lua_ref_t_fake.call_count);
+}
+
+/* Events of other types don't wake a waiting task. */
+void test_task_coroutine_wait_event_ignores_other_types(void) {
+  lua_resume_task_hook_fake.custom_fake = wait_for_arrival;
+
+  spawn();
+
+  now = 1001;
+  task_run_due_tasks(&game);
+
+  lua_get_event_type_fake.return_val = "depart";
+  arrive();
+
+  lua_get_event_type_fake.return_val = NULL;
+  arrive();
+
+  now = 1100;
+  TEST_ASSERT_EQUAL_size_t(0, task_run_due_tasks(&game));
+  TEST_ASSERT_EQUAL_INT(0, lua_dup_lua_ref_t_fake.call_count);
+}
+
+/* A coroutine task waiting for an event resumes without it once the timeout passes. */
+void test_task_coroutine_wait_event_times_out(void) {
+  lua_resume_task_hook_fake.custom_fake = wait_for_arrival_or_timeout;
+
+  spawn();
+
+  now = 1001;
+  task_run_due_tasks(&game);
+
+  now = 1201;
+  TEST_ASSERT_EQUAL_size_t(1, task_run_due_tasks(&game));
+  TEST_ASSERT_FALSE(resumed_with_event);
+
+  arrive();
+  TEST_ASSERT_EQUAL_INT(0, lua_dup_lua_ref_t_fake.call_count);
+}
+
+/* Every task waiting for an event type is woken by one event. */
+void test_task_coroutine_wait_event_wakes_every_waiter(void) {
+  lua_resume_task_hook_fake.custom_fake = wait_for_arrival_or_timeout;
+
+  spawn();
+  spawn();
+  spawn();
+
+  now = 1001;
+  TEST_ASSERT_EQUAL_size_t(3, task_run_due_tasks(&game));
+
+  arrive();
+
+  now = 1002;
+  TEST_ASSERT_EQUAL_size_t(3, task_run_due_tasks(&game));
+  TEST_ASSERT_EQUAL_INT(3, lua_dup_lua_ref_t_fake.call_count);
+  TEST_ASSERT_EQUAL_size_t(0, game.task_wheel->active);
+}
+
+/* A coroutine task which fails is freed. */
+void test_task_coroutine_error_frees_task(void) {
+  lua_resume_task_hook_fake.return_val = -1;
+
+  spawn();
+
+  now = 1001;
+  TEST_ASSERT_EQUAL_size_t(1, task_run_due_tasks(&game));
+  TEST_ASSERT_EQUAL_INT(1, lua_free_lua_ref_t_fake.call_count);
+  TEST_ASSERT_EQUAL_size_t(0, game.task_wheel->active);
+}
+
+/* Cancelling a task waiting for an event stops it being woken. */
+void test_task_coroutine_cancel_while_waiting(void) {
+  lua_resume_task_hook_fake.custom_fake = wait_for_arrival;
+
+  task_t* task = spawn();
+
+  now = 1001;
+  task_run_due_tasks(&game);
+
+  task_cancel_task(&game, task);
+  TEST_ASSERT_EQUAL_INT(1, lua_free_lua_ref_t_fake.call_count);
+
+  arrive();
+  TEST_ASSERT_EQUAL_INT(0, lua_dup_lua_ref_t_fake.call_count);
+}
+
+/* Shutting down frees tasks waiting for events as well as pending ones. */
+void test_task_shutdown_frees_waiting(void) {
+  lua_resume_task_hook_fake.custom_fake = wait_for_arrival_or_timeout;
+
+  spawn();
+  spawn();
+
+  now = 1001;
+  task_run_due_tasks(&game);
+
+  lua_resume_task_hook_fake.custom_fake = wait_for_arrival;
+  spawn();
+
+  now = 1002;
+  task_run_due_tasks(&game);
+
+  task_shutdown(&game);
+
+  TEST_ASSERT_EQUAL_INT(3, lua_free_lua_ref_t_fake.call_count);
+  TEST_ASSERT_EQUAL_size_t(0, game.task_wheel->active);
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_task_runs_once_after_delay);
+  RUN_TEST(test_task_due_tasks_run_as_one_batch);
+  RUN_TEST(test_task_beyond_rotation_runs_on_time);
+  RUN_TEST(test_task_cancel_prevents_run);
+  RUN_TEST(test_task_repeating_runs_every_interval);
+  RUN_TEST(test_task_repeating_skips_missed_runs);
+  RUN_TEST(test_task_repeating_may_cancel_itself);
+  RUN_TEST(test_task_shutdown_frees_pending);
+  RUN_TEST(test_task_coroutine_resumes_each_tick_until_finished);
+  RUN_TEST(test_task_coroutine_wait_resumes_after_delay);
+  RUN_TEST(test_task_coroutine_wait_event_resumes_with_event);
+  RUN_TEST(test_task_coroutine_wait_event_ignores_other_types);
+  RUN_TEST(test_task_coroutine_wait_event_times_out);
+  RUN_TEST(test_task_coroutine_wait_event_wakes_every_waiter);
+  RUN_TEST(test_task_coroutine_error_frees_task);
+  RUN_TEST(test_task_coroutine_cancel_while_waiting);
+  RUN_TEST(test_task_shutdown_frees_waiting);
+  return UNITY_END();
+}
@@ -0,0 +1,307 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "fff.h"
+#include "unity.h"
+
+#include "mud/clock.h"
+#include "mud/tick.h"
+
+#define MS 1000000ULL
+
+DEFINE_FFF_GLOBALS;
+FAKE_VALUE_FUNC(uint64_t, uv_hrtime);
+FAKE_VALUE_FUNC(uint64_t, uv_now, const uv_loop_t*);
+FAKE_VOID_FUNC(uv_update_time, uv_loop_t*);
+FAKE_VALUE_FUNC(int, uv_timer_init, uv_loop_t*, uv_timer_t*);
+FAKE_VALUE_FUNC(int, uv_timer_start, uv_timer_t*, uv_timer_cb, uint64_t, uint64_t);
+FAKE_VALUE_FUNC(int, uv_timer_stop, uv_timer_t*);
+FAKE_VOID_FUNC(uv_close, uv_handle_t*, uv_close_cb);
+FAKE_VALUE_FUNC(const char*, uv_strerror, int);
+
+static uv_loop_t loop;
+static tick_scheduler_t scheduler;
+
+static uint64_t now = 0;
+static uint64_t durations[8];
+static size_t ticks_run = 0;
+static bool stop_in_tick = false;
+
+static uint64_t fake_hrtime(void) {
+  return now;
+}
+
+/**
+ * Runs a tick which takes the next of the durations, or 10ms once they run out.
+**/
+static void tick(tick_scheduler_t* s, void* context) {
+  now += ticks_run < 8 && durations[ticks_run] > 0 ? durations[ticks_run] : 10 * MS;
+  ticks_run++;
+
+  if (stop_in_tick) {
+    tick_stop_scheduler(s);
+  }
+}
+
+/**
+ * Runs a tick which spends 1ms, 3ms, 5ms and 2ms in the commands, events, systems and
+ * flush phases.
+**/
+static void phased_tick(tick_scheduler_t* s, void* context) {
+  now += 1 * MS;
+  tick_record_phase(s, TICK_PHASE_COMMANDS);
+  now += 3 * MS;
+  tick_record_phase(s, TICK_PHASE_EVENTS);
+  now += 5 * MS;
+  tick_record_phase(s, TICK_PHASE_SYSTEMS);
+  now += 2 * MS;
+  tick_record_phase(s, TICK_PHASE_FLUSH);
+}
+
+/**
+ * Starts the scheduler at 20 ticks per second and fires its timer when the first tick is due.
+**/
+static void start_and_fire(tick_policy_t policy, unsigned int catch_up_limit, tick_func_t func) {
+  tick_init_scheduler(&scheduler, 20, policy, catch_up_limit);
+  TEST_ASSERT_EQUAL_INT(0, tick_start_scheduler(&scheduler, &loop, func, NULL));
+
+  now = scheduler.due;
+  uv_timer_start_fake.arg1_val(&scheduler.timer);
+}
+
+void setUp(void) {
+  RESET_FAKE(uv_hrtime);
+  RESET_FAKE(uv_now);
+  RESET_FAKE(uv_update_time);
+  RESET_FAKE(uv_timer_init);
+  RESET_FAKE(uv_timer_start);
+  RESET_FAKE(uv_timer_stop);
+  RESET_FAKE(uv_close);
+  RESET_FAKE(uv_strerror);
+  FFF_RESET_HISTORY();
+
+  uv_hrtime_fake.custom_fake = fake_hrtime;
+
+  now = 1000 * MS;
+  memset(durations, 0, sizeof(durations));
+  ticks_run = 0;
+  stop_in_tick = false;
+}
+
+void tearDown(void) {
+  clock_use_real_time();
+}
+
+/* Starting the scheduler arms a one shot timer for a full interval. */
+void test_tick_start_arms_timer_for_interval(void) {
+  tick_init_scheduler(&scheduler, 20, TICK_POLICY_SKIP, 0);
+  TEST_ASSERT_EQUAL_INT(0, tick_start_scheduler(&scheduler, &loop, tick, NULL));
+
+  TEST_ASSERT_EQUAL_UINT64(50 * MS, scheduler.interval);
+  TEST_ASSERT_EQUAL_INT(1, uv_timer_start_fake.call_count);
+  TEST_ASSERT_EQUAL_UINT64(50, uv_timer_start_fake.arg2_val);
+  TEST_ASSERT_EQUAL_UINT64(0, uv_timer_start_fake.arg3_val);
+}
+
+/* Starting the scheduler fails when the timer can't be initialised. */
+void test_tick_start_fails_when_timer_init_fails(void) {
+  uv_timer_init_fake.return_val = -1;
+
+  tick_init_scheduler(&scheduler, 20, TICK_POLICY_SKIP, 0);
+
+  TEST_ASSERT_EQUAL_INT(-1, tick_start_scheduler(&scheduler, &loop, tick, NULL));
+  TEST_ASSERT_EQUAL_INT(0, uv_timer_start_fake.call_count);
+}
+
+/* A tick which finishes in time waits out the rest of the interval rather than a full one. */
+void test_tick_on_time_waits_out_interval(void) {
+  start_and_fire(TICK_POLICY_SKIP, 0, tick);
+
+  TEST_ASSERT_EQUAL_INT(1, ticks_run);
+  TEST_ASSERT_EQUAL_UINT64(0, scheduler.overruns);
+  TEST_ASSERT_EQUAL_UINT64(40, uv_timer_start_fake.arg2_val);
+  TEST_ASSERT_EQUAL_UINT64(10 * MS, scheduler.duration.last);
+}
+
+/* A late timer is recorded as lag. */
+void test_tick_records_lag(void) {
+  tick_init_scheduler(&scheduler, 20, TICK_POLICY_SKIP, 0);
+  tick_start_scheduler(&scheduler, &loop, tick, NULL);
+
+  now = scheduler.due + 4 * MS;
+  uv_timer_start_fake.arg1_val(&scheduler.timer);
+
+  TEST_ASSERT_EQUAL_UINT64(4 * MS, scheduler.lag);
+  TEST_ASSERT_EQUAL_UINT64(36, uv_timer_start_fake.arg2_val);
+}
+
+/* Under the skip policy the ticks an overrun delayed are dropped and the schedule kept. */
+void test_tick_skip_policy_drops_overdue_ticks(void) {
+  durations[0] = 120 * MS;
+
+  start_and_fire(TICK_POLICY_SKIP, 0, tick);
+
+  TEST_ASSERT_EQUAL_INT(1, ticks_run);
+  TEST_ASSERT_EQUAL_UINT64(1, scheduler.overruns);
+  TEST_ASSERT_EQUAL_UINT64(2, scheduler.skipped);
+  TEST_ASSERT_EQUAL_UINT64(30, uv_timer_start_fake.arg2_val);
+}
+
+/* Under the catch up policy overdue ticks run back to back until back on schedule. */
+void test_tick_catch_up_policy_runs_overdue_ticks(void) {
+  durations[0] = 120 * MS;
+
+  start_and_fire(TICK_POLICY_CATCH_UP, 5, tick);
+
+  TEST_ASSERT_EQUAL_INT(3, ticks_run);
+  TEST_ASSERT_EQUAL_UINT64(2, scheduler.overruns);
+  TEST_ASSERT_EQUAL_UINT64(2, scheduler.caught_up);
+  TEST_ASSERT_EQUAL_UINT64(0, scheduler.skipped);
+  TEST_ASSERT_EQUAL_UINT64(10, uv_timer_start_fake.arg2_val);
+}
+
+/* Under the catch up policy overdue ticks past the limit are skipped. */
+void test_tick_catch_up_policy_skips_past_limit(void) {
+  durations[0] = 120 * MS;
+
+  start_and_fire(TICK_POLICY_CATCH_UP, 1, tick);
+
+  TEST_ASSERT_EQUAL_INT(2, ticks_run);
+  TEST_ASSERT_EQUAL_UINT64(1, scheduler.caught_up);
+  TEST_ASSERT_EQUAL_UINT64(1, scheduler.skipped);
+  TEST_ASSERT_EQUAL_UINT64(20, uv_timer_start_fake.arg2_val);
+}
+
+/* Under the stretch policy the next tick is a full interval after the overrunning one. */
+void test_tick_stretch_policy_pushes_schedule_back(void) {
+  durations[0] = 120 * MS;
+
+  start_and_fire(TICK_POLICY_STRETCH, 0, tick);
+
+  TEST_ASSERT_EQUAL_INT(1, ticks_run);
+  TEST_ASSERT_EQUAL_UINT64(1, scheduler.overruns);
+  TEST_ASSERT_EQUAL_UINT64(0, scheduler.skipped);
+  TEST_ASSERT_EQUAL_UINT64(120 * MS, scheduler.stretched);
+  TEST_ASSERT_EQUAL_UINT64(50, uv_timer_start_fake.arg2_val);
+}
+
+/* A tick which finishes in time ends a run of overruns. */
+void test_tick_overrunning_cleared_by_tick_in_time(void) {
+  durations[0] = 120 * MS;
+
+  start_and_fire(TICK_POLICY_SKIP, 0, tick);
+  TEST_ASSERT_TRUE(scheduler.overrunning);
+
+  now = scheduler.due;
+  uv_timer_start_fake.arg1_val(&scheduler.timer);
+  TEST_ASSERT_FALSE(scheduler.overrunning);
+}
+
+/* Each phase is timed from the end of the one before it. */
+void test_tick_records_phase_timings(void) {
+  start_and_fire(TICK_POLICY_SKIP, 0, phased_tick);
+
+  TEST_ASSERT_EQUAL_UINT64(1 * MS, scheduler.phases[TICK_PHASE_COMMANDS].last);
+  TEST_ASSERT_EQUAL_UINT64(3 * MS, scheduler.phases[TICK_PHASE_EVENTS].last);
+  TEST_ASSERT_EQUAL_UINT64(5 * MS, scheduler.phases[TICK_PHASE_SYSTEMS].last);
+  TEST_ASSERT_EQUAL_UINT64(2 * MS, scheduler.phases[TICK_PHASE_FLUSH].last);
+  TEST_ASSERT_EQUAL_UINT64(11 * MS, scheduler.duration.last);
+
+  now = scheduler.due;
+  uv_timer_start_fake.arg1_val(&scheduler.timer);
+
+  TEST_ASSERT_EQUAL_UINT64(2, scheduler.phases[TICK_PHASE_SYSTEMS].count);
+  TEST_ASSERT_EQUAL_UINT64(10 * MS, scheduler.phases[TICK_PHASE_SYSTEMS].total);
+  TEST_ASSERT_EQUAL_UINT64(5 * MS, scheduler.phases[TICK_PHASE_SYSTEMS].max);
+}
+
+/* Stopping the scheduler from within a tick closes the timer and runs no more ticks. */
+void test_tick_stop_in_tick_does_not_rearm(void) {
+  durations[0] = 120 * MS;
+  stop_in_tick = true;
+
+  start_and_fire(TICK_POLICY_CATCH_UP, 5, tick);
+
+  TEST_ASSERT_EQUAL_INT(1, ticks_run);
+  TEST_ASSERT_FALSE(scheduler.running);
+  TEST_ASSERT_EQUAL_INT(1, uv_timer_stop_fake.call_count);
+  TEST_ASSERT_EQUAL_INT(1, uv_close_fake.call_count);
+  TEST_ASSERT_EQUAL_INT(1, uv_timer_start_fake.call_count);
+}
+
+/* Policy names parse back to the policy they name and unknown names are rejected. */
+void test_tick_parse_policy(void) {
+  tick_policy_t policy = TICK_POLICY_SKIP;
+
+  TEST_ASSERT_EQUAL_INT(0, tick_parse_policy("catch-up", &policy));
+  TEST_ASSERT_EQUAL_INT(TICK_POLICY_CATCH_UP, policy);
+  TEST_ASSERT_EQUAL_STRING("catch-up", tick_policy_name(policy));
+
+  TEST_ASSERT_EQUAL_INT(0, tick_parse_policy("stretch", &policy));
+  TEST_ASSERT_EQUAL_INT(TICK_POLICY_STRETCH, policy);
+
+  TEST_ASSERT_EQUAL_INT(0, tick_parse_policy("skip", &policy));
+  TEST_ASSERT_EQUAL_INT(TICK_POLICY_SKIP, policy);
+
+  TEST_ASSERT_EQUAL_INT(-1, tick_parse_policy("sometimes", &policy));
+  TEST_ASSERT_EQUAL_INT(TICK_POLICY_SKIP, policy);
+}
+
+/* A driven scheduler runs a tick each time it's stepped without using a timer. */
+void test_tick_driven_scheduler_steps_without_timer(void) {
+  tick_init_scheduler(&scheduler, 20, TICK_POLICY_SKIP, 0);
+  tick_drive_scheduler(&scheduler, tick, NULL);
+
+  TEST_ASSERT_EQUAL_UINT64(1050 * MS, scheduler.due);
+
+  now = scheduler.due;
+  tick_step_scheduler(&scheduler);
+
+  TEST_ASSERT_EQUAL_INT(1, ticks_run);
+  TEST_ASSERT_EQUAL_UINT64(1100 * MS, scheduler.due);
+  TEST_ASSERT_EQUAL_INT(0, uv_timer_init_fake.call_count);
+  TEST_ASSERT_EQUAL_INT(0, uv_timer_start_fake.call_count);
+
+  tick_stop_scheduler(&scheduler);
+
+  TEST_ASSERT_FALSE(scheduler.running);
+  TEST_ASSERT_EQUAL_INT(0, uv_close_fake.call_count);
+}
+
+/* On virtual time a slow tick doesn't overrun, but how long it took is still recorded. */
+void test_tick_driven_on_virtual_time_records_real_duration(void) {
+  durations[0] = 500 * MS;
+
+  clock_use_virtual_time(1);
+
+  tick_init_scheduler(&scheduler, 20, TICK_POLICY_SKIP, 0);
+  tick_drive_scheduler(&scheduler, tick, NULL);
+
+  clock_advance_to(scheduler.due);
+  tick_step_scheduler(&scheduler);
+
+  TEST_ASSERT_EQUAL_INT(1, ticks_run);
+  TEST_ASSERT_EQUAL_UINT64(0, scheduler.overruns);
+  TEST_ASSERT_EQUAL_UINT64(0, scheduler.skipped);
+  TEST_ASSERT_EQUAL_UINT64(1100 * MS, scheduler.due);
+  TEST_ASSERT_EQUAL_UINT64(500 * MS, scheduler.duration.last);
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_tick_start_arms_timer_for_interval);
+  RUN_TEST(test_tick_start_fails_when_timer_init_fails);
+  RUN_TEST(test_tick_on_time_waits_out_interval);
+  RUN_TEST(test_tick_records_lag);
+  RUN_TEST(test_tick_skip_policy_drops_overdue_ticks);
+  RUN_TEST(test_tick_catch_up_policy_runs_overdue_ticks);
+  RUN_TEST(test_tick_catch_up_policy_skips_past_limit);
+  RUN_TEST(test_tick_stretch_policy_pushes_schedule_back);
+  RUN_TEST(test_tick_overrunning_cleared_by_tick_in_time);
+  RUN_TEST(test_tick_records_phase_timings);
+  RUN_TEST(test_tick_stop_in_tick_does_not_rearm);
+  RUN_TEST(test_tick_parse_policy);
+  RUN_TEST(test_tick_driven_scheduler_steps_without_timer);
+  RUN_TEST(test_tick_driven_on_virtual_time_records_real_duration);
+  return UNITY_END();
+}